@@ -52,6 +52,19 @@ AsyncSocketBase::doSend(const StunTuple& destination, unsigned short channel, bo
       boost::shared_ptr<DataBuffer> empty;
       mSendDataQueue.push_back(SendData(destination, empty, data, bufferStartPos));
    }
+   else if(bufferStartPos == 0 && data->headroom() >= 4 && data.use_count() == 1)
+   {
+      // Nobody else can see the buffer, so write the Turn Framing into its
+      // headroom instead of allocating a separate frame
+      unsigned short msgsize = htons((unsigned short)data->size());
+      channel = htons(channel);
+      char* frame = data->prepend(4);
+      memcpy(frame, &channel, 2);
+      memcpy(frame+2, &msgsize, 2);  // UDP doesn't need size - but shouldn't hurt to send it anyway
+
+      boost::shared_ptr<DataBuffer> empty;
+      mSendDataQueue.push_back(SendData(destination, empty, data, 0));
+   }
    else
    {
       // Add Turn Framing
@@ -164,7 +177,7 @@ AsyncSocketBase::close()
 boost::shared_ptr<DataBuffer>  
 AsyncSocketBase::allocateBuffer(unsigned int size)
 {
-   return boost::shared_ptr<DataBuffer>(new DataBuffer(size));
+   return DataBuffer::allocate(size);
 }
 
 } // namespace
@@ -18,6 +18,14 @@
 
 namespace reTurn {
 
+#if defined(__linux__) && defined(SO_REUSEPORT)
+// Several sockets may bind the same address and port, and the kernel hashes
+// each flow (by source and destination) onto one of them.  The BSDs accept
+// the option but hand all unicast traffic to the last socket bound.
+#define RETURN_SHARED_LISTENERS
+typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+
 class AsyncSocketBaseHandler;
 class AsyncSocketBaseDestroyedHandler;
 
@@ -44,8 +52,10 @@ public:
    virtual void close();
 
    bool isConnected() { return mConnected; }
+   bool hasQueuedSends() const { return !mSendDataQueue.empty(); }
    asio::ip::address& getConnectedAddress() { return mConnectedAddress; }
    unsigned short getConnectedPort() { return mConnectedPort; }
+   asio::io_service& getIOService() { return mIOService; }
 
    virtual void setOnBeforeSocketClosedFp(boost::function<void(unsigned int)> fp) { mOnBeforeSocketCloseFp = fp; }
 
@@ -20,6 +20,8 @@ public:
    virtual unsigned int getSocketDescriptor();
 
    virtual asio::error_code bind(const asio::ip::address& address, unsigned short port);
+   /// reusePort lets other sockets share address:port (see RETURN_SHARED_LISTENERS)
+   asio::error_code bind(const asio::ip::address& address, unsigned short port, bool reusePort);
    virtual void connect(const std::string& address, unsigned short port);  
 
    virtual void transportReceive();
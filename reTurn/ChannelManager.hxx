@@ -26,8 +26,8 @@ public:
    RemotePeer* findRemotePeerByPeerAddress(const StunTuple& peerAddress);
 
 private:
-   typedef std::map<unsigned short,RemotePeer*> ChannelRemotePeerMap;
-   typedef std::map<StunTuple,RemotePeer*> TupleRemotePeerMap;
+   typedef HashMap<unsigned short,RemotePeer*> ChannelRemotePeerMap;
+   typedef HashMap<StunTuple,RemotePeer*> TupleRemotePeerMap;
    ChannelRemotePeerMap mChannelRemotePeerMap;
    TupleRemotePeerMap mTupleRemotePeerMap;
 
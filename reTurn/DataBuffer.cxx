@@ -1,8 +1,14 @@
 #include "DataBuffer.hxx"
 #include <memory.h>
+#include <boost/make_shared.hpp>
 #include "rutil/ResipAssert.h"
+#include "rutil/Lock.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
 #include <rutil/WinLeakCheck.hxx>
 
+using namespace resip;
+
 namespace reTurn {
 
 void ArrayDeallocator(char* data)
@@ -10,6 +16,177 @@ void ArrayDeallocator(char* data)
    delete [] data;
 }
 
+namespace
+{
+
+// Free blocks are linked through their first word
+struct FreeList
+{
+   FreeList() : mHead(0), mCount(0) {}
+
+   void* pop()
+   {
+      void* block = mHead;
+      if(block)
+      {
+         mHead = *(void**)block;
+         --mCount;
+      }
+      return block;
+   }
+
+   bool push(void* block)
+   {
+      if(mCount >= MaxCachedBlocks)
+      {
+         return false;
+      }
+      *(void**)block = mHead;
+      mHead = block;
+      ++mCount;
+      return true;
+   }
+
+   void clear()
+   {
+      void* block;
+      while((block = pop()) != 0)
+      {
+         ::operator delete(block);
+      }
+   }
+
+   // Caps what an idle thread keeps: about 1MB of storage blocks
+   static const unsigned int MaxCachedBlocks = 256;
+
+   void* mHead;
+   unsigned int mCount;
+};
+
+struct ThreadBuffers
+{
+   FreeList mStorage;  // Headroom + PoolBufferSize bytes each
+   FreeList mShared;   // SharedBlockSize bytes each - DataBuffer plus its shared_ptr count
+};
+
+const unsigned int StorageBlockSize = DataBuffer::Headroom + DataBuffer::PoolBufferSize;
+const unsigned int SharedBlockSize = 128;
+
+Mutex buffersMutex;
+volatile bool buffersKeyCreated = false;
+ThreadIf::TlsKey buffersKey;
+
+void
+freeThreadBuffers(void* arg)
+{
+   ThreadBuffers* buffers = (ThreadBuffers*)arg;
+   buffers->mStorage.clear();
+   buffers->mShared.clear();
+   delete buffers;
+}
+
+// Blocks go back to the list of whichever thread releases them, so buffers
+// handed between threads migrate rather than bouncing back to their origin
+ThreadBuffers*
+threadBuffers()
+{
+   if(!buffersKeyCreated)
+   {
+      Lock lock(buffersMutex);
+      if(!buffersKeyCreated)
+      {
+         ThreadIf::tlsKeyCreate(buffersKey, freeThreadBuffers);
+         buffersKeyCreated = true;
+      }
+   }
+
+   ThreadBuffers* buffers = (ThreadBuffers*)ThreadIf::tlsGetValue(buffersKey);
+   if(!buffers)
+   {
+      buffers = new ThreadBuffers;
+      ThreadIf::tlsSetValue(buffersKey, buffers);
+   }
+   return buffers;
+}
+
+void*
+getBlock(FreeList& list, unsigned int size)
+{
+   void* block = list.pop();
+   return block ? block : ::operator new(size);
+}
+
+void
+releaseBlock(FreeList& list, void* block)
+{
+   if(!list.push(block))
+   {
+      ::operator delete(block);
+   }
+}
+
+void
+StorageDeallocator(char* data)
+{
+   if(data)
+   {
+      releaseBlock(threadBuffers()->mStorage, data);
+   }
+}
+
+// Allocator for boost::allocate_shared - the DataBuffer and its reference
+// counts share one block from the per-thread list
+template <class T>
+class SharedAllocator
+{
+public:
+   typedef T value_type;
+   typedef T* pointer;
+   typedef const T* const_pointer;
+   typedef T& reference;
+   typedef const T& const_reference;
+   typedef std::size_t size_type;
+   typedef std::ptrdiff_t difference_type;
+
+   template <class U> struct rebind { typedef SharedAllocator<U> other; };
+
+   SharedAllocator() {}
+   template <class U> SharedAllocator(const SharedAllocator<U>&) {}
+
+   pointer address(reference r) const { return &r; }
+   const_pointer address(const_reference r) const { return &r; }
+   size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+   pointer allocate(size_type n, const void* = 0)
+   {
+      if(n * sizeof(T) <= SharedBlockSize)
+      {
+         return (pointer)getBlock(threadBuffers()->mShared, SharedBlockSize);
+      }
+      return (pointer)::operator new(n * sizeof(T));
+   }
+
+   void deallocate(pointer p, size_type n)
+   {
+      if(n * sizeof(T) <= SharedBlockSize)
+      {
+         releaseBlock(threadBuffers()->mShared, p);
+      }
+      else
+      {
+         ::operator delete(p);
+      }
+   }
+
+   void construct(pointer p, const T& val) { new((void*)p) T(val); }
+   void destroy(pointer p) { p->~T(); }
+
+   template <class U> bool operator==(const SharedAllocator<U>&) const { return true; }
+   template <class U> bool operator!=(const SharedAllocator<U>&) const { return false; }
+};
+
+}
+
 DataBuffer::DataBuffer(const char* data, unsigned int size, deallocator dealloc)
    : mDealloc(dealloc)
 {
@@ -42,6 +219,26 @@ DataBuffer::~DataBuffer()
    mDealloc(mBuffer);
 }
 
+boost::shared_ptr<DataBuffer>
+DataBuffer::allocate(unsigned int size)
+{
+   const bool pooled = size <= PoolBufferSize;
+   const deallocator dealloc = pooled ? StorageDeallocator : ArrayDeallocator;
+   boost::shared_ptr<DataBuffer> buffer = boost::allocate_shared<DataBuffer>(SharedAllocator<DataBuffer>(), 0u, dealloc);
+   if(pooled)
+   {
+      buffer->mBuffer = (char*)getBlock(threadBuffers()->mStorage, StorageBlockSize);
+   }
+   else
+   {
+      buffer->mBuffer = new char[Headroom + size];
+   }
+   buffer->mStart = buffer->mBuffer + Headroom;
+   buffer->mSize = size;
+   memset(buffer->mStart, 0, size);
+   return buffer;
+}
+
 DataBuffer* DataBuffer::own(char* data, unsigned int size, deallocator dealloc)
 {
    DataBuffer* buff = new reTurn::DataBuffer(0, dealloc);
@@ -79,14 +276,14 @@ char&
 DataBuffer::operator[](unsigned int p) 
 { 
    resip_assert(p < mSize); 
-   return mBuffer[p]; 
+   return mStart[p]; 
 }
 
 char 
 DataBuffer::operator[](unsigned int p) const 
 { 
    resip_assert(p < mSize); 
-   return mBuffer[p]; 
+   return mStart[p]; 
 }
 
 unsigned int 
@@ -106,6 +303,21 @@ DataBuffer::offset(unsigned int bytes)
    return mSize;
 }
 
+unsigned int
+DataBuffer::headroom() const
+{
+   return (unsigned int)(mStart - mBuffer);
+}
+
+char*
+DataBuffer::prepend(unsigned int bytes)
+{
+   resip_assert(bytes <= headroom());
+   mStart = mStart-bytes;
+   mSize = mSize+bytes;
+   return mStart;
+}
+
 } // namespace
 
 
@@ -1,6 +1,8 @@
 #ifndef DATA_BUFFER_HXX
 #define DATA_BUFFER_HXX
 
+#include <boost/shared_ptr.hpp>
+
 namespace reTurn {
 
 void ArrayDeallocator(char* data);
@@ -16,6 +18,17 @@ public:
 
    static DataBuffer* own(char* data, unsigned int size, deallocator dealloc=ArrayDeallocator);
 
+   /// Bytes reserved in front of data() by allocate() - enough for a ChannelData header
+   static const unsigned int Headroom = 4;
+   /// Largest size allocate() serves from its per-thread pool
+   static const unsigned int PoolBufferSize = 4096;
+
+   /// Returns a zeroed buffer of size bytes with Headroom bytes free in front
+   /// of data().  Storage of up to PoolBufferSize bytes, and the buffer's
+   /// shared_ptr control block, are recycled through per-thread free lists, so
+   /// a steady packet flow does not touch the heap.
+   static boost::shared_ptr<DataBuffer> allocate(unsigned int size);
+
    const char* data();
    unsigned int size();
    char& operator[](unsigned int p);
@@ -24,6 +37,12 @@ public:
    unsigned int truncate(unsigned int newSize);
    unsigned int offset(unsigned int bytes);
 
+   /// Bytes available in front of data() - see prepend()
+   unsigned int headroom() const;
+   /// Moves the start of the data back by bytes (at most headroom()) and
+   /// returns the new start, so a header can be written without copying
+   char* prepend(unsigned int bytes);
+
    char* mutableData();
    unsigned int& mutableSize();
 
@@ -39,6 +39,9 @@ ReTurnConfig::ReTurnConfig() :
    mTurnAddress(asio::ip::address::from_string("0.0.0.0")),
    mTurnV6Address(asio::ip::address::from_string("::0")),
    mAltStunAddress(asio::ip::address::from_string("0.0.0.0")),
+   mNumThreads(1),
+   mPinThreads(true),
+   mUdpRelayBatchSize(0),
    mAuthenticationRealm("reTurn"),
    mUserDatabaseCheckInterval(60),
    mNonceLifetime(3600),            // 1 hour - at least 1 hours is recommended by the RFC
@@ -61,7 +64,8 @@ ReTurnConfig::ReTurnConfig() :
    mDaemonize(false),
    mPidFile(""),
    mRunAsUser(""),
-   mRunAsGroup("")
+   mRunAsGroup(""),
+   mUserDataVersion(0)
 {
 }
 
@@ -77,6 +81,9 @@ void ReTurnConfig::parseConfig(int argc, char** argv, const resip::Data& default
    mTurnAddress = asio::ip::address::from_string(getConfigData("TurnAddress", "0.0.0.0").c_str());
    mTurnV6Address = asio::ip::address::from_string(getConfigData("TurnV6Address", "::0").c_str());
    mAltStunAddress = asio::ip::address::from_string(getConfigData("AltStunAddress", "0.0.0.0").c_str());
+   mNumThreads = getConfigUnsignedLong("NumThreads", mNumThreads);
+   mPinThreads = getConfigBool("PinThreads", mPinThreads);
+   mUdpRelayBatchSize = getConfigUnsignedLong("UdpRelayBatchSize", mUdpRelayBatchSize);
    mAuthenticationRealm = getConfigData("AuthenticationRealm", mAuthenticationRealm);
    mUserDatabaseCheckInterval = getConfigUnsignedShort("UserDatabaseCheckInterval", 60);
    mNonceLifetime = getConfigUnsignedLong("NonceLifetime", mNonceLifetime);
@@ -149,6 +156,7 @@ ReTurnConfig::addUser(const resip::Data& username, const resip::Data& password,
        : UserAuthData::createFromPassword(username, realm, password)
       );
    mRealmUsersAuthenticaionCredentials[std::make_pair(username, realm)] = newUser.getHa1();
+   mUserDataVersion++;
    RealmUsers& realmUsers(mUsers[realm]);
    realmUsers.insert(pair<resip::Data,UserAuthData>(username, newUser));
 }
@@ -166,6 +174,7 @@ ReTurnConfig::authParse(const resip::Data& accountDatabaseFilename)
 
    mUsers.clear();
    mRealmUsersAuthenticaionCredentials.clear();
+   mUserDataVersion++;
 
    while(std::getline(accountDatabaseFile, sline))
    {
@@ -339,7 +348,7 @@ ReTurnConfig::getUser(const resip::Data& userName, const resip::Data& realm) con
    if(it == mUsers.end())
       return ret;
 
-   RealmUsers realmUsers = it->second;
+   const RealmUsers& realmUsers = it->second;
    RealmUsers::const_iterator it2 = realmUsers.find(userName);
    if(it2 == realmUsers.end())
       return ret;
@@ -58,6 +58,9 @@ public:
    asio::ip::address mTurnAddress;
    asio::ip::address mTurnV6Address;
    asio::ip::address mAltStunAddress;
+   unsigned int mNumThreads;  // io_service threads, 0 = one per CPU
+   bool mPinThreads;          // pin each io_service thread to its own CPU
+   unsigned int mUdpRelayBatchSize;  // datagrams per recvmmsg/sendmmsg on relay ports, 0 = off
 
    resip::Data mAuthenticationRealm;
    int mUserDatabaseCheckInterval;
@@ -91,12 +94,15 @@ public:
    bool isUserNameValid(const resip::Data& username,  const resip::Data& realm) const;
    resip::Data getHa1ForUsername(const resip::Data& username, const resip::Data& realm) const;
    std::auto_ptr<UserAuthData> getUser(const resip::Data& userName, const resip::Data& realm) const;
+   // Changes whenever users are added or reloaded, so cached credentials can be revalidated
+   unsigned int getUserDataVersion() const { return mUserDataVersion; }
    void addUser(const resip::Data& username, const resip::Data& password, const resip::Data& realm);
    void authParse(const resip::Data& accountDatabaseFilename);
 
 private:
    std::map<resip::Data,RealmUsers> mUsers;
    std::map<RealmUserPair, resip::Data> mRealmUsersAuthenticaionCredentials;
+   volatile unsigned int mUserDataVersion;
 
    friend class ReTurnUserFileScanner;
 };
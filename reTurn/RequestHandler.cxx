@@ -8,7 +8,6 @@
 #include "StunAuth.hxx"
 #include <rutil/Random.hxx>
 #include <rutil/Timer.hxx>
-#include <rutil/ParseBuffer.hxx>
 #include <rutil/WinLeakCheck.hxx>
 #include <rutil/Logger.hxx>
 #include "ReTurnSubsystem.hxx"
@@ -41,6 +40,8 @@ RequestHandler::RequestHandler(TurnManager& turnManager,
       mRFC3489SupportEnabled = false;
    }
    mPrivateNonceKey = Random::getRandomHex(24);
+   MD5Init(&mNonceKeyContext);
+   MD5Update(&mNonceKeyContext, reinterpret_cast<const md5byte*>(mPrivateNonceKey.data()), (unsigned int)mPrivateNonceKey.size());
 }
 
 RequestHandler::ProcessResult 
@@ -50,7 +51,7 @@ RequestHandler::processStunMessage(AsyncSocketBase* turnSocket, TurnAllocationMa
 
    response.mRemoteTuple = request.mRemoteTuple; // Default to send response back to sender
 
-   if(handleAuthentication(request, response))  
+   if(handleAuthentication(turnAllocationManager, request, response))  
    {
       // Check if there were unknown require attributes
       if(request.mUnknownRequiredAttributes.numAttributes > 0)
@@ -166,53 +167,76 @@ RequestHandler::buildErrorResponse(StunMessage& response, unsigned short errorCo
       response.setRealm(realm);
 
       // Add a random nonce value that is expirable
-      Data nonce(100, Data::Preallocate);
-      Data timestamp(Timer::getTimeMs()/1000);
-      generateNonce(timestamp, nonce);
-      response.setNonce(nonce.c_str());
+      char nonce[NonceSize + 1];
+      generateNonce((UInt32)(Timer::getTimeMs()/1000), nonce);
+      nonce[NonceSize] = 0;
+      response.setNonce(nonce);
    }
 }
 
+static const char hexDigits[] = "0123456789abcdef";
+
+static int
+hexDigitValue(char c)
+{
+   if(c >= '0' && c <= '9') return c - '0';
+   if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+   if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+   return -1;
+}
+
 void 
-RequestHandler::generateNonce(const Data& timestamp, Data& nonce)
+RequestHandler::generateNonce(UInt32 timestamp, char* nonce)
 {
-   nonce += timestamp;
-   nonce += ":";
-   Data noncePrivate(100, Data::Preallocate);
-   noncePrivate += timestamp;
-   noncePrivate += ":";
-   //noncePrivate += user;  // ?slg? What could we put here
-   noncePrivate += mPrivateNonceKey;
-   nonce += noncePrivate.md5();
+   for(int i = NonceTimestampSize - 1; i >= 0; i--)
+   {
+      nonce[i] = hexDigits[timestamp & 0xf];
+      timestamp >>= 4;
+   }
+
+   MD5Context context = mNonceKeyContext;
+   MD5Update(&context, reinterpret_cast<const md5byte*>(nonce), NonceTimestampSize);
+   unsigned char digest[16];
+   MD5Final(digest, &context);
+   for(unsigned int i = 0; i < sizeof(digest); i++)
+   {
+      nonce[NonceTimestampSize + i*2] = hexDigits[digest[i] >> 4];
+      nonce[NonceTimestampSize + i*2 + 1] = hexDigits[digest[i] & 0xf];
+   }
 }
 
 RequestHandler::CheckNonceResult
 RequestHandler::checkNonce(const Data& nonce)
 {
-   ParseBuffer pb(nonce.data(), nonce.size());
-   if (!pb.eof() && !isdigit(*pb.position()))
+   if(nonce.size() != NonceSize)
    {
-      DebugLog(<< "Invalid nonce.  Expected timestamp.");
+      DebugLog(<< "Invalid nonce.  Wrong size.");
       return NotValid;
    }
-   const char* anchor = pb.position();
-   pb.skipToChar(':');
-   if (pb.eof())
+   UInt32 creationTime = 0;
+   for(unsigned int i = 0; i < NonceTimestampSize; i++)
    {
-      DebugLog(<< "Invalid nonce. Expected timestamp terminator.");
-      return NotValid;
+      int digit = hexDigitValue(nonce.data()[i]);
+      if(digit < 0)
+      {
+         DebugLog(<< "Invalid nonce.  Expected timestamp.");
+         return NotValid;
+      }
+      creationTime = (creationTime << 4) | digit;
    }
-   UInt64 now = Timer::getTimeMs()/1000;
-   Data creationTimeData;
-   UInt64 creationTime;
-   pb.data(creationTimeData, anchor);
-   creationTime = creationTimeData.convertUInt64();
+   UInt32 now = (UInt32)(Timer::getTimeMs()/1000);
    if((now-creationTime) <= getConfig().mNonceLifetime)
    {
-      // If nonce hasn't expired yet - ensure this is a nonce we generated
-      Data nonceToMatch(100, Data::Preallocate);
-      generateNonce(creationTimeData, nonceToMatch);
-      if(nonceToMatch == nonce)
+      // If nonce hasn't expired yet - ensure this is a nonce we generated.  Every
+      // character is compared so the time taken doesn't depend on where they differ.
+      char nonceToMatch[NonceSize];
+      generateNonce(creationTime, nonceToMatch);
+      char diff = 0;
+      for(unsigned int i = 0; i < NonceSize; i++)
+      {
+         diff |= nonceToMatch[i] ^ nonce.data()[i];
+      }
+      if(diff == 0)
       {
          return Valid;
       }
@@ -230,7 +254,7 @@ RequestHandler::checkNonce(const Data& nonce)
 }
 
 bool 
-RequestHandler::handleAuthentication(StunMessage& request, StunMessage& response)
+RequestHandler::handleAuthentication(TurnAllocationManager& turnAllocationManager, StunMessage& request, StunMessage& response)
 {
    // Don't authenticate shared secret requests, Binding Requests or Indications (if LongTermCredentials are used)
    if((request.mClass == StunMessage::StunClassRequest && request.mMethod == StunMessage::SharedSecretMethod) ||
@@ -285,6 +309,38 @@ RequestHandler::handleAuthentication(StunMessage& request, StunMessage& response
          break;
       }
 
+      // Refreshes, permissions and channel binds on an existing allocation can reuse the
+      // key the allocation cached, as long as the user database hasn't changed since it
+      // was last checked
+      TurnAllocation* allocation = 0;
+      if(request.mMethod == StunMessage::TurnRefreshMethod ||
+         request.mMethod == StunMessage::TurnCreatePermissionMethod ||
+         request.mMethod == StunMessage::TurnChannelBindMethod)
+      {
+         allocation = turnAllocationManager.findTurnAllocation(TurnAllocationKey(request.mLocalTuple, request.mRemoteTuple));
+         if(allocation && 
+            (allocation->getClientAuth().getClientUsername() != *request.mUsername ||
+             allocation->getClientAuth().getClientRealm() != *request.mRealm))
+         {
+            allocation = 0;  // Let the request processor reject the mismatch
+         }
+      }
+      unsigned int userDataVersion = getConfig().getUserDataVersion();
+      if(allocation && allocation->getClientAuth().getUserDataVersion() == userDataVersion)
+      {
+         const StunAuth& clientAuth = allocation->getClientAuth();
+         if(!request.checkMessageIntegrity(*clientAuth.getClientHmacKey()))
+         {
+            WarningLog(<< "MessageIntegrity is bad. Sending 401. Sender=" << request.mRemoteTuple);
+            buildErrorResponse(response, 401, "Unauthorized", getConfig().mAuthenticationRealm.c_str());
+            return false;
+         }
+         response.mHasMessageIntegrity = true;
+         response.mHmacKey = clientAuth.getClientSharedSecret();
+         response.mCachedHmacKey = clientAuth.getClientHmacKey();
+         return true;
+      }
+
       StackLog(<< "Validating username: " << *request.mUsername);  // Note: we ensure username is present above
 
       // !slg! need to determine whether the USERNAME contains a known entity, and is known 
@@ -315,6 +371,12 @@ RequestHandler::handleAuthentication(StunMessage& request, StunMessage& response
       // need to compute this later after message is filled in
       response.mHasMessageIntegrity = true;
       response.mHmacKey = hmacKey;  // Used to later calculate Message Integrity during encoding
+
+      if(allocation && allocation->getClientAuth().getClientSharedSecret() == hmacKey)
+      {
+         allocation->getClientAuth().setUserDataVersion(userDataVersion);
+         response.mCachedHmacKey = allocation->getClientAuth().getClientHmacKey();
+      }
    }
 
    return true;
@@ -585,7 +647,7 @@ RequestHandler::processTurnAllocateRequest(AsyncSocketBase* turnSocket, TurnAllo
                                       turnSocket, 
                                       request.mLocalTuple, 
                                       request.mRemoteTuple, 
-                                      StunAuth(*request.mUsername, response.mHmacKey), // The HMAC is already calculated and added to the response in handleAuthentication
+                                      StunAuth(*request.mUsername, response.mHmacKey, *request.mRealm), // The HMAC is already calculated and added to the response in handleAuthentication
                                       allocationTuple, 
                                       lifetime);
       if(!allocation->startRelay())
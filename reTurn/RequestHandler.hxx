@@ -3,6 +3,7 @@
 
 #include <string>
 #include <boost/noncopyable.hpp>
+#include <rutil/vmd5.hxx>
 
 #include "DataBuffer.hxx"
 #include "StunMessage.hxx"
@@ -49,10 +50,15 @@ private:
    asio::ip::address mAlt3489Address;
    unsigned short mAlt3489Port;
 
+   // Nonces are the creation time as 8 hex digits followed by the hex MD5 of those
+   // digits keyed with mPrivateNonceKey, so they can be checked without parsing
+   static const unsigned int NonceTimestampSize = 8;
+   static const unsigned int NonceSize = NonceTimestampSize + 32;
    resip::Data mPrivateNonceKey;
+   resip::MD5Context mNonceKeyContext;  // MD5 state after hashing mPrivateNonceKey
 
    // Authentication handler
-   bool handleAuthentication(StunMessage& request, StunMessage& response);
+   bool handleAuthentication(TurnAllocationManager& turnAllocationManager, StunMessage& request, StunMessage& response);
 
    // Specific request processors
    ProcessResult processStunBindingRequest(StunMessage& request, StunMessage& response, bool isRFC3489BackwardsCompatServer);
@@ -67,7 +73,7 @@ private:
 
    // Utility methods
    void buildErrorResponse(StunMessage& response, unsigned short errorCode, const char* msg, const char* realm = 0);
-   void generateNonce(const resip::Data& timestamp, resip::Data& nonce);
+   void generateNonce(UInt32 timestamp, char* nonce);  // writes NonceSize characters, not null terminated
    enum CheckNonceResult { Valid, NotValid, Expired };
    CheckNonceResult checkNonce(const resip::Data& nonce);
 };
@@ -6,9 +6,13 @@ using namespace resip;
 namespace reTurn {
 
 StunAuth::StunAuth(const Data& clientUsername,
-                   const Data& clientSharedSecret) :
+                   const Data& clientSharedSecret,
+                   const Data& clientRealm) :
    mClientUsername(clientUsername),
-   mClientSharedSecret(clientSharedSecret)
+   mClientSharedSecret(clientSharedSecret),
+   mClientRealm(clientRealm),
+   mClientHmacKey(new StunHmacKey(clientSharedSecret)),
+   mUserDataVersion(0)
 {
 }
 
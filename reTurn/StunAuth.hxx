@@ -2,6 +2,9 @@
 #define STUNAUTH_HXX
 
 #include <rutil/Data.hxx>
+#include <boost/shared_ptr.hpp>
+
+#include "StunMessage.hxx"
 
 namespace reTurn {
 
@@ -9,14 +12,24 @@ class StunAuth
 {
 public:
    explicit StunAuth(const resip::Data& clientUsername,
-                     const resip::Data& clientSharedSecret);
+                     const resip::Data& clientSharedSecret,
+                     const resip::Data& clientRealm = resip::Data::Empty);
 
    const resip::Data& getClientUsername() const { return mClientUsername; }
    const resip::Data& getClientSharedSecret() const { return mClientSharedSecret; }
+   const resip::Data& getClientRealm() const { return mClientRealm; }
+   const boost::shared_ptr<StunHmacKey>& getClientHmacKey() const { return mClientHmacKey; }
+
+   // Version of the user database the shared secret was last checked against, 0 if never
+   unsigned int getUserDataVersion() const { return mUserDataVersion; }
+   void setUserDataVersion(unsigned int userDataVersion) { mUserDataVersion = userDataVersion; }
 
 private:
    resip::Data mClientUsername;
    resip::Data mClientSharedSecret;
+   resip::Data mClientRealm;
+   boost::shared_ptr<StunHmacKey> mClientHmacKey;
+   unsigned int mUserDataVersion;
 };
 
 } 
@@ -20,6 +20,7 @@
 
 #ifdef USE_SSL
 #include <openssl/hmac.h>
+#include <openssl/evp.h>
 #endif
 
 using namespace std;
@@ -1643,7 +1644,14 @@ StunMessage::stunEncodeMessage(char* buf, unsigned int bufLen)
       int len = ptr - buf;
       StackLog(<< "Adding message integrity: buffer size=" << len << ", hmacKey=" << mHmacKey.hex());
       StunAtrIntegrity integrity;
-      computeHmac(integrity.hash, buf, len, mHmacKey.c_str(), (int)mHmacKey.size());
+      if(mCachedHmacKey)
+      {
+         mCachedHmacKey->computeHmac(integrity.hash, buf, len);
+      }
+      else
+      {
+         computeHmac(integrity.hash, buf, len, mHmacKey.c_str(), (int)mHmacKey.size());
+      }
 	   ptr = encodeAtrIntegrity(ptr, integrity);
    }
 
@@ -1699,6 +1707,94 @@ StunMessage::computeHmac(char* hmac, const char* input, int length, const char*
 }
 #endif
 
+#ifndef USE_SSL
+struct StunHmacKey::Pads
+{
+};
+
+StunHmacKey::StunHmacKey(const Data& key) :
+   mKey(key),
+   mPads(0)
+{
+}
+
+StunHmacKey::~StunHmacKey()
+{
+}
+
+void
+StunHmacKey::computeHmac(char* hmac, const char* input, int length) const
+{
+   strncpy(hmac,"hmac-not-implemented",20);
+}
+#else
+struct StunHmacKey::Pads
+{
+   EVP_MD_CTX* mInner;  // SHA1 state after hashing key ^ ipad
+   EVP_MD_CTX* mOuter;  // SHA1 state after hashing key ^ opad
+};
+
+static EVP_MD_CTX*
+hashPad(const unsigned char* block, unsigned int blockSize, unsigned char padByte)
+{
+   unsigned char pad[64];
+   for(unsigned int i = 0; i < blockSize; i++)
+   {
+      pad[i] = block[i] ^ padByte;
+   }
+   EVP_MD_CTX* ctx = EVP_MD_CTX_create();
+   EVP_DigestInit_ex(ctx, EVP_sha1(), 0);
+   EVP_DigestUpdate(ctx, pad, blockSize);
+   return ctx;
+}
+
+StunHmacKey::StunHmacKey(const Data& key) :
+   mKey(key),
+   mPads(new Pads)
+{
+   // RFC 2104: keys longer than the SHA1 block are hashed first, shorter ones are zero padded
+   unsigned char block[64];
+   memset(block, 0, sizeof(block));
+   if(key.size() > sizeof(block))
+   {
+      unsigned int size;
+      EVP_Digest(key.data(), key.size(), block, &size, EVP_sha1(), 0);
+   }
+   else
+   {
+      memcpy(block, key.data(), key.size());
+   }
+   mPads->mInner = hashPad(block, sizeof(block), 0x36);
+   mPads->mOuter = hashPad(block, sizeof(block), 0x5c);
+}
+
+StunHmacKey::~StunHmacKey()
+{
+   EVP_MD_CTX_destroy(mPads->mInner);
+   EVP_MD_CTX_destroy(mPads->mOuter);
+   delete mPads;
+}
+
+void
+StunHmacKey::computeHmac(char* hmac, const char* input, int length) const
+{
+   unsigned char innerHash[EVP_MAX_MD_SIZE];
+   unsigned int size;
+   EVP_MD_CTX* ctx = EVP_MD_CTX_create();
+
+   EVP_MD_CTX_copy_ex(ctx, mPads->mInner);
+   EVP_DigestUpdate(ctx, input, length);
+   EVP_DigestFinal_ex(ctx, innerHash, &size);
+
+   EVP_MD_CTX_copy_ex(ctx, mPads->mOuter);
+   EVP_DigestUpdate(ctx, innerHash, size);
+   EVP_DigestFinal_ex(ctx, reinterpret_cast<unsigned char*>(hmac), &size);
+   resip_assert(size == 20);
+
+   EVP_MD_CTX_destroy(ctx);
+}
+#endif
+
 void
 StunMessage::createUsernameAndPassword()
 {
@@ -1837,6 +1933,18 @@ StunMessage::calculateHmacKey(Data& hmacKey, const Data& username, const Data& r
 
 bool 
 StunMessage::checkMessageIntegrity(const Data& hmacKey)
+{
+   return checkMessageIntegrity(hmacKey, 0);
+}
+
+bool 
+StunMessage::checkMessageIntegrity(const StunHmacKey& hmacKey)
+{
+   return checkMessageIntegrity(hmacKey.getKey(), &hmacKey);
+}
+
+bool 
+StunMessage::checkMessageIntegrity(const Data& hmacKey, const StunHmacKey* cachedHmacKey)
 {
    if(mHasMessageIntegrity)
    {
@@ -1854,7 +1962,14 @@ StunMessage::checkMessageIntegrity(const Data& hmacKey)
       // Calculate HMAC
       int iHMACBufferSize = mMessageIntegrityMsgLength - 24 /* MessageIntegrity size */ + sizeof(StunMsgHdr); // The entire message proceeding the message integrity attribute
       StackLog(<< "Checking message integrity: length=" << mMessageIntegrityMsgLength << ", size=" << iHMACBufferSize << ", hmacKey=" << hmacKey.hex());
-      computeHmac((char*)hmac, mBuffer.data(), iHMACBufferSize, hmacKey.c_str(), hmacKey.size());
+      if(cachedHmacKey)
+      {
+         cachedHmacKey->computeHmac((char*)hmac, mBuffer.data(), iHMACBufferSize);
+      }
+      else
+      {
+         computeHmac((char*)hmac, mBuffer.data(), iHMACBufferSize, hmacKey.c_str(), hmacKey.size());
+      }
 
       // Restore original stun message length in mBuffer
       memcpy(lengthposition, &originalLength, 2);
@@ -5,6 +5,7 @@
 #include <rutil/compat.hxx>
 #include <rutil/Data.hxx>
 #include <asio.hpp>
+#include <boost/shared_ptr.hpp>
 #ifdef USE_SSL
 #include <asio/ssl.hpp>
 #endif
@@ -25,6 +26,27 @@ bool operator<(const UInt128&, const UInt128&);
 bool operator==(const UInt128&, const UInt128&);
 #endif
 
+// MESSAGE-INTEGRITY key with the HMAC-SHA1 inner and outer pads already
+// hashed.  Each HMAC computed with it only hashes the message itself, so
+// servers keep one per allocation rather than rekeying for every request.
+class StunHmacKey
+{
+public:
+   explicit StunHmacKey(const resip::Data& key);
+   ~StunHmacKey();
+
+   const resip::Data& getKey() const { return mKey; }
+   void computeHmac(char* hmac, const char* input, int length) const;
+
+private:
+   StunHmacKey(const StunHmacKey&);
+   StunHmacKey& operator=(const StunHmacKey&);
+
+   struct Pads;
+   resip::Data mKey;
+   Pads* mPads;
+};
+
 class StunMessage
 {
 public:
@@ -66,6 +88,7 @@ public:
    void calculateHmacKeyForHa1(resip::Data& hmacKey, const resip::Data& ha1);
    void calculateHmacKey(resip::Data& hmacKey, const resip::Data& username, const resip::Data& realm, const resip::Data& longtermAuthenticationPassword);
    bool checkMessageIntegrity(const resip::Data& hmacKey);
+   bool checkMessageIntegrity(const StunHmacKey& hmacKey);
    bool checkFingerprint();
 
    /// define stun address families
@@ -239,6 +262,7 @@ public:
    StunTuple mRemoteTuple; // Remote address and port that sent the stun message
    resip::Data mBuffer;
    resip::Data mHmacKey;
+   boost::shared_ptr<StunHmacKey> mCachedHmacKey;  // Optional, used instead of mHmacKey when encoding if set
 
    UInt16 mMessageIntegrityMsgLength;
 
@@ -384,6 +408,7 @@ private:
    char* encodeAtrIntegrity(char* ptr, const StunAtrIntegrity& atr);
    char* encodeAtrEvenPort(char* ptr, const TurnAtrEvenPort& atr);
    void computeHmac(char* hmac, const char* input, int length, const char* key, int sizeKey);
+   bool checkMessageIntegrity(const resip::Data& hmacKey, const StunHmacKey* cachedHmacKey);
 
    bool mIsValid;
 };
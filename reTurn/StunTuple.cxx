@@ -60,6 +60,33 @@ StunTuple::operator<(const StunTuple& rhs) const
    return false;
 }
 
+size_t
+StunTuple::hash() const
+{
+   UInt64 h;
+   if(mAddress.is_v4())
+   {
+      h = mAddress.to_v4().to_ulong();
+   }
+   else
+   {
+      asio::ip::address_v6::bytes_type bytes = mAddress.to_v6().to_bytes();
+      UInt64 high, low;
+      memcpy(&high, bytes.data(), 8);
+      memcpy(&low, bytes.data() + 8, 8);
+      h = high ^ (low * 0x9E3779B97F4A7C15ULL);
+   }
+   h ^= ((UInt64)mPort << 32) ^ ((UInt64)mTransport << 48);
+
+   // Murmur3 finalizer - spreads port and address bits over the whole word
+   h ^= h >> 33;
+   h *= 0xFF51AFD7ED558CCDULL;
+   h ^= h >> 33;
+   h *= 0xC4CEB9FE1A85EC53ULL;
+   h ^= h >> 33;
+   return (size_t)h;
+}
+
 void
 StunTuple::toSockaddr(sockaddr* addr) const
 {
@@ -115,6 +142,8 @@ operator<<(EncodeStream& strm, const StunTuple& tuple)
 
 } // namespace
 
+HashValueImp(reTurn::StunTuple, data.hash());
+
 
 /* ====================================================================
 
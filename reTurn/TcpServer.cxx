@@ -8,7 +8,7 @@
 
 namespace reTurn {
 
-TcpServer::TcpServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port)
+TcpServer::TcpServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port, bool reusePort)
 : mIOService(ioService),
   mAcceptor(ioService),
   mConnectionManager(),
@@ -20,6 +20,14 @@ TcpServer::TcpServer(asio::io_service& ioService, RequestHandler& requestHandler
 
    mAcceptor.open(endpoint.protocol());
    mAcceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef RETURN_SHARED_LISTENERS
+   if(reusePort)
+   {
+      mAcceptor.set_option(reuse_port(true));
+   }
+#else
+   resip_assert(!reusePort);
+#endif
 #ifdef USE_IPV6
 #ifdef __linux__
    if(address.is_v6())
@@ -18,7 +18,8 @@ class TcpServer
 {
 public:
   /// Create the server to listen on the specified TCP address and port
-  explicit TcpServer(asio::io_service& ioService, RequestHandler& rqeuestHandler, const asio::ip::address& address, unsigned short port);
+  /// reusePort lets one TcpServer per io_service thread share address:port
+  explicit TcpServer(asio::io_service& ioService, RequestHandler& rqeuestHandler, const asio::ip::address& address, unsigned short port, bool reusePort = false);
 
   void start();
 
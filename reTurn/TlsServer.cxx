@@ -15,7 +15,7 @@
 
 namespace reTurn {
 
-TlsServer::TlsServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port)
+TlsServer::TlsServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port, bool reusePort)
 : mIOService(ioService),
   mAcceptor(ioService),
   mContext(ioService, asio::ssl::context::sslv23),  // SSLv23 (actually chooses TLS version dynamically)
@@ -64,6 +64,14 @@ TlsServer::TlsServer(asio::io_service& ioService, RequestHandler& requestHandler
 
    mAcceptor.open(endpoint.protocol());
    mAcceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef RETURN_SHARED_LISTENERS
+   if(reusePort)
+   {
+      mAcceptor.set_option(reuse_port(true));
+   }
+#else
+   resip_assert(!reusePort);
+#endif
 #ifdef USE_IPV6
 #ifdef __linux__
    if(address.is_v6())
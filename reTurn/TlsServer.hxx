@@ -22,7 +22,8 @@ class TlsServer
 {
 public:
   /// Create the server to listen on the specified TCP address and port
-  explicit TlsServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port);
+  /// reusePort lets one TlsServer per io_service thread share address:port
+  explicit TlsServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port, bool reusePort = false);
 
   void start();
 
@@ -32,9 +32,13 @@ TurnAllocation::TurnAllocation(TurnManager& turnManager,
    mKey(clientLocalTuple, clientRemoteTuple),
    mClientAuth(clientAuth),
    mRequestedTuple(requestedTuple),
+   mPacketsToPeer(0),
+   mBytesToPeer(0),
+   mPacketsToClient(0),
+   mBytesToClient(0),
    mTurnManager(turnManager),
    mTurnAllocationManager(turnAllocationManager),
-   mAllocationTimer(turnManager.getIOService()),
+   mAllocationTimer(localTurnSocket->getIOService()),
    mLocalTurnSocket(localTurnSocket),
    mBadChannelErrorLogged(false),
    mNoPermissionToPeerLogged(false),
@@ -52,7 +56,9 @@ TurnAllocation::TurnAllocation(TurnManager& turnManager,
 TurnAllocation::~TurnAllocation()
 {
    InfoLog(<< "TurnAllocation destroyed: clientLocal=" << mKey.getClientLocalTuple() << " clientRemote=" << 
-           mKey.getClientRemoteTuple() << " allocation=" << mRequestedTuple);
+           mKey.getClientRemoteTuple() << " allocation=" << mRequestedTuple << 
+           " toPeer=" << mPacketsToPeer << "/" << mBytesToPeer << 
+           " toClient=" << mPacketsToClient << "/" << mBytesToClient << " (packets/bytes)");
 
    stopRelay();
 
@@ -78,7 +84,7 @@ TurnAllocation::startRelay()
 {
    if(mRequestedTuple.getTransportType() == StunTuple::UDP)
    {
-      mUdpRelayServer.reset(new UdpRelayServer(mTurnManager.getIOService(), *this));
+      mUdpRelayServer.reset(new UdpRelayServer(mLocalTurnSocket->getIOService(), *this, mTurnManager.getConfig().mUdpRelayBatchSize));
       if(!mUdpRelayServer->startReceiving())
       {
          stopRelay();  // Ensure allocation timer is stopped
@@ -123,13 +129,13 @@ TurnAllocation::refresh(unsigned int lifetime)  // update expiration time
 bool 
 TurnAllocation::existsPermission(const asio::ip::address& address)
 {
-   TurnPermissionMap::iterator it = mTurnPermissionMap.find(address);
+   TurnPermissionMap::iterator it = mTurnPermissionMap.find(permissionKey(address));
    if(it != mTurnPermissionMap.end())
    {
       if(it->second->isExpired()) // check if expired
       {
          InfoLog(<< "TurnAllocation has expired permission: clientLocal=" << mKey.getClientLocalTuple() << " clientRemote=" << 
-            mKey.getClientRemoteTuple() << " allocation=" << mRequestedTuple << " exipred address=" << it->first.to_string());
+            mKey.getClientRemoteTuple() << " allocation=" << mRequestedTuple << " exipred address=" << address.to_string());
          delete it->second;
          mTurnPermissionMap.erase(it);
          return false;
@@ -142,7 +148,7 @@ TurnAllocation::existsPermission(const asio::ip::address& address)
 void 
 TurnAllocation::refreshPermission(const asio::ip::address& address)
 {
-   TurnPermissionMap::iterator it = mTurnPermissionMap.find(address);
+   TurnPermissionMap::iterator it = mTurnPermissionMap.find(permissionKey(address));
    TurnPermission* turnPermission = 0;
    if(it != mTurnPermissionMap.end())
    {
@@ -150,7 +156,7 @@ TurnAllocation::refreshPermission(const asio::ip::address& address)
    }
    if(!turnPermission) // create if doesn't exist
    {
-      mTurnPermissionMap[address] = new TurnPermission(address, TURN_PERMISSION_LIFETIME_SECONDS);  
+      mTurnPermissionMap[permissionKey(address)] = new TurnPermission(address, TURN_PERMISSION_LIFETIME_SECONDS);  
       InfoLog(<< "Permission for " << address.to_string() << " created: clientLocal=" << mKey.getClientLocalTuple() << " clientRemote=" << 
               mKey.getClientRemoteTuple() << " allocation=" << mRequestedTuple);
    }
@@ -218,6 +224,8 @@ TurnAllocation::sendDataToPeer(const StunTuple& peerAddress, boost::shared_ptr<D
    if(mRequestedTuple.getTransportType() == StunTuple::UDP)
    {
       resip_assert(mUdpRelayServer);
+      ++mPacketsToPeer;
+      mBytesToPeer += data->size() - (isFramed ? 4 : 0);
       mUdpRelayServer->doSend(peerAddress, data, isFramed ? 4 /* bufferStartPos is 4 so that framing is skipped */ : 0);
    }
    else
@@ -250,6 +258,9 @@ TurnAllocation::sendDataToClient(const StunTuple& peerAddress, boost::shared_ptr
       }
       return;
    }
+   ++mPacketsToClient;
+   mBytesToClient += data->size();
+
    // See if a channel binding exists - if so, use it
    RemotePeer* remotePeer = mChannelManager.findRemotePeerByPeerAddress(peerAddress);
    if(remotePeer)
@@ -283,6 +294,36 @@ TurnAllocation::sendDataToClient(const StunTuple& peerAddress, boost::shared_ptr
    }
 }
 
+bool
+TurnAllocation::frameDataForClient(const StunTuple& peerAddress, DataBuffer& data)
+{
+   // Anything already queued on the turn socket must go out first, or the
+   // client would see packets reordered
+   if(!mLocalTurnSocket || 
+      mKey.getClientLocalTuple().getTransportType() != StunTuple::UDP ||
+      mLocalTurnSocket->hasQueuedSends() ||
+      data.headroom() < 4 ||
+      !existsPermission(peerAddress.getAddress()))
+   {
+      return false;
+   }
+   RemotePeer* remotePeer = mChannelManager.findRemotePeerByPeerAddress(peerAddress);
+   if(!remotePeer)
+   {
+      return false;
+   }
+
+   ++mPacketsToClient;
+   mBytesToClient += data.size();
+
+   unsigned short channel = htons(remotePeer->getChannel());
+   unsigned short msgsize = htons((unsigned short)data.size());
+   char* frame = data.prepend(4);
+   memcpy(frame, &channel, 2);
+   memcpy(frame+2, &msgsize, 2);
+   return true;
+}
+
 bool 
 TurnAllocation::addChannelBinding(const StunTuple& peerAddress, unsigned short channelNumber)
 {
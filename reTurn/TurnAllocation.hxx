@@ -1,7 +1,6 @@
 #ifndef TURNALLOCATION_HXX
 #define TURNALLOCATION_HXX
 
-#include <map>
 #include <boost/noncopyable.hpp>
 #include <asio.hpp>
 #ifdef USE_SSL
@@ -61,6 +60,10 @@ public:
    void sendDataToPeer(const StunTuple& peerAddress, boost::shared_ptr<DataBuffer>& data, bool isFramed);  
    // Used when Data is received from peer, to forward data to client
    void sendDataToClient(const StunTuple& peerAddress, boost::shared_ptr<DataBuffer>& data); 
+   // Used by the UdpRelayServer's batched receive: if data from peerAddress can go
+   // to a UDP client as ChannelData, writes the header into the buffer's headroom
+   // and returns true - the caller then sends it on the local turn socket
+   bool frameDataForClient(const StunTuple& peerAddress, DataBuffer& data);
 
    // Called when a ChannelBind Request is received
    bool addChannelBinding(const StunTuple& peerAddress, unsigned short channelNumber);
@@ -68,6 +71,8 @@ public:
    const StunTuple& getRequestedTuple() const { return mRequestedTuple; }
    time_t getExpires() const { return mExpires; }
    const StunAuth& getClientAuth() const { return mClientAuth; }
+   StunAuth& getClientAuth() { return mClientAuth; }
+   AsyncSocketBase* getLocalTurnSocket() { return mLocalTurnSocket; }
 
 private:
    TurnAllocationKey mKey;  // contains ClientLocalTuple and clientRemoteTuple
@@ -77,7 +82,15 @@ private:
    time_t    mExpires;
    //unsigned int mBandwidth; // future use
 
-   typedef std::map<asio::ip::address,TurnPermission*> TurnPermissionMap;
+   // Relayed traffic - logged when the allocation is destroyed
+   UInt64 mPacketsToPeer;
+   UInt64 mBytesToPeer;
+   UInt64 mPacketsToClient;
+   UInt64 mBytesToClient;
+
+   // Permissions are per address - keyed by a tuple with no transport or port
+   static StunTuple permissionKey(const asio::ip::address& address) { return StunTuple(StunTuple::None, address, 0); }
+   typedef HashMap<StunTuple,TurnPermission*> TurnPermissionMap;
    TurnPermissionMap mTurnPermissionMap;
 
    TurnManager& mTurnManager;
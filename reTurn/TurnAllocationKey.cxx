@@ -38,9 +38,17 @@ TurnAllocationKey::operator<(const TurnAllocationKey& rhs) const
    return false;
 }
 
+size_t
+TurnAllocationKey::hash() const
+{
+   size_t h = mClientLocalTuple.hash();
+   return h ^ (mClientRemoteTuple.hash() + 0x9E3779B9 + (h << 6) + (h >> 2));
+}
 
 } // namespace
 
+HashValueImp(reTurn::TurnAllocationKey, data.hash());
+
 
 /* ====================================================================
 
@@ -6,6 +6,7 @@
 #ifdef USE_SSL
 #include <asio/ssl.hpp>
 #endif
+#include <rutil/Mutex.hxx>
 #include "ReTurnConfig.hxx"
 #include "StunTuple.hxx"
 
@@ -19,6 +20,8 @@ public:
 
    asio::io_service& getIOService() { return mIOService; }
 
+   // The port allocators are shared by all io_service threads and are
+   // safe to call from any of them.
    unsigned short allocateAnyPort(StunTuple::TransportType transport);
    unsigned short allocateEvenPort(StunTuple::TransportType transport);
    unsigned short allocateOddPort(StunTuple::TransportType transport);
@@ -46,6 +49,7 @@ private:
 
    asio::io_service& mIOService;
    const ReTurnConfig& mConfig;
+   resip::Mutex mMutex;  // guards the port allocation maps and last allocated ports
 };
 
 } 
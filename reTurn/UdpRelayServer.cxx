@@ -7,15 +7,136 @@
 #include <rutil/Logger.hxx>
 #include "ReTurnSubsystem.hxx"
 
+#ifdef RETURN_RELAY_MMSG
+#include <sys/socket.h>
+#include <rutil/Lock.hxx>
+#include <rutil/Mutex.hxx>
+#include <rutil/ThreadIf.hxx>
+#endif
+
 #define RESIPROCATE_SUBSYSTEM ReTurnSubsystem::RETURN
 
 using namespace std;
+using namespace resip;
 
 namespace reTurn {
 
-UdpRelayServer::UdpRelayServer(asio::io_service& ioService, TurnAllocation& turnAllocation)
+#ifdef RETURN_RELAY_MMSG
+namespace
+{
+
+// Limit on batches drained per readable event, so one busy relay port does
+// not hold up the other sockets on its io_service
+const unsigned int MaxBatchesPerWakeup = 4;
+
+// Scratch space for one batch.  A batch is received, relayed and released
+// within a single handler, so all relay ports on an io_service thread share
+// one set of buffers rather than each holding batchSize of them.
+struct RelayBatch
+{
+   std::vector<boost::shared_ptr<DataBuffer> > mBuffers;
+   std::vector<iovec> mRecvIovs;
+   std::vector<sockaddr_storage> mAddresses;
+   std::vector<mmsghdr> mRecvMsgs;
+   std::vector<iovec> mSendIovs;
+   std::vector<mmsghdr> mSendMsgs;
+   std::vector<unsigned int> mSendIndex;  // into mBuffers
+
+   void resize(unsigned int size)
+   {
+      unsigned int oldSize = (unsigned int)mBuffers.size();
+      mBuffers.resize(size);
+      mRecvIovs.resize(size);
+      mAddresses.resize(size);
+      mRecvMsgs.resize(size);
+      mSendIovs.resize(size);
+      mSendMsgs.resize(size);
+      mSendIndex.resize(size);
+      memset(&mRecvMsgs[0], 0, size * sizeof(mmsghdr));
+      memset(&mSendMsgs[0], 0, size * sizeof(mmsghdr));
+      for(unsigned int i = 0; i < size; i++)
+      {
+         if(i >= oldSize)
+         {
+            mBuffers[i] = AsyncSocketBase::allocateBuffer(RECEIVE_BUFFER_SIZE);
+         }
+         prepare(i);
+         mSendMsgs[i].msg_hdr.msg_iov = &mSendIovs[i];
+         mSendMsgs[i].msg_hdr.msg_iovlen = 1;
+      }
+   }
+
+   // Readies slot i for the next recvmmsg.  A buffer that is still referenced
+   // elsewhere (queued by the regular path) is replaced.
+   void prepare(unsigned int i)
+   {
+      if(mBuffers[i].use_count() != 1)
+      {
+         mBuffers[i] = AsyncSocketBase::allocateBuffer(RECEIVE_BUFFER_SIZE);
+      }
+      else if(mBuffers[i]->headroom() < DataBuffer::Headroom)
+      {
+         // Undo the header written by the fast path
+         mBuffers[i]->offset(DataBuffer::Headroom - mBuffers[i]->headroom());
+      }
+      mBuffers[i]->mutableSize() = RECEIVE_BUFFER_SIZE;
+      mRecvIovs[i].iov_base = mBuffers[i]->mutableData();
+      mRecvIovs[i].iov_len = RECEIVE_BUFFER_SIZE;
+      mRecvMsgs[i].msg_hdr.msg_name = &mAddresses[i];
+      mRecvMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+      mRecvMsgs[i].msg_hdr.msg_iov = &mRecvIovs[i];
+      mRecvMsgs[i].msg_hdr.msg_iovlen = 1;
+      mRecvMsgs[i].msg_hdr.msg_flags = 0;
+   }
+};
+
+Mutex batchMutex;
+volatile bool batchKeyCreated = false;
+ThreadIf::TlsKey batchKey;
+
+void
+freeRelayBatch(void* arg)
+{
+   delete (RelayBatch*)arg;
+}
+
+RelayBatch&
+threadBatch(unsigned int size)
+{
+   if(!batchKeyCreated)
+   {
+      Lock lock(batchMutex);
+      if(!batchKeyCreated)
+      {
+         ThreadIf::tlsKeyCreate(batchKey, freeRelayBatch);
+         batchKeyCreated = true;
+      }
+   }
+
+   RelayBatch* batch = (RelayBatch*)ThreadIf::tlsGetValue(batchKey);
+   if(!batch)
+   {
+      batch = new RelayBatch;
+      ThreadIf::tlsSetValue(batchKey, batch);
+   }
+   if(batch->mBuffers.size() < size)
+   {
+      batch->resize(size);
+   }
+   return *batch;
+}
+
+}
+#endif
+
+UdpRelayServer::UdpRelayServer(asio::io_service& ioService, TurnAllocation& turnAllocation, unsigned int batchSize)
 : AsyncUdpSocketBase(ioService),
   mTurnAllocation(turnAllocation),
+#ifdef RETURN_RELAY_MMSG
+  mBatchSize(resipMin(batchSize, (unsigned int)UIO_MAXIOV)),
+#else
+  mBatchSize(0),
+#endif
   mStopping(false),
   mBindSuccess(false)
 {
@@ -42,7 +163,7 @@ UdpRelayServer::startReceiving()
    if(mBindSuccess)
    {
       // Note:  This function is required, since you cannot call shared_from_this in the constructor: shared_from_this requires that at least one shared ptr exists already
-      doReceive();
+      receiveNext();
       return true;
    }
    else
@@ -90,9 +211,126 @@ UdpRelayServer::onReceiveFailure(const asio::error_code& e)
 {
    if(!mStopping && e != asio::error::operation_aborted && e != asio::error::bad_descriptor)
    {
-      doReceive();
+      receiveNext();
+   }
+}
+
+void
+UdpRelayServer::receiveNext()
+{
+#ifdef RETURN_RELAY_MMSG
+   if(mBatchSize > 0)
+   {
+      doBatchReceive();
+      return;
+   }
+#endif
+   doReceive();
+}
+
+#ifdef RETURN_RELAY_MMSG
+void
+UdpRelayServer::doBatchReceive()
+{
+   // Wait for readability only - the datagrams are read by handleBatchReadable
+   mSocket.async_receive(asio::null_buffers(),
+                         boost::bind(&UdpRelayServer::handleBatchReadable, 
+                                     boost::static_pointer_cast<UdpRelayServer>(shared_from_this()), 
+                                     asio::placeholders::error));
+}
+
+void
+UdpRelayServer::handleBatchReadable(const asio::error_code& e)
+{
+   if(mStopping)
+   {
+      return;
+   }
+   if(e)
+   {
+      onReceiveFailure(e);
+      return;
+   }
+
+   RelayBatch& batch = threadBatch(mBatchSize);
+   for(unsigned int round = 0; round < MaxBatchesPerWakeup; round++)
+   {
+      // Errors (ie. ICMP unreachable) are consumed by the failed call - just wait again
+      int count = recvmmsg(mSocket.native(), &batch.mRecvMsgs[0], mBatchSize, MSG_DONTWAIT, 0);
+      if(count <= 0)
+      {
+         break;
+      }
+      relayBatch((unsigned int)count);
+      if(mStopping || (unsigned int)count < mBatchSize)
+      {
+         break;
+      }
+   }
+   if(!mStopping)
+   {
+      doBatchReceive();
+   }
+}
+
+void
+UdpRelayServer::relayBatch(unsigned int count)
+{
+   RelayBatch& batch = threadBatch(mBatchSize);
+   AsyncSocketBase* turnSocket = mTurnAllocation.getLocalTurnSocket();
+   const StunTuple& clientTuple = mTurnAllocation.getKey().getClientRemoteTuple();
+   asio::ip::udp::endpoint client(clientTuple.getAddress(), clientTuple.getPort());
+   unsigned int framed = 0;
+
+   for(unsigned int i = 0; i <= count; i++)
+   {
+      bool flush = i == count;
+      StunTuple peer;
+      if(!flush)
+      {
+         boost::shared_ptr<DataBuffer>& data = batch.mBuffers[i];
+         data->truncate(batch.mRecvMsgs[i].msg_len);
+         asio::ip::udp::endpoint sender;
+         memcpy(sender.data(), &batch.mAddresses[i], batch.mRecvMsgs[i].msg_hdr.msg_namelen);
+         peer = StunTuple(StunTuple::UDP, sender.address(), sender.port());
+
+         if(data->size() > 0 && mTurnAllocation.frameDataForClient(peer, *data))
+         {
+            batch.mSendIovs[framed].iov_base = data->mutableData();
+            batch.mSendIovs[framed].iov_len = data->size();
+            batch.mSendMsgs[framed].msg_hdr.msg_name = client.data();
+            batch.mSendMsgs[framed].msg_hdr.msg_namelen = (socklen_t)client.size();
+            batch.mSendIndex[framed] = i;
+            framed++;
+            continue;
+         }
+         flush = true;  // so the fast path does not overtake this one
+      }
+
+      if(flush && framed > 0)
+      {
+         int sent = sendmmsg((int)turnSocket->getSocketDescriptor(), &batch.mSendMsgs[0], framed, MSG_DONTWAIT);
+         for(unsigned int j = sent > 0 ? (unsigned int)sent : 0; j < framed; j++)
+         {
+            // Socket buffer full or an error - hand the rest to the socket's send queue
+            turnSocket->doSend(clientTuple, batch.mBuffers[batch.mSendIndex[j]]);
+         }
+         framed = 0;
+      }
+
+      if(i < count && batch.mBuffers[i]->size() > 0)
+      {
+         DebugLog(<< "Read " << (int)batch.mBuffers[i]->size() << " bytes from udp relay socket (" << peer << ")");
+         mTurnAllocation.sendDataToClient(peer, batch.mBuffers[i]);
+      }
+   }
+
+   for(unsigned int i = 0; i < count; i++)
+   {
+      batch.prepare(i);
    }
 }
+#endif
 
 void
 UdpRelayServer::onSendSuccess()
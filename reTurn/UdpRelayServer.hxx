@@ -10,6 +10,11 @@
 #include "RequestHandler.hxx"
 #include "AsyncUdpSocketBase.hxx"
 
+// Relay ports can move datagrams in batches with recvmmsg/sendmmsg
+#if defined(__linux__)
+#define RETURN_RELAY_MMSG
+#endif
+
 namespace reTurn {
 
 class StunTuple;
@@ -20,7 +25,9 @@ class UdpRelayServer
 {
 public:
    /// Create the server to listen on the specified UDP address and port
-   explicit UdpRelayServer(asio::io_service& ioService, TurnAllocation& turnAllocation);
+   /// batchSize > 0 reads that many datagrams per system call where
+   /// RETURN_RELAY_MMSG is available (see UdpRelayBatchSize in reTurnServer.config)
+   explicit UdpRelayServer(asio::io_service& ioService, TurnAllocation& turnAllocation, unsigned int batchSize = 0);
    ~UdpRelayServer();
 
    /// Starts processing
@@ -38,7 +45,16 @@ private:
    virtual void onSendSuccess();
    virtual void onSendFailure(const asio::error_code& e);
 
+   /// Starts the next receive - batched or not
+   void receiveNext();
+#ifdef RETURN_RELAY_MMSG
+   void doBatchReceive();
+   void handleBatchReadable(const asio::error_code& e);
+   void relayBatch(unsigned int count);
+#endif
+
    TurnAllocation& mTurnAllocation;
+   unsigned int mBatchSize;
    bool mStopping;
    bool mBindSuccess;
    asio::error_code mLastSendErrorCode;  // Use to ensure we only log at Warning level once for a particular send error
@@ -16,7 +16,7 @@
 #include <vector>
 
 #include <rutil/Data.hxx>
-#include <rutil/Mutex.hxx>
+#include <rutil/RecursiveMutex.hxx>
 
 #include "reTurn/StunTuple.hxx"
 #include "reTurn/StunMessage.hxx"
@@ -130,7 +130,7 @@ protected:
    bool mConnected;
 
 private:
-   resip::Mutex mMutex;
+   resip::RecursiveMutex mMutex;  // destroyAllocation() and receive() may refresh with it held
    asio::error_code channelBind(RemotePeer& remotePeer);
    asio::error_code checkIfAllocationRefreshRequired();
    asio::error_code checkIfChannelBindingRefreshRequired();
@@ -0,0 +1,252 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#ifdef WIN32
+#pragma warning(disable : 4267)
+#endif
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <asio.hpp>
+#include <rutil/ThreadIf.hxx>
+
+#include "../../StunTuple.hxx"
+#include "../../StunMessage.hxx"
+#include "../TurnUdpSocket.hxx"
+#include <rutil/Timer.hxx>
+#include <rutil/Logger.hxx>
+#include <rutil/WinLeakCheck.hxx>
+
+using namespace reTurn;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM resip::Subsystem::TEST
+
+// Measures how many packets a reTurnServer relays per second.  Each client
+// thread owns a pair of UDP allocations pointed at each other's relay
+// address, and sends bursts from one to the other through the server
+// (client -> relay A -> relay B -> client).  The run is repeated with
+// 1, 2, 4, 8 and 16 client threads.
+//
+// To see how the server scales, run it once per server thread count, ie:
+//    reTurnServer --NumThreads=N --TurnAddress=<address> ...
+// for N in 1 2 4 8 16, on a host with at least N cores to spare for the
+// server besides those used by this program.
+
+static unsigned int SECONDS_PER_RUN = 5;
+static unsigned int PAYLOAD_SIZE = 172;   // G.711 RTP at 20ms
+static const unsigned int BURST = 32;
+static const unsigned int MAX_CLIENT_THREADS = 16;
+
+resip::Data turnAddress;
+unsigned int turnPort = 0;
+resip::Data localAddress;
+
+class RelayPair : public resip::ThreadIf
+{
+public:
+   RelayPair()
+      : mSender(asio::ip::address::from_string(localAddress.c_str()), 0),
+        mReceiver(asio::ip::address::from_string(localAddress.c_str()), 0),
+        mSent(0),
+        mReceived(0),
+        mReady(false)
+   {
+   }
+
+   bool setup()
+   {
+      TurnUdpSocket* sockets[2] = { &mSender, &mReceiver };
+      for(int i = 0; i < 2; i++)
+      {
+         asio::error_code rc = sockets[i]->connect(turnAddress.c_str(), turnPort);
+         if(!rc)
+         {
+            sockets[i]->setUsernameAndPassword("test", "1234");
+            rc = sockets[i]->createAllocation(60, TurnSocket::UnspecifiedBandwidth, StunMessage::PropsNone, TurnSocket::UnspecifiedToken, StunTuple::UDP);
+         }
+         if(rc)
+         {
+            ErrLog(<< "Unable to create allocation: " << rc.message());
+            return false;
+         }
+      }
+      // each side permits and binds a channel to the other's relay
+      if(mSender.setActiveDestination(mReceiver.getRelayTuple().getAddress(), mReceiver.getRelayTuple().getPort()) ||
+         mReceiver.setActiveDestination(mSender.getRelayTuple().getAddress(), mSender.getRelayTuple().getPort()))
+      {
+         ErrLog(<< "Unable to set active destinations");
+         return false;
+      }
+      mReady = true;
+      return true;
+   }
+
+   void teardown()
+   {
+      if(mReady)
+      {
+         mSender.destroyAllocation();
+         mReceiver.destroyAllocation();
+      }
+   }
+
+   virtual void thread()
+   {
+      vector<char> payload(PAYLOAD_SIZE, 'x');
+      char buffer[2048];
+      while(!isShutdown())
+      {
+         for(unsigned int i = 0; i < BURST; i++)
+         {
+            mSender.send(&payload[0], (unsigned int)payload.size());
+         }
+         mSent += BURST;
+         for(unsigned int i = 0; i < BURST; i++)
+         {
+            unsigned int size = sizeof(buffer);
+            if(mReceiver.receive(buffer, size, 100))
+            {
+               break;  // lost packets - send the next burst
+            }
+            mReceived++;
+         }
+      }
+   }
+
+   UInt64 sent() const { return mSent; }
+   UInt64 received() const { return mReceived; }
+
+private:
+   TurnUdpSocket mSender;
+   TurnUdpSocket mReceiver;
+   UInt64 mSent;
+   UInt64 mReceived;
+   bool mReady;
+};
+
+int main(int argc, char* argv[])
+{
+#if defined(WIN32) && defined(_DEBUG) && defined(LEAK_CHECK) 
+   resip::FindMemoryLeaks fml;
+#endif
+   resip::Log::initialize("cout", "WARNING", "TestRelayThroughput");
+
+   if(argc < 4)
+   {
+      std::cerr << "Usage: TestRelayThroughput <host> <port> <localAddress> [<seconds per run>] [<payload size>]\n";
+      return 1;
+   }
+   turnAddress = argv[1];
+   turnPort = resip::Data(argv[2]).convertUnsignedLong();
+   localAddress = argv[3];
+   if(argc > 4)
+   {
+      SECONDS_PER_RUN = resip::Data(argv[4]).convertUnsignedLong();
+   }
+   if(argc > 5)
+   {
+      PAYLOAD_SIZE = resip::Data(argv[5]).convertUnsignedLong();
+   }
+
+   try
+   {
+      for(unsigned int numThreads = 1; numThreads <= MAX_CLIENT_THREADS; numThreads *= 2)
+      {
+         vector<RelayPair*> pairs;
+         bool ok = true;
+         for(unsigned int i = 0; i < numThreads && ok; i++)
+         {
+            pairs.push_back(new RelayPair);
+            ok = pairs.back()->setup();
+         }
+
+         if(ok)
+         {
+            UInt64 start = resip::Timer::getTimeMs();
+            for(unsigned int i = 0; i < numThreads; i++)
+            {
+               pairs[i]->run();
+            }
+#ifdef WIN32
+            Sleep(SECONDS_PER_RUN*1000);
+#else
+            sleep(SECONDS_PER_RUN);
+#endif
+            for(unsigned int i = 0; i < numThreads; i++)
+            {
+               pairs[i]->shutdown();
+            }
+            for(unsigned int i = 0; i < numThreads; i++)
+            {
+               pairs[i]->join();
+            }
+            UInt64 elapsed = resip::Timer::getTimeMs() - start;
+
+            UInt64 sent = 0;
+            UInt64 received = 0;
+            for(unsigned int i = 0; i < numThreads; i++)
+            {
+               sent += pairs[i]->sent();
+               received += pairs[i]->received();
+            }
+            std::cout << numThreads << " client thread(s): " << received*1000/elapsed << " packets/s relayed, "
+                      << received*1000/elapsed*PAYLOAD_SIZE*8/1000000 << " Mbit/s payload, "
+                      << (sent ? (sent - received)*100/sent : 0) << "% lost" << std::endl;
+         }
+
+         for(unsigned int i = 0; i < pairs.size(); i++)
+         {
+            pairs[i]->teardown();
+            delete pairs[i];
+         }
+         if(!ok)
+         {
+            return 1;
+         }
+      }
+   }
+   catch (std::exception& e)
+   {
+      std::cerr << "Exception: " << e.what() << "\n";
+      return 1;
+   }
+
+   return 0;
+}
+
+/* ====================================================================
+
+ Copyright (c) 2007-2008, Plantronics, Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are 
+ met:
+
+ 1. Redistributions of source code must retain the above copyright 
+    notice, this list of conditions and the following disclaimer. 
+
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution. 
+
+ 3. Neither the name of Plantronics nor the names of its contributors 
+    may be used to endorse or promote products derived from this 
+    software without specific prior written permission. 
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==================================================================== */
@@ -4,7 +4,13 @@
 
 #include <iostream>
 #include <csignal>
+#include <cstring>
 #include <string>
+#include <vector>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
 #include <asio.hpp>
 #ifdef USE_SSL
 #include <asio/ssl.hpp>
@@ -12,6 +18,7 @@
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <rutil/Data.hxx>
 #include "reTurnServer.hxx"
 #include "TcpServer.hxx"
@@ -47,6 +54,50 @@ BOOL WINAPI console_ctrl_handler(DWORD ctrl_type)
 }
 #endif // defined(_WIN32)
 
+typedef std::vector<boost::shared_ptr<asio::io_service> > IOServiceList;
+
+static unsigned int
+numCpus()
+{
+#if defined(_WIN32)
+   SYSTEM_INFO systemInfo;
+   GetSystemInfo(&systemInfo);
+   return systemInfo.dwNumberOfProcessors;
+#else
+   long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+   return cpus > 0 ? (unsigned int)cpus : 1;
+#endif
+}
+
+// Thread body for one ioService, pinned to cpu if it is not negative
+static void
+runIOService(asio::io_service* ioService, int cpu)
+{
+#ifdef __linux__
+   if(cpu >= 0)
+   {
+      cpu_set_t cpuSet;
+      CPU_ZERO(&cpuSet);
+      CPU_SET(cpu, &cpuSet);
+      int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+      if(rc != 0)
+      {
+         WarningLog(<< "Unable to pin thread to CPU " << cpu << ": " << strerror(rc));
+      }
+   }
+#endif
+   ioService->run();
+}
+
+static void
+stopIOServices(IOServiceList* ioServices)
+{
+   for(IOServiceList::iterator it = ioServices->begin(); it != ioServices->end(); it++)
+   {
+      (*it)->stop();
+   }
+}
+
 int main(int argc, char* argv[])
 {
    reTurn::ReTurnServerProcess proc;
@@ -102,82 +153,102 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
       resip::Log::initialize(reTurnConfig.mLoggingType, reTurnConfig.mLoggingLevel, "reTurnServer", reTurnConfig.mLoggingFilename.c_str(), 0, reTurnConfig.mSyslogFacility);
       resip::GenericLogImpl::MaxLineCount = reTurnConfig.mLoggingFileMaxLineCount;
 
-      // Initialize server.
-      asio::io_service ioService;                                // The one and only ioService for the stunServer
-      reTurn::TurnManager turnManager(ioService, reTurnConfig);  // The one and only Turn Manager
-
-      boost::shared_ptr<reTurn::UdpServer> udpTurnServer;  // also a1p1StunUdpServer
-      boost::shared_ptr<reTurn::TcpServer> tcpTurnServer;
-#ifdef USE_SSL
-      boost::shared_ptr<reTurn::TlsServer> tlsTurnServer;
+      unsigned int numThreads = reTurnConfig.mNumThreads != 0 ? reTurnConfig.mNumThreads : numCpus();
+#ifndef RETURN_SHARED_LISTENERS
+      if(numThreads > 1)
+      {
+         WarningLog(<< "NumThreads = " << numThreads << " needs SO_REUSEPORT load balancing, which is not available on this platform, using 1 thread");
+         numThreads = 1;
+      }
 #endif
-      boost::shared_ptr<reTurn::UdpServer> a1p2StunUdpServer;
-      boost::shared_ptr<reTurn::UdpServer> a2p1StunUdpServer;
-      boost::shared_ptr<reTurn::UdpServer> a2p2StunUdpServer;
+      const bool reusePort = numThreads > 1;
+      InfoLog(<< "Running STUN/TURN transports on " << numThreads << " thread(s)");
 
-#ifdef USE_IPV6
-      boost::shared_ptr<reTurn::UdpServer> udpV6TurnServer;
-      boost::shared_ptr<reTurn::TcpServer> tcpV6TurnServer;
-      boost::shared_ptr<reTurn::TlsServer> tlsV6TurnServer;
-#endif
+      // Initialize server.
+      // Each thread runs its own ioService with its own set of listening sockets,
+      // all bound to the same addresses and ports.  An allocation is kept by the
+      // TurnAllocationManager of the socket it was requested on, and its relay
+      // socket and timers use that socket's ioService, so an allocation never
+      // leaves the thread it was created on.  Only the port allocator in the
+      // TurnManager is shared between threads.
+      // The one and only Turn Manager - declared ahead of the ioServices, since
+      // allocations still referenced by their pending handlers return their
+      // ports to it when the ioServices are destroyed
+      boost::scoped_ptr<reTurn::TurnManager> turnManager;
+      IOServiceList ioServices;
+      for(unsigned int i = 0; i < numThreads; i++)
+      {
+         ioServices.push_back(boost::shared_ptr<asio::io_service>(new asio::io_service));
+      }
+      turnManager.reset(new reTurn::TurnManager(*ioServices[0], reTurnConfig));
 
       // The one and only RequestHandler - if altStunPort is non-zero, then assume RFC3489 support is enabled and pass settings to request handler
-      reTurn::RequestHandler requestHandler(turnManager, 
+      reTurn::RequestHandler requestHandler(*turnManager, 
          reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnAddress : 0, 
          reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnPort : 0, 
          reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunAddress : 0, 
          reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunPort : 0); 
 
-      udpTurnServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort));
-      tcpTurnServer.reset(new reTurn::TcpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort));
+      std::vector<boost::shared_ptr<reTurn::UdpServer> > udpServers;
+      std::vector<boost::shared_ptr<reTurn::TcpServer> > tcpServers;
 #ifdef USE_SSL
-      if(reTurnConfig.mTlsTurnPort != 0)
+      std::vector<boost::shared_ptr<reTurn::TlsServer> > tlsServers;
+#endif
+
+      for(unsigned int i = 0; i < numThreads; i++)
       {
-         tlsTurnServer.reset(new reTurn::TlsServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTlsTurnPort));
-      }
+         asio::io_service& ioService = *ioServices[i];
+
+         boost::shared_ptr<reTurn::UdpServer> udpTurnServer(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort, reusePort));  // also a1p1StunUdpServer
+         udpServers.push_back(udpTurnServer);
+         tcpServers.push_back(boost::shared_ptr<reTurn::TcpServer>(new reTurn::TcpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort, reusePort)));
+#ifdef USE_SSL
+         if(reTurnConfig.mTlsTurnPort != 0)
+         {
+            tlsServers.push_back(boost::shared_ptr<reTurn::TlsServer>(new reTurn::TlsServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTlsTurnPort, reusePort)));
+         }
 #endif
 
 #ifdef USE_IPV6
-      udpV6TurnServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort));
-      tcpV6TurnServer.reset(new reTurn::TcpServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort));
-      if(reTurnConfig.mTlsTurnPort != 0)
-      {
-         tlsV6TurnServer.reset(new reTurn::TlsServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTlsTurnPort));
-      }
+         udpServers.push_back(boost::shared_ptr<reTurn::UdpServer>(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort, reusePort)));
+         tcpServers.push_back(boost::shared_ptr<reTurn::TcpServer>(new reTurn::TcpServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort, reusePort)));
+#ifdef USE_SSL
+         if(reTurnConfig.mTlsTurnPort != 0)
+         {
+            tlsServers.push_back(boost::shared_ptr<reTurn::TlsServer>(new reTurn::TlsServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTlsTurnPort, reusePort)));
+         }
+#endif
 #endif
 
-      if(reTurnConfig.mAltStunPort != 0) // if alt stun port is non-zero, then RFC3489 support is enabled
-      {
-         a1p2StunUdpServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mAltStunPort));
-         a2p1StunUdpServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mTurnPort));
-         a2p2StunUdpServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mAltStunPort));
-         udpTurnServer->setAlternateUdpServers(a1p2StunUdpServer.get(), a2p1StunUdpServer.get(), a2p2StunUdpServer.get());
-         a1p2StunUdpServer->setAlternateUdpServers(udpTurnServer.get(), a2p2StunUdpServer.get(), a2p1StunUdpServer.get());
-         a2p1StunUdpServer->setAlternateUdpServers(a2p2StunUdpServer.get(), udpTurnServer.get(), a1p2StunUdpServer.get());
-         a2p2StunUdpServer->setAlternateUdpServers(a2p1StunUdpServer.get(), a1p2StunUdpServer.get(), udpTurnServer.get());
-         a1p2StunUdpServer->start();
-         a2p1StunUdpServer->start();
-         a2p2StunUdpServer->start();
+         if(reTurnConfig.mAltStunPort != 0) // if alt stun port is non-zero, then RFC3489 support is enabled
+         {
+            // the alternates answer for each other, so keep each set on one thread
+            boost::shared_ptr<reTurn::UdpServer> a1p2StunUdpServer(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mAltStunPort, reusePort));
+            boost::shared_ptr<reTurn::UdpServer> a2p1StunUdpServer(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mTurnPort, reusePort));
+            boost::shared_ptr<reTurn::UdpServer> a2p2StunUdpServer(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mAltStunPort, reusePort));
+            udpTurnServer->setAlternateUdpServers(a1p2StunUdpServer.get(), a2p1StunUdpServer.get(), a2p2StunUdpServer.get());
+            a1p2StunUdpServer->setAlternateUdpServers(udpTurnServer.get(), a2p2StunUdpServer.get(), a2p1StunUdpServer.get());
+            a2p1StunUdpServer->setAlternateUdpServers(a2p2StunUdpServer.get(), udpTurnServer.get(), a1p2StunUdpServer.get());
+            a2p2StunUdpServer->setAlternateUdpServers(a2p1StunUdpServer.get(), a1p2StunUdpServer.get(), udpTurnServer.get());
+            udpServers.push_back(a1p2StunUdpServer);
+            udpServers.push_back(a2p1StunUdpServer);
+            udpServers.push_back(a2p2StunUdpServer);
+         }
       }
 
-      udpTurnServer->start();
-      tcpTurnServer->start();
-#ifdef USE_SSL
-      if(tlsTurnServer)
+      for(std::vector<boost::shared_ptr<reTurn::UdpServer> >::iterator it = udpServers.begin(); it != udpServers.end(); it++)
       {
-         tlsTurnServer->start();
+         (*it)->start();
+      }
+      for(std::vector<boost::shared_ptr<reTurn::TcpServer> >::iterator it = tcpServers.begin(); it != tcpServers.end(); it++)
+      {
+         (*it)->start();
       }
-#endif
-
-#ifdef USE_IPV6
-      udpV6TurnServer->start();
-      tcpV6TurnServer->start();
 #ifdef USE_SSL
-      if(tlsV6TurnServer)
+      for(std::vector<boost::shared_ptr<reTurn::TlsServer> >::iterator it = tlsServers.begin(); it != tlsServers.end(); it++)
       {
-         tlsV6TurnServer->start();
+         (*it)->start();
       }
-#endif
 #endif
 
       // Drop privileges (can do this now that sockets are bound)
@@ -187,25 +258,30 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
          dropPrivileges(reTurnConfig.mRunAsUser, reTurnConfig.mRunAsGroup);
       }
 
-      ReTurnUserFileScanner userFileScanner(ioService, reTurnConfig);
+      ReTurnUserFileScanner userFileScanner(*ioServices[0], reTurnConfig);
       userFileScanner.start();
 
 #ifdef _WIN32
       // Set console control handler to allow server to be stopped.
-      console_ctrl_function = boost::bind(&asio::io_service::stop, &ioService);
+      console_ctrl_function = boost::bind(&stopIOServices, &ioServices);
       SetConsoleCtrlHandler(console_ctrl_handler, TRUE);
 #else
-      // Block all signals for background thread.
+      // Block all signals for background threads.
       sigset_t new_mask;
       sigfillset(&new_mask);
       sigset_t old_mask;
       pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
 #endif
 
-      // Run the ioService until stopped.
-      // Create a pool of threads to run all of the io_services.
-      boost::shared_ptr<asio::thread> thread(new asio::thread(
-         boost::bind(&asio::io_service::run, &ioService)));
+      // Run each ioService on its own thread until stopped.
+      const unsigned int cpus = numCpus();
+      std::vector<boost::shared_ptr<asio::thread> > threads;
+      for(unsigned int i = 0; i < numThreads; i++)
+      {
+         const int cpu = (numThreads > 1 && reTurnConfig.mPinThreads) ? (int)(i % cpus) : -1;
+         threads.push_back(boost::shared_ptr<asio::thread>(new asio::thread(
+            boost::bind(&runIOService, ioServices[i].get(), cpu))));
+      }
 
 #ifndef _WIN32
       // Restore previous signals.
@@ -220,11 +296,14 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
       pthread_sigmask(SIG_BLOCK, &wait_mask, 0);
       int sig = 0;
       sigwait(&wait_mask, &sig);
-      ioService.stop();
+      stopIOServices(&ioServices);
 #endif
 
-      // Wait for thread to exit
-      thread->join();
+      // Wait for threads to exit
+      for(std::vector<boost::shared_ptr<asio::thread> >::iterator it = threads.begin(); it != threads.end(); it++)
+      {
+         (*it)->join();
+      }
    }
    catch (std::exception& e)
    {
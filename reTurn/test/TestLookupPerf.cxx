@@ -0,0 +1,165 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <asio.hpp>
+
+#include "../StunTuple.hxx"
+#include "../TurnAllocationKey.hxx"
+#include "../ChannelManager.hxx"
+#include <rutil/HashMap.hxx>
+#include <rutil/Random.hxx>
+#include <rutil/Timer.hxx>
+#include <rutil/Logger.hxx>
+
+using namespace reTurn;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM resip::Subsystem::TEST
+
+// Times the lookups made for every relayed packet: the allocation by
+// (client local, client remote) tuple, then the channel binding by channel
+// number or by peer tuple.  Allocation lookups are run against the
+// HashMap used by TurnAllocationManager and against the std::map it
+// replaced, at 100k allocations by default (override with argv[1]).
+
+static const unsigned int LOOKUPS = 2000000;
+static const unsigned int CHANNELS = 16;
+
+static StunTuple
+randomTuple(unsigned short port = 0)
+{
+   asio::ip::address_v4 address((unsigned long)(unsigned int)resip::Random::getRandom());
+   return StunTuple(StunTuple::UDP, address, port ? port : (unsigned short)(1024 + (unsigned int)resip::Random::getRandom() % 60000));
+}
+
+template <class Map>
+static void
+timeAllocationLookups(const char* name, Map& map, const vector<TurnAllocationKey>& keys)
+{
+   UInt64 start = resip::Timer::getTimeMs();
+   for(unsigned int i = 0; i < keys.size(); i++)
+   {
+      map[keys[i]] = i;
+   }
+   UInt64 inserted = resip::Timer::getTimeMs();
+
+   unsigned int found = 0;
+   for(unsigned int i = 0; i < LOOKUPS; i++)
+   {
+      const TurnAllocationKey& key = keys[(i * 7919) % keys.size()];
+      typename Map::const_iterator it = map.find(key);
+      if(it != map.end() && it->first == key)
+      {
+         found++;
+      }
+   }
+   UInt64 done = resip::Timer::getTimeMs();
+   assert(found == LOOKUPS);
+
+   cout << name << ": " << keys.size() << " allocations inserted in " << (inserted - start) << " ms, "
+        << LOOKUPS << " lookups in " << (done - inserted) << " ms ("
+        << (double)(done - inserted) * 1000000.0 / LOOKUPS << " ns each)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+   resip::Log::initialize(resip::Log::Cout, resip::Log::Warning, "");
+
+   unsigned int allocations = 100000;
+   if(argc > 1)
+   {
+      allocations = atoi(argv[1]);
+   }
+
+   // Every allocation on a UDP listener shares the client local tuple
+   StunTuple local(StunTuple::UDP, asio::ip::address::from_string("10.0.0.1"), 3478);
+   vector<TurnAllocationKey> keys;
+   HashMap<TurnAllocationKey, unsigned int> unique;
+   while(keys.size() < allocations)
+   {
+      TurnAllocationKey key(local, randomTuple());
+      if(unique.insert(make_pair(key, 0)).second)
+      {
+         keys.push_back(key);
+      }
+   }
+
+   {
+      std::map<TurnAllocationKey, unsigned int> map;
+      timeAllocationLookups("std::map", map, keys);
+   }
+   {
+      HashMap<TurnAllocationKey, unsigned int> map;
+      timeAllocationLookups("HashMap ", map, keys);
+   }
+
+   // Channel bindings of a single allocation
+   ChannelManager channelManager;
+   vector<StunTuple> peers;
+   vector<unsigned short> channels;
+   for(unsigned int i = 0; i < CHANNELS; i++)
+   {
+      peers.push_back(randomTuple());
+      RemotePeer* remotePeer = channelManager.createChannelBinding(peers.back());
+      channels.push_back(remotePeer->getChannel());
+   }
+
+   UInt64 start = resip::Timer::getTimeMs();
+   for(unsigned int i = 0; i < LOOKUPS; i++)
+   {
+      RemotePeer* remotePeer = channelManager.findRemotePeerByChannel(channels[i % CHANNELS]);
+      assert(remotePeer && remotePeer->getPeerTuple() == peers[i % CHANNELS]);
+   }
+   UInt64 byChannel = resip::Timer::getTimeMs();
+   for(unsigned int i = 0; i < LOOKUPS; i++)
+   {
+      RemotePeer* remotePeer = channelManager.findRemotePeerByPeerAddress(peers[i % CHANNELS]);
+      assert(remotePeer && remotePeer->getChannel() == channels[i % CHANNELS]);
+   }
+   UInt64 byPeer = resip::Timer::getTimeMs();
+   assert(channelManager.findRemotePeerByPeerAddress(randomTuple()) == 0);
+
+   cout << "ChannelManager: " << LOOKUPS << " lookups by channel in " << (byChannel - start) << " ms, by peer in " << (byPeer - byChannel) << " ms" << endl;
+
+   return 0;
+}
+
+
+/* ====================================================================
+
+ Copyright (c) 2007-2008, Plantronics, Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are
+ met:
+
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+ 3. Neither the name of Plantronics nor the names of its contributors
+    may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==================================================================== */
@@ -17,6 +17,8 @@
 #include "repro/XmlRpcServerBase.hxx"
 #include "repro/XmlRpcConnection.hxx"
 #include "repro/ReproRunner.hxx"
+#include "repro/UserStore.hxx"
+#include "repro/Dispatcher.hxx"
 #include "repro/CommandServer.hxx"
 
 using namespace repro;
@@ -105,6 +107,18 @@ CommandServer::handleRequest(unsigned int connectionId, unsigned int requestId,
       {
          handleSetCongestionToleranceRequest(connectionId, requestId, xml);
       }
+      else if(isEqualNoCase(xml.getTag(), "GetUserAuthCacheStats"))
+      {
+         handleGetUserAuthCacheStatsRequest(connectionId, requestId, xml);
+      }
+      else if(isEqualNoCase(xml.getTag(), "ClearUserAuthCache"))
+      {
+         handleClearUserAuthCacheRequest(connectionId, requestId, xml);
+      }
+      else if(isEqualNoCase(xml.getTag(), "GetDispatcherStats"))
+      {
+         handleGetDispatcherStatsRequest(connectionId, requestId, xml);
+      }
       else if(isEqualNoCase(xml.getTag(), "Shutdown"))
       {
          handleShutdownRequest(connectionId, requestId, xml);
@@ -254,6 +268,61 @@ CommandServer::handleGetCongestionStatsRequest(unsigned int connectionId, unsign
    }
 }
 
+void 
+CommandServer::handleGetUserAuthCacheStatsRequest(unsigned int connectionId, unsigned int requestId, XMLCursor& xml)
+{
+   InfoLog(<< "CommandServer::handleGetUserAuthCacheStatsRequest");
+
+   Data buffer;
+   {
+      DataStream strm(buffer);
+      mReproRunner.getProxy()->getUserStore().encodeAuthCacheStats(strm);
+   }
+   sendResponse(connectionId, requestId, buffer, 200, "User auth cache stats retrieved.");
+}
+
+void 
+CommandServer::handleClearUserAuthCacheRequest(unsigned int connectionId, unsigned int requestId, XMLCursor& xml)
+{
+   InfoLog(<< "CommandServer::handleClearUserAuthCacheRequest");
+
+   mReproRunner.getProxy()->getUserStore().clearAuthCache();
+   sendResponse(connectionId, requestId, Data::Empty, 200, "User auth cache cleared.");
+}
+
+static void
+encodeDispatcherStats(EncodeStream& strm, const char* name, const Dispatcher* dispatcher)
+{
+   if(dispatcher)
+   {
+      strm << name << ": workers=" << dispatcher->workPoolSize()
+           << " mode=" << (dispatcher->queueMode() == Dispatcher::WorkStealing ? "WorkStealing" : "SharedQueue")
+           << " depth=" << dispatcher->fifoCountDepth() 
+           << " timeDepth=" << dispatcher->fifoTimeDepth() << "s" << endl;
+      strm << name << ": queueLatency ";
+      dispatcher->encodeQueueLatencyHistogram(strm);
+      strm << endl;
+   }
+}
+
+void 
+CommandServer::handleGetDispatcherStatsRequest(unsigned int connectionId, unsigned int requestId, XMLCursor& xml)
+{
+   InfoLog(<< "CommandServer::handleGetDispatcherStatsRequest");
+
+   Data buffer;
+   {
+      DataStream strm(buffer);
+      AuthenticatorFactory* authFactory = mReproRunner.getAuthenticatorFactory();
+      if(authFactory)
+      {
+         encodeDispatcherStats(strm, "AuthGrabber", authFactory->getDispatcher());
+      }
+      encodeDispatcherStats(strm, "AsyncProcessor", mReproRunner.getAsyncProcessorDispatcher());
+   }
+   sendResponse(connectionId, requestId, buffer, 200, "Dispatcher stats retrieved.");
+}
+
 void 
 CommandServer::handleSetCongestionToleranceRequest(unsigned int connectionId, unsigned int requestId, XMLCursor& xml)
 {
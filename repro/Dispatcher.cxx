@@ -1,26 +1,66 @@
 #include "repro/Dispatcher.hxx"
 #include "resip/stack/Message.hxx"
 #include "resip/stack/SipStack.hxx"
+#include "rutil/Timer.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 
 namespace repro
 {
 
+const unsigned int Dispatcher::QueueLatencyBucketLimitsMs[Dispatcher::QueueLatencyBuckets - 1] = 
+   { 1, 2, 5, 10, 20, 50, 100, 200, 500 };
+
+unsigned int Dispatcher::AffinityStealDelayMs = 20;
+
+Dispatcher::WorkQueue::WorkQueue()
+{
+   for(unsigned int i = 0; i < QueueLatencyBuckets; i++)
+   {
+      mLatency[i] = 0;
+   }
+}
+
+resip::ApplicationMessage*
+Dispatcher::WorkQueue::take(std::deque<QueuedWork>::iterator it, UInt64 now)
+{
+   resip::ApplicationMessage* msg = it->msg;
+   UInt64 latency = now > it->posted ? now - it->posted : 0;
+   unsigned int bucket = 0;
+   while(bucket < QueueLatencyBuckets - 1 && latency >= QueueLatencyBucketLimitsMs[bucket])
+   {
+      bucket++;
+   }
+   mLatency[bucket]++;
+   mWork.erase(it);
+   return msg;
+}
+
 Dispatcher::Dispatcher(std::auto_ptr<Worker> prototype,
                         resip::SipStack* stack,
                         int workers, 
-                        bool startImmediately):
+                        bool startImmediately,
+                        QueueMode mode):
    mStack(stack),
    mFifo(0,0),
    mAcceptingWork(false),
    mShutdown(false),
    mStarted(false),
-   mWorkerPrototype(prototype.release())
+   mWorkerPrototype(prototype.release()),
+   mQueueMode(mode),
+   mNextQueue(0)
 {
    for(int i=0; i<workers;i++)
    {
-      mWorkerThreads.push_back(new WorkerThread(mWorkerPrototype->clone(),mFifo,mStack));
+      if(mQueueMode == WorkStealing)
+      {
+         mWorkQueues.push_back(new WorkQueue);
+         mWorkerThreads.push_back(new WorkerThread(mWorkerPrototype->clone(),*this,i,mStack));
+      }
+      else
+      {
+         mWorkerThreads.push_back(new WorkerThread(mWorkerPrototype->clone(),mFifo,mStack));
+      }
    }
    
    if(startImmediately)
@@ -45,6 +85,18 @@ Dispatcher::~Dispatcher()
    {
       delete mFifo.getNext();
    }
+
+   std::vector<WorkQueue*>::iterator q;
+   for(q=mWorkQueues.begin(); q!=mWorkQueues.end(); ++q)
+   {
+      std::deque<QueuedWork>::iterator w;
+      for(w=(*q)->mWork.begin(); w!=(*q)->mWork.end(); ++w)
+      {
+         delete w->msg;
+      }
+      delete *q;
+   }
+   mWorkQueues.clear();
    
    delete mWorkerPrototype;
    
@@ -56,6 +108,13 @@ Dispatcher::post(std::auto_ptr<resip::ApplicationMessage>& work)
    resip::ReadLock r(mMutex);
    if(mAcceptingWork)
    {
+      if(mQueueMode == WorkStealing)
+      {
+         // Round robin under the read lock, so concurrent posters need an
+         // atomic increment; the cast keeps the index positive after wrap
+         UInt32 next = (UInt32)resip::atomicAdd(&mNextQueue, 1);
+         return postToQueue(work.release(), next % mWorkQueues.size(), false);
+      }
       mFifo.add(work.release(),
                   resip::TimeLimitFifo<resip::ApplicationMessage>::InternalElement);
       return true;
@@ -68,18 +127,159 @@ Dispatcher::post(std::auto_ptr<resip::ApplicationMessage>& work)
    // auto_ptr)
 }
 
+bool
+Dispatcher::post(std::auto_ptr<resip::ApplicationMessage>& work, const resip::Data& affinityKey)
+{
+   if(mQueueMode != WorkStealing || affinityKey.empty())
+   {
+      return post(work);
+   }
+
+   resip::ReadLock r(mMutex);
+   if(mAcceptingWork)
+   {
+      return postToQueue(work.release(), affinityKey.hash() % mWorkQueues.size(), true);
+   }
+   return false;
+}
+
+bool
+Dispatcher::postToQueue(resip::ApplicationMessage* work, unsigned int index, bool affine)
+{
+   QueuedWork queued;
+   queued.msg = work;
+   queued.posted = resip::Timer::getTimeMs();
+   queued.affine = affine;
+
+   WorkQueue& queue = *mWorkQueues[index];
+   bool busy;
+   {
+      resip::Lock lock(queue.mMutex);
+      busy = !queue.mWork.empty();
+      queue.mWork.push_back(queued);
+      queue.mCondition.signal();
+   }
+   if(busy && mWorkQueues.size() > 1)
+   {
+      // The owner is behind - wake a neighbour in case it is idle and can 
+      // take some of the backlog
+      WorkQueue& neighbour = *mWorkQueues[(index + 1) % mWorkQueues.size()];
+      resip::Lock lock(neighbour.mMutex);
+      neighbour.mCondition.signal();
+   }
+   return true;
+}
+
+resip::ApplicationMessage*
+Dispatcher::getNextWork(unsigned int index, unsigned int ms)
+{
+   WorkQueue& own = *mWorkQueues[index];
+   {
+      resip::Lock lock(own.mMutex);
+      if(!own.mWork.empty())
+      {
+         return own.take(own.mWork.begin(), resip::Timer::getTimeMs());
+      }
+   }
+
+   // Nothing of our own, so take the oldest message from another queue -
+   // unless it was posted with an affinity key and hasn't waited long
+   UInt64 now = resip::Timer::getTimeMs();
+   for(size_t n = 1; n < mWorkQueues.size(); n++)
+   {
+      WorkQueue& victim = *mWorkQueues[(index + n) % mWorkQueues.size()];
+      resip::Lock lock(victim.mMutex);
+      if(!victim.mWork.empty() && 
+         (!victim.mWork.front().affine || victim.mWork.front().posted + AffinityStealDelayMs <= now))
+      {
+         return victim.take(victim.mWork.begin(), now);
+      }
+   }
+
+   resip::Lock lock(own.mMutex);
+   if(own.mWork.empty())
+   {
+      own.mCondition.wait(own.mMutex, ms);
+   }
+   if(!own.mWork.empty())
+   {
+      return own.take(own.mWork.begin(), resip::Timer::getTimeMs());
+   }
+   return 0;
+}
+
 size_t
 Dispatcher::fifoCountDepth() const 
 {
+   if(mQueueMode == WorkStealing)
+   {
+      size_t depth = 0;
+      std::vector<WorkQueue*>::const_iterator q;
+      for(q=mWorkQueues.begin(); q!=mWorkQueues.end(); ++q)
+      {
+         resip::Lock lock((*q)->mMutex);
+         depth += (*q)->mWork.size();
+      }
+      return depth;
+   }
    return mFifo.getCountDepth();
 }
 
 time_t
 Dispatcher::fifoTimeDepth() const 
 {
+   if(mQueueMode == WorkStealing)
+   {
+      UInt64 now = resip::Timer::getTimeMs();
+      UInt64 oldest = now;
+      std::vector<WorkQueue*>::const_iterator q;
+      for(q=mWorkQueues.begin(); q!=mWorkQueues.end(); ++q)
+      {
+         resip::Lock lock((*q)->mMutex);
+         if(!(*q)->mWork.empty() && (*q)->mWork.front().posted < oldest)
+         {
+            oldest = (*q)->mWork.front().posted;
+         }
+      }
+      return (time_t)((now - oldest) / 1000);
+   }
    return mFifo.getTimeDepth();
 }
 
+void
+Dispatcher::getQueueLatencyHistogram(std::vector<UInt64>& counts) const
+{
+   counts.assign(QueueLatencyBuckets, 0);
+   std::vector<WorkQueue*>::const_iterator q;
+   for(q=mWorkQueues.begin(); q!=mWorkQueues.end(); ++q)
+   {
+      resip::Lock lock((*q)->mMutex);
+      for(unsigned int i = 0; i < QueueLatencyBuckets; i++)
+      {
+         counts[i] += (*q)->mLatency[i];
+      }
+   }
+}
+
+EncodeStream&
+Dispatcher::encodeQueueLatencyHistogram(EncodeStream& strm) const
+{
+   std::vector<UInt64> counts;
+   getQueueLatencyHistogram(counts);
+   for(unsigned int i = 0; i < QueueLatencyBuckets; i++)
+   {
+      if(i < QueueLatencyBuckets - 1)
+      {
+         strm << "<" << QueueLatencyBucketLimitsMs[i] << "ms=" << counts[i] << " ";
+      }
+      else
+      {
+         strm << ">=" << QueueLatencyBucketLimitsMs[i-1] << "ms=" << counts[i];
+      }
+   }
+   return strm;
+}
+
 int
 Dispatcher::workPoolSize() const 
 {
@@ -6,7 +6,11 @@
 #include "resip/stack/ApplicationMessage.hxx"
 #include "rutil/TimeLimitFifo.hxx"
 #include "rutil/RWMutex.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/Condition.hxx"
 #include "rutil/Lock.hxx"
+#include "rutil/AtomicOps.hxx"
+#include <deque>
 #include <vector>
 
 namespace resip
@@ -35,12 +39,37 @@ namespace repro
    of this class when constructing the Dispatcher. Dispatcher will clone this
    Worker as many times as needed to fill the thread bank. 
    
+   By default all the Workers take messages from one shared queue.  In
+   WorkStealing mode each Worker has a queue of its own: messages are spread
+   over the queues, and a Worker whose queue is empty takes the oldest message
+   from another Worker's queue, so posting and taking work rarely contend on
+   the same lock and one slow message holds up only its own queue.
+   
    @note The functions in this class are intended to be thread-safe.
 */
 
 class Dispatcher
 {
    public:
+
+      typedef enum
+      {
+         SharedQueue,
+         WorkStealing
+      } QueueMode;
+
+      /**
+         Upper bounds (in ms) of the queue latency histogram buckets; the last
+         bucket counts everything slower.
+      */
+      static const unsigned int QueueLatencyBuckets = 10;
+      static const unsigned int QueueLatencyBucketLimitsMs[QueueLatencyBuckets - 1];
+
+      /**
+         In WorkStealing mode, a message posted with an affinity key is only
+         taken by another Worker once it has waited this long (in ms).
+      */
+      static unsigned int AffinityStealDelayMs;
    
       /**
          @param prototype The prototypical instance of Worker.
@@ -51,11 +80,15 @@ class Dispatcher
          
          @param startImmediately Whether to start this thread bank on 
             construction.
+
+         @param mode Whether the threads share one queue, or each have their
+            own and steal from each other.
       */
       Dispatcher(std::auto_ptr<Worker> prototype, 
                   resip::SipStack* stack,
                   int workers=2, 
-                  bool startImmediately=true);
+                  bool startImmediately=true,
+                  QueueMode mode=SharedQueue);
 
       virtual ~Dispatcher();
       
@@ -72,6 +105,15 @@ class Dispatcher
       */
       virtual bool post(std::auto_ptr<resip::ApplicationMessage>& work);
 
+      /**
+         Posts a message that should preferably be handled by the same thread
+         as every other message with the same key (eg. lookups for the same
+         user, so that they hit the same warmed database connection).  The
+         key is ignored in SharedQueue mode.
+      */
+      virtual bool post(std::auto_ptr<resip::ApplicationMessage>& work, 
+                        const resip::Data& affinityKey);
+
       /**
          @returns The number of messages in this Dispatcher's queue
       */
@@ -87,6 +129,16 @@ class Dispatcher
          @returns The number of workers in this thread bank.
       */
       int workPoolSize() const;
+
+      QueueMode queueMode() const { return mQueueMode; }
+
+      /**
+         Fills counts with the number of messages that waited in the queues 
+         for each of the QueueLatencyBuckets.  Only kept in WorkStealing mode;
+         all zero otherwise.
+      */
+      void getQueueLatencyHistogram(std::vector<UInt64>& counts) const;
+      EncodeStream& encodeQueueLatencyHistogram(EncodeStream& strm) const;
       
       /**
          This Dispatcher will stop accepting new
@@ -115,16 +167,47 @@ class Dispatcher
 
       
    protected:
+      friend class WorkerThread;
+
+      /**
+         WorkStealing mode: returns the next message for the worker that owns
+         queue index, waiting up to ms for one, or 0.
+      */
+      resip::ApplicationMessage* getNextWork(unsigned int index, unsigned int ms);
+      bool postToQueue(resip::ApplicationMessage* work, unsigned int index, bool affine);
+
+      class QueuedWork
+      {
+         public:
+            resip::ApplicationMessage* msg;
+            UInt64 posted;   // ms
+            bool affine;
+      };
+
+      class WorkQueue
+      {
+         public:
+            WorkQueue();
+            resip::ApplicationMessage* take(std::deque<QueuedWork>::iterator it, UInt64 now);
+
+            mutable resip::Mutex mMutex;
+            resip::Condition mCondition;
+            std::deque<QueuedWork> mWork;
+            UInt64 mLatency[QueueLatencyBuckets];  // of the work taken from this queue
+      };
 
       resip::TimeLimitFifo<resip::ApplicationMessage> mFifo;
       bool mAcceptingWork;
       bool mShutdown;
       bool mStarted;
       Worker* mWorkerPrototype;
+      QueueMode mQueueMode;
 
       resip::RWMutex mMutex;
 
       std::vector<WorkerThread*> mWorkerThreads;
+      std::vector<WorkQueue*> mWorkQueues;   // WorkStealing mode only, one per worker
+      volatile Int32 mNextQueue;   // round robin cursor, atomicAdd only
 
    private:
       //No copying!
@@ -24,12 +24,20 @@ using namespace std;
 RegSyncClient::RegSyncClient(InMemorySyncRegDb* regDb,
                              Data address,
                              unsigned short port,
-                             InMemorySyncPubDb* pubDb) :
+                             InMemorySyncPubDb* pubDb,
+                             bool incremental,
+                             bool binaryEncoding) :
    mRegDb(regDb),
    mPubDb(pubDb),
    mAddress(address),
    mPort(port),
-   mSocketDesc(0)
+   mSocketDesc(0),
+   mIncremental(incremental),
+   mBinaryEncoding(binaryEncoding),
+   mSyncEpoch(0),
+   mSyncSequence(0),
+   mPendingSequence(0),
+   mInitialSyncComplete(false)
 {
     resip_assert(mRegDb);
 }
@@ -124,9 +132,19 @@ RegSyncClient::thread()
       Data request(
          "<InitialSync>\r\n"
          "  <Request>\r\n"
-         "     <Version>" + Data(REGSYNC_VERSION) + "</Version>\r\n"   // For use in detecting if client/server are a compatible version
+         "     <Version>" + Data(REGSYNC_VERSION) + "</Version>\r\n");   // For use in detecting if client/server are a compatible version
+      if(mIncremental)
+      {
+         request += "     <Epoch>" + Data(mSyncEpoch) + "</Epoch>\r\n"
+                    "     <Sequence>" + Data(mSyncSequence) + "</Sequence>\r\n"
+                    "     <Encoding>" + Data(mBinaryEncoding ? "binary" : "xml") + "</Encoding>\r\n";
+      }
+      request += 
          "  </Request>\r\n"
-         "</InitialSync>\r\n");   
+         "</InitialSync>\r\n";
+      mRxDataBuffer.clear();  // anything left from the last connection is incomplete
+      mPendingSequence = 0;
+      mInitialSyncComplete = false;
       rc = ::send(mSocketDesc, request.c_str(), (int)request.size(), 0);
       if(rc < 0) 
       {
@@ -177,7 +195,7 @@ RegSyncClient::thread()
          }
          else if(rc == 0) // timeout - send keepalive
          {
-            rc = ::send(mSocketDesc, Symbols::CRLFCRLF, (int)request.size(), 0);
+            rc = ::send(mSocketDesc, Symbols::CRLFCRLF, (int)strlen(Symbols::CRLFCRLF), 0);
             if(rc < 0) 
             {
                int e = getErrno();
@@ -264,7 +282,18 @@ RegSyncClient::handleXml(const Data& xmlData)
       if(isEqualNoCase(xml.getTag(), "InitialSync"))
       {
          // Must be an InitialSync response
-         InfoLog(<< "RegSyncClient::handleXml: InitialSync complete.");
+         handleInitialSyncResponse(xml);
+      }
+      else if(isEqualNoCase(xml.getTag(), "regbatch"))
+      {
+         try
+         {
+            handleRegBatchEvent(xml);
+         }
+         catch(BaseException& e)
+         {
+             ErrLog(<< "RegSyncClient::handleXml: exception: " << e);
+         }
       }
       else if(isEqualNoCase(xml.getTag(), "reginfo"))
       {
@@ -299,13 +328,159 @@ RegSyncClient::handleXml(const Data& xmlData)
    }
 }
 
+void 
+RegSyncClient::handleInitialSyncResponse(resip::XMLCursor& xml)
+{
+   UInt64 epoch = 0;
+   UInt64 sequence = 0;
+   Data resultCode;
+   if(xml.firstChild())
+   {
+      do
+      {
+         if(isEqualNoCase(xml.getTag(), "response") && xml.firstChild())
+         {
+            do
+            {
+               if(isEqualNoCase(xml.getTag(), "result"))
+               {
+                  XMLCursor::AttributeMap::const_iterator it = xml.getAttributes().find("Code");
+                  if(it != xml.getAttributes().end())
+                  {
+                     resultCode = it->second;
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "epoch"))
+               {
+                  if(xml.firstChild())
+                  {
+                     epoch = xml.getValue().convertUInt64();
+                     xml.parent();
+                  }
+               }
+               else if(isEqualNoCase(xml.getTag(), "sequence"))
+               {
+                  if(xml.firstChild())
+                  {
+                     sequence = xml.getValue().convertUInt64();
+                     xml.parent();
+                  }
+               }
+            } while(xml.nextSibling());
+            xml.parent();
+         }
+      } while(xml.nextSibling());
+      xml.parent();
+   }
+
+   if(resultCode != "200")
+   {
+      WarningLog(<< "RegSyncClient::handleInitialSyncResponse: InitialSync failed, code=" << resultCode);
+      return;
+   }
+   if(epoch != 0)
+   {
+      // Everything up to sequence has been sent to us, as have the batches
+      // that arrived while the initial sync was in progress
+      mSyncEpoch = epoch;
+      mSyncSequence = resipMax(sequence, mPendingSequence);
+      mInitialSyncComplete = true;
+      InfoLog(<< "RegSyncClient::handleInitialSyncResponse: InitialSync complete, epoch=" << mSyncEpoch << ", sequence=" << mSyncSequence);
+   }
+   else
+   {
+      // Peer does not support incremental sync
+      mSyncEpoch = 0;
+      mSyncSequence = 0;
+      InfoLog(<< "RegSyncClient::handleInitialSyncResponse: InitialSync complete.");
+   }
+}
+
+void 
+RegSyncClient::handleRegBatchEvent(resip::XMLCursor& xml)
+{
+   UInt64 sequence = 0;
+   unsigned int aors = 0;
+   DebugLog(<< "RegSyncClient::handleRegBatchEvent");
+   if(xml.firstChild())
+   {
+      do
+      {
+         if(isEqualNoCase(xml.getTag(), "sequence"))
+         {
+            if(xml.firstChild())
+            {
+               sequence = xml.getValue().convertUInt64();
+               xml.parent();
+            }
+         }
+         else if(isEqualNoCase(xml.getTag(), "reginfo"))
+         {
+            Uri aor;
+            ContactList contacts;
+            parseRegInfo(xml, aor, contacts);
+            processModify(aor, contacts);
+            aors++;
+         }
+         else if(isEqualNoCase(xml.getTag(), "records"))
+         {
+            if(xml.firstChild())
+            {
+               Data records = xml.getValue().base64decode();
+               Data::size_type pos = 0;
+               while(pos < records.size())
+               {
+                  Uri aor;
+                  ContactList contacts;
+                  if(!RegSyncServer::decodeRegInfoBinary(records, pos, aor, contacts))
+                  {
+                     // Don't take the sequence from a batch we could not read
+                     ErrLog(<< "RegSyncClient::handleRegBatchEvent: truncated record after " << aors << " AORs");
+                     return;
+                  }
+                  processModify(aor, contacts);
+                  aors++;
+               }
+               xml.parent();
+            }
+         }
+      } while(xml.nextSibling());
+      xml.parent();
+   }
+
+   if(sequence != 0)
+   {
+      if(mInitialSyncComplete)
+      {
+         mSyncSequence = resipMax(mSyncSequence, sequence);
+      }
+      else
+      {
+         mPendingSequence = resipMax(mPendingSequence, sequence);
+      }
+   }
+   DebugLog(<< "RegSyncClient::handleRegBatchEvent: " << aors << " AORs, sequence=" << sequence);
+}
+
 void 
 RegSyncClient::handleRegInfoEvent(resip::XMLCursor& xml)
 {
-   UInt64 now = Timer::getTimeSecs();
    Uri aor;
    ContactList contacts;
    DebugLog(<< "RegSyncClient::handleRegInfoEvent");
+   parseRegInfo(xml, aor, contacts);
+   xml.parent();
+
+   if (mRegDb)
+   {
+      processModify(aor, contacts);
+   }
+}
+
+void 
+RegSyncClient::parseRegInfo(resip::XMLCursor& xml, Uri& aor, ContactList& contacts)
+{
+   UInt64 now = Timer::getTimeSecs();
    if(xml.firstChild())
    {
       do
@@ -410,12 +585,6 @@ RegSyncClient::handleRegInfoEvent(resip::XMLCursor& xml)
       } while(xml.nextSibling());
       xml.parent();
    }
-   xml.parent();
-
-   if (mRegDb)
-   {
-      processModify(aor, contacts);
-   }
 }
 
 void 
@@ -13,10 +13,17 @@ namespace repro
 class RegSyncClient : public resip::ThreadIf
 {
 public:
+   // If incremental is set, the peer is asked for only the registrations that
+   // changed since the last sync (when it still has the same database), and
+   // for later changes in batches - binaryEncoding asks for these in the
+   // compact encoding instead of XML.  Peers that do not support incremental
+   // sync ignore the request and send everything as before.
    RegSyncClient(resip::InMemorySyncRegDb* regDb,
                  resip::Data address,
                  unsigned short port,
-                 resip::InMemorySyncPubDb* pubDb = 0);
+                 resip::InMemorySyncPubDb* pubDb = 0,
+                 bool incremental = false,
+                 bool binaryEncoding = false);
 
    virtual void thread();
    virtual void shutdown();
@@ -25,7 +32,10 @@ private:
    void delaySeconds(unsigned int seconds);
    bool tryParse();  // returns true if we processed something and there is more data in the buffer
    void handleXml(const resip::Data& xmlData);
+   void handleInitialSyncResponse(resip::XMLCursor& xml);
    void handleRegInfoEvent(resip::XMLCursor& xml);
+   void handleRegBatchEvent(resip::XMLCursor& xml);
+   void parseRegInfo(resip::XMLCursor& xml, resip::Uri& aor, resip::ContactList& contacts);
    void handlePubInfoEvent(resip::XMLCursor& xml);
    void processModify(const resip::Uri& aor, resip::ContactList& syncContacts);
 
@@ -36,6 +46,13 @@ private:
    char mRxBuffer[8000];
    resip::Data mRxDataBuffer;
    int mSocketDesc;
+
+   bool mIncremental;
+   bool mBinaryEncoding;
+   UInt64 mSyncEpoch;        // peer's database epoch, 0 until the first incremental sync completes
+   UInt64 mSyncSequence;     // last sequence of mSyncEpoch that we have everything up to
+   UInt64 mPendingSequence;  // highest sequence received while an initial sync is in progress
+   bool mInitialSyncComplete;
 };
 
 }
@@ -3,12 +3,15 @@
 #endif
 
 #include <sstream>
+#include <vector>
 
 #include <resip/stack/Symbols.hxx>
 #include <resip/stack/Tuple.hxx>
 #include <rutil/ResipAssert.h>
 #include <rutil/Data.hxx>
+#include <rutil/DataStream.hxx>
 #include <rutil/DnsUtil.hxx>
+#include <rutil/Lock.hxx>
 #include <rutil/Logger.hxx>
 #include <rutil/ParseBuffer.hxx>
 #include <rutil/Socket.hxx>
@@ -25,6 +28,64 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
 
+// Static registrations and ones that can only be reached over the flow they
+// arrived on are not synced
+static bool
+isReplicated(const ContactInstanceRecord& rec)
+{
+   return !rec.mReceivedFrom.onlyUseExistingConnection && rec.mRegExpires != NeverExpire;
+}
+
+// The binary encoding is built from variable length numbers (7 bits per byte,
+// least significant first, top bit set on all but the last byte) and strings
+// (a number giving the length, then the bytes)
+static void
+encodeNumber(Data& buffer, UInt64 value)
+{
+   while(value >= 0x80)
+   {
+      buffer += (char)((value & 0x7f) | 0x80);
+      value >>= 7;
+   }
+   buffer += (char)value;
+}
+
+static void
+encodeString(Data& buffer, const Data& value)
+{
+   encodeNumber(buffer, value.size());
+   buffer.append(value.data(), value.size());
+}
+
+static bool
+decodeNumber(const Data& buffer, Data::size_type& pos, UInt64& value)
+{
+   value = 0;
+   for(unsigned int shift = 0; pos < buffer.size() && shift < 64; shift += 7)
+   {
+      unsigned char c = (unsigned char)buffer[pos++];
+      value |= (UInt64)(c & 0x7f) << shift;
+      if(!(c & 0x80))
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+static bool
+decodeString(const Data& buffer, Data::size_type& pos, Data& value)
+{
+   UInt64 size;
+   if(!decodeNumber(buffer, pos, size) || size > buffer.size() - pos)
+   {
+      return false;
+   }
+   value = Data(buffer.data() + pos, (Data::size_type)size);
+   pos += (Data::size_type)size;
+   return true;
+}
+
 
 RegSyncServer::RegSyncServer(resip::InMemorySyncRegDb* regDb,
                              int port, 
@@ -32,7 +93,13 @@ RegSyncServer::RegSyncServer(resip::InMemorySyncRegDb* regDb,
                              resip::InMemorySyncPubDb* pubDb) :
    XmlRpcServerBase(port, version),
    mRegDb(regDb),
-   mPubDb(pubDb)
+   mPubDb(pubDb),
+   mPendingSince(0),
+   mBatchIntervalMs(0),
+   mInitialSyncInProgress(false),
+   mInitialSyncConnectionId(0),
+   mInitialSyncBinary(false),
+   mInitialSyncAors(0)
 {
    if (mRegDb)
    {
@@ -49,7 +116,13 @@ RegSyncServer::RegSyncServer(resip::InMemorySyncRegDb* regDb,
                              resip::InMemorySyncPubDb* pubDb) :
    XmlRpcServerBase(brokerQueue),
    mRegDb(regDb),
-   mPubDb(pubDb)
+   mPubDb(pubDb),
+   mPendingSince(0),
+   mBatchIntervalMs(0),
+   mInitialSyncInProgress(false),
+   mInitialSyncConnectionId(0),
+   mInitialSyncBinary(false),
+   mInitialSyncAors(0)
 {
    if (mRegDb)
    {
@@ -98,27 +171,235 @@ RegSyncServer::sendRegistrationModifiedEvent(unsigned int connectionId, const re
 void 
 RegSyncServer::sendRegistrationModifiedEvent(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts)
 {
-   std::stringstream ss;
-   bool infoFound = false;
+   Data event;
+   bool infoFound;
+   {
+      oDataStream ds(event);
+      infoFound = encodeRegInfoXml(ds, aor, contacts);
+   }
+   if(infoFound)
+   {
+      sendEvent(connectionId, event);
+   }
+}
+
+bool
+RegSyncServer::encodeRegInfoXml(EncodeStream& ss, const resip::Uri& aor, const ContactList& contacts)
+{
+   ContactList::const_iterator cit = contacts.begin();
+   while(cit != contacts.end() && !isReplicated(*cit))
+   {
+      cit++;
+   }
+   if(cit == contacts.end())
+   {
+      return false;
+   }
 
    ss << "<reginfo>" << Symbols::CRLF;
    ss << "   <aor>" << Data::from(aor).xmlCharDataEncode() << "</aor>" << Symbols::CRLF;
-   ContactList::const_iterator cit = contacts.begin();
    for(; cit != contacts.end(); cit++)
    {
-      const ContactInstanceRecord& rec = *cit;
-      if(!rec.mReceivedFrom.onlyUseExistingConnection &&
-          rec.mRegExpires != NeverExpire)  // Don't sync over static registrations
+      if(isReplicated(*cit))
       {
-          streamContactInstanceRecord(ss, rec);
-          infoFound = true;
+          streamContactInstanceRecord(ss, *cit);
       }
    }
    ss << "</reginfo>" << Symbols::CRLF;
+   return true;
+}
 
-   if(infoFound)
+bool
+RegSyncServer::encodeRegInfoBinary(Data& buffer, const resip::Uri& aor, const ContactList& contacts)
+{
+   UInt64 count = 0;
+   for(ContactList::const_iterator cit = contacts.begin(); cit != contacts.end(); cit++)
+   {
+      if(isReplicated(*cit))
+      {
+         count++;
+      }
+   }
+   if(count == 0)
+   {
+      return false;
+   }
+
+   // Same fields, and the same relative times, as streamContactInstanceRecord
+   UInt64 now = Timer::getTimeSecs();
+   encodeString(buffer, Data::from(aor));
+   encodeNumber(buffer, count);
+   for(ContactList::const_iterator cit = contacts.begin(); cit != contacts.end(); cit++)
+   {
+      const ContactInstanceRecord& rec = *cit;
+      if(!isReplicated(rec))
+      {
+         continue;
+      }
+      encodeString(buffer, Data::from(rec.mContact));
+      encodeNumber(buffer, ((rec.mRegExpires == 0) || (rec.mRegExpires <= now)) ? 0 : (rec.mRegExpires-now));
+      encodeNumber(buffer, now-rec.mLastUpdated);
+      Data binaryFlowToken;
+      if(rec.mReceivedFrom.getPort() != 0)
+      {
+         Tuple::writeBinaryToken(rec.mReceivedFrom, binaryFlowToken);
+      }
+      encodeString(buffer, binaryFlowToken);
+      binaryFlowToken.clear();
+      if(rec.mPublicAddress.getType() != UNKNOWN_TRANSPORT)
+      {
+         Tuple::writeBinaryToken(rec.mPublicAddress, binaryFlowToken);
+      }
+      encodeString(buffer, binaryFlowToken);
+      encodeNumber(buffer, rec.mSipPath.size());
+      for(NameAddrs::const_iterator naIt = rec.mSipPath.begin(); naIt != rec.mSipPath.end(); naIt++)
+      {
+         encodeString(buffer, Data::from(naIt->uri()));
+      }
+      encodeString(buffer, rec.mInstance);
+      encodeNumber(buffer, rec.mRegId);
+   }
+   return true;
+}
+
+bool
+RegSyncServer::decodeRegInfoBinary(const Data& buffer, Data::size_type& pos, resip::Uri& aor, ContactList& contacts)
+{
+   UInt64 now = Timer::getTimeSecs();
+   Data value;
+   UInt64 count;
+   if(!decodeString(buffer, pos, value) || !decodeNumber(buffer, pos, count))
+   {
+      return false;
+   }
+   aor = Uri(value);
+   for(UInt64 i = 0; i < count; i++)
+   {
+      ContactInstanceRecord rec;
+      UInt64 expires;
+      UInt64 lastUpdate;
+      Data receivedFrom;
+      Data publicAddress;
+      UInt64 paths;
+      if(!decodeString(buffer, pos, value) ||
+         !decodeNumber(buffer, pos, expires) ||
+         !decodeNumber(buffer, pos, lastUpdate) ||
+         !decodeString(buffer, pos, receivedFrom) ||
+         !decodeString(buffer, pos, publicAddress) ||
+         !decodeNumber(buffer, pos, paths))
+      {
+         return false;
+      }
+      rec.mContact = NameAddr(value);
+      rec.mRegExpires = (expires == 0 ? 0 : now+expires);
+      rec.mLastUpdated = now-lastUpdate;
+      if(!receivedFrom.empty())
+      {
+         rec.mReceivedFrom = Tuple::makeTupleFromBinaryToken(receivedFrom);
+      }
+      if(!publicAddress.empty())
+      {
+         rec.mPublicAddress = Tuple::makeTupleFromBinaryToken(publicAddress);
+      }
+      for(UInt64 j = 0; j < paths; j++)
+      {
+         if(!decodeString(buffer, pos, value))
+         {
+            return false;
+         }
+         rec.mSipPath.push_back(NameAddr(value));
+      }
+      UInt64 regId;
+      if(!decodeString(buffer, pos, rec.mInstance) || !decodeNumber(buffer, pos, regId))
+      {
+         return false;
+      }
+      rec.mRegId = (UInt32)regId;
+      rec.mSyncContact = true;  // This ContactInstanceRecord came from registration sync process
+      contacts.push_back(rec);
+   }
+   return true;
+}
+
+void
+RegSyncServer::sendRegBatch(unsigned int connectionId, bool binary, const Data& records, UInt64 sequence)
+{
+   // Batches sent during initial sync have no sequence - the peer takes the
+   // sequence in the InitialSync response once they have all arrived
+   Data batch(records.size() * 4 / 3 + 100, Data::Preallocate);
+   batch += "<regbatch>";
+   batch += Symbols::CRLF;
+   if(sequence != 0)
+   {
+      batch += "   <sequence>" + Data(sequence) + "</sequence>";
+      batch += Symbols::CRLF;
+   }
+   if(binary)
+   {
+      batch += "   <records>" + records.base64encode() + "</records>";
+      batch += Symbols::CRLF;
+   }
+   else
+   {
+      batch += records;
+   }
+   batch += "</regbatch>";
+   batch += Symbols::CRLF;
+   sendEvent(connectionId, batch);
+}
+
+void
+RegSyncServer::flushPendingAors(bool force)
+{
+   PendingAorMap pending;
+   std::vector<std::pair<unsigned int, bool> > connections;
+   {
+      Lock lock(mSyncMutex);
+      if(mPendingAors.empty() || 
+         (!force && Timer::getTimeMs() < mPendingSince + mBatchIntervalMs))
+      {
+         return;
+      }
+      pending.swap(mPendingAors);
+      for(SyncConnectionMap::iterator it = mSyncConnections.begin(); it != mSyncConnections.end(); it++)
+      {
+         if(it->second.mIncremental)
+         {
+            connections.push_back(std::make_pair(it->first, it->second.mBinary));
+         }
+      }
+   }
+
+   // Split into batches of at most REGSYNC_MAX_BATCH_AORS, only the last one
+   // carries the sequence.  Only this thread flushes, so batches go out in
+   // sequence order.
+   UInt64 sequence = 0;
+   for(PendingAorMap::iterator it = pending.begin(); it != pending.end(); it++)
    {
-      sendEvent(connectionId, ss.str().c_str());
+      sequence = resipMax(sequence, it->second.mSequence);
+   }
+   Data xmlRecords;
+   Data binaryRecords;
+   unsigned int aors = 0;
+   for(PendingAorMap::iterator it = pending.begin(); it != pending.end(); )
+   {
+      {
+         oDataStream ds(xmlRecords);
+         encodeRegInfoXml(ds, it->first, it->second.mContacts);
+      }
+      encodeRegInfoBinary(binaryRecords, it->first, it->second.mContacts);
+      aors++;
+      it++;
+      if(aors == REGSYNC_MAX_BATCH_AORS || it == pending.end())
+      {
+         for(std::vector<std::pair<unsigned int, bool> >::iterator cit = connections.begin(); cit != connections.end(); cit++)
+         {
+            sendRegBatch(cit->first, cit->second, cit->second ? binaryRecords : xmlRecords, it == pending.end() ? sequence : 0);
+         }
+         xmlRecords.clear();
+         binaryRecords.clear();
+         aors = 0;
+      }
    }
 }
 
@@ -219,6 +500,23 @@ RegSyncServer::sendDocumentRemovedEvent(unsigned int connectionId, const Data& e
    sendEvent(connectionId, ss.str().c_str());
 }
 
+void 
+RegSyncServer::onConnectionClosed(unsigned int connectionId)
+{
+   Lock lock(mSyncMutex);
+   mSyncConnections.erase(connectionId);
+}
+
+bool
+RegSyncServer::wantsSelectiveEvent(unsigned int connectionId)
+{
+   // Single registration changes go to every peer that is not synced
+   // incrementally, including those that have not sent InitialSync yet
+   Lock lock(mSyncMutex);
+   SyncConnectionMap::iterator it = mSyncConnections.find(connectionId);
+   return it == mSyncConnections.end() || !it->second.mIncremental;
+}
+
 void 
 RegSyncServer::handleRequest(unsigned int connectionId, unsigned int requestId, const resip::Data& request)
 {
@@ -251,22 +549,43 @@ RegSyncServer::handleInitialSyncRequest(unsigned int connectionId, unsigned int
 {
    InfoLog(<< "RegSyncServer::handleInitialSyncRequest");
 
-   // Check for correct Version
+   // Check for correct Version.  Peers that want incremental sync also send
+   // the epoch and sequence they last synced to, and the encoding they want.
    unsigned int version = 0;
+   SyncConnection syncConnection;
+   UInt64 epoch = 0;
+   UInt64 sequence = 0;
    if(xml.firstChild())
    {
       if(isEqualNoCase(xml.getTag(), "request"))
       {
          if(xml.firstChild())
          {
-            if(isEqualNoCase(xml.getTag(), "version"))
+            do
             {
+               Data tag = xml.getTag();
                if(xml.firstChild())
                {
-                  version = xml.getValue().convertUnsignedLong();
+                  if(isEqualNoCase(tag, "version"))
+                  {
+                     version = xml.getValue().convertUnsignedLong();
+                  }
+                  else if(isEqualNoCase(tag, "epoch"))
+                  {
+                     epoch = xml.getValue().convertUInt64();
+                  }
+                  else if(isEqualNoCase(tag, "sequence"))
+                  {
+                     syncConnection.mIncremental = true;
+                     sequence = xml.getValue().convertUInt64();
+                  }
+                  else if(isEqualNoCase(tag, "encoding"))
+                  {
+                     syncConnection.mBinary = isEqualNoCase(xml.getValue(), "binary");
+                  }
                   xml.parent();
                }
-            }
+            } while(xml.nextSibling());
             xml.parent();
          }
       }
@@ -275,7 +594,53 @@ RegSyncServer::handleInitialSyncRequest(unsigned int connectionId, unsigned int
 
    if(version == REGSYNC_VERSION)
    {
-      if (mRegDb)
+      Data responseData;
+      if(!mRegDb)
+      {
+         syncConnection.mIncremental = false;
+      }
+      {
+         // Registered before the sequence is read, so no change can fall
+         // between the initial sync and the batches that follow it
+         Lock lock(mSyncMutex);
+         mSyncConnections[connectionId] = syncConnection;
+         mInitialSyncInProgress = syncConnection.mIncremental;
+      }
+      if (syncConnection.mIncremental)
+      {
+         UInt64 currentSequence = mRegDb->getSequence();
+         UInt64 fromSequence = 0;
+         if(epoch == mRegDb->getEpoch() && sequence <= currentSequence)
+         {
+            fromSequence = sequence;
+         }
+         InfoLog(<< "RegSyncServer::handleInitialSyncRequest: incremental sync from sequence " << fromSequence 
+                 << " to " << currentSequence << (syncConnection.mBinary ? " (binary)" : ""));
+
+         mInitialSyncConnectionId = connectionId;
+         mInitialSyncBinary = syncConnection.mBinary;
+         mInitialSyncRecords.clear();
+         mInitialSyncAors = 0;
+         mRegDb->initialSync(connectionId, fromSequence);
+         if(mInitialSyncAors > 0)
+         {
+            sendRegBatch(connectionId, mInitialSyncBinary, mInitialSyncRecords, 0);
+         }
+         mInitialSyncRecords.clear();
+         mInitialSyncConnectionId = 0;
+
+         // Changes made during the sync were held back, so that none could
+         // overtake an older record of the same AOR; they can go now
+         {
+            Lock lock(mSyncMutex);
+            mInitialSyncInProgress = false;
+         }
+         flushPendingAors();
+
+         responseData = "    <Epoch>" + Data(mRegDb->getEpoch()) + "</Epoch>" + Symbols::CRLF +
+                        "    <Sequence>" + Data(currentSequence) + "</Sequence>" + Symbols::CRLF;
+      }
+      else if (mRegDb)
       {
          mRegDb->initialSync(connectionId);
       }
@@ -283,7 +648,7 @@ RegSyncServer::handleInitialSyncRequest(unsigned int connectionId, unsigned int
       {
          mPubDb->initialSync(connectionId);
       }
-      sendResponse(connectionId, requestId, Data::Empty, 200, "Initial Sync Completed.");
+      sendResponse(connectionId, requestId, responseData, 200, "Initial Sync Completed.");
    }
    else
    {
@@ -292,7 +657,7 @@ RegSyncServer::handleInitialSyncRequest(unsigned int connectionId, unsigned int
 }
 
 void 
-RegSyncServer::streamContactInstanceRecord(std::stringstream& ss, const ContactInstanceRecord& rec)
+RegSyncServer::streamContactInstanceRecord(EncodeStream& ss, const ContactInstanceRecord& rec)
 {
     UInt64 now = Timer::getTimeSecs();
 
@@ -335,12 +700,96 @@ RegSyncServer::onAorModified(const resip::Uri& aor, const ContactList& contacts)
    sendRegistrationModifiedEvent(0, aor, contacts);
 }
 
+void 
+RegSyncServer::onAorModified(const resip::Uri& aor, const ContactList& contacts, UInt64 sequence)
+{
+   // Peers that did not ask for incremental sync (or an AMQP broker) get the
+   // change on its own, as before; see wantsSelectiveEvent()
+   Data event;
+   bool infoFound;
+   {
+      oDataStream ds(event);
+      infoFound = encodeRegInfoXml(ds, aor, contacts);
+   }
+   if(infoFound)
+   {
+      sendEvent(0, event, true /* selective */);
+   }
+
+   Lock lock(mSyncMutex);
+   bool incremental = false;
+   for(SyncConnectionMap::iterator it = mSyncConnections.begin(); it != mSyncConnections.end(); it++)
+   {
+      if(it->second.mIncremental)
+      {
+         incremental = true;
+         break;
+      }
+   }
+
+   if(incremental)
+   {
+      // While an incremental initial sync is being sent, a change sent at
+      // once could reach the peer before the older record of the same AOR
+      // that the sync has read but not sent yet, so it waits in mPendingAors
+      if(mBatchIntervalMs == 0 && !mInitialSyncInProgress)
+      {
+         Data binaryRecords;
+         encodeRegInfoBinary(binaryRecords, aor, contacts);
+         for(SyncConnectionMap::iterator it = mSyncConnections.begin(); it != mSyncConnections.end(); it++)
+         {
+            if(it->second.mIncremental)
+            {
+               sendRegBatch(it->first, it->second.mBinary, it->second.mBinary ? binaryRecords : event, sequence);
+            }
+         }
+      }
+      else
+      {
+         if(mPendingAors.empty())
+         {
+            mPendingSince = Timer::getTimeMs();
+         }
+         PendingAor& pending = mPendingAors[aor];
+         pending.mSequence = sequence;
+         pending.mContacts = contacts;
+      }
+   }
+}
+
 void 
 RegSyncServer::onInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts)
 {
    sendRegistrationModifiedEvent(connectionId, aor, contacts);
 }
 
+void 
+RegSyncServer::onInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts, UInt64 sequence)
+{
+   if(connectionId == 0 || connectionId != mInitialSyncConnectionId)
+   {
+      sendRegistrationModifiedEvent(connectionId, aor, contacts);
+      return;
+   }
+
+   bool added;
+   if(mInitialSyncBinary)
+   {
+      added = encodeRegInfoBinary(mInitialSyncRecords, aor, contacts);
+   }
+   else
+   {
+      oDataStream ds(mInitialSyncRecords);
+      added = encodeRegInfoXml(ds, aor, contacts);
+   }
+   if(added && ++mInitialSyncAors == REGSYNC_MAX_BATCH_AORS)
+   {
+      sendRegBatch(connectionId, mInitialSyncBinary, mInitialSyncRecords, 0);
+      mInitialSyncRecords.clear();
+      mInitialSyncAors = 0;
+   }
+}
+
 void 
 RegSyncServer::onDocumentModified(bool sync, const Data& eventType, const Data& documentKey, const Data& eTag, UInt64 expirationTime, UInt64 lastUpdated, const Contents* contents, const SecurityAttributes* securityAttributes)
 {
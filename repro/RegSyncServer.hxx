@@ -1,7 +1,9 @@
 #if !defined(RegSyncServer_hxx)
 #define RegSyncServer_hxx 
 
+#include <map>
 #include <rutil/Data.hxx>
+#include <rutil/Mutex.hxx>
 #include <rutil/TransportType.hxx>
 #include <rutil/XMLCursor.hxx>
 #include <resip/dum/InMemorySyncRegDb.hxx>
@@ -10,6 +12,9 @@
 
 #define REGSYNC_VERSION 4
 
+// Largest number of AORs sent in one <regbatch>
+#define REGSYNC_MAX_BATCH_AORS 500
+
 namespace repro
 {
 class RegSyncServer;
@@ -41,12 +46,35 @@ public:
    virtual void sendDocumentModifiedEvent(unsigned int connectionId, const resip::Data& eventType, const resip::Data& documentKey, const resip::Data& eTag, UInt64 expirationTime, UInt64 lastUpdated, const resip::Contents* contents, const resip::SecurityAttributes* securityAttributes);
    virtual void sendDocumentRemovedEvent(unsigned int connectionId, const resip::Data& eventType, const resip::Data& documentKey, const resip::Data& eTag, UInt64 lastUpdated);
 
+   // Peers that ask for incremental sync get registration changes in batches:
+   // changes are collected for this long, so that an AOR refreshed several
+   // times in the interval is only sent once.  0 sends every change at once.
+   void setBatchIntervalMs(unsigned int ms) { mBatchIntervalMs = ms; }
+   unsigned int getBatchIntervalMs() const { return mBatchIntervalMs; }
+   // Sends the changes collected for incremental peers, if they have waited
+   // for the batch interval (or at once if force is set)
+   void flushPendingAors(bool force = false);
+
+   // Registration encodings - the <reginfo> XML element, and the compact binary
+   // form carried base64 encoded in the <records> element of a <regbatch>.
+   // Contacts that are not replicated (static and flow-routed ones) are left
+   // out; the encode methods add nothing and return false if that is all of them.
+   static bool encodeRegInfoXml(EncodeStream& ss, const resip::Uri& aor, const resip::ContactList& contacts);
+   static bool encodeRegInfoBinary(resip::Data& buffer, const resip::Uri& aor, const resip::ContactList& contacts);
+   // Decodes the record at pos and advances pos past it - returns false if the
+   // buffer is truncated
+   static bool decodeRegInfoBinary(const resip::Data& buffer, resip::Data::size_type& pos, resip::Uri& aor, resip::ContactList& contacts);
+
 protected:
    virtual void handleRequest(unsigned int connectionId, unsigned int requestId, const resip::Data& request); 
+   virtual void onConnectionClosed(unsigned int connectionId);
+   virtual bool wantsSelectiveEvent(unsigned int connectionId);
 
    // InMemorySyncRegDbHandler methods
    virtual void onAorModified(const resip::Uri& aor, const resip::ContactList& contacts);
+   virtual void onAorModified(const resip::Uri& aor, const resip::ContactList& contacts, UInt64 sequence);
    virtual void onInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const resip::ContactList& contacts);
+   virtual void onInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const resip::ContactList& contacts, UInt64 sequence);
 
    // InMemorySyncPubDbHandler methods
    virtual void onDocumentModified(bool sync, const resip::Data& eventType, const resip::Data& documentKey, const resip::Data& eTag, UInt64 expirationTime, UInt64 lastUpdated, const resip::Contents* contents, const resip::SecurityAttributes* securityAttributes);
@@ -55,10 +83,42 @@ protected:
 
 private: 
    void handleInitialSyncRequest(unsigned int connectionId, unsigned int requestId, resip::XMLCursor& xml);
-   void streamContactInstanceRecord(std::stringstream& ss, const resip::ContactInstanceRecord& rec);
+   static void streamContactInstanceRecord(EncodeStream& ss, const resip::ContactInstanceRecord& rec);
+   void sendRegBatch(unsigned int connectionId, bool binary, const resip::Data& records, UInt64 sequence);
 
    resip::InMemorySyncRegDb* mRegDb;
    resip::InMemorySyncPubDb* mPubDb;
+
+   // Connections that have sent InitialSync, and how they want to be synced
+   class SyncConnection
+   {
+   public:
+      SyncConnection() : mIncremental(false), mBinary(false) {}
+      bool mIncremental;
+      bool mBinary;
+   };
+   typedef std::map<unsigned int, SyncConnection> SyncConnectionMap;
+   SyncConnectionMap mSyncConnections;
+
+   // Changes waiting to be sent to incremental connections, latest contacts per AOR
+   class PendingAor
+   {
+   public:
+      UInt64 mSequence;
+      resip::ContactList mContacts;
+   };
+   typedef std::map<resip::Uri, PendingAor> PendingAorMap;
+   PendingAorMap mPendingAors;
+   UInt64 mPendingSince;
+   unsigned int mBatchIntervalMs;
+   bool mInitialSyncInProgress;  // changes are held in mPendingAors while set
+   resip::Mutex mSyncMutex;  // protects the above
+
+   // Incremental initial sync in progress - only used from the server's thread
+   unsigned int mInitialSyncConnectionId;
+   bool mInitialSyncBinary;
+   resip::Data mInitialSyncRecords;
+   unsigned int mInitialSyncAors;
 };
 
 }
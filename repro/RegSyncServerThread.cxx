@@ -23,18 +23,24 @@ RegSyncServerThread::thread()
       try
       {
            FdSet fdset; 
+           unsigned int timeoutMs = 2*1000;
      
            std::list<RegSyncServer*>::iterator it = mRegSyncServerList.begin();
            for(;it!=mRegSyncServerList.end();it++)
            {
               (*it)->buildFdSet(fdset);
+              if((*it)->getBatchIntervalMs() != 0)
+              {
+                 timeoutMs = resipMin(timeoutMs, (*it)->getBatchIntervalMs());
+              }
            }
-           fdset.selectMilliSeconds( 2*1000 );
+           fdset.selectMilliSeconds( timeoutMs );
            
            it = mRegSyncServerList.begin();
            for(;it!=mRegSyncServerList.end();it++)
            {
               (*it)->process(fdset);
+              (*it)->flushPendingAors();
            }
       }
       catch (...)
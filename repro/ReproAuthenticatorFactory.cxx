@@ -58,7 +58,9 @@ ReproAuthenticatorFactory::init()
          numAuthGrabberWorkerThreads = 1; // must have at least one thread
       }
       std::auto_ptr<Worker> grabber(new UserAuthGrabber(mProxyConfig.getDataStore()->mUserStore));
-      mAuthRequestDispatcher.reset(new Dispatcher(grabber, &mSipStack, numAuthGrabberWorkerThreads));
+      mAuthRequestDispatcher.reset(new Dispatcher(grabber, &mSipStack, numAuthGrabberWorkerThreads, true,
+                                                  mProxyConfig.getConfigBool("DispatcherWorkStealing", false) ? 
+                                                     Dispatcher::WorkStealing : Dispatcher::SharedQueue));
    }
 
    // TODO: should be implemented using AbstractDb
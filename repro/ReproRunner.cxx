@@ -90,6 +90,7 @@
 #if defined(USE_SSL)
 #include "repro/stateAgents/CertServer.hxx"
 #include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsBaseTransport.hxx"
 #define DEFAULT_TLS_METHOD SecurityTypes::SSLv23
 #endif
 
@@ -329,6 +330,11 @@ ReproRunner::run(int argc, char** argv)
                    mProxyConfig->getConfigData("LogFilename", "repro.log", true).c_str(),
                    isEqualNoCase(loggingType, "file") ? &g_ReproLogger : 0, // if logging to file then write WARNINGS, and Errors to console still
                    syslogFacilityName);
+   unsigned long logAsyncBufferBytes = mProxyConfig->getConfigUnsignedLong("LogAsyncBufferBytes", 0);
+   if(logAsyncBufferBytes > 0)
+   {
+      Log::setAsync(logAsyncBufferBytes);
+   }
 
    InfoLog( << "Starting repro version " << VersionUtils::instance().releaseVersion() << "...");
 
@@ -707,6 +713,10 @@ ReproRunner::createSipStack()
          "OpenSSLCTXSetOptions", BaseSecurity::OpenSSLCTXSetOptions);
    setOpenSSLCTXOptionsFromConfig(
          "OpenSSLCTXClearOptions", BaseSecurity::OpenSSLCTXClearOptions);
+   BaseSecurity::TlsSessionCacheSize = (long)mProxyConfig->getConfigUnsignedLong("TlsSessionCacheSize", BaseSecurity::TlsSessionCacheSize);
+   BaseSecurity::TlsSessionTimeout = (long)mProxyConfig->getConfigUnsignedLong("TlsSessionTimeout", BaseSecurity::TlsSessionTimeout);
+   BaseSecurity::TlsSessionTickets = mProxyConfig->getConfigBool("TlsSessionTickets", BaseSecurity::TlsSessionTickets);
+   TlsBaseTransport::HandshakeThreads = mProxyConfig->getConfigUnsignedLong("TlsHandshakeThreads", TlsBaseTransport::HandshakeThreads);
    Security::CipherList cipherList = Security::StrongestSuite;
    Data ciphers = mProxyConfig->getConfigData("OpenSSLCipherList", Data::Empty);
    if(!ciphers.empty())
@@ -1016,6 +1026,10 @@ ReproRunner::createDatastore()
       return false;
    }
    mProxyConfig->createDataStore(mAbstractDb, mRuntimeAbstractDb);
+   mProxyConfig->getDataStore()->mUserStore.setAuthCacheParameters(
+      mProxyConfig->getConfigUnsignedLong("UserAuthCacheSize", 0),
+      mProxyConfig->getConfigUnsignedLong("UserAuthCacheTTL", 300),
+      mProxyConfig->getConfigUnsignedLong("UserAuthCacheNegativeTTL", 30));
 
    // Create ImMemory Registration Database
    mRegSyncPort = mProxyConfig->getConfigInt("RegSyncPort", 0);
@@ -1197,7 +1211,10 @@ ReproRunner::createProxy()
       resip_assert(!mAsyncProcessorDispatcher);
       mAsyncProcessorDispatcher = new Dispatcher(std::auto_ptr<Worker>(new AsyncProcessorWorker), 
                                                  mSipStack, 
-                                                 numAsyncProcessorWorkerThreads);
+                                                 numAsyncProcessorWorkerThreads,
+                                                 true,
+                                                 mProxyConfig->getConfigBool("DispatcherWorkStealing", false) ? 
+                                                    Dispatcher::WorkStealing : Dispatcher::SharedQueue);
    }
 
    std::vector<Plugin*>::iterator it;
@@ -1425,11 +1442,13 @@ ReproRunner::createRegSync()
    if(mRegSyncPort != 0)
    {
       std::list<RegSyncServer*> regSyncServerList;
+      unsigned int regSyncBatchMs = mProxyConfig->getConfigUnsignedLong("RegSyncBatchMs", 100);
       if(mUseV4) 
       {
          mRegSyncServerV4 = new RegSyncServer(dynamic_cast<InMemorySyncRegDb*>(mRegistrationPersistenceManager), 
                                               mRegSyncPort, V4, 
                                               enablePublicationReplication ? dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager) : 0);
+         mRegSyncServerV4->setBatchIntervalMs(regSyncBatchMs);
          regSyncServerList.push_back(mRegSyncServerV4);
       }
       if(mUseV6) 
@@ -1437,6 +1456,7 @@ ReproRunner::createRegSync()
          mRegSyncServerV6 = new RegSyncServer(dynamic_cast<InMemorySyncRegDb*>(mRegistrationPersistenceManager),
                                               mRegSyncPort, V6,
                                               enablePublicationReplication ? dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager) : 0);
+         mRegSyncServerV6->setBatchIntervalMs(regSyncBatchMs);
          regSyncServerList.push_back(mRegSyncServerV6);
       }
       if(!regSyncServerList.empty())
@@ -1453,7 +1473,9 @@ ReproRunner::createRegSync()
          }
          mRegSyncClient = new RegSyncClient(dynamic_cast<InMemorySyncRegDb*>(mRegistrationPersistenceManager),
                                             regSyncPeerAddress, remoteRegSyncPort,
-                                            enablePublicationReplication ? dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager) : 0);
+                                            enablePublicationReplication ? dynamic_cast<InMemorySyncPubDb*>(mPublicationPersistenceManager) : 0,
+                                            mProxyConfig->getConfigBool("RegSyncIncremental", false),
+                                            mProxyConfig->getConfigBool("RegSyncBinaryEncoding", false));
       }
    }
    Data regSyncBrokerTopic = mProxyConfig->getConfigData("RegSyncBrokerTopic", Data::Empty);
@@ -1638,6 +1660,8 @@ ReproRunner::addTransports(bool& allTransportsSpecifyRecordRoute)
          // Transport1TlsClientVerification = None
          // Transport1RecordRouteUri = sip:sipdomain.com;transport=TLS
          // Transport1RcvBufLen = 2000
+         // Transport1BatchSize = 32
+         // Transport1Shards = 4
 
          allTransportsSpecifyRecordRoute = true;
 
@@ -1709,7 +1733,22 @@ ReproRunner::addTransports(bool& allTransportsSpecifyRecordRoute)
                }
 #endif
 
-               Transport *t = mSipStack->addTransport(tt,
+               std::vector<Transport*> shards;
+               int numShards = tc.getConfigInt("Shards", 0);
+               Transport *t = 0;
+               if(tt == UDP && numShards > 1)
+               {
+                  t = mSipStack->addShardedUdpTransport(port,
+                                 numShards,
+                                 DnsUtil::isIpV6Address(ipAddr) ? V6 : V4,
+                                 StunEnabled,
+                                 ipAddr,
+                                 0,            // transport flags
+                                 &shards);
+               }
+               else
+               {
+                  t = mSipStack->addTransport(tt,
                                  port,
                                  DnsUtil::isIpV6Address(ipAddr) ? V6 : V4,
                                  StunEnabled, 
@@ -1722,19 +1761,30 @@ ReproRunner::addTransports(bool& allTransportsSpecifyRecordRoute)
                                  cvm,          // tls client verification mode
                                  useEmailAsSIP,
                                  basicWsConnectionValidator, wsCookieContextFactory);
+                  shards.push_back(t);
+               }
 
                if (t)
                {
                   int rcvBufLen = tc.getConfigInt("RcvBufLen", 0);
-                  if (rcvBufLen >0 )
+                  int batchSize = tc.getConfigInt("BatchSize", 0);
+                  for(std::vector<Transport*>::iterator itShard = shards.begin(); itShard != shards.end(); itShard++)
                   {
+                     if (rcvBufLen >0 )
+                     {
 #if defined(RESIP_SIPSTACK_HAVE_FDPOLL)
-                     // this new method is part of the epoll changeset,
-                     // which isn't commited yet.
-                     t->setRcvBufLen(rcvBufLen);
+                        // this new method is part of the epoll changeset,
+                        // which isn't commited yet.
+                        (*itShard)->setRcvBufLen(rcvBufLen);
 #else
-                      resip_assert(0);
+                         resip_assert(0);
 #endif
+                     }
+
+                     if (batchSize > 1)
+                     {
+                        (*itShard)->setBatchSize(batchSize);
+                     }
                   }
 
                   Data recordRouteUri = tc.getConfigData("RecordRouteUri", Data::Empty);
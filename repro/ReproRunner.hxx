@@ -58,6 +58,8 @@ public:
    virtual void onReload();
 
    virtual Proxy* getProxy() { return mProxy; }
+   virtual AuthenticatorFactory* getAuthenticatorFactory() { return mAuthFactory; }
+   virtual Dispatcher* getAsyncProcessorDispatcher() { return mAsyncProcessorDispatcher; }
 
    // External Stats handler
    virtual bool operator()(resip::StatisticsMessage &statsMessage);
@@ -119,7 +121,7 @@ protected:
    RegSyncClient* mRegSyncClient;
    RegSyncServer* mRegSyncServerV4;
    RegSyncServer* mRegSyncServerV6;
-   RegSyncServer* mRegSyncServerAMQP;
+   RegSyncServer* mRegSyncServerAMQP;
    RegSyncServerThread* mRegSyncServerThread;
    std::list<CommandServer*> mCommandServerList;
    CommandServerThread* mCommandServerThread;
@@ -1,7 +1,11 @@
 
+#include <algorithm>
+#include <iterator>
+
 #include "rutil/Logger.hxx"
 #include "rutil/ParseBuffer.hxx"
 #include "rutil/Lock.hxx"
+#include "rutil/DataStream.hxx"
 #include "resip/stack/Uri.hxx"
 
 #include "repro/RouteStore.hxx"
@@ -17,12 +21,195 @@ using namespace std;
 
 bool RouteStore::RouteOp::operator<(const RouteOp& rhs) const
 {
-   return routeRecord.mOrder < rhs.routeRecord.mOrder;
+   if(routeRecord.mOrder != rhs.routeRecord.mOrder)
+   {
+      return routeRecord.mOrder < rhs.routeRecord.mOrder;
+   }
+   return sequence < rhs.sequence;
+}
+
+
+namespace
+{
+
+// One element of a POSIX extended regex: a literal character, or something
+// else (bracket expression, group paren, anchor or '.') along with the
+// quantifier that follows it, if any
+struct PatternAtom
+{
+   char c;
+   bool isLiteral;
+   char quantifier;
+   size_t group;  // for ')', the index of its '('
+};
+
+// Splits pattern into atoms.  Returns false for anything not worth
+// understanding (alternation, back references, escaped ordinary characters,
+// unbalanced groups), leaving the route to be matched by regexec alone.
+bool
+parsePattern(const Data& pattern, vector<PatternAtom>& atoms, bool& anchoredStart, bool& anchoredEnd)
+{
+   const char* p = pattern.data();
+   Data::size_type start = 0;
+   Data::size_type end = pattern.size();
+   vector<size_t> openGroups;
+
+   anchoredStart = end > 0 && p[0] == '^';
+   if(anchoredStart)
+   {
+      start = 1;
+   }
+
+   // A trailing $ anchors the end, unless it is escaped
+   anchoredEnd = false;
+   if(end > start && p[end-1] == '$')
+   {
+      Data::size_type escapes = 0;
+      while(end - 1 - escapes > start && p[end-2-escapes] == '\\')
+      {
+         escapes++;
+      }
+      if(escapes % 2 == 0)
+      {
+         anchoredEnd = true;
+         end--;
+      }
+   }
+
+   for(Data::size_type i = start; i < end; i++)
+   {
+      PatternAtom atom;
+      atom.c = p[i];
+      atom.isLiteral = false;
+      atom.quantifier = 0;
+      atom.group = 0;
+
+      switch(p[i])
+      {
+         case '|':
+            return false;
+         case '\\':
+            if(i + 1 >= end || isalnum((unsigned char)p[i+1]))
+            {
+               return false;
+            }
+            atom.c = p[++i];
+            atom.isLiteral = true;
+            break;
+         case '[':
+         {
+            Data::size_type j = i + 1;
+            if(j < end && p[j] == '^') j++;
+            if(j < end && p[j] == ']') j++;  // a leading ] is a member of the set
+            while(j < end && p[j] != ']')
+            {
+               if(p[j] == '[' && j + 1 < end && (p[j+1] == ':' || p[j+1] == '.' || p[j+1] == '='))
+               {
+                  // [:class:], [.coll.] or [=equiv=] - skip past its closing bracket
+                  char delimiter = p[j+1];
+                  for(j += 2; j + 1 < end && !(p[j] == delimiter && p[j+1] == ']'); j++)
+                  {
+                  }
+                  j++;
+               }
+               j++;
+            }
+            if(j >= end)
+            {
+               return false;
+            }
+            i = j;
+            break;
+         }
+         case '(':
+            openGroups.push_back(atoms.size());
+            break;
+         case ')':
+            if(openGroups.empty())
+            {
+               return false;
+            }
+            atom.group = openGroups.back();
+            openGroups.pop_back();
+            break;
+         case '*':
+         case '+':
+         case '?':
+         case '{':
+         {
+            if(atoms.empty())
+            {
+               return false;
+            }
+            char quantifier = p[i];
+            if(quantifier == '{')
+            {
+               Data::size_type close = pattern.find("}", i);
+               if(close == Data::npos || close >= end)
+               {
+                  return false;
+               }
+               i = close;
+            }
+            // Stacked quantifiers (a+?, a{2}*) may make the atom optional
+            PatternAtom& quantified = atoms.back();
+            quantified.quantifier = quantified.quantifier ? '*' : quantifier;
+            if(!quantified.isLiteral && quantified.c == ')')
+            {
+               atoms[quantified.group].quantifier = quantified.quantifier;
+            }
+            continue;
+         }
+         case '.':
+         case '^':
+         case '$':
+            break;
+         default:
+            atom.isLiteral = true;
+            break;
+      }
+      atoms.push_back(atom);
+   }
+   return openGroups.empty();
+}
+
+// The literal text every match of atoms starts with, or when reading
+// backwards, ends with (back to front)
+Data
+requiredLiteral(const vector<PatternAtom>& atoms, bool backwards)
+{
+   Data literal;
+   for(vector<PatternAtom>::size_type n = 0; n < atoms.size(); n++)
+   {
+      const PatternAtom& atom = atoms[backwards ? atoms.size() - 1 - n : n];
+      if(!atom.isLiteral)
+      {
+         // Parens of a group that isn't quantified don't change what is matched
+         if((atom.c == '(' || atom.c == ')') && !atom.quantifier)
+         {
+            continue;
+         }
+         break;
+      }
+      if(atom.quantifier && atom.quantifier != '+')
+      {
+         break;
+      }
+      literal += atom.c;
+      if(atom.quantifier == '+')
+      {
+         break;
+      }
+   }
+   return literal;
+}
+
 }
 
 
 RouteStore::RouteStore(AbstractDb& db):
-   mDb(db)
+   mDb(db),
+   mNextSequence(0)
 {  
    Key key = mDb.firstRouteKey();
    while ( !key.empty() )
@@ -31,27 +218,14 @@ RouteStore::RouteStore(AbstractDb& db):
       route.routeRecord = mDb.getRoute(key);
 
       route.key = key;
-      route.preq = 0;
-      
-      if(!route.routeRecord.mMatchingPattern.empty())
+      compileRoute(route);
+      if(!route.routeRecord.mMatchingPattern.empty() && !route.preq)
       {
-         int flags = REG_EXTENDED;
-         if(route.routeRecord.mRewriteExpression.find("$") == Data::npos)
-         {
-            flags |= REG_NOSUB;
-         }
-         route.preq = new regex_t;
-         int ret = regcomp(route.preq, route.routeRecord.mMatchingPattern.c_str(), flags);
-         if(ret != 0)
-         {
-            delete route.preq;
-            ErrLog(<< "Routing rule has invalid match expression: "
-                   << route.routeRecord.mMatchingPattern);
-            route.preq = 0;
-         }
+         ErrLog(<< "Routing rule has invalid match expression: "
+                << route.routeRecord.mMatchingPattern);
       }
 
-      mRouteOperators.insert( route );
+      indexRoute(*mRouteOperators.insert( route ));
 
       key = mDb.nextRouteKey();
    }
@@ -95,6 +269,173 @@ RouteStore::~RouteStore()
    mRouteOperators.clear();
 }
 
+
+void
+RouteStore::compileRoute(RouteOp& route)
+{
+   route.preq = 0;
+   route.sequence = mNextSequence++;
+   route.matchType = RouteOp::MatchRegex;
+   route.prefix.clear();
+   route.reversedSuffix.clear();
+
+   if(route.routeRecord.mMatchingPattern.empty())
+   {
+      return;
+   }
+
+   int flags = REG_EXTENDED;
+   if(route.routeRecord.mRewriteExpression.find("$") == Data::npos)
+   {
+      flags |= REG_NOSUB;
+   }
+   route.preq = new regex_t;
+   int ret = regcomp(route.preq, route.routeRecord.mMatchingPattern.c_str(), flags);
+   if(ret != 0)
+   {
+      delete route.preq;
+      route.preq = 0;
+      return;
+   }
+
+   vector<PatternAtom> atoms;
+   bool anchoredStart;
+   bool anchoredEnd;
+   if(parsePattern(route.routeRecord.mMatchingPattern, atoms, anchoredStart, anchoredEnd))
+   {
+      if(anchoredStart)
+      {
+         route.prefix = requiredLiteral(atoms, false);
+      }
+      if(anchoredEnd)
+      {
+         route.reversedSuffix = requiredLiteral(atoms, true);
+      }
+
+      bool literalOnly = anchoredStart;
+      for(vector<PatternAtom>::const_iterator it = atoms.begin(); it != atoms.end() && literalOnly; it++)
+      {
+         literalOnly = it->isLiteral && !it->quantifier;
+      }
+      if(literalOnly)
+      {
+         route.matchType = anchoredEnd ? RouteOp::MatchExact : RouteOp::MatchPrefix;
+      }
+   }
+}
+
+
+void
+RouteStore::indexRoute(const RouteOp& route)
+{
+   if(!route.preq)
+   {
+      return;  // never matches
+   }
+   if(!route.prefix.empty() && route.prefix.size() >= route.reversedSuffix.size())
+   {
+      mPrefixIndex.add(route.prefix, &route);
+   }
+   else if(!route.reversedSuffix.empty())
+   {
+      mSuffixIndex.add(route.reversedSuffix, &route);
+   }
+   else
+   {
+      mUnindexedRoutes.insert(&route);
+   }
+}
+
+
+void
+RouteStore::unindexRoute(const RouteOp& route)
+{
+   if(!route.preq)
+   {
+      return;
+   }
+   if(!route.prefix.empty() && route.prefix.size() >= route.reversedSuffix.size())
+   {
+      mPrefixIndex.remove(route.prefix, &route);
+   }
+   else if(!route.reversedSuffix.empty())
+   {
+      mSuffixIndex.remove(route.reversedSuffix, &route);
+   }
+   else
+   {
+      mUnindexedRoutes.erase(&route);
+   }
+}
+
+
+void
+RouteStore::LiteralIndex::add(const Data& literal, const RouteOp* route)
+{
+   mRoutes.insert(RouteMap::value_type(literal, route));
+   mLengths[literal.size()]++;
+}
+
+
+void
+RouteStore::LiteralIndex::remove(const Data& literal, const RouteOp* route)
+{
+   pair<RouteMap::iterator, RouteMap::iterator> range = mRoutes.equal_range(literal);
+   for(RouteMap::iterator it = range.first; it != range.second; it++)
+   {
+      if(it->second == route)
+      {
+         mRoutes.erase(it);
+         LengthMap::iterator length = mLengths.find(literal.size());
+         if(--length->second == 0)
+         {
+            mLengths.erase(length);
+         }
+         return;
+      }
+   }
+}
+
+
+void
+RouteStore::LiteralIndex::find(const Data& uri, vector<const RouteOp*>& routes) const
+{
+   for(LengthMap::const_iterator length = mLengths.begin(); 
+       length != mLengths.end() && length->first <= uri.size(); length++)
+   {
+      pair<RouteMap::const_iterator, RouteMap::const_iterator> range = 
+         mRoutes.equal_range(Data(Data::Share, uri.data(), length->first));
+      for(RouteMap::const_iterator it = range.first; it != range.second; it++)
+      {
+         routes.push_back(it->second);
+      }
+   }
+}
+
+
+void
+RouteStore::findCandidates(const Data& uri, vector<const RouteOp*>& candidates) const
+{
+   vector<const RouteOp*> indexed;
+   mPrefixIndex.find(uri, indexed);
+   if(!mSuffixIndex.empty())
+   {
+      Data reversedUri(uri.size(), Data::Preallocate);
+      for(Data::size_type i = uri.size(); i > 0; i--)
+      {
+         reversedUri += uri[i-1];
+      }
+      mSuffixIndex.find(reversedUri, indexed);
+   }
+   sort(indexed.begin(), indexed.end(), RouteOpPtrLess());
+
+   // Merge back into route order
+   candidates.reserve(indexed.size() + mUnindexedRoutes.size());
+   merge(indexed.begin(), indexed.end(), 
+         mUnindexedRoutes.begin(), mUnindexedRoutes.end(), 
+         back_inserter(candidates), RouteOpPtrLess());
+}
+
       
 bool
 RouteStore::addRoute(const resip::Data& method,
@@ -123,26 +464,11 @@ RouteStore::addRoute(const resip::Data& method,
    }
 
    route.key = key;
-   route.preq = 0;
-   if( !route.routeRecord.mMatchingPattern.empty() )
-   {
-     int flags = REG_EXTENDED;
-     if( route.routeRecord.mRewriteExpression.find("$") == Data::npos )
-     {
-       flags |= REG_NOSUB;
-     }
-     route.preq = new regex_t;
-     int ret = regcomp( route.preq, route.routeRecord.mMatchingPattern.c_str(), flags );
-     if( ret != 0 )
-     {
-       delete route.preq;
-       route.preq = 0;
-     }
-   }
 
    {
       WriteLock lock(mMutex);
-      mRouteOperators.insert( route );
+      compileRoute(route);
+      indexRoute(*mRouteOperators.insert( route ));
    }
    mCursor = mRouteOperators.begin(); 
 
@@ -193,6 +519,7 @@ RouteStore::eraseRoute(const resip::Data& key )
          {
             RouteOpList::iterator i = it;
             it++;
+            unindexRoute(*i);
             if ( i->preq )
             {
                regfree ( i->preq );
@@ -310,15 +637,26 @@ RouteStore::process(const resip::Uri& ruri,
 
    ReadLock lock(mMutex);
 
-   for (RouteOpList::iterator it = mRouteOperators.begin();
-        it != mRouteOperators.end(); it++)
+   Data uri;
    {
-      DebugLog( << "Consider route " // << *it
+      DataStream s(uri);
+      s << ruri;
+      s.flush();
+   }
+
+   vector<const RouteOp*> candidates;
+   findCandidates(uri, candidates);
+
+   for (vector<const RouteOp*>::const_iterator it = candidates.begin();
+        it != candidates.end(); it++)
+   {
+      const RouteOp& route = **it;
+      DebugLog( << "Consider route " // << route
                 << " reqUri=" << ruri
                 << " method=" << method 
                 << " event=" << event );
 
-      const AbstractDb::RouteRecord& rec = it->routeRecord;
+      const AbstractDb::RouteRecord& rec = route.routeRecord;
       
       if(!rec.mMethod.empty())
       {
@@ -339,28 +677,40 @@ RouteStore::process(const resip::Uri& ruri,
       }
       const Data& rewrite = rec.mRewriteExpression;
       const Data& match = rec.mMatchingPattern;
-      if ( it->preq ) 
+      if ( route.preq ) 
       {
          int ret;
-         // TODO - !cj! www.pcre.org looks like it has better performance
-         // !mbg! is this true now that the compiled regexp is used?
-         Data uri;
-         {
-            DataStream s(uri);
-            s << ruri;
-            s.flush();
-         }
-         
          const int nmatch=10;
          regmatch_t pmatch[nmatch];
          
-         ret = regexec(it->preq, uri.c_str(), nmatch, pmatch, 0/*eflags*/);
+         switch(route.matchType)
+         {
+            case RouteOp::MatchExact:
+               ret = (uri == route.prefix) ? 0 : REG_NOMATCH;
+               break;
+            case RouteOp::MatchPrefix:
+               ret = uri.prefix(route.prefix) ? 0 : REG_NOMATCH;
+               break;
+            default:
+               // TODO - !cj! www.pcre.org looks like it has better performance
+               // !mbg! is this true now that the compiled regexp is used?
+               ret = regexec(route.preq, uri.c_str(), nmatch, pmatch, 0/*eflags*/);
+               break;
+         }
          if ( ret != 0 )
          {
             // did not match 
             DebugLog( << "  Skipped - request URI "<< uri << " did not match " << match );
             continue;
          }
+         if ( route.matchType != RouteOp::MatchRegex )
+         {
+            // A literal pattern has no subexpressions to substitute
+            for ( int i=0; i<nmatch; i++)
+            {
+               pmatch[i].rm_so = -1;
+            }
+         }
 
          DebugLog( << "  Route matched" );
          Data target = rewrite;
@@ -7,7 +7,9 @@
 #include <regex.h>
 #endif
 
+#include <map>
 #include <set>
+#include <vector>
 
 #include "rutil/Data.hxx"
 #include "rutil/RWMutex.hxx"
@@ -70,16 +72,63 @@ class RouteStore
       class RouteOp
       {
          public:
+            // How process() decides whether the request URI matches
+            typedef enum
+            {
+               MatchRegex,    // run regexec
+               MatchPrefix,   // pattern is ^literal - the URI starts with prefix
+               MatchExact     // pattern is ^literal$ - the URI is prefix
+            } MatchType;
+
             Key key;
             regex_t *preq;
             AbstractDb::RouteRecord routeRecord;
+            unsigned int sequence;   // keeps routes with the same order in the order they were added
+            MatchType matchType;
+            resip::Data prefix;          // literal any matching URI starts with
+            resip::Data reversedSuffix;  // literal any matching URI ends with, back to front
             bool operator<(const RouteOp&) const;
       };
+
+      struct RouteOpPtrLess
+      {
+         bool operator()(const RouteOp* lhs, const RouteOp* rhs) const { return *lhs < *rhs; }
+      };
+
+      // Routes keyed by literal text, looked up by probing the request URI
+      // with each distinct key length
+      class LiteralIndex
+      {
+         public:
+            void add(const resip::Data& literal, const RouteOp* route);
+            void remove(const resip::Data& literal, const RouteOp* route);
+            void find(const resip::Data& uri, std::vector<const RouteOp*>& routes) const;
+            bool empty() const { return mRoutes.empty(); }
+
+         private:
+            typedef std::multimap<resip::Data, const RouteOp*> RouteMap;
+            typedef std::map<resip::Data::size_type, unsigned int> LengthMap;
+            RouteMap mRoutes;
+            LengthMap mLengths;  // key lengths in mRoutes, with the number of keys of each
+      };
+
+      void compileRoute(RouteOp& route);
+      void indexRoute(const RouteOp& route);
+      void unindexRoute(const RouteOp& route);
+      void findCandidates(const resip::Data& uri, std::vector<const RouteOp*>& candidates) const;
       
       resip::RWMutex mMutex;
       typedef std::multiset<RouteOp> RouteOpList;
       RouteOpList mRouteOperators; 
       RouteOpList::iterator mCursor;
+      unsigned int mNextSequence;
+
+      // Every route with a matching pattern is in exactly one of these, so that
+      // process() only considers routes whose literal prefix or suffix the
+      // request URI has, plus the routes whose pattern has neither
+      LiteralIndex mPrefixIndex;
+      LiteralIndex mSuffixIndex;   // keyed by the reversed suffix
+      std::set<const RouteOp*, RouteOpPtrLess> mUnindexedRoutes;
 };
 
  }
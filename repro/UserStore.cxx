@@ -7,6 +7,8 @@
 #include "rutil/DataStream.hxx"
 #include "resip/stack/Symbols.hxx"
 #include "rutil/Logger.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Timer.hxx"
 #include "resip/stack/TransactionUser.hxx"
 #include "resip/dum/UserAuthInfo.hxx"
 
@@ -21,7 +23,17 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
 
-UserStore::UserStore(AbstractDb& db ) : mDb(db)
+UserStore::UserStore(AbstractDb& db ) : 
+   mDb(db),
+   mAuthCacheMaxEntries(0),
+   mAuthCacheTtl(0),
+   mAuthCacheNegativeTtl(0),
+   mAuthCacheGeneration(0),
+   mAuthCacheHits(0),
+   mAuthCacheNegativeHits(0),
+   mAuthCacheMisses(0),
+   mAuthCacheRefreshes(0),
+   mAuthCacheEvictions(0)
 { 
 }
 
@@ -40,7 +52,79 @@ UserStore::getUserAuthInfo(  const resip::Data& user,
                              const resip::Data& realm ) const
 {
    Key key =  buildKey(user, realm);
-   return mDb.getUserAuthInfo( key );
+   if(mAuthCacheMaxEntries == 0)
+   {
+      return mDb.getUserAuthInfo( key );
+   }
+
+   unsigned int generation;
+   {
+      Lock lock(mAuthCacheMutex);
+      AuthCache::iterator it = mAuthCache.find(key);
+      if(it != mAuthCache.end() && Timer::getTimeMs() < it->second.expires)
+      {
+         AuthCacheEntry& entry = it->second;
+         mAuthCacheLru.splice(mAuthCacheLru.begin(), mAuthCacheLru, entry.lruPosition);
+         if(entry.a1.empty())
+         {
+            mAuthCacheNegativeHits++;
+         }
+         else
+         {
+            mAuthCacheHits++;
+         }
+         if(entry.refreshing || Timer::getTimeMs() < entry.refreshAt)
+         {
+            return entry.a1;
+         }
+         // Getting close to expiry - this request re-reads the db while
+         // everyone else keeps using the cached value, so that busy users
+         // never all miss at once
+         entry.refreshing = true;
+         mAuthCacheRefreshes++;
+      }
+      else
+      {
+         mAuthCacheMisses++;
+      }
+      generation = mAuthCacheGeneration;
+   }
+
+   Data a1 = mDb.getUserAuthInfo( key );
+
+   Lock lock(mAuthCacheMutex);
+   AuthCache::iterator it = mAuthCache.find(key);
+   UInt64 ttl = a1.empty() ? mAuthCacheNegativeTtl : mAuthCacheTtl;
+   if(generation != mAuthCacheGeneration || ttl == 0)
+   {
+      // A user was modified while we were reading, so a1 may already be
+      // stale - leave it for the next request to fetch
+      if(it != mAuthCache.end())
+      {
+         it->second.refreshing = false;
+      }
+      return a1;
+   }
+
+   if(it == mAuthCache.end())
+   {
+      mAuthCacheLru.push_front(key);
+      it = mAuthCache.insert(AuthCache::value_type(key, AuthCacheEntry())).first;
+      it->second.lruPosition = mAuthCacheLru.begin();
+      if(mAuthCache.size() > mAuthCacheMaxEntries)
+      {
+         mAuthCache.erase(mAuthCacheLru.back());
+         mAuthCacheLru.pop_back();
+         mAuthCacheEvictions++;
+      }
+   }
+   UInt64 now = Timer::getTimeMs();
+   AuthCacheEntry& entry = it->second;
+   entry.a1 = a1;
+   entry.expires = now + ttl;
+   entry.refreshAt = now + ttl * 3 / 4;
+   entry.refreshing = false;
+   return a1;
 }
 
 bool 
@@ -89,13 +173,20 @@ UserStore::addUser( const Data& username,
    rec.email = emailAddress;
    rec.forwardAddress = Data::Empty;
 
-   return mDb.addUser( buildKey(username,domain), rec);
+   bool ret = mDb.addUser( buildKey(username,domain), rec);
+   invalidateAuthCache(buildKey(username, domain));
+   if(realm != domain)
+   {
+      invalidateAuthCache(buildKey(username, realm));
+   }
+   return ret;
 }
 
 void 
 UserStore::eraseUser( const Key& key )
 { 
    mDb.eraseUser( key );
+   invalidateAuthCache(key);
 }
 
 bool
@@ -138,6 +229,64 @@ UserStore::buildKey( const resip::Data& user, const resip::Data& realm)
    return ret;
 }
 
+void
+UserStore::setAuthCacheParameters(unsigned int maxEntries, 
+                                  unsigned int ttlSecs, 
+                                  unsigned int negativeTtlSecs)
+{
+   Lock lock(mAuthCacheMutex);
+   mAuthCacheMaxEntries = ttlSecs > 0 || negativeTtlSecs > 0 ? maxEntries : 0;
+   mAuthCacheTtl = (UInt64)ttlSecs * 1000;
+   mAuthCacheNegativeTtl = (UInt64)negativeTtlSecs * 1000;
+   mAuthCacheGeneration++;
+   mAuthCache.clear();
+   mAuthCacheLru.clear();
+}
+
+void
+UserStore::clearAuthCache()
+{
+   Lock lock(mAuthCacheMutex);
+   mAuthCacheGeneration++;
+   mAuthCache.clear();
+   mAuthCacheLru.clear();
+}
+
+void
+UserStore::invalidateAuthCache(const Key& key)
+{
+   Lock lock(mAuthCacheMutex);
+   mAuthCacheGeneration++;
+   AuthCache::iterator it = mAuthCache.find(key);
+   if(it != mAuthCache.end())
+   {
+      mAuthCacheLru.erase(it->second.lruPosition);
+      mAuthCache.erase(it);
+   }
+}
+
+EncodeStream&
+UserStore::encodeAuthCacheStats(EncodeStream& strm) const
+{
+   Lock lock(mAuthCacheMutex);
+   if(mAuthCacheMaxEntries == 0)
+   {
+      strm << "disabled" << endl;
+   }
+   else
+   {
+      strm << "entries=" << mAuthCache.size() << " maxEntries=" << mAuthCacheMaxEntries << endl
+           << "ttl=" << mAuthCacheTtl / 1000 << "s negativeTtl=" << mAuthCacheNegativeTtl / 1000 << "s" << endl;
+   }
+   strm << "hits=" << mAuthCacheHits 
+        << " negativeHits=" << mAuthCacheNegativeHits
+        << " misses=" << mAuthCacheMisses 
+        << " refreshes=" << mAuthCacheRefreshes 
+        << " evictions=" << mAuthCacheEvictions << endl;
+   strm.flush();
+   return strm;
+}
+
 
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
@@ -1,8 +1,12 @@
 #if !defined(REPRO_USERSTORE_HXX)
 #define REPRO_USERSTORE_HXX
 
+#include <list>
+
 #include "rutil/Data.hxx"
 #include "rutil/Fifo.hxx"
+#include "rutil/HashMap.hxx"
+#include "rutil/Mutex.hxx"
 #include "resip/stack/Message.hxx"
 
 #include "repro/AbstractDb.hxx"
@@ -57,9 +61,47 @@ class UserStore
       
       static Key buildKey(const resip::Data& user, const resip::Data& domain);
 
+      // Caches the A1 hashes returned by getUserAuthInfo(), so that digest
+      // challenge responses don't each cost a database round trip.  Users that
+      // don't exist are remembered for negativeTtlSecs.  Entries are dropped
+      // when the user is modified through this UserStore; changes made to the
+      // database directly take up to ttlSecs to be seen.  A maxEntries of 0
+      // (the default) disables the cache.
+      void setAuthCacheParameters(unsigned int maxEntries, 
+                                  unsigned int ttlSecs, 
+                                  unsigned int negativeTtlSecs);
+      void clearAuthCache();
+      EncodeStream& encodeAuthCacheStats(EncodeStream& strm) const;
+
    private:
+      void invalidateAuthCache(const Key& key);
 
       AbstractDb& mDb;
+
+      class AuthCacheEntry
+      {
+         public:
+            resip::Data a1;          // empty if the user doesn't exist
+            UInt64 expires;          // ms
+            UInt64 refreshAt;        // ms - after this, the next hit re-reads the db
+            bool refreshing;
+            std::list<Key>::iterator lruPosition;
+      };
+      typedef HashMap<Key, AuthCacheEntry> AuthCache;
+
+      mutable resip::Mutex mAuthCacheMutex;
+      mutable AuthCache mAuthCache;
+      mutable std::list<Key> mAuthCacheLru;  // most recently used at the front
+      unsigned int mAuthCacheMaxEntries;
+      UInt64 mAuthCacheTtl;                  // ms
+      UInt64 mAuthCacheNegativeTtl;          // ms
+      unsigned int mAuthCacheGeneration;     // bumped whenever entries are invalidated
+
+      mutable UInt64 mAuthCacheHits;
+      mutable UInt64 mAuthCacheNegativeHits;
+      mutable UInt64 mAuthCacheMisses;
+      mutable UInt64 mAuthCacheRefreshes;
+      mutable UInt64 mAuthCacheEvictions;
 };
 
  }
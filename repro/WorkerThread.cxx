@@ -1,4 +1,5 @@
 #include "repro/WorkerThread.hxx"
+#include "repro/Dispatcher.hxx"
 
 #include "resip/stack/SipStack.hxx"
 #include "resip/stack/ApplicationMessage.hxx"
@@ -13,7 +14,20 @@ WorkerThread::WorkerThread(Worker* worker,
                         resip::TimeLimitFifo<resip::ApplicationMessage>& fifo,
                         resip::SipStack* stack):
    mWorker(worker),
-   mFifo(fifo),
+   mFifo(&fifo),
+   mDispatcher(0),
+   mIndex(0),
+   mStack(stack)
+{}
+
+WorkerThread::WorkerThread(Worker* worker,
+                        Dispatcher& dispatcher,
+                        unsigned int index,
+                        resip::SipStack* stack):
+   mWorker(worker),
+   mFifo(0),
+   mDispatcher(&dispatcher),
+   mIndex(index),
    mStack(stack)
 {}
 
@@ -34,7 +48,8 @@ WorkerThread::thread()
       mWorker->onStart();
       while(mWorker && !isShutdown())
       {
-         if( (msg=mFifo.getNext(100)) != 0 )
+         msg = mDispatcher ? mDispatcher->getNextWork(mIndex, 100) : mFifo->getNext(100);
+         if( msg != 0 )
          {
             queueToStack = mWorker->process(msg);
 
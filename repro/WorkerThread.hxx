@@ -13,18 +13,23 @@ class SipStack;
 
 namespace repro
 {
+class Dispatcher;
 
 class WorkerThread : public resip::ThreadIf
 {
 
    public:
       WorkerThread(Worker* impl,resip::TimeLimitFifo<resip::ApplicationMessage>& fifo,resip::SipStack* stack);
+      // Takes work from queue index of a WorkStealing Dispatcher
+      WorkerThread(Worker* impl,Dispatcher& dispatcher,unsigned int index,resip::SipStack* stack);
       virtual ~WorkerThread();
       void thread();
       
    protected:
       Worker* mWorker;
-      resip::TimeLimitFifo<resip::ApplicationMessage>& mFifo;
+      resip::TimeLimitFifo<resip::ApplicationMessage>* mFifo;
+      Dispatcher* mDispatcher;
+      unsigned int mIndex;
       resip::SipStack* mStack;
 
 };
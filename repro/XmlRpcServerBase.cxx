@@ -195,7 +195,10 @@ XmlRpcServerBase::process(FdSet& fdset)
             ConnectionMap::iterator it = mConnections.begin();
             for(; it != mConnections.end(); it++)
             {
-               it->second->sendEvent(responseInfo->getResponseData());
+               if(!responseInfo->getIsSelective() || wantsSelectiveEvent(it->first))
+               {
+                  it->second->sendEvent(responseInfo->getResponseData());
+               }
             }
          }
          else
@@ -263,6 +266,7 @@ XmlRpcServerBase::process(FdSet& fdset)
       bool ok = it->second->process(fdset);
       if (!ok)
       {
+         onConnectionClosed(it->first);
          delete it->second;
          mConnections.erase(it++);
       }
@@ -293,7 +297,8 @@ XmlRpcServerBase::sendResponse(unsigned int connectionId,
 
 void 
 XmlRpcServerBase::sendEvent(unsigned int connectionId,
-                            const Data& eventData)
+                            const Data& eventData,
+                            bool selective)
 {
 #ifdef BUILD_QPID_PROTON
    if(mQpidProtonThread.get())
@@ -302,7 +307,7 @@ XmlRpcServerBase::sendEvent(unsigned int connectionId,
       return;
    }
 #endif
-   mResponseFifo.add(new ResponseInfo(connectionId, 0 /* requestId */, eventData, true /* isFinal */));
+   mResponseFifo.add(new ResponseInfo(connectionId, 0 /* requestId */, eventData, true /* isFinal */, selective));
    mSelectInterruptor.interrupt();
 }
 
@@ -333,6 +338,7 @@ XmlRpcServerBase::closeOldestConnection()
          lowestConnectionIdIt = it;
       }
    }
+   onConnectionClosed(lowestConnectionIdIt->first);
    delete lowestConnectionIdIt->second;
    mConnections.erase(lowestConnectionIdIt);
 }
@@ -29,11 +29,13 @@ public:
    ResponseInfo(unsigned int connectionId,
                 unsigned int requestId,
                 const resip::Data& responseData,
-                bool isFinal) :
+                bool isFinal,
+                bool selective = false) :
       mConnectionId(connectionId),
       mRequestId(requestId),
       mResponseData(responseData),
-      mIsFinal(isFinal) {}
+      mIsFinal(isFinal),
+      mSelective(selective) {}
 
    ~ResponseInfo() {}
 
@@ -41,12 +43,14 @@ public:
    unsigned int getRequestId() const { return mRequestId; }
    const resip::Data& getResponseData() const { return mResponseData; }
    bool getIsFinal() const { return mIsFinal; }
+   bool getIsSelective() const { return mSelective; }
 
 private:
    unsigned int mConnectionId;
    unsigned int mRequestId;
    resip::Data mResponseData;
    bool mIsFinal;
+   bool mSelective;
 };
 
 class XmlRpcServerBase
@@ -70,9 +74,11 @@ public:
                      const resip::Data& responseData,
                      bool isFinal=true);
 
-   // thread safe - uses fifo (use connectionId == 0 to send to all connections)
+   // thread safe - uses fifo (use connectionId == 0 to send to all connections,
+   // or with selective set, to those that wantsSelectiveEvent() accepts)
    void sendEvent(unsigned int connectionId,
-                  const resip::Data& eventData);
+                  const resip::Data& eventData,
+                  bool selective=false);
 
    resip::SharedPtr<resip::ThreadIf> getThread();
 
@@ -80,6 +86,9 @@ protected:
    virtual void handleRequest(unsigned int connectionId, 
                               unsigned int requestId, 
                               const resip::Data& request) = 0; 
+   virtual void onConnectionClosed(unsigned int connectionId) {}
+   // Called from the server's thread, when a selective event is sent to all connections
+   virtual bool wantsSelectiveEvent(unsigned int connectionId) { return true; }
       
 private:
    static const unsigned int MaxConnections = 60;   // Note:  use caution if making this any bigger, default fd_set size in windows is 64
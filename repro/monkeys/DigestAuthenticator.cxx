@@ -411,8 +411,9 @@ DigestAuthenticator::requestUserAuthInfo(repro::RequestContext &rc, resip::Data
 Processor::processor_action_t
 DigestAuthenticator::requestUserAuthInfo(RequestContext &rc, const Auth& auth, UserInfoMessage *userInfo)
 {
+   Data affinityKey(userInfo->user() + "@" + userInfo->realm());
    std::auto_ptr<ApplicationMessage> app(userInfo);
-   mAuthRequestDispatcher->post(app);
+   mAuthRequestDispatcher->post(app, affinityKey);
    return WaitingForEvent;
 }
 
@@ -139,7 +139,7 @@ LocationServer::process(RequestContext& context)
          async->realm() = inputUri.host();
          async->domain() = inputUri.host();
          std::auto_ptr<ApplicationMessage> app(async);
-         mUserInfoDispatcher->post(app);
+         mUserInfoDispatcher->post(app, inputUri.user() + "@" + inputUri.host());
          return WaitingForEvent;
       }
    }
@@ -48,6 +48,10 @@ main (int argc, char** argv)
       cerr << "  /GetCongestionStats - retrieves the stacks congestion manager stats and state" << endl;
       cerr << "  /SetCongestionTolerance metric=<SIZE|WAIT_TIME|TIME_DEPTH> maxTolerance=<value>" << endl;
       cerr << "                          [fifoDescription=<desc>] - sets congestion tolerances" << endl;
+      cerr << "  /GetUserAuthCacheStats - retrieves the size and hit/miss counters of the user auth cache" << endl;
+      cerr << "  /ClearUserAuthCache - empties the user auth cache" << endl;
+      cerr << "  /GetDispatcherStats - retrieves the queue depth and queue latency histogram of the" << endl;
+      cerr << "                        worker thread pools" << endl;
       cerr << "  /Shutdown - signal the proxy to shut down." << endl;
       cerr << "  /Restart - signal the proxy to restart - leaving active registrations in place." << endl;
       cerr << "  /GetProxyConfig - retrieves the all of configuration file settings currently" << endl;
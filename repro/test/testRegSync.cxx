@@ -0,0 +1,370 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+
+#include "repro/RegSyncClient.hxx"
+#include "repro/RegSyncServer.hxx"
+#include "repro/RegSyncServerThread.hxx"
+#include "resip/dum/InMemorySyncRegDb.hxx"
+#include "resip/stack/NameAddr.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "resip/stack/Uri.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Socket.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks the binary registration encoding against the XML one, then runs a
+// RegSyncServer and an incremental RegSyncClient over loopback: initial sync,
+// batched (and unbatched) changes, changes to a peer that has not synced, and
+// catch-up from a sequence number after a reconnect.
+
+namespace
+{
+
+int Port = 25093;
+const unsigned int Aors = 2000;
+
+Uri
+aor(unsigned int i)
+{
+   return Uri("sip:user" + Data(i) + "@example.com");
+}
+
+ContactInstanceRecord
+contact(unsigned int i, unsigned int instance)
+{
+   ContactInstanceRecord rec;
+   rec.mContact = NameAddr("<sip:user" + Data(i) + "@192.0.2." + Data(instance % 250 + 1) + ":5060;transport=tcp>;+sip.instance=\"<urn:uuid:" + Data(i) + ">\"");
+   rec.mRegExpires = Timer::getTimeSecs() + 3600;
+   rec.mLastUpdated = Timer::getTimeSecs() - 10;
+   rec.mReceivedFrom = Tuple("192.0.2." + Data(instance % 250 + 1), 40000 + i % 20000, V4, TCP);
+   rec.mPublicAddress = Tuple("198.51.100.1", 5060, V4, UDP);
+   rec.mSipPath.push_back(NameAddr("<sip:edge" + Data(i % 4) + ".example.net;lr>"));
+   rec.mInstance = "<urn:uuid:" + Data(i) + ">";
+   rec.mRegId = instance;
+   return rec;
+}
+
+void
+registerContact(InMemorySyncRegDb& db, unsigned int i, unsigned int instance)
+{
+   db.lockRecord(aor(i));
+   db.updateContact(aor(i), contact(i, instance));
+   db.unlockRecord(aor(i));
+}
+
+void
+checkEncoding()
+{
+   ContactList contacts;
+   contacts.push_back(contact(7, 1));
+   contacts.push_back(contact(7, 2));
+   ContactInstanceRecord staticContact = contact(7, 3);
+   staticContact.mRegExpires = NeverExpire;
+   contacts.push_back(staticContact);
+
+   Data buffer;
+   assert(RegSyncServer::encodeRegInfoBinary(buffer, aor(7), contacts));
+   assert(RegSyncServer::encodeRegInfoBinary(buffer, aor(8), contacts));
+   Data::size_type pos = 0;
+   Uri decodedAor;
+   ContactList decoded;
+   assert(RegSyncServer::decodeRegInfoBinary(buffer, pos, decodedAor, decoded));
+   assert(decodedAor == aor(7));
+   assert(decoded.size() == 2);  // static contacts are not replicated
+   ContactList::iterator it = decoded.begin();
+   for(ContactList::iterator orig = contacts.begin(); it != decoded.end(); it++, orig++)
+   {
+      assert(*it == *orig);
+      assert(it->mRegExpires == orig->mRegExpires && it->mLastUpdated == orig->mLastUpdated);
+      assert(it->mReceivedFrom == orig->mReceivedFrom && it->mReceivedFrom.getType() == TCP);
+      assert(it->mPublicAddress == orig->mPublicAddress);
+      assert(it->mSipPath.size() == 1 && it->mSipPath.front().uri() == orig->mSipPath.front().uri());
+      assert(it->mInstance == orig->mInstance && it->mRegId == orig->mRegId);
+      assert(it->mSyncContact);
+   }
+   assert(RegSyncServer::decodeRegInfoBinary(buffer, pos, decodedAor, decoded));
+   assert(decodedAor == aor(8) && pos == buffer.size());
+
+   // A truncated record is rejected rather than half applied
+   pos = 0;
+   decoded.clear();
+   assert(!RegSyncServer::decodeRegInfoBinary(buffer.substr(0, buffer.size() / 2 - 1), pos, decodedAor, decoded));
+
+   ContactList onlyStatic;
+   onlyStatic.push_back(staticContact);
+   Data empty;
+   assert(!RegSyncServer::encodeRegInfoBinary(empty, aor(7), onlyStatic) && empty.empty());
+
+   // Size of a full sync of the test database in either encoding
+   Data xml;
+   Data binary;
+   {
+      oDataStream ds(xml);
+      for(unsigned int i = 0; i < Aors; i++)
+      {
+         ContactList single;
+         single.push_back(contact(i, 1));
+         RegSyncServer::encodeRegInfoXml(ds, aor(i), single);
+         RegSyncServer::encodeRegInfoBinary(binary, aor(i), single);
+      }
+   }
+   cout << Aors << " AORs: " << xml.size() << " bytes as XML, " << binary.size() << " bytes binary ("
+        << binary.base64encode().size() << " base64 encoded)" << endl;
+   assert(binary.base64encode().size() < xml.size() / 2);
+}
+
+bool
+waitForAors(InMemorySyncRegDb& db, unsigned int aors)
+{
+   for(unsigned int wait = 0; wait < 200; wait++)
+   {
+      RegistrationPersistenceManager::UriList found;
+      db.getAors(found);
+      if(found.size() == aors)
+      {
+         return true;
+      }
+      sleepMs(50);
+   }
+   return false;
+}
+
+bool
+waitFor(InMemorySyncRegDb& db, unsigned int i, unsigned int contacts)
+{
+   for(unsigned int wait = 0; wait < 200; wait++)
+   {
+      ContactList found;
+      db.getContacts(aor(i), found);
+      if(found.size() == contacts)
+      {
+         return true;
+      }
+      sleepMs(50);
+   }
+   return false;
+}
+
+Socket
+connectToServer()
+{
+   Socket fd = ::socket(PF_INET, SOCK_STREAM, 0);
+   Tuple server("127.0.0.1", Port, V4, TCP);
+   int rc = ::connect(fd, &server.getMutableSockaddr(), server.length());
+   assert(rc == 0);
+   return fd;
+}
+
+// Reads from fd until text turns up
+bool
+waitForText(Socket fd, const Data& text)
+{
+   Data received;
+   char buffer[8000];
+   while(received.find(text) == Data::npos)
+   {
+      FdSet fdset;
+      fdset.setRead(fd);
+      if(fdset.selectMilliSeconds(5000) <= 0)
+      {
+         return false;
+      }
+      int rc = ::recv(fd, buffer, sizeof(buffer), 0);
+      if(rc <= 0)
+      {
+         return false;
+      }
+      received.append(buffer, rc);
+   }
+   return true;
+}
+
+// Sends InitialSync the way an incremental RegSyncClient does, and returns
+// the number of AORs in the binary batches that come back before the response
+unsigned int
+initialSync(UInt64 epoch, UInt64 sequence, Data& response)
+{
+   Socket fd = connectToServer();
+   Data request("<InitialSync>\r\n  <Request>\r\n     <Version>" + Data(REGSYNC_VERSION) + "</Version>\r\n"
+                "     <Epoch>" + Data(epoch) + "</Epoch>\r\n     <Sequence>" + Data(sequence) + "</Sequence>\r\n"
+                "     <Encoding>binary</Encoding>\r\n  </Request>\r\n</InitialSync>\r\n");
+   int rc = ::send(fd, request.c_str(), (int)request.size(), 0);
+   assert(rc == (int)request.size());
+
+   Data received;
+   char buffer[8000];
+   while(received.find("</InitialSync>") == Data::npos)
+   {
+      FdSet fdset;
+      fdset.setRead(fd);
+      rc = fdset.selectMilliSeconds(5000);
+      assert(rc > 0);
+      rc = ::recv(fd, buffer, sizeof(buffer), 0);
+      assert(rc > 0);
+      received.append(buffer, rc);
+   }
+   closeSocket(fd);
+
+   unsigned int aors = 0;
+   Data::size_type start = 0;
+   while((start = received.find("<records>", start)) != Data::npos)
+   {
+      start += 9;
+      Data records = received.substr(start, received.find("</records>", start) - start).base64decode();
+      Data::size_type pos = 0;
+      while(pos < records.size())
+      {
+         Uri decodedAor;
+         ContactList decoded;
+         assert(RegSyncServer::decodeRegInfoBinary(records, pos, decodedAor, decoded));
+         aors++;
+      }
+   }
+   response = received.substr(received.find("<Response>"));
+   return aors;
+}
+
+void
+checkSync(unsigned int batchIntervalMs)
+{
+   InMemorySyncRegDb serverDb(86400);
+   InMemorySyncRegDb clientDb(86400);
+   InMemorySyncRegDb legacyClientDb(86400);
+   for(unsigned int i = 0; i < Aors; i++)
+   {
+      registerContact(serverDb, i, 1);
+   }
+
+   RegSyncServer server(&serverDb, Port, V4);
+   assert(server.isSane());
+   server.setBatchIntervalMs(batchIntervalMs);
+   std::list<RegSyncServer*> servers;
+   servers.push_back(&server);
+   RegSyncServerThread serverThread(servers);
+   serverThread.run();
+
+   {
+      RegSyncClient client(&clientDb, "127.0.0.1", Port, 0, true /* incremental */, true /* binaryEncoding */);
+      client.run();
+      // Peers that don't ask for incremental sync still get a full XML sync
+      RegSyncClient legacyClient(&legacyClientDb, "127.0.0.1", Port);
+      legacyClient.run();
+
+      // Initial sync, then a change that arrives in a batch
+      assert(waitForAors(clientDb, Aors));
+      assert(waitForAors(legacyClientDb, Aors));
+      registerContact(serverDb, 5, 2);
+      registerContact(serverDb, 5, 3);
+      assert(waitFor(clientDb, 5, 3));
+      assert(waitFor(legacyClientDb, 5, 3));
+
+      // A peer that is connected but has not sent InitialSync yet still gets
+      // each change, as it did before incremental sync
+      Socket unsynced = connectToServer();
+      sleepMs(200);
+      registerContact(serverDb, 6, 2);
+      assert(waitForText(unsynced, "user6@example.com"));
+      closeSocket(unsynced);
+      assert(waitFor(clientDb, 6, 2));
+
+      client.shutdown();
+      client.join();
+      legacyClient.shutdown();
+      legacyClient.join();
+   }
+
+   // A peer that has seen everything up to sequence only gets what changed since
+   UInt64 sequence = serverDb.getSequence();
+   for(unsigned int i = 100; i < 110; i++)
+   {
+      registerContact(serverDb, i, 2);
+   }
+   Data response;
+   assert(initialSync(serverDb.getEpoch(), sequence, response) == 10);
+   assert(response.find("<Sequence>" + Data(serverDb.getSequence()) + "</Sequence>") != Data::npos);
+   assert(response.find("Code=\"200\"") != Data::npos);
+   assert(initialSync(serverDb.getEpoch(), serverDb.getSequence(), response) == 0);
+
+   // A different epoch means a different database - everything is sent
+   assert(initialSync(serverDb.getEpoch() + 1, sequence, response) == Aors);
+
+   serverThread.shutdown();
+   serverThread.join();
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+   initNetwork();
+
+   checkEncoding();
+   checkSync(50);
+   // Every change sent at once, except while an initial sync is being sent
+   Port++;
+   checkSync(0);
+
+   cout << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ */
@@ -0,0 +1,229 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "repro/AbstractDb.hxx"
+#include "repro/RouteStore.hxx"
+#include "resip/stack/Uri.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Times RouteStore::process() over synthetic route tables shaped like a
+// carrier deployment: mostly E.164 digit prefixes, some per-domain routes,
+// some exact matches and a few patterns with no literal anchor at all.
+// The table size defaults to 10k routes; pass sizes in argv to time larger
+// tables (adding 100k routes takes minutes).
+
+namespace
+{
+
+// Keeps nothing - RouteStore holds its own copy of every route
+class NullDb : public AbstractDb
+{
+   public:
+      virtual bool isSane() { return true; }
+      virtual bool dbWriteRecord(const Table table, const Data& key, const Data& data) { return true; }
+      virtual bool dbReadRecord(const Table table, const Data& key, Data& data) const { return false; }
+      virtual void dbEraseRecord(const Table table, const Data& key, bool isSecondaryKey=false) {}
+      virtual Data dbNextKey(const Table table, bool first=false) { return Data::Empty; }
+      virtual bool dbNextRecord(const Table table, const Data& key, Data& data, bool forUpdate, bool first=false) { return false; }
+      virtual bool dbBeginTransaction(const Table table) { return true; }
+      virtual bool dbCommitTransaction(const Table table) { return true; }
+      virtual bool dbRollbackTransaction(const Table table) { return true; }
+};
+
+Data
+e164Prefix(unsigned int i)
+{
+   // 1 + 7 digits, distinct for every route
+   return "1" + Data(2000000 + i * 7 % 8000000);
+}
+
+void
+buildRoutes(RouteStore& store, unsigned int routes)
+{
+   for(unsigned int i = 0; i < routes; i++)
+   {
+      Data method(i % 3 ? "INVITE" : "");
+      switch(i % 10)
+      {
+         case 0: case 1: case 2: case 3: case 4: case 5:
+            store.addRoute(method, Data::Empty, "^sip:" + e164Prefix(i) + "([0-9]*)@", "sip:" + e164Prefix(i) + "$1@gw" + Data(i % 16) + ".example.net", 10);
+            break;
+         case 6: case 7:
+            store.addRoute(method, Data::Empty, "^sip:(.*)@domain" + Data(i) + "\\.example\\.com$", "sip:$1@proxy" + Data(i % 16) + ".example.net", 20);
+            break;
+         case 8:
+            store.addRoute(method, Data::Empty, "^sip:user" + Data(i) + "@example\\.com$", "sip:voicemail@vm.example.net", 5);
+            break;
+         default:
+            if(i % 1000 == 9)
+            {
+               // Unanchored - must be run against every request
+               store.addRoute(method, Data::Empty, "emergency" + Data(i) + "[0-9]+@", "sip:psap@example.net", 1);
+            }
+            else
+            {
+               store.addRoute(method, "presence", "^sip:(.*)@presence" + Data(i) + "\\.example\\.com$", "sip:$1@pres.example.net", 30);
+            }
+            break;
+      }
+   }
+}
+
+void
+checkRoutes(RouteStore& store)
+{
+   RouteStore::UriList targets = store.process(Uri("sip:" + e164Prefix(0) + "4444@example.com"), "INVITE", Data::Empty);
+   assert(targets.size() == 1);
+   assert(targets[0] == Uri("sip:" + e164Prefix(0) + "4444@gw0.example.net"));
+
+   targets = store.process(Uri("sip:bob@domain6.example.com"), "INVITE", Data::Empty);
+   assert(targets.size() == 1);
+   assert(targets[0].user() == "bob" && targets[0].host() == "proxy6.example.net");
+
+   targets = store.process(Uri("sip:bob@domain6.example.com.evil"), "INVITE", Data::Empty);
+   assert(targets.empty());
+
+   targets = store.process(Uri("sip:user8@example.com"), "INVITE", Data::Empty);
+   assert(targets.size() == 1 && targets[0].host() == "vm.example.net");
+
+   targets = store.process(Uri("sip:user18@example.com"), "MESSAGE", Data::Empty);
+   assert(targets.size() == 1);  // route 18 has no method
+
+   targets = store.process(Uri("sip:user8@example.com"), "MESSAGE", Data::Empty);
+   assert(targets.empty());  // route 8 is INVITE only
+
+   // Order of the results follows route order, not index order
+   targets = store.process(Uri("sip:emergency91@domain6.example.com"), "INVITE", Data::Empty);
+   assert(targets.size() == 2);
+   assert(targets[0].host() == "example.net" && targets[1].host() == "proxy6.example.net");
+
+   targets = store.process(Uri("sip:nobody@nowhere.example.org"), "INVITE", Data::Empty);
+   assert(targets.empty());
+}
+
+void
+timeRoutes(unsigned int routes)
+{
+   NullDb db;
+   RouteStore store(db);
+   UInt64 start = Timer::getTimeMs();
+   buildRoutes(store, routes);
+   UInt64 built = Timer::getTimeMs();
+
+   checkRoutes(store);
+
+   vector<Uri> requests;
+   for(unsigned int i = 0; i < 200; i++)
+   {
+      unsigned int route = (i * 7919) % routes;
+      if(i % 2)
+      {
+         requests.push_back(Uri("sip:" + e164Prefix(route - route % 10) + "5551234@example.com"));
+      }
+      else
+      {
+         requests.push_back(Uri("sip:alice@domain" + Data(route - route % 10 + 6) + ".example.com"));
+      }
+   }
+
+   const unsigned int passes = routes > 20000 ? 1 : 10;
+   unsigned int found = 0;
+   UInt64 checked = Timer::getTimeMs();
+   for(unsigned int pass = 0; pass < passes; pass++)
+   {
+      for(vector<Uri>::const_iterator it = requests.begin(); it != requests.end(); it++)
+      {
+         found += (unsigned int)store.process(*it, "INVITE", Data::Empty).size();
+      }
+   }
+   UInt64 done = Timer::getTimeMs();
+   assert(found >= passes * requests.size());
+
+   cout << routes << " routes added in " << (built - start) << " ms, "
+        << passes * requests.size() << " requests routed in " << (done - checked) << " ms ("
+        << (double)(done - checked) * 1000.0 / (passes * requests.size()) << " us each)" << endl;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   vector<unsigned int> sizes;
+   for(int i = 1; i < argc; i++)
+   {
+      sizes.push_back(atoi(argv[i]));
+   }
+   if(sizes.empty())
+   {
+      sizes.push_back(10000);
+   }
+
+   for(vector<unsigned int>::const_iterator it = sizes.begin(); it != sizes.end(); it++)
+   {
+      timeRoutes(*it);
+   }
+
+   cout << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ */
@@ -0,0 +1,169 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <iostream>
+#include <map>
+
+#include "repro/AbstractDb.hxx"
+#include "repro/UserStore.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Time.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+namespace
+{
+
+// Users held in a map, counting the auth lookups that reach the "database"
+class CountingDb : public AbstractDb
+{
+   public:
+      CountingDb() : mAuthLookups(0) {}
+
+      virtual bool isSane() { return true; }
+      virtual bool addUser(const Key& key, const UserRecord& rec) { mUsers[key] = rec.passwordHash; return true; }
+      virtual void eraseUser(const Key& key) { mUsers.erase(key); }
+      virtual Data getUserAuthInfo(const Key& key) const
+      {
+         mAuthLookups++;
+         map<Key, Data>::const_iterator it = mUsers.find(key);
+         return it == mUsers.end() ? Data::Empty : it->second;
+      }
+
+      virtual bool dbWriteRecord(const Table table, const Data& key, const Data& data) { return true; }
+      virtual bool dbReadRecord(const Table table, const Data& key, Data& data) const { return false; }
+      virtual void dbEraseRecord(const Table table, const Data& key, bool isSecondaryKey=false) {}
+      virtual Data dbNextKey(const Table table, bool first=false) { return Data::Empty; }
+      virtual bool dbNextRecord(const Table table, const Data& key, Data& data, bool forUpdate, bool first=false) { return false; }
+      virtual bool dbBeginTransaction(const Table table) { return true; }
+      virtual bool dbCommitTransaction(const Table table) { return true; }
+      virtual bool dbRollbackTransaction(const Table table) { return true; }
+
+      map<Key, Data> mUsers;
+      mutable unsigned int mAuthLookups;
+};
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   CountingDb db;
+   UserStore store(db);
+   store.addUser("alice", "example.com", "example.com", "a1-alice", false, "Alice", "alice@example.com");
+   store.addUser("bob", "example.com", "example.com", "a1-bob", false, "Bob", "bob@example.com");
+
+   // Disabled by default - every lookup goes to the db
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice");
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice");
+   assert(db.mAuthLookups == 2);
+
+   store.setAuthCacheParameters(2, 2, 2);
+   db.mAuthLookups = 0;
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice");
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice");
+   assert(db.mAuthLookups == 1);
+
+   // Unknown users are cached too
+   assert(store.getUserAuthInfo("mallory", "example.com").empty());
+   assert(store.getUserAuthInfo("mallory", "example.com").empty());
+   assert(db.mAuthLookups == 2);
+
+   // Modifying a user through the store drops its cached credentials
+   store.updateUser(UserStore::buildKey("alice", "example.com"), "alice", "example.com", "example.com", "a1-alice2", false, "Alice", "alice@example.com");
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice2");
+   assert(db.mAuthLookups == 3);
+   store.addUser("mallory", "example.com", "example.com", "a1-mallory", false, "Mallory", "mallory@example.com");
+   assert(store.getUserAuthInfo("mallory", "example.com") == "a1-mallory");
+   assert(db.mAuthLookups == 4);
+   store.eraseUser(UserStore::buildKey("mallory", "example.com"));
+   assert(store.getUserAuthInfo("mallory", "example.com").empty());
+   assert(db.mAuthLookups == 5);
+
+   // Changes made behind the store's back are seen once the entry expires;
+   // in the last quarter of its lifetime one hit re-reads it
+   db.mUsers[UserStore::buildKey("alice", "example.com")] = "a1-alice3";
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice2");
+   sleepMs(1700);
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice3");
+   assert(db.mAuthLookups == 6);
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice3");
+   assert(db.mAuthLookups == 6);
+
+   // The least recently used entry is evicted to make room
+   assert(store.getUserAuthInfo("bob", "example.com") == "a1-bob");
+   assert(store.getUserAuthInfo("carol", "example.com").empty());
+   assert(db.mAuthLookups == 8);
+   assert(store.getUserAuthInfo("carol", "example.com").empty());
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice3");
+   assert(db.mAuthLookups == 9);
+
+   store.clearAuthCache();
+   assert(store.getUserAuthInfo("alice", "example.com") == "a1-alice3");
+   assert(db.mAuthLookups == 10);
+
+   Data stats;
+   {
+      DataStream strm(stats);
+      store.encodeAuthCacheStats(strm);
+   }
+   cout << stats;
+   assert(stats.find("evictions=3") != Data::npos);
+
+   cout << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ */
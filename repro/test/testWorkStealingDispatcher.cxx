@@ -0,0 +1,253 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "repro/Dispatcher.hxx"
+#include "repro/Worker.hxx"
+#include "resip/stack/ApplicationMessage.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Time.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Pushes lookups shaped like auth grabber traffic through a Dispatcher in
+// each queue mode: several threads posting, mostly quick lookups and the
+// odd slow one (a stalled database query).  Checks that every message is
+// processed, and in WorkStealing mode that messages with the same affinity
+// key stay on one thread while it keeps up.
+
+namespace
+{
+
+const unsigned int Workers = 4;
+const unsigned int Posters = 4;
+const unsigned int Users = 64;
+
+class LookupMessage : public ApplicationMessage
+{
+   public:
+      LookupMessage(unsigned int user, bool slow) : mUser(user), mSlow(slow) {}
+      virtual Message* clone() const { return new LookupMessage(*this); }
+      virtual EncodeStream& encode(EncodeStream& strm) const { return strm << "LookupMessage(" << mUser << ")"; }
+      virtual EncodeStream& encodeBrief(EncodeStream& strm) const { return encode(strm); }
+
+      unsigned int mUser;
+      bool mSlow;
+};
+
+class Results
+{
+   public:
+      Results() : mProcessed(0), mAffinityMisses(0) {}
+
+      Mutex mMutex;
+      unsigned int mProcessed;
+      unsigned int mAffinityMisses;     // lookups for a user not on the thread of its last lookup
+      map<unsigned int, const void*> mLastThread;
+};
+
+class LookupWorker : public Worker
+{
+   public:
+      LookupWorker(Results& results) : mResults(results) {}
+
+      virtual bool process(ApplicationMessage* msg)
+      {
+         LookupMessage* lookup = dynamic_cast<LookupMessage*>(msg);
+         assert(lookup);
+         if(lookup->mSlow)
+         {
+            sleepMs(10);
+         }
+         else
+         {
+            // A quick indexed query
+            volatile unsigned int spin = 0;
+            for(unsigned int i = 0; i < 20000; i++)
+            {
+               spin += i;
+            }
+         }
+
+         Lock lock(mResults.mMutex);
+         mResults.mProcessed++;
+         map<unsigned int, const void*>::iterator it = mResults.mLastThread.find(lookup->mUser);
+         if(it != mResults.mLastThread.end() && it->second != this)
+         {
+            mResults.mAffinityMisses++;
+         }
+         mResults.mLastThread[lookup->mUser] = this;
+         return false;
+      }
+
+      virtual Worker* clone() const { return new LookupWorker(mResults); }
+
+   private:
+      Results& mResults;
+};
+
+class Poster : public ThreadIf
+{
+   public:
+      Poster(Dispatcher& dispatcher, unsigned int id, unsigned int count) : 
+         mDispatcher(dispatcher), mId(id), mCount(count) {}
+
+      virtual void thread()
+      {
+         for(unsigned int i = 0; i < mCount; i++)
+         {
+            unsigned int user = (i * 7 + mId * 13) % Users;
+            std::auto_ptr<ApplicationMessage> msg(new LookupMessage(user, i % 100 == 0));
+            bool posted = mDispatcher.post(msg, "user" + Data(user) + "@example.com");
+            assert(posted);
+            if(i % 16 == 0)
+            {
+               sleepMs(1);
+            }
+         }
+      }
+
+   private:
+      Dispatcher& mDispatcher;
+      unsigned int mId;
+      unsigned int mCount;
+};
+
+void
+run(Dispatcher::QueueMode mode, unsigned int perPoster)
+{
+   Results results;
+   Dispatcher dispatcher(std::auto_ptr<Worker>(new LookupWorker(results)), 0, Workers, true, mode);
+   assert(dispatcher.queueMode() == mode);
+
+   UInt64 start = Timer::getTimeMs();
+   vector<Poster*> posters;
+   for(unsigned int i = 0; i < Posters; i++)
+   {
+      posters.push_back(new Poster(dispatcher, i, perPoster));
+      posters.back()->run();
+   }
+   for(unsigned int i = 0; i < Posters; i++)
+   {
+      posters[i]->join();
+      delete posters[i];
+   }
+   while(true)
+   {
+      {
+         Lock lock(results.mMutex);
+         if(results.mProcessed == Posters * perPoster)
+         {
+            break;
+         }
+      }
+      sleepMs(1);
+   }
+   UInt64 done = Timer::getTimeMs();
+   assert(dispatcher.fifoCountDepth() == 0);
+
+   vector<UInt64> latency;
+   dispatcher.getQueueLatencyHistogram(latency);
+   UInt64 measured = 0;
+   for(unsigned int i = 0; i < latency.size(); i++)
+   {
+      measured += latency[i];
+   }
+
+   cout << (mode == Dispatcher::WorkStealing ? "WorkStealing" : "SharedQueue ") << ": " 
+        << results.mProcessed << " messages in " << (done - start) << " ms, " 
+        << results.mAffinityMisses << " on a different thread to the user's previous lookup" << endl;
+   if(mode == Dispatcher::WorkStealing)
+   {
+      assert(measured == results.mProcessed);
+      // Most lookups for a user stay on its thread
+      assert(results.mAffinityMisses < results.mProcessed / 4);
+      cout << "  queue latency: ";
+      dispatcher.encodeQueueLatencyHistogram(cout);
+      cout << endl;
+   }
+   else
+   {
+      assert(measured == 0);
+   }
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   // Workers with no stack warn about every message they discard
+   Log::initialize(Log::Cout, Log::Err, argv[0]);
+
+   unsigned int perPoster = 5000;
+   if(argc > 1)
+   {
+      perPoster = atoi(argv[1]);
+   }
+
+   run(Dispatcher::SharedQueue, perPoster);
+   run(Dispatcher::WorkStealing, perPoster);
+
+   cout << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ */
@@ -1,4 +1,6 @@
 #include "resip/dum/InMemorySyncRegDb.hxx"
+#include "rutil/AtomicOps.hxx"
+#include "rutil/Random.hxx"
 #include "rutil/Timer.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/WinLeakCheck.hxx"
@@ -53,19 +55,39 @@ contactsRemoveIfRequired(ContactList& contacts, UInt64& now,
 #endif
 }
 
-InMemorySyncRegDb::InMemorySyncRegDb(unsigned int removeLingerSecs) : 
-   mRemoveLingerSecs(removeLingerSecs)
+InMemorySyncRegDb::InMemorySyncRegDb(unsigned int removeLingerSecs, unsigned int shards) : 
+   mRemoveLingerSecs(removeLingerSecs),
+   mHandlerCount(0),
+   mSequence(0),
+   mEpoch(((UInt64)(unsigned int)Random::getRandom() << 32) ^ (unsigned int)Random::getRandom() ^ Timer::getTimeMs())
 {
+   for(unsigned int i = 0; i < resipMax(shards, 1u); i++)
+   {
+      mShards.push_back(new Shard);
+   }
 }
 
 InMemorySyncRegDb::~InMemorySyncRegDb()
 {
-   for( database_map_t::const_iterator it = mDatabase.begin();
-        it != mDatabase.end(); it++)
+   for(std::vector<Shard*>::iterator shard = mShards.begin(); shard != mShards.end(); shard++)
    {
-      delete it->second;
+      for( database_map_t::const_iterator it = (*shard)->mDatabase.begin();
+           it != (*shard)->mDatabase.end(); it++)
+      {
+         delete it->second.mContacts;
+      }
+      delete *shard;
    }
-   mDatabase.clear();
+   mShards.clear();
+}
+
+InMemorySyncRegDb::Shard&
+InMemorySyncRegDb::getShard(const Uri& aor)
+{
+   // Only the user part is hashed: AORs that compare equal must land on the
+   // same shard, and Uri ordering compares hosts case-insensitively and
+   // IPv6 addresses canonicalized
+   return *mShards[aor.user().hash() % mShards.size()];
 }
 
 void 
@@ -73,6 +95,7 @@ InMemorySyncRegDb::addHandler(InMemorySyncRegDbHandler* handler)
 { 
    Lock lock(mHandlerMutex);
    mHandlers.push_back(handler); 
+   atomicAdd(&mHandlerCount, 1);
 }
 
 void 
@@ -84,54 +107,85 @@ InMemorySyncRegDb::removeHandler(InMemorySyncRegDbHandler* handler)
        if(*it == handler)
        {
            mHandlers.erase(it);
+           atomicAdd(&mHandlerCount, -1);
            break;
        }
    }
 }
 
 void 
-InMemorySyncRegDb::invokeOnAorModified(bool sync, const resip::Uri& aor, const ContactList& contacts)
+InMemorySyncRegDb::invokeOnAorModified(bool sync, const resip::Uri& aor, AorRecord& record, const ContactList& contacts)
 {
+   if(atomicLoad(&mHandlerCount) == 0)
+   {
+      // Nobody to call, so writers to different shards need not wait for each
+      // other. A handler added later picks this change up from initialSync(),
+      // which reads the record under the shard lock we hold.
+      record.mSequence = atomicAdd(&mSequence, 1);
+      return;
+   }
+
    Lock lock(mHandlerMutex);
+   // Numbered under the same lock as the callbacks so that handlers see
+   // sequence numbers in increasing order
+   record.mSequence = atomicAdd(&mSequence, 1);
    for(HandlerList::iterator it = mHandlers.begin(); it != mHandlers.end(); it++)
    {
       // If handler mode is all, then send notification, otherwise handler mode is sync and we check the passed
       // in sync flag
       if (sync || (*it)->getMode() == InMemorySyncRegDbHandler::AllChanges)
       {
-         (*it)->onAorModified(aor, contacts);
+         (*it)->onAorModified(aor, contacts, record.mSequence);
       }
    }
 }
 
 void
-InMemorySyncRegDb::invokeOnInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts)
+InMemorySyncRegDb::invokeOnInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts, UInt64 sequence)
 {
    Lock lock(mHandlerMutex);
    for (HandlerList::iterator it = mHandlers.begin(); it != mHandlers.end(); it++)
    {
       if ((*it)->getMode() == InMemorySyncRegDbHandler::SyncServer)
       {
-         (*it)->onInitialSyncAor(connectionId, aor, contacts);
+         (*it)->onInitialSyncAor(connectionId, aor, contacts, sequence);
       }
    }
 }
 
+UInt64
+InMemorySyncRegDb::getSequence()
+{
+   return atomicLoad(&mSequence);
+}
+
 void 
 InMemorySyncRegDb::initialSync(unsigned int connectionId)
 {
-   Lock g(mDatabaseMutex);
+   initialSync(connectionId, 0);
+}
+
+void 
+InMemorySyncRegDb::initialSync(unsigned int connectionId, UInt64 fromSequence)
+{
    UInt64 now = Timer::getTimeSecs();
-   for(database_map_t::iterator it = mDatabase.begin(); it != mDatabase.end(); it++)
+   for(std::vector<Shard*>::iterator shard = mShards.begin(); shard != mShards.end(); shard++)
    {
-      if(it->second)
+      Lock g((*shard)->mDatabaseMutex);
+      for(database_map_t::iterator it = (*shard)->mDatabase.begin(); it != (*shard)->mDatabase.end(); it++)
       {
-         ContactList& contacts = *(it->second);
-         if(mRemoveLingerSecs > 0) 
+         if(it->second.mContacts)
          {
-            contactsRemoveIfRequired(contacts, now, mRemoveLingerSecs);
+            ContactList& contacts = *(it->second.mContacts);
+            if(mRemoveLingerSecs > 0) 
+            {
+               contactsRemoveIfRequired(contacts, now, mRemoveLingerSecs);
+            }
+            if(it->second.mSequence > fromSequence)
+            {
+               invokeOnInitialSyncAor(connectionId, it->first, contacts, it->second.mSequence);
+            }
          }
-         invokeOnInitialSyncAor(connectionId, it->first, contacts);
       }
    }
 }
@@ -140,41 +194,36 @@ void
 InMemorySyncRegDb::addAor(const Uri& aor,
                           const ContactList& contacts)
 {
-   Lock g(mDatabaseMutex);
-   database_map_t::iterator it = mDatabase.find(aor);
-   if(it != mDatabase.end())
+   Shard& shard = getShard(aor);
+   Lock g(shard.mDatabaseMutex);
+   AorRecord& record = shard.mDatabase[aor];
+   if(record.mContacts)
    {
-       if(it->second)
-       {
-           *(it->second) = contacts;
-       }
-       else
-       {
-           it->second = new ContactList(contacts);
-       }
+       *(record.mContacts) = contacts;
    }
    else
    {
-       mDatabase[aor] = new ContactList(contacts);
+       record.mContacts = new ContactList(contacts);
    }
-   invokeOnAorModified(true /* sync? */, aor, contacts);
+   invokeOnAorModified(true /* sync? */, aor, record, contacts);
 }
 
 void 
 InMemorySyncRegDb::removeAor(const Uri& aor)
 {
+  Shard& shard = getShard(aor);
   database_map_t::iterator i;
 
-  Lock g(mDatabaseMutex);
-  i = mDatabase.find(aor);
+  Lock g(shard.mDatabaseMutex);
+  i = shard.mDatabase.find(aor);
   //DebugLog (<< "Removing registration bindings " << aor);
-  if (i != mDatabase.end())
+  if (i != shard.mDatabase.end())
   {
-     if (i->second)
+     if (i->second.mContacts)
      {
         if(mRemoveLingerSecs > 0)
         {
-           ContactList& contacts = *(i->second);
+           ContactList& contacts = *(i->second.mContacts);
            UInt64 now = Timer::getTimeSecs();
            for(ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
            {
@@ -182,15 +231,15 @@ InMemorySyncRegDb::removeAor(const Uri& aor)
               it->mRegExpires = 0;
               it->mLastUpdated = now;
            }
-           invokeOnAorModified(true /* sync? */, aor, contacts);
+           invokeOnAorModified(true /* sync? */, aor, i->second, contacts);
         }
         else
         {
-           delete i->second;
+           delete i->second.mContacts;
            // Setting this to 0 causes it to be removed when we unlock the AOR.
-           i->second = 0;
+           i->second.mContacts = 0;
            ContactList emptyList;
-           invokeOnAorModified(true /* sync? */, aor, emptyList);
+           invokeOnAorModified(true /* sync? */, aor, i->second, emptyList);
         }
      }
   }
@@ -200,11 +249,19 @@ void
 InMemorySyncRegDb::getAors(InMemorySyncRegDb::UriList& container)
 {
    container.clear();
-   Lock g(mDatabaseMutex);
-   for( database_map_t::const_iterator it = mDatabase.begin();
-        it != mDatabase.end(); it++)
+   for(std::vector<Shard*>::iterator shard = mShards.begin(); shard != mShards.end(); shard++)
    {
-      container.push_back(it->first);
+      Lock g((*shard)->mDatabaseMutex);
+      for( database_map_t::const_iterator it = (*shard)->mDatabase.begin();
+           it != (*shard)->mDatabase.end(); it++)
+      {
+         container.push_back(it->first);
+      }
+   }
+   if(mShards.size() > 1)
+   {
+      // Same order as a single map
+      container.sort();
    }
 }
 
@@ -217,14 +274,15 @@ InMemorySyncRegDb::aorIsRegistered(const Uri& aor)
 bool 
 InMemorySyncRegDb::aorIsRegistered(const Uri& aor, UInt64* maxExpires)
 {
-   Lock g(mDatabaseMutex);
+   Shard& shard = getShard(aor);
+   Lock g(shard.mDatabaseMutex);
    bool registered = false;
-   database_map_t::iterator i = mDatabase.find(aor);
-   if (i != mDatabase.end() && i->second != 0)
+   database_map_t::iterator i = shard.mDatabase.find(aor);
+   if (i != shard.mDatabase.end() && i->second.mContacts != 0)
    {
       if (mRemoveLingerSecs > 0 || maxExpires)
       {
-         ContactList& contacts = *(i->second);
+         ContactList& contacts = *(i->second.mContacts);
          UInt64 now = Timer::getTimeSecs();
          for(ContactList::iterator it = contacts.begin(); it != contacts.end(); it++)
          {
@@ -253,69 +311,68 @@ InMemorySyncRegDb::aorIsRegistered(const Uri& aor, UInt64* maxExpires)
 void
 InMemorySyncRegDb::lockRecord(const Uri& aor)
 {
-   Lock g2(mLockedRecordsMutex);
+   Shard& shard = getShard(aor);
+   Lock g2(shard.mLockedRecordsMutex);
 
    DebugLog(<< "InMemorySyncRegDb::lockRecord:  aor=" << aor << " threadid=" << ThreadIf::selfId());
 
    {
-      Lock g1(mDatabaseMutex);
+      Lock g1(shard.mDatabaseMutex);
       // This forces insertion if the record does not yet exist.
-      mDatabase[aor];
+      shard.mDatabase[aor];
    }
 
-   while (mLockedRecords.count(aor))
+   while (shard.mLockedRecords.count(aor))
    {
-      mRecordUnlocked.wait(mLockedRecordsMutex);
+      shard.mRecordUnlocked.wait(shard.mLockedRecordsMutex);
    }
 
-   mLockedRecords.insert(aor);
+   shard.mLockedRecords.insert(aor);
 }
 
 void
 InMemorySyncRegDb::unlockRecord(const Uri& aor)
 {
-   Lock g2(mLockedRecordsMutex);
+   Shard& shard = getShard(aor);
+   Lock g2(shard.mLockedRecordsMutex);
 
    DebugLog(<< "InMemorySyncRegDb::unlockRecord:  aor=" << aor << " threadid=" << ThreadIf::selfId());
 
    {
-      Lock g1(mDatabaseMutex);
+      Lock g1(shard.mDatabaseMutex);
       // If the pointer is null, we remove the record from the map.
-      database_map_t::iterator i = mDatabase.find(aor);
+      database_map_t::iterator i = shard.mDatabase.find(aor);
 
       // The record must have been inserted when we locked it in the first place
-      resip_assert (i != mDatabase.end());
+      resip_assert (i != shard.mDatabase.end());
 
-      if (i->second == 0)
+      if (i->second.mContacts == 0)
       {
-         mDatabase.erase(i);
+         shard.mDatabase.erase(i);
       }
    }
 
-   mLockedRecords.erase(aor);
-   mRecordUnlocked.broadcast();
+   shard.mLockedRecords.erase(aor);
+   shard.mRecordUnlocked.broadcast();
 }
 
 RegistrationPersistenceManager::update_status_t 
 InMemorySyncRegDb::updateContact(const resip::Uri& aor, 
                                  const ContactInstanceRecord& rec) 
 {
+   Shard& shard = getShard(aor);
+   AorRecord* record = 0;
    ContactList *contactList = 0;
 
    {
-      Lock g(mDatabaseMutex);
+      Lock g(shard.mDatabaseMutex);
 
-      database_map_t::iterator i;
-      i = mDatabase.find(aor);
-      if (i == mDatabase.end() || i->second == 0)
-      {
-         contactList = new ContactList();
-         mDatabase[aor] = contactList;
-      }
-      else
+      record = &shard.mDatabase[aor];
+      if (record->mContacts == 0)
       {
-         contactList = i->second;
+         record->mContacts = new ContactList();
       }
+      contactList = record->mContacts;
    }
    
    resip_assert(contactList);
@@ -337,16 +394,18 @@ InMemorySyncRegDb::updateContact(const resip::Uri& aor,
             status = CONTACT_CREATED;
          }
          *j=rec;
+         Lock g(shard.mDatabaseMutex);
          // Only pass sync as true if this update didn't just come from an inbound sync operation
-         invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *contactList);
+         invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *record, *contactList);
          return status;
       }
    }
 
    // This is a new contact, so we add it to the list.
    contactList->push_back(rec);
+   Lock g(shard.mDatabaseMutex);
    // Only pass sync as true if this update didn't just come from an inbound sync operation
-   invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *contactList);
+   invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *record, *contactList);
    return CONTACT_CREATED;
 }
 
@@ -354,18 +413,21 @@ void
 InMemorySyncRegDb::removeContact(const Uri& aor, 
                                  const ContactInstanceRecord& rec)
 {
+   Shard& shard = getShard(aor);
+   AorRecord* record = 0;
    ContactList *contactList = 0;
 
    {
-      Lock g(mDatabaseMutex);
+      Lock g(shard.mDatabaseMutex);
 
       database_map_t::iterator i;
-      i = mDatabase.find(aor);
-      if (i == mDatabase.end() || i->second == 0)
+      i = shard.mDatabase.find(aor);
+      if (i == shard.mDatabase.end() || i->second.mContacts == 0)
       {
          return;
       }
-      contactList = i->second;
+      record = &i->second;
+      contactList = i->second.mContacts;
    }
 
    ContactList::iterator j;
@@ -379,8 +441,9 @@ InMemorySyncRegDb::removeContact(const Uri& aor,
          {
             j->mRegExpires = 0;
             j->mLastUpdated = Timer::getTimeSecs();
+            Lock g(shard.mDatabaseMutex);
             // Only pass sync as true if this update didn't just come from an inbound sync operation
-            invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *contactList);
+            invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *record, *contactList);
          }
          else
          {
@@ -391,8 +454,9 @@ InMemorySyncRegDb::removeContact(const Uri& aor,
             }
             else
             {
+               Lock g(shard.mDatabaseMutex);
                // Only pass sync as true if this update didn't just come from an inbound sync operation
-               invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *contactList);
+               invokeOnAorModified(!rec.mSyncContact /* sync? */, aor, *record, *contactList);
             }
          }
          return;
@@ -403,16 +467,17 @@ InMemorySyncRegDb::removeContact(const Uri& aor,
 void
 InMemorySyncRegDb::getContacts(const Uri& aor, ContactList& container)
 {
-   Lock g(mDatabaseMutex);
-   database_map_t::iterator i = mDatabase.find(aor);
-   if (i == mDatabase.end() || i->second == 0)
+   Shard& shard = getShard(aor);
+   Lock g(shard.mDatabaseMutex);
+   database_map_t::iterator i = shard.mDatabase.find(aor);
+   if (i == shard.mDatabase.end() || i->second.mContacts == 0)
    {
       container.clear();
       return;
    }
    if(mRemoveLingerSecs > 0)
    {
-      ContactList& contacts = *(i->second);
+      ContactList& contacts = *(i->second.mContacts);
       UInt64 now = Timer::getTimeSecs();
       contactsRemoveIfRequired(contacts, now, mRemoveLingerSecs);
       container.clear();
@@ -426,21 +491,22 @@ InMemorySyncRegDb::getContacts(const Uri& aor, ContactList& container)
    }
    else
    {
-      container = *(i->second);
+      container = *(i->second.mContacts);
    }
 }
 
 void
 InMemorySyncRegDb::getContactsFull(const Uri& aor, ContactList& container)
 {
-   Lock g(mDatabaseMutex);
-   database_map_t::iterator i = mDatabase.find(aor);
-   if (i == mDatabase.end() || i->second == 0)
+   Shard& shard = getShard(aor);
+   Lock g(shard.mDatabaseMutex);
+   database_map_t::iterator i = shard.mDatabase.find(aor);
+   if (i == shard.mDatabase.end() || i->second.mContacts == 0)
    {
       container.clear();
       return;
    }
-   ContactList& contacts = *(i->second);
+   ContactList& contacts = *(i->second.mContacts);
    if(mRemoveLingerSecs > 0)
    {
       UInt64 now = Timer::getTimeSecs();
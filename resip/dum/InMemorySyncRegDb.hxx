@@ -4,6 +4,7 @@
 #include <map>
 #include <set>
 #include <list>
+#include <vector>
 
 #include "resip/dum/RegistrationPersistenceManager.hxx"
 #include "rutil/Mutex.hxx"
@@ -26,6 +27,11 @@ public:
    HandlerMode getMode() { return mMode; }
    virtual void onAorModified(const resip::Uri& aor, const ContactList& contacts) = 0;
    virtual void onInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts) {}
+   // These are the ones actually called by InMemorySyncRegDb; sequence is the value of
+   // InMemorySyncRegDb::getSequence() right after the AOR was (last) modified.  Handlers
+   // that replicate incrementally override them, the defaults drop the sequence.
+   virtual void onAorModified(const resip::Uri& aor, const ContactList& contacts, UInt64 sequence) { onAorModified(aor, contacts); }
+   virtual void onInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts, UInt64 sequence) { onInitialSyncAor(connectionId, aor, contacts); }
 protected:
    HandlerMode mMode;
 };
@@ -48,18 +54,36 @@ protected:
   transport registration bindings to a remote peer for replication.
   See the RegSyncClient and RegSyncServer implementations in the repro
   project.
+
+  The AORs are spread over a number of shards (by a hash of the AOR's user
+  part), each with its own map and locks, so that registrations and lookups
+  for different users rarely contend with each other.  Handler callbacks
+  are still made one at a time.
+
+  Every modification of an AOR is given the next number of a database wide
+  sequence, in the same order as the handlers are called.  A peer that
+  remembers the last sequence number it received can then ask initialSync
+  for only the AORs modified since, as long as the epoch (which identifies
+  this instance of the database) has not changed.
 */
 class InMemorySyncRegDb : public RegistrationPersistenceManager
 {
    public:
 
-      InMemorySyncRegDb(unsigned int removeLingerSecs = 0);
+      InMemorySyncRegDb(unsigned int removeLingerSecs = 0, unsigned int shards = 16);
       virtual ~InMemorySyncRegDb();
       
       virtual void addHandler(InMemorySyncRegDbHandler* handler);
       virtual void removeHandler(InMemorySyncRegDbHandler* handler);
 
       virtual void initialSync(unsigned int connectionId);
+      /// Only calls onInitialSyncAor for AORs modified after fromSequence
+      virtual void initialSync(unsigned int connectionId, UInt64 fromSequence);
+
+      /// Sequence number of the last modification, 0 if there has been none
+      UInt64 getSequence();
+      /// Sequence numbers from two instances of the database are not comparable
+      UInt64 getEpoch() const { return mEpoch; }
 
       virtual void addAor(const Uri& aor, const ContactList& contacts);
       virtual void removeAor(const Uri& aor);
@@ -81,20 +105,38 @@ class InMemorySyncRegDb : public RegistrationPersistenceManager
       virtual void getAors(UriList& container);
       
    protected:
-      typedef std::map<Uri,ContactList *> database_map_t;
-      database_map_t mDatabase;
-      Mutex mDatabaseMutex;
-
-      std::set<Uri> mLockedRecords;
-      Mutex mLockedRecordsMutex;
-      Condition mRecordUnlocked;
-
-      void invokeOnAorModified(bool sync, const resip::Uri& aor, const ContactList& contacts);
-      void invokeOnInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts);
+      class AorRecord
+      {
+         public:
+            AorRecord() : mContacts(0), mSequence(0) {}
+            ContactList* mContacts;
+            UInt64 mSequence;
+      };
+      typedef std::map<Uri,AorRecord> database_map_t;
+
+      class Shard
+      {
+         public:
+            database_map_t mDatabase;
+            Mutex mDatabaseMutex;
+
+            std::set<Uri> mLockedRecords;
+            Mutex mLockedRecordsMutex;
+            Condition mRecordUnlocked;
+      };
+      std::vector<Shard*> mShards;
+      Shard& getShard(const Uri& aor);
+
+      // Must be called with the AOR's shard locked
+      void invokeOnAorModified(bool sync, const resip::Uri& aor, AorRecord& record, const ContactList& contacts);
+      void invokeOnInitialSyncAor(unsigned int connectionId, const resip::Uri& aor, const ContactList& contacts, UInt64 sequence);
       unsigned int mRemoveLingerSecs;
       typedef std::list<InMemorySyncRegDbHandler*> HandlerList;
       HandlerList mHandlers;  // use list over set to preserve add order
       Mutex mHandlerMutex;
+      volatile Int32 mHandlerCount;  // mHandlers.size(), so writers can skip mHandlerMutex when it is 0
+      volatile UInt64 mSequence;  // taken with atomicAdd
+      const UInt64 mEpoch;
 };
 
 }
@@ -177,6 +177,12 @@ class TestInviteSessionHandler : public InviteSessionHandler
          InfoLog( << "TestInviteSessionHandler::onReferRejected" );
       }
 
+      virtual void onReferNoSub(InviteSessionHandle,
+                                const SipMessage& msg)
+      {
+         InfoLog( << "TestInviteSessionHandler::onReferNoSub" );
+      }
+
       virtual void onInfo(InviteSessionHandle,
                           const SipMessage& msg)
       {
@@ -0,0 +1,726 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#if defined (HAVE_POPT_H)
+#include <popt.h>
+#else
+#ifndef WIN32
+#warning "will not work very well without libpopt"
+#endif
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "resip/stack/Helper.hxx"
+#include "resip/stack/SdpContents.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "resip/stack/SipStack.hxx"
+#include "resip/stack/Uri.hxx"
+#ifdef USE_SSL
+#include "resip/stack/ssl/Security.hxx"
+#endif
+#include "resip/dum/DialogUsageManager.hxx"
+#include "resip/dum/MasterProfile.hxx"
+#include "resip/dum/ServerInviteSession.hxx"
+#include "resip/dum/ClientInviteSession.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+#include "TestDumHandlers.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+/************************************************************************
+
+  resip-bench: one reproducible benchmark for the SIP stack, so that
+  releases can be compared.  Build it with "make resip-bench" from the top
+  of the tree; it is not run by "make check".
+
+  Everything runs in this one thread against fixed corpora, and the results
+  are written as JSON (to stdout unless --output is given):
+
+    parse            SipMessage::make() over the corpus below
+    lazy-access      first access to the common headers of parsed messages
+    encode-raw       encoding messages whose headers were never accessed
+    encode-parsed    encoding messages whose headers have all been parsed
+    transaction-udp  REGISTER transactions between two SipStacks over
+    transaction-tcp  loopback; TLS needs --cert-dir with a domain cert and
+    transaction-tls  key for 127.0.0.1 (see testSocketFunc.cxx), otherwise
+                     it is reported as skipped
+    dum-call         DUM INVITE/200/ACK/BYE call setups and teardowns
+                     between two DialogUsageManagers over loopback UDP
+
+************************************************************************/
+
+namespace
+{
+
+const char* corpus[] =
+{
+   "INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bK776asdhds\r\n"
+   "Max-Forwards: 70\r\n"
+   "To: Bob <sip:bob@biloxi.example.com>\r\n"
+   "From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+   "Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+   "CSeq: 314159 INVITE\r\n"
+   "Contact: <sip:alice@pc33.atlanta.example.com>\r\n"
+   "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO\r\n"
+   "Supported: replaces, timer\r\n"
+   "User-Agent: resip-bench\r\n"
+   "Content-Type: application/sdp\r\n"
+   "Content-Length: 149\r\n"
+   "\r\n"
+   "v=0\r\n"
+   "o=alice 2890844526 2890844526 IN IP4 pc33.atlanta.example.com\r\n"
+   "s=-\r\n"
+   "c=IN IP4 192.0.2.101\r\n"
+   "t=0 0\r\n"
+   "m=audio 49172 RTP/AVP 0\r\n"
+   "a=rtpmap:0 PCMU/8000\r\n",
+
+   "SIP/2.0 180 Ringing\r\n"
+   "Via: SIP/2.0/UDP server10.biloxi.example.com;branch=z9hG4bK4b43c2ff8.1;received=192.0.2.3\r\n"
+   "Via: SIP/2.0/UDP bigbox3.site3.atlanta.example.com;branch=z9hG4bK77ef4c2312983.1;received=192.0.2.2\r\n"
+   "Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bKnashds8;received=192.0.2.1\r\n"
+   "Record-Route: <sip:server10.biloxi.example.com;lr>, <sip:bigbox3.site3.atlanta.example.com;lr>\r\n"
+   "To: Bob <sip:bob@biloxi.example.com>;tag=a6c85cf\r\n"
+   "From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+   "Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+   "Contact: <sip:bob@192.0.2.4>\r\n"
+   "CSeq: 314159 INVITE\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n",
+
+   "REGISTER sip:registrar.biloxi.example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/TCP bobspc.biloxi.example.com:5060;branch=z9hG4bKnashds7;rport\r\n"
+   "Max-Forwards: 70\r\n"
+   "To: Bob <sip:bob@biloxi.example.com>\r\n"
+   "From: Bob <sip:bob@biloxi.example.com>;tag=456248\r\n"
+   "Call-ID: 843817637684230@998sdasdh09\r\n"
+   "CSeq: 1826 REGISTER\r\n"
+   "Contact: <sip:bob@192.0.2.4;transport=tcp>;expires=7200;+sip.instance=\"<urn:uuid:00000000-0000-1000-8000-000A95A0E128>\";reg-id=1\r\n"
+   "Supported: path, outbound, gruu\r\n"
+   "Expires: 7200\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n",
+
+   "BYE sip:alice@pc33.atlanta.example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 192.0.2.4;branch=z9hG4bKnashds10\r\n"
+   "Max-Forwards: 70\r\n"
+   "Route: <sip:bigbox3.site3.atlanta.example.com;lr>\r\n"
+   "From: Bob <sip:bob@biloxi.example.com>;tag=a6c85cf\r\n"
+   "To: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+   "Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+   "CSeq: 231 BYE\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n"
+};
+const int corpusSize = sizeof(corpus) / sizeof(corpus[0]);
+
+// Messages kept alive at once by the access and encode benchmarks.
+const int batchSize = 1000;
+
+const char* offer =
+   "v=0\r\n"
+   "o=- 369696545 369696545 IN IP4 127.0.0.1\r\n"
+   "s=resip-bench\r\n"
+   "c=IN IP4 127.0.0.1\r\n"
+   "t=0 0\r\n"
+   "m=audio 8000 RTP/AVP 0 101\r\n"
+   "a=rtpmap:0 PCMU/8000\r\n"
+   "a=rtpmap:101 telephone-event/8000\r\n"
+   "a=fmtp:101 0-15\r\n";
+
+struct Result
+{
+      Result(const char* name, const char* unit)
+         : mName(name), mUnit(unit), mCount(0), mElapsedUs(0)
+      {}
+
+      Data mName;
+      Data mUnit;
+      UInt64 mCount;
+      UInt64 mElapsedUs;
+      Data mSkipped;     // Why the benchmark did not run, if it did not.
+};
+
+class Stopwatch
+{
+   public:
+      Stopwatch() : mStart(Timer::getTimeMicroSec()), mElapsed(0) {}
+      void start() { mStart = Timer::getTimeMicroSec(); }
+      void stop() { mElapsed += Timer::getTimeMicroSec() - mStart; }
+      UInt64 elapsedUs() const { return mElapsed; }
+   private:
+      UInt64 mStart;
+      UInt64 mElapsed;
+};
+
+// Content-Length has to be kept in step with the bodies by hand, and a
+// corpus of malformed messages would make every result meaningless.
+bool
+checkCorpus()
+{
+   for (int i = 0; i < corpusSize; ++i)
+   {
+      auto_ptr<SipMessage> msg(SipMessage::make(Data(Data::Share, corpus[i])));
+      if (msg.get() == 0 ||
+          msg->header(h_ContentLength).value() != msg->getRawBody().getLength())
+      {
+         cerr << "corpus message " << i << " is malformed" << endl;
+         return false;
+      }
+   }
+   return true;
+}
+
+vector<SipMessage*>
+parseBatch(int count)
+{
+   vector<SipMessage*> messages;
+   messages.reserve(count);
+   for (int i = 0; i < count; ++i)
+   {
+      messages.push_back(SipMessage::make(Data(Data::Share, corpus[i % corpusSize])));
+   }
+   return messages;
+}
+
+void
+deleteBatch(vector<SipMessage*>& messages)
+{
+   for (size_t i = 0; i < messages.size(); ++i)
+   {
+      delete messages[i];
+   }
+   messages.clear();
+}
+
+// Touches what a proxy or UA looks at in nearly every message.
+void
+accessHeaders(SipMessage& msg)
+{
+   msg.header(h_Vias).front().param(p_branch).getTransactionId();
+   msg.header(h_Vias).front().sentHost();
+   msg.header(h_From).uri().user();
+   msg.header(h_From).param(p_tag);
+   msg.header(h_To).uri().host();
+   msg.header(h_CallId).value();
+   msg.header(h_CSeq).sequence();
+   if (msg.isRequest())
+   {
+      msg.header(h_RequestLine).uri().host();
+      msg.header(h_MaxForwards).value();
+   }
+   else
+   {
+      msg.header(h_StatusLine).statusCode();
+   }
+   if (msg.exists(h_Contacts))
+   {
+      msg.header(h_Contacts).front().uri().host();
+   }
+   if (msg.exists(h_RecordRoutes))
+   {
+      msg.header(h_RecordRoutes).front().uri().host();
+   }
+   if (msg.exists(h_Routes))
+   {
+      msg.header(h_Routes).front().uri().host();
+   }
+   if (msg.exists(h_ContentLength))
+   {
+      msg.header(h_ContentLength).value();
+   }
+}
+
+Result
+benchParse(int iterations)
+{
+   Result result("parse", "msgs/s");
+   Stopwatch watch;
+   for (int i = 0; i < iterations; ++i)
+   {
+      delete SipMessage::make(Data(Data::Share, corpus[i % corpusSize]));
+   }
+   watch.stop();
+   result.mCount = iterations;
+   result.mElapsedUs = watch.elapsedUs();
+   return result;
+}
+
+Result
+benchLazyAccess(int iterations)
+{
+   Result result("lazy-access", "msgs/s");
+   Stopwatch watch;
+   for (int done = 0; done < iterations; done += batchSize)
+   {
+      vector<SipMessage*> messages = parseBatch(batchSize);
+      watch.start();
+      for (size_t i = 0; i < messages.size(); ++i)
+      {
+         accessHeaders(*messages[i]);
+      }
+      watch.stop();
+      result.mCount += messages.size();
+      deleteBatch(messages);
+   }
+   result.mElapsedUs = watch.elapsedUs();
+   return result;
+}
+
+Result
+benchEncode(int iterations, bool parsed)
+{
+   Result result(parsed ? "encode-parsed" : "encode-raw", "msgs/s");
+   Stopwatch watch;
+   Data encoded;
+   for (int done = 0; done < iterations; done += batchSize)
+   {
+      vector<SipMessage*> messages = parseBatch(batchSize);
+      if (parsed)
+      {
+         for (size_t i = 0; i < messages.size(); ++i)
+         {
+            accessHeaders(*messages[i]);
+         }
+      }
+      watch.start();
+      for (size_t i = 0; i < messages.size(); ++i)
+      {
+         encoded.clear();
+         DataStream ds(encoded);
+         messages[i]->encode(ds);
+      }
+      watch.stop();
+      result.mCount += messages.size();
+      deleteBatch(messages);
+   }
+   result.mElapsedUs = watch.elapsedUs();
+   return result;
+}
+
+SipStack*
+makeStack(const Data& certDir)
+{
+   SipStackOptions options;
+#ifdef USE_SSL
+   if (!certDir.empty())
+   {
+      options.mSecurity = new Security(certDir);
+   }
+#endif
+   return new SipStack(options);
+}
+
+bool
+haveTlsCert(const Data& certDir, Data& reason)
+{
+#ifdef USE_SSL
+   if (certDir.empty())
+   {
+      reason = "no --cert-dir given";
+      return false;
+   }
+   Data certFile = certDir + "/domain_cert_127.0.0.1.pem";
+   if (!ifstream(certFile.c_str()).good())
+   {
+      reason = "no " + certFile;
+      return false;
+   }
+   return true;
+#else
+   reason = "built without TLS support";
+   return false;
+#endif
+}
+
+// REGISTERs from a sender stack to a receiver stack that answers 200 to
+// each, keeping "window" transactions outstanding, both stacks driven from
+// this thread.
+Result
+benchTransactions(TransportType type, int runs, int window, int port, const Data& certDir)
+{
+   Data name = Data("transaction-") + toDataLower(type);
+   Result result(name.c_str(), "transactions/s");
+   if (type == TLS && !haveTlsCert(certDir, result.mSkipped))
+   {
+      return result;
+   }
+
+   const Data localhost("127.0.0.1");
+   auto_ptr<SipStack> sender(makeStack(certDir));
+   auto_ptr<SipStack> receiver(makeStack(certDir));
+   try
+   {
+      sender->addTransport(type, port, V4, StunDisabled, localhost, localhost);
+      receiver->addTransport(type, port + 1, V4, StunDisabled, localhost, localhost);
+   }
+   catch (BaseException& e)
+   {
+      result.mSkipped = Data("could not add transport: ") + e.getMessage();
+      return result;
+   }
+
+   NameAddr target;
+   target.uri().scheme() = "sip";
+   target.uri().user() = "bench";
+   target.uri().host() = localhost;
+   target.uri().port() = port + 1;
+   target.uri().param(p_transport) = toDataLower(type);
+   NameAddr from = target;
+   from.uri().port() = port;
+   NameAddr contact = from;
+
+   int sent = 0;
+   int completed = 0;
+   Stopwatch watch;
+   UInt64 lastProgress = Timer::getTimeMs();
+   while (completed < runs)
+   {
+      while (sent < runs && sent - completed < window)
+      {
+         sender->send(std::auto_ptr<SipMessage>(Helper::makeRegister(target, from, contact)));
+         ++sent;
+      }
+
+      sender->process(0);
+      receiver->process(0);
+
+      SipMessage* msg;
+      while ((msg = receiver->receive()) != 0)
+      {
+         if (msg->isRequest())
+         {
+            SipMessage response;
+            Helper::makeResponse(response, *msg, 200);
+            receiver->send(response);
+         }
+         delete msg;
+      }
+      while ((msg = sender->receive()) != 0)
+      {
+         if (msg->isResponse() && msg->header(h_StatusLine).statusCode() == 200)
+         {
+            ++completed;
+            lastProgress = Timer::getTimeMs();
+         }
+         else
+         {
+            // Failed transaction (e.g. timeout); send it again.
+            --sent;
+         }
+         delete msg;
+      }
+      if (Timer::getTimeMs() - lastProgress > 10000)
+      {
+         result.mSkipped = "no progress for 10 seconds";
+         break;
+      }
+   }
+   watch.stop();
+   result.mCount = completed;
+   result.mElapsedUs = watch.elapsedUs();
+   return result;
+}
+
+class BenchUac : public TestInviteSessionHandler
+{
+   public:
+      BenchUac() : mCompleted(0), mFailed(0) {}
+
+      virtual void onConnected(ClientInviteSessionHandle cis, const SipMessage&)
+      {
+         cis->end();
+      }
+
+      virtual void onFailure(ClientInviteSessionHandle, const SipMessage&)
+      {
+         ++mFailed;
+      }
+
+      virtual void onTerminated(InviteSessionHandle,
+                                InviteSessionHandler::TerminatedReason reason,
+                                const SipMessage*)
+      {
+         // Calls that failed before connecting still end up here.
+         ++mCompleted;
+      }
+
+      int mCompleted;
+      int mFailed;
+};
+
+class BenchUas : public TestInviteSessionHandler
+{
+   public:
+      virtual void onOffer(InviteSessionHandle is, const SipMessage&, const SdpContents& sdp)
+      {
+         is->provideAnswer(sdp);
+         ServerInviteSession* sis = dynamic_cast<ServerInviteSession*>(is.get());
+         if (sis)
+         {
+            sis->accept();
+         }
+      }
+};
+
+class BenchShutdownHandler : public DumShutdownHandler
+{
+   public:
+      BenchShutdownHandler() : mDone(false) {}
+      virtual void onDumCanBeDeleted() { mDone = true; }
+      bool mDone;
+};
+
+void
+setupDum(DialogUsageManager& dum, SipStack& stack, int port, InviteSessionHandler& handler)
+{
+   stack.addTransport(UDP, port, V4, StunDisabled, Data("127.0.0.1"));
+   SharedPtr<MasterProfile> profile(new MasterProfile);
+   NameAddr aor;
+   aor.uri().scheme() = "sip";
+   aor.uri().user() = Data("bench") + Data(port);
+   aor.uri().host() = "127.0.0.1";
+   aor.uri().port() = port;
+   profile->setDefaultFrom(aor);
+   dum.setMasterProfile(profile);
+   dum.setInviteSessionHandler(&handler);
+}
+
+void
+processDums(SipStack& uacStack, DialogUsageManager& uacDum,
+            SipStack& uasStack, DialogUsageManager& uasDum)
+{
+   uacStack.process(0);
+   while (uacDum.process());
+   uasStack.process(0);
+   while (uasDum.process());
+}
+
+Result
+benchDumCalls(int calls, int window, int port)
+{
+   Result result("dum-call", "calls/s");
+
+   SipStack uacStack;
+   SipStack uasStack;
+   DialogUsageManager uacDum(uacStack);
+   DialogUsageManager uasDum(uasStack);
+   BenchUac uac;
+   BenchUas uas;
+   setupDum(uacDum, uacStack, port, uac);
+   setupDum(uasDum, uasStack, port + 1, uas);
+
+   NameAddr target;
+   target.uri().scheme() = "sip";
+   target.uri().user() = "bench";
+   target.uri().host() = "127.0.0.1";
+   target.uri().port() = port + 1;
+
+   HeaderFieldValue hfv(offer, (unsigned int)strlen(offer));
+   SdpContents sdp(hfv, Mime("application", "sdp"));
+
+   int started = 0;
+   Stopwatch watch;
+   UInt64 lastProgress = Timer::getTimeMs();
+   int lastCompleted = 0;
+   while (uac.mCompleted < calls)
+   {
+      while (started < calls && started - uac.mCompleted < window)
+      {
+         uacDum.send(uacDum.makeInviteSession(target, &sdp));
+         ++started;
+      }
+      processDums(uacStack, uacDum, uasStack, uasDum);
+      if (uac.mCompleted != lastCompleted)
+      {
+         lastCompleted = uac.mCompleted;
+         lastProgress = Timer::getTimeMs();
+      }
+      else if (Timer::getTimeMs() - lastProgress > 10000)
+      {
+         result.mSkipped = "no progress for 10 seconds";
+         break;
+      }
+   }
+   watch.stop();
+   result.mCount = uac.mCompleted - uac.mFailed;
+   result.mElapsedUs = watch.elapsedUs();
+   if (uac.mFailed && result.mSkipped.empty())
+   {
+      result.mSkipped = Data(uac.mFailed) + " calls failed";
+   }
+
+   BenchShutdownHandler uacShutdown;
+   BenchShutdownHandler uasShutdown;
+   uacDum.shutdown(&uacShutdown);
+   uasDum.shutdown(&uasShutdown);
+   while (!(uacShutdown.mDone && uasShutdown.mDone))
+   {
+      processDums(uacStack, uacDum, uasStack, uasDum);
+   }
+   return result;
+}
+
+void
+writeJson(ostream& strm, const vector<Result>& results)
+{
+   strm << "{" << endl
+        << "  \"benchmark\": \"resip-bench\"," << endl
+#ifdef PACKAGE_VERSION
+        << "  \"version\": \"" << PACKAGE_VERSION << "\"," << endl
+#endif
+        << "  \"results\": [" << endl;
+   for (size_t i = 0; i < results.size(); ++i)
+   {
+      const Result& r = results[i];
+      strm << "    { \"name\": \"" << r.mName << "\", \"unit\": \"" << r.mUnit << "\"";
+      if (r.mCount)
+      {
+         double seconds = r.mElapsedUs ? r.mElapsedUs / 1000000.0 : 0.000001;
+         strm << ", \"count\": " << r.mCount
+              << ", \"elapsedMs\": " << r.mElapsedUs / 1000
+              << ", \"rate\": " << (UInt64)(r.mCount / seconds)
+              << ", \"nsPerOp\": " << (UInt64)(r.mElapsedUs * 1000.0 / r.mCount);
+      }
+      if (!r.mSkipped.empty())
+      {
+         strm << ", \"" << (r.mCount ? "warning" : "skipped") << "\": \""
+              << r.mSkipped.escaped() << "\"";
+      }
+      strm << " }" << (i + 1 < results.size() ? "," : "") << endl;
+   }
+   strm << "  ]" << endl
+        << "}" << endl;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   const char* logType = "cerr";
+   const char* logLevel = "WARNING";
+   const char* output = 0;
+   const char* certDir = "";
+   int iterations = 100000;
+   int runs = 5000;
+   int calls = 1000;
+   int window = 50;
+   int port = 26000;
+
+#if defined(HAVE_POPT_H)
+   struct poptOption table[] = {
+      {"log-type",    'l', POPT_ARG_STRING, &logType,    0, "where to send logging messages", "syslog|cerr|cout"},
+      {"log-level",   'v', POPT_ARG_STRING, &logLevel,   0, "specify the default log level", "DEBUG|INFO|WARNING|ALERT"},
+      {"output",      'o', POPT_ARG_STRING, &output,     0, "file to write the JSON results to (default stdout)", 0},
+      {"cert-dir",    0,   POPT_ARG_STRING, &certDir,    0, "directory holding domain_cert/key_127.0.0.1.pem for TLS", 0},
+      {"iterations",  'i', POPT_ARG_INT,    &iterations, 0, "messages per parse/access/encode benchmark", 0},
+      {"num-runs",    'r', POPT_ARG_INT,    &runs,       0, "transactions per transport", 0},
+      {"calls",       'c', POPT_ARG_INT,    &calls,      0, "DUM calls", 0},
+      {"window-size", 'w', POPT_ARG_INT,    &window,     0, "transactions or calls in flight", 0},
+      {"port",        'p', POPT_ARG_INT,    &port,       0, "first of the local ports to use", 0},
+      POPT_AUTOHELP
+      { NULL, 0, 0, NULL, 0 }
+   };
+
+   poptContext context = poptGetContext(NULL, argc, const_cast<const char**>(argv), table, 0);
+   poptGetNextOpt(context);
+#endif
+
+#ifdef WIN32
+   initNetwork();
+#endif
+   Log::initialize(logType, logLevel, argv[0]);
+
+   if (!checkCorpus())
+   {
+      return 1;
+   }
+
+   vector<Result> results;
+   results.push_back(benchParse(iterations));
+   results.push_back(benchLazyAccess(iterations));
+   results.push_back(benchEncode(iterations, false));
+   results.push_back(benchEncode(iterations, true));
+   results.push_back(benchTransactions(UDP, runs, window, port, certDir));
+   results.push_back(benchTransactions(TCP, runs, window, port + 2, certDir));
+   results.push_back(benchTransactions(TLS, runs, window, port + 4, certDir));
+   results.push_back(benchDumCalls(calls, window, port + 6));
+
+   if (output)
+   {
+      ofstream file(output);
+      writeJson(file, results);
+   }
+   else
+   {
+      writeJson(cout, results);
+   }
+
+#if defined(HAVE_POPT_H)
+   poptFreeContext(context);
+#endif
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,318 @@
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "resip/dum/InMemorySyncRegDb.hxx"
+#include "resip/stack/NameAddr.hxx"
+#include "resip/stack/Uri.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks that a sharded InMemorySyncRegDb behaves like a single map and
+// numbers its changes for incremental initial sync, then
+// times REGISTER-style updates (lock, update, unlock - as ServerRegistration
+// does) and location lookups from several threads at once, with 1 and with
+// 16 shards, and with and without a handler (which serializes the writers).
+
+namespace
+{
+
+const unsigned int Aors = 10000;
+const unsigned int Registrars = 4;
+const unsigned int Lookups = 4;
+
+class CountingHandler : public InMemorySyncRegDbHandler
+{
+   public:
+      CountingHandler(HandlerMode mode = AllChanges) : InMemorySyncRegDbHandler(mode), mModified(0), mSynced(0) {}
+      virtual void onAorModified(const Uri& aor, const ContactList& contacts) { mModified++; }
+      virtual void onInitialSyncAor(unsigned int connectionId, const Uri& aor, const ContactList& contacts) { mSynced++; }
+      unsigned int mModified;  // handler calls are serialized
+      unsigned int mSynced;
+};
+
+class SequenceHandler : public InMemorySyncRegDbHandler
+{
+   public:
+      SequenceHandler() : mLastSequence(0), mSynced(0) {}
+      virtual void onAorModified(const Uri& aor, const ContactList& contacts) { assert(false); }
+      virtual void onAorModified(const Uri& aor, const ContactList& contacts, UInt64 sequence)
+      {
+         assert(sequence > mLastSequence);
+         mLastSequence = sequence;
+      }
+      virtual void onInitialSyncAor(unsigned int connectionId, const Uri& aor, const ContactList& contacts, UInt64 sequence)
+      {
+         assert(sequence <= mLastSequence);
+         mSynced++;
+      }
+      UInt64 mLastSequence;
+      unsigned int mSynced;
+};
+
+Uri
+aor(unsigned int i)
+{
+   return Uri("sip:user" + Data(i) + "@example.com");
+}
+
+ContactInstanceRecord
+contact(unsigned int i, unsigned int instance)
+{
+   ContactInstanceRecord rec;
+   rec.mContact = NameAddr("sip:user" + Data(i) + "@192.0.2." + Data(instance % 250 + 1) + ":5060");
+   rec.mRegExpires = Timer::getTimeSecs() + 3600;
+   rec.mLastUpdated = Timer::getTimeSecs();
+   return rec;
+}
+
+void
+checkDb(unsigned int shards)
+{
+   InMemorySyncRegDb db(0, shards);
+   CountingHandler handler;
+   db.addHandler(&handler);
+   SequenceHandler sequenceHandler;
+   db.addHandler(&sequenceHandler);
+   assert(db.getSequence() == 0);
+
+   for(unsigned int i = 0; i < 100; i++)
+   {
+      db.lockRecord(aor(i));
+      assert(db.updateContact(aor(i), contact(i, 1)) == RegistrationPersistenceManager::CONTACT_CREATED);
+      assert(db.updateContact(aor(i), contact(i, 2)) == RegistrationPersistenceManager::CONTACT_CREATED);
+      assert(db.updateContact(aor(i), contact(i, 1)) == RegistrationPersistenceManager::CONTACT_UPDATED);
+      db.unlockRecord(aor(i));
+   }
+   assert(handler.mModified == 300);
+   assert(db.getSequence() == 300 && sequenceHandler.mLastSequence == 300);
+
+   // The same AOR written differently finds the same record
+   ContactList contacts;
+   db.getContacts(Uri("sip:user7@EXAMPLE.com"), contacts);
+   assert(contacts.size() == 2);
+   assert(db.aorIsRegistered(aor(7)));
+   assert(!db.aorIsRegistered(aor(100)));
+
+   db.lockRecord(aor(7));
+   db.removeContact(aor(7), contact(7, 1));
+   db.removeContact(aor(7), contact(7, 2));
+   db.unlockRecord(aor(7));
+   assert(!db.aorIsRegistered(aor(7)));
+
+   // AORs come back in order, whatever shard they are in
+   RegistrationPersistenceManager::UriList aors;
+   db.getAors(aors);
+   assert(aors.size() == 99);
+   for(RegistrationPersistenceManager::UriList::iterator it = aors.begin(); it != aors.end(); )
+   {
+      const Uri& previous = *it;
+      if(++it != aors.end())
+      {
+         assert(previous < *it);
+      }
+   }
+
+   // Only SyncServer handlers take part in initial sync
+   CountingHandler syncHandler(InMemorySyncRegDbHandler::SyncServer);
+   db.addHandler(&syncHandler);
+   db.initialSync(1);
+   assert(handler.mSynced == 0);
+   assert(syncHandler.mSynced == 99);
+   db.removeHandler(&syncHandler);
+
+   // Incremental initial sync only covers AORs changed since the given sequence
+   UInt64 sequence = db.getSequence();
+   sequenceHandler.mSynced = 0;
+   db.initialSync(1, sequence);
+   assert(sequenceHandler.mSynced == 0);
+   db.lockRecord(aor(3));
+   db.updateContact(aor(3), contact(3, 1));
+   db.updateContact(aor(3), contact(3, 3));
+   db.unlockRecord(aor(3));
+   ContactList single;
+   single.push_back(contact(50, 1));
+   db.addAor(aor(50), single);
+   assert(db.getSequence() == sequence + 3);
+   db.initialSync(1, sequence);
+   assert(sequenceHandler.mSynced == 2);
+   db.initialSync(1, 0);
+   assert(sequenceHandler.mSynced == 2 + 99);
+
+   InMemorySyncRegDb other(0, shards);
+   assert(other.getEpoch() != db.getEpoch());
+
+   db.removeHandler(&sequenceHandler);
+   db.removeHandler(&handler);
+
+   // Changes made with no handlers are still numbered, and a handler added
+   // afterwards gets them from initialSync()
+   sequence = db.getSequence();
+   db.addAor(aor(60), single);
+   db.addAor(aor(61), single);
+   assert(db.getSequence() == sequence + 2);
+   CountingHandler lateHandler(InMemorySyncRegDbHandler::SyncServer);
+   db.addHandler(&lateHandler);
+   db.initialSync(1, sequence);
+   assert(lateHandler.mSynced == 2 && lateHandler.mModified == 0);
+   db.removeHandler(&lateHandler);
+}
+
+class Registrar : public ThreadIf
+{
+   public:
+      Registrar(InMemorySyncRegDb& db, unsigned int id, unsigned int count) : mDb(db), mId(id), mCount(count) {}
+      virtual void thread()
+      {
+         for(unsigned int n = 0; n < mCount; n++)
+         {
+            unsigned int i = (n * 7919 + mId) % Aors;
+            Uri user(aor(i));
+            mDb.lockRecord(user);
+            mDb.updateContact(user, contact(i, n));
+            mDb.unlockRecord(user);
+         }
+      }
+   private:
+      InMemorySyncRegDb& mDb;
+      unsigned int mId;
+      unsigned int mCount;
+};
+
+class Locator : public ThreadIf
+{
+   public:
+      Locator(InMemorySyncRegDb& db, unsigned int id, unsigned int count) : mDb(db), mId(id), mCount(count) {}
+      virtual void thread()
+      {
+         ContactList contacts;
+         for(unsigned int n = 0; n < mCount; n++)
+         {
+            mDb.getContacts(aor((n * 104729 + mId) % Aors), contacts);
+         }
+      }
+   private:
+      InMemorySyncRegDb& mDb;
+      unsigned int mId;
+      unsigned int mCount;
+};
+
+void
+timeDb(unsigned int shards, unsigned int perThread, bool withHandler)
+{
+   InMemorySyncRegDb db(0, shards);
+   CountingHandler handler;
+   if(withHandler)
+   {
+      db.addHandler(&handler);
+   }
+
+   UInt64 start = Timer::getTimeMs();
+   vector<ThreadIf*> threads;
+   for(unsigned int i = 0; i < Registrars; i++)
+   {
+      threads.push_back(new Registrar(db, i, perThread));
+   }
+   for(unsigned int i = 0; i < Lookups; i++)
+   {
+      threads.push_back(new Locator(db, i, perThread));
+   }
+   for(vector<ThreadIf*>::iterator it = threads.begin(); it != threads.end(); it++)
+   {
+      (*it)->run();
+   }
+   for(vector<ThreadIf*>::iterator it = threads.begin(); it != threads.end(); it++)
+   {
+      (*it)->join();
+      delete *it;
+   }
+   UInt64 done = Timer::getTimeMs();
+   assert(handler.mModified == (withHandler ? Registrars * perThread : 0));
+   assert(db.getSequence() == Registrars * perThread);
+
+   cout << shards << " shard(s), " << (withHandler ? "with" : "no") << " handler: " << Registrars << " threads x " << perThread << " registrations and "
+        << Lookups << " threads x " << perThread << " lookups in " << (done - start) << " ms" << endl;
+   if(withHandler)
+   {
+      db.removeHandler(&handler);
+   }
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   unsigned int perThread = 50000;
+   if(argc > 1)
+   {
+      perThread = atoi(argv[1]);
+   }
+
+   checkDb(1);
+   checkDb(16);
+
+   timeDb(1, perThread, true);
+   timeDb(16, perThread, true);
+   timeDb(1, perThread, false);
+   timeDb(16, perThread, false);
+
+   cout << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ */
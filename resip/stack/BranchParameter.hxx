@@ -38,6 +38,8 @@ class BranchParameter : public Parameter
 
       // returns tid
       const Data& getTransactionId() const;
+      // Data::caseInsensitiveTokenHash() of the tid, computed when it was set
+      size_t getTransactionIdHash() const;
 
       // increments the transport sequence component - not part of tid
       void incrementTransportSequence();
@@ -75,6 +77,7 @@ class BranchParameter : public Parameter
       bool mHasMagicCookie;
       bool mIsMyBranch;
       Data mTransactionId;
+      size_t mTransactionIdHash;
       unsigned int mTransportSeq;
       Data mClientData;
       //magic cookie for interop; if case is different some proxies will treat this as a different tid
@@ -37,6 +37,7 @@ Connection::Connection(Transport* transport,const Tuple& who, Socket socket,
    : ConnectionBase(transport,who,compression),
      mFirstWriteAfterConnectedPending(false),
      mInWritable(false),
+     mIoSuspended(false),
      mFlowTimerEnabled(false),
      mPollItemHandle(0),
      mIsServer(isServer)
@@ -140,6 +141,16 @@ Connection::performWrite()
       break;
    }
 
+   // WebSocket framing and SigComp both need the message in one piece
+   if (mOutstandingSends.front()->isGathered() &&
+       (!canWriteGathered() ||
+        !mOutstandingSends.front()->sigcompId.empty() ||
+        (mSendingTransmissionFormat != Unknown &&
+         mSendingTransmissionFormat != Uncompressed)))
+   {
+      mOutstandingSends.front()->flatten();
+   }
+
    const Data& sigcompId = mOutstandingSends.front()->sigcompId;
 
    if(mSendingTransmissionFormat == Unknown)
@@ -259,10 +270,22 @@ Connection::performWrite()
       }
    }
 
-   const Data& data = mOutstandingSends.front()->data;
-   int nBytes = write(data.data() + mSendPos,int(data.size() - mSendPos));
+   const SendData& sendData = *mOutstandingSends.front();
+   const Data& data = sendData.data;
+   Data::size_type size;
+   int nBytes;
+   if (sendData.isGathered())
+   {
+      size = (Data::size_type)sendData.size();
+      nBytes = writeGathered(sendData, mSendPos);
+   }
+   else
+   {
+      size = data.size();
+      nBytes = write(data.data() + mSendPos,int(data.size() - mSendPos));
+   }
 
-   //DebugLog (<< "Tried to send " << data.size() - mSendPos << " bytes, sent " << nBytes << " bytes");
+   //DebugLog (<< "Tried to send " << size - mSendPos << " bytes, sent " << nBytes << " bytes");
 
    if (nBytes < 0)
    {
@@ -281,7 +304,7 @@ Connection::performWrite()
       // Safe because of the conditional above ( < 0 ).
       Data::size_type bytesWritten = static_cast<Data::size_type>(nBytes);
       mSendPos += bytesWritten;
-      if (mSendPos == data.size())
+      if (mSendPos == size)
       {
          mSendPos = 0;
          removeFrontOutstandingSend();
@@ -319,6 +342,26 @@ Connection::ensureWritable()
    }
 }
 
+void
+Connection::suspendIo()
+{
+   if(!mIoSuspended)
+   {
+      getConnectionManager().suspend(this);
+      mIoSuspended = true;
+   }
+}
+
+void
+Connection::resumeIo()
+{
+   if(mIoSuspended)
+   {
+      mIoSuspended = false;
+      getConnectionManager().resume(this);
+   }
+}
+
 ConnectionManager&
 Connection::getConnectionManager() const
 {
@@ -109,6 +109,12 @@ class Connection : public ConnectionBase,
       virtual int read(char* /* buffer */, const int /* count */) { return 0; }
       /// pure virtual, but need concrete Connection for book-ends of lists
       virtual int write(const char* /* buffer */, const int /* count */) { return 0; }
+      /// true if writeGathered() can send a gathered SendData as it is;
+      /// otherwise performWrite() flattens it first
+      virtual bool canWriteGathered() const { return false; }
+      /// writes the segments of {data} past its first {offset} bytes;
+      /// returns like write()
+      virtual int writeGathered(const SendData& /* data */, size_t /* offset */) { return 0; }
       virtual void onDoubleCRLF();
       virtual void onSingleCRLF();
 
@@ -117,10 +123,19 @@ class Connection : public ConnectionBase,
 
       virtual void invokeAfterSocketCreationFunc() const;
 
+      /** Takes the socket out of the transport's poll set until resumeIo(),
+          for while another thread is using it (a TLS handshake step on the
+          crypto pool).  Changes to the writable state made in between are
+          applied by resumeIo(). */
+      void suspendIo();
+      void resumeIo();
+      bool isIoSuspended() const { return mIoSuspended; }
+
    private:
       ConnectionManager& getConnectionManager() const;
       void removeFrontOutstandingSend();
       bool mInWritable;
+      bool mIoSuspended;
       bool mFlowTimerEnabled;
       FdPollItemHandle mPollItemHandle;
       
@@ -272,7 +272,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             return true;
          }
 
-         mMessage->addBuffer(mBuffer);
+         mMessage->addBuffer(mBuffer, mBufferSize);
          mBuffer=0;
 
          if (scanChunkResult == MsgHeaderScanner::scrNextChunk)
@@ -473,7 +473,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
          mBufferPos += bytesRead;
          if (mBufferPos == contentLength)
          {
-            mMessage->addBuffer(mBuffer);
+            mMessage->addBuffer(mBuffer, mBufferSize);
             mMessage->setBody(mBuffer, (UInt32)contentLength);
             mBuffer=0;
             // .bwc. basicCheck takes up substantial CPU. Don't bother doing it
@@ -820,7 +820,7 @@ ConnectionBase::wsProcessData(int bytesRead)
       Data::size_type msg_len = msg->size();
       // cast permitted, as it is borrowed:
       char *sipBuffer = (char *)msg->data();
-      mMessage->addBuffer(sipBuffer);
+      mMessage->addBuffer(sipBuffer, msg_len);
       mMsgHeaderScanner.prepareForMessage(mMessage);
       char *unprocessedCharPtr;
       if (mMsgHeaderScanner.scanChunk(sipBuffer,
@@ -906,7 +906,7 @@ ConnectionBase::decompressNewBytes(int bytesRead)
 
     char *sipBuffer = new char[bytesUncompressed];
     memmove(sipBuffer, uncompressed, bytesUncompressed);
-    mMessage->addBuffer(sipBuffer);
+    mMessage->addBuffer(sipBuffer, bytesUncompressed);
     mMsgHeaderScanner.prepareForMessage(mMessage);
     char *unprocessedCharPtr;
     if (mMsgHeaderScanner.scanChunk(sipBuffer,
@@ -0,0 +1,262 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include "resip/stack/ConnectionIndex.hxx"
+#include "resip/stack/Connection.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+using namespace resip;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
+
+static const size_t NotFound = (size_t)-1;
+static const size_t MinSlots = 64;
+
+ConnectionIndex::ConnectionIndex()
+   : mMask(0),
+     mCount(0)
+{
+}
+
+ConnectionIndex::~ConnectionIndex()
+{
+}
+
+Connection*
+ConnectionIndex::find(const Tuple& addr) const
+{
+   size_t i = findSlot(addr, hashOf(addr));
+   if (i != NotFound)
+   {
+      return mSlots[i].mConnection;
+   }
+   else
+   {
+      return 0;
+   }
+}
+
+Connection*
+ConnectionIndex::find(FlowKey flowKey) const
+{
+#ifdef WIN32
+   FlowKeyMap::const_iterator i = mByFlowKey.find(flowKey);
+   return i == mByFlowKey.end() ? 0 : i->second;
+#else
+   return flowKey < mByFlowKey.size() ? mByFlowKey[flowKey] : 0;
+#endif
+}
+
+void
+ConnectionIndex::add(Connection* connection)
+{
+   const Tuple& who = connection->who();
+   const size_t hash = hashOf(who);
+   resip_assert(findSlot(who, hash) == NotFound);
+
+   if ((mCount + 1)*10 > mSlots.size()*7)
+   {
+      grow();
+   }
+   insert(hash, connection);
+
+   const FlowKey flowKey = who.mFlowKey;
+#ifdef WIN32
+   mByFlowKey[flowKey] = connection;
+#else
+   if (flowKey >= mByFlowKey.size())
+   {
+      // fds are handed out lowest first, so this settles at the peak fd
+      mByFlowKey.resize(flowKey + flowKey/2 + 1, (Connection*)0);
+   }
+   mByFlowKey[flowKey] = connection;
+#endif
+}
+
+void
+ConnectionIndex::remove(Connection* connection)
+{
+   const FlowKey flowKey = connection->who().mFlowKey;
+#ifdef WIN32
+   FlowKeyMap::iterator f = mByFlowKey.find(flowKey);
+   if (f != mByFlowKey.end() && f->second == connection)
+   {
+      mByFlowKey.erase(f);
+   }
+#else
+   if (flowKey < mByFlowKey.size() && mByFlowKey[flowKey] == connection)
+   {
+      mByFlowKey[flowKey] = 0;
+   }
+#endif
+
+   size_t i = findSlot(connection->who(), hashOf(connection->who()));
+   if (i == NotFound || mSlots[i].mConnection != connection)
+   {
+      InfoLog(<< "Couldn't find " << connection->who() << " to remove");
+      return;
+   }
+
+   // Close the gap: walk the rest of the probe run and move back any entry
+   // whose home slot is not between the gap and where it sits now.
+   size_t j = i;
+   for (;;)
+   {
+      j = (j + 1) & mMask;
+      if (!mSlots[j].mConnection)
+      {
+         break;
+      }
+      const size_t home = mSlots[j].mHash & mMask;
+      const bool stays = (i < j) ? (i < home && home <= j) : (i < home || home <= j);
+      if (!stays)
+      {
+         mSlots[i] = mSlots[j];
+         i = j;
+      }
+   }
+   mSlots[i].mConnection = 0;
+   --mCount;
+}
+
+void
+ConnectionIndex::getConnections(std::vector<Connection*>& connections) const
+{
+   connections.reserve(connections.size() + mCount);
+   for (std::vector<Slot>::const_iterator i = mSlots.begin(); i != mSlots.end(); ++i)
+   {
+      if (i->mConnection)
+      {
+         connections.push_back(i->mConnection);
+      }
+   }
+}
+
+size_t
+ConnectionIndex::getMemoryUsage() const
+{
+   size_t bytes = sizeof(*this) + mSlots.capacity()*sizeof(Slot);
+#ifdef WIN32
+   // roughly: a red-black tree node per entry
+   bytes += mByFlowKey.size()*(sizeof(FlowKeyMap::value_type) + 4*sizeof(void*));
+#else
+   bytes += mByFlowKey.capacity()*sizeof(Connection*);
+#endif
+   return bytes;
+}
+
+size_t
+ConnectionIndex::hashOf(const Tuple& addr)
+{
+   // MurmurHash3's 64-bit finalizer
+   UInt64 h = (UInt64)addr.hash();
+   h ^= h >> 33;
+   h *= UInt64(0xff51afd7ed558ccdULL);
+   h ^= h >> 33;
+   h *= UInt64(0xc4ceb9fe1a85ec53ULL);
+   h ^= h >> 33;
+   return (size_t)h;
+}
+
+size_t
+ConnectionIndex::findSlot(const Tuple& addr, size_t hash) const
+{
+   if (mCount == 0)
+   {
+      return NotFound;
+   }
+   for (size_t i = hash & mMask; mSlots[i].mConnection; i = (i + 1) & mMask)
+   {
+      if (mSlots[i].mHash == hash && mSlots[i].mConnection->who() == addr)
+      {
+         return i;
+      }
+   }
+   return NotFound;
+}
+
+void
+ConnectionIndex::insert(size_t hash, Connection* connection)
+{
+   size_t i = hash & mMask;
+   while (mSlots[i].mConnection)
+   {
+      i = (i + 1) & mMask;
+   }
+   mSlots[i].mHash = hash;
+   mSlots[i].mConnection = connection;
+   ++mCount;
+}
+
+void
+ConnectionIndex::grow()
+{
+   std::vector<Slot> old;
+   old.swap(mSlots);
+
+   Slot empty;
+   empty.mHash = 0;
+   empty.mConnection = 0;
+   mSlots.resize(old.empty() ? MinSlots : old.size()*2, empty);
+   mMask = mSlots.size() - 1;
+   mCount = 0;
+   for (std::vector<Slot>::const_iterator i = old.begin(); i != old.end(); ++i)
+   {
+      if (i->mConnection)
+      {
+         insert(i->mHash, i->mConnection);
+      }
+   }
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,142 @@
+#ifndef RESIP_ConnectionIndex_hxx
+#define RESIP_ConnectionIndex_hxx
+
+#include <vector>
+#ifdef WIN32
+#include <map>
+#endif
+
+#include "resip/stack/Tuple.hxx"
+
+namespace resip
+{
+
+class Connection;
+
+/**
+   @internal
+
+   The ConnectionManager's lookup tables for its connections, by address
+   and by flow key.
+
+   By address it is a flat open-addressing table (linear probing) of
+   (hash, Connection*) pairs, compared against Connection::who() only when
+   the hashes match, so a lookup usually costs one cache line and one Tuple
+   compare instead of a walk down a tree of Tuple::operator< calls. Removal
+   shifts the rest of the probe run back instead of leaving a tombstone.
+
+   By flow key it is a vector indexed by the socket, since on POSIX the
+   flow key of a connection is its fd and fds are small and dense. Windows
+   SOCKETs are opaque handles, so there it stays a std::map.
+
+   Neither table allocates per connection; both only grow.
+*/
+class ConnectionIndex
+{
+   public:
+      ConnectionIndex();
+      ~ConnectionIndex();
+
+      /// may return 0
+      Connection* find(const Tuple& addr) const;
+      /// the connection that was added with this flow key, or 0
+      Connection* find(FlowKey flowKey) const;
+
+      /// {connection}->who() must not be in the index yet
+      void add(Connection* connection);
+      /// {connection} must have been added, with who() unchanged since
+      void remove(Connection* connection);
+
+      size_t size() const { return mCount; }
+      bool empty() const { return mCount == 0; }
+
+      /// appends every indexed connection to {connections}
+      void getConnections(std::vector<Connection*>& connections) const;
+
+      /// bytes held by the index itself, not counting the Connections
+      size_t getMemoryUsage() const;
+
+   private:
+      struct Slot
+      {
+         size_t mHash;
+         Connection* mConnection; // 0 if the slot is free
+      };
+
+      // Tuple::hash() is a plain sum of address, port and transport, which
+      // would pile neighbouring clients into neighbouring slots
+      static size_t hashOf(const Tuple& addr);
+
+      size_t findSlot(const Tuple& addr, size_t hash) const;
+      void insert(size_t hash, Connection* connection);
+      void grow();
+
+      std::vector<Slot> mSlots;
+      size_t mMask;
+      size_t mCount;
+
+#ifdef WIN32
+      typedef std::map<FlowKey, Connection*> FlowKeyMap;
+      FlowKeyMap mByFlowKey;
+#else
+      std::vector<Connection*> mByFlowKey;
+#endif
+
+      // no value semantics
+      ConnectionIndex(const ConnectionIndex&);
+      ConnectionIndex& operator=(const ConnectionIndex&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -46,9 +46,12 @@ ConnectionManager::~ConnectionManager()
 void 
 ConnectionManager::closeConnections()
 {
-   while (!mAddrMap.empty())
+   // each delete takes the connection back out of mIndex
+   std::vector<Connection*> connections;
+   mIndex.getConnections(connections);
+   for (std::vector<Connection*>::iterator i = connections.begin(); i != connections.end(); ++i)
    {
-      delete mAddrMap.begin()->second;
+      delete *i;
    }
 }
 
@@ -57,19 +60,19 @@ ConnectionManager::findConnection(const Tuple& addr)
 {
    if (addr.mFlowKey != 0)
    {
-      IdMap::iterator i = mIdMap.find(addr.mFlowKey);
-      if (i != mIdMap.end())
+      Connection* byFd = mIndex.find(addr.mFlowKey);
+      if (byFd)
       {
-         if(i->second->who() == addr)
+         if(byFd->who() == addr)
          {
             DebugLog(<<"Found fd " << addr.mFlowKey);
-            return i->second;
+            return byFd;
          }
          else
          {
             DebugLog(<<"fd " << addr.mFlowKey 
                      << " exists, but does not match the destination. FD -> "
-                     << i->second->who() << ", tuple -> " << addr);
+                     << byFd->who() << ", tuple -> " << addr);
          }
       }
       else
@@ -83,11 +86,11 @@ ConnectionManager::findConnection(const Tuple& addr)
       }
    }
    
-   AddrMap::iterator i = mAddrMap.find(addr);
-   if (i != mAddrMap.end())
+   Connection* conn = mIndex.find(addr);
+   if (conn)
    {
       DebugLog(<<"Found connection for tuple "<< addr );
-      return i->second;
+      return conn;
    }
 
    DebugLog(<<"Could not find a connection for " << addr);
@@ -99,19 +102,19 @@ ConnectionManager::findConnection(const Tuple& addr) const
 {
    if (addr.mFlowKey != 0)
    {
-      IdMap::const_iterator i = mIdMap.find(addr.mFlowKey);
-      if (i != mIdMap.end())
+      Connection* byFd = mIndex.find(addr.mFlowKey);
+      if (byFd)
       {
-         if(i->second->who()==addr)
+         if(byFd->who()==addr)
          {
             DebugLog(<<"Found fd " << addr.mFlowKey);
-            return i->second;
+            return byFd;
          }
          else
          {
             DebugLog(<<"fd " << addr.mFlowKey 
                      << " exists, but does not match the destination. FD -> "
-                     << i->second->who() << ", tuple -> " << addr);
+                     << byFd->who() << ", tuple -> " << addr);
          }
       }
       else
@@ -120,11 +123,11 @@ ConnectionManager::findConnection(const Tuple& addr) const
       }
    }
    
-   AddrMap::const_iterator i = mAddrMap.find(addr);
-   if (i != mAddrMap.end())
+   const Connection* conn = mIndex.find(addr);
+   if (conn)
    {
       DebugLog(<<"Found connection for tuple "<< addr );
-      return i->second;
+      return conn;
    }
 
    DebugLog(<<"Could not find a connection for " << addr);
@@ -155,6 +158,11 @@ ConnectionManager::buildFdSet(FdSet& fdset)
 void
 ConnectionManager::addToWritable(Connection* conn)
 {
+   if ( conn->mIoSuspended )
+   {
+      // resume() picks this up
+      return;
+   }
    if ( mPollGrp ) 
    {
       mPollGrp->modPollItem(conn->mPollItemHandle, FPEM_Read|FPEM_Write|FPEM_Error);
@@ -168,6 +176,10 @@ ConnectionManager::addToWritable(Connection* conn)
 void
 ConnectionManager::removeFromWritable(Connection* conn)
 {
+   if ( conn->mIoSuspended )
+   {
+      return;
+   }
    if ( mPollGrp ) 
    {
       mPollGrp->modPollItem(conn->mPollItemHandle, FPEM_Read|FPEM_Error);
@@ -179,15 +191,49 @@ ConnectionManager::removeFromWritable(Connection* conn)
    }
 }
 
+void
+ConnectionManager::suspend(Connection* conn)
+{
+   if ( mPollGrp )
+   {
+      // removed rather than masked, a hangup would otherwise be reported
+      // on every wait until resume()
+      mPollGrp->delPollItem(conn->mPollItemHandle);
+      conn->mPollItemHandle = 0;
+   }
+   else
+   {
+      conn->ConnectionReadList::remove();
+      conn->ConnectionWriteList::remove();
+   }
+}
+
+void
+ConnectionManager::resume(Connection* conn)
+{
+   if ( mPollGrp )
+   {
+      conn->mPollItemHandle = mPollGrp->addPollItem(conn->getSocket(),
+         conn->mInWritable ? FPEM_Read|FPEM_Write|FPEM_Error : FPEM_Read|FPEM_Error, conn);
+   }
+   else
+   {
+      mReadHead->push_back(conn);
+      if ( conn->mInWritable )
+      {
+         mWriteHead->push_back(conn);
+      }
+   }
+}
+
 void
 ConnectionManager::addConnection(Connection* connection)
 {
-   resip_assert(mAddrMap.find(connection->who())==mAddrMap.end());
+   resip_assert(mIndex.find(connection->who()) == 0);
 
-   DebugLog (<< "ConnectionManager::addConnection() " << connection->mWho.mFlowKey  << ":" << connection->who() << ", totalConnections=" << mIdMap.size());
+   DebugLog (<< "ConnectionManager::addConnection() " << connection->mWho.mFlowKey  << ":" << connection->who() << ", totalConnections=" << mIndex.size());
    
-   mAddrMap[connection->who()] = connection;
-   mIdMap[connection->who().mFlowKey] = connection;
+   mIndex.add(connection);
 
    if ( mPollGrp ) 
    {
@@ -206,9 +252,7 @@ ConnectionManager::addConnection(Connection* connection)
       gc(MinimumGcAge, 0);  // cleanup all connections that haven't seen data in last x ms
    }
 
-   //DebugLog (<< "count=" << mAddrMap.count(connection->who()) << "who=" << connection->who() << " mAddrMap=" << Inserter(mAddrMap));
-   //assert(mAddrMap.begin()->first == connection->who());
-   resip_assert(mAddrMap.count(connection->who()) == 1);
+   resip_assert(mIndex.find(connection->who()) == connection);
 }
 
 void
@@ -216,16 +260,18 @@ ConnectionManager::removeConnection(Connection* connection)
 {
    DebugLog (<< "ConnectionManager::removeConnection()");
 
-   mIdMap.erase(connection->mWho.mFlowKey);
-   mAddrMap.erase(connection->mWho);
+   mIndex.remove(connection);
 
    if ( mPollGrp ) 
    {
-      mPollGrp->delPollItem(connection->mPollItemHandle);
+      if ( connection->mPollItemHandle )
+      {
+         mPollGrp->delPollItem(connection->mPollItemHandle);
+      }
    }
    else
    {
-      resip_assert(!mReadHead->empty());
+      resip_assert(connection->mIoSuspended || !mReadHead->empty());
       connection->ConnectionReadList::remove();
       connection->ConnectionWriteList::remove();
       if(connection->isFlowTimerEnabled())
@@ -306,13 +352,13 @@ ConnectionManager::gc(UInt64 relThreshold, unsigned int maxToRemove)
       else
       {
          rlim_t& soft_limit = rlim.rlim_cur;
-         AddrMap::size_type conn_count = mAddrMap.size();
-         AddrMap::size_type headroom = soft_limit - conn_count;
+         size_t conn_count = mIndex.size();
+         size_t headroom = soft_limit - conn_count;
          DebugLog(<< "GC headroom check: soft_limit = " << soft_limit << ", managed connection count = " << conn_count << ", headroom = " << headroom << ", minimum headroom = " << MinimumGcHeadroom);
          if(headroom < MinimumGcHeadroom)
          {
             WarningLog(<< "actual headroom = " << headroom << ", MinimumGcHeadroom = " << MinimumGcHeadroom << ", garbage collector making extra effort to reclaim file descriptors");
-            AddrMap::size_type mustRemove = MinimumGcHeadroom - headroom;
+            size_t mustRemove = MinimumGcHeadroom - headroom;
             unsigned int remainder = gcWithTarget(mustRemove);
             numRemoved += (mustRemove - remainder);
             if(remainder > 0)
@@ -465,9 +511,11 @@ ConnectionManager::setPollGrp(FdPollGrp *grp)
 void 
 ConnectionManager::invokeAfterSocketCreationFunc() const
 {
-    for (AddrMap::const_iterator it = mAddrMap.begin(); it != mAddrMap.end(); it++)
+    std::vector<Connection*> connections;
+    mIndex.getConnections(connections);
+    for (std::vector<Connection*>::const_iterator it = connections.begin(); it != connections.end(); it++)
     {
-        it->second->invokeAfterSocketCreationFunc();
+        (*it)->invokeAfterSocketCreationFunc();
     }
 }
 
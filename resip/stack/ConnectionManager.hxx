@@ -1,9 +1,9 @@
 #ifndef RESIP_ConnectionMgr_hxx
 #define RESIP_ConnectionMgr_hxx 
 
-#include <map>
 #include "rutil/HashMap.hxx"
 #include "resip/stack/Connection.hxx"
+#include "resip/stack/ConnectionIndex.hxx"
 
 namespace resip
 {
@@ -49,16 +49,19 @@ class ConnectionManager
 
       virtual void invokeAfterSocketCreationFunc() const;
 
+      /// deletes every connection
+      void closeConnections();
+
    private:
       void addToWritable(Connection* conn); // add the specified conn to end
       void removeFromWritable(Connection* conn); // remove the current mWriteMark
 
-      typedef std::map<Tuple, Connection*> AddrMap;
-      typedef std::map<Socket, Connection*> IdMap;
+      /// stop and restart polling conn's socket, see Connection::suspendIo()
+      void suspend(Connection* conn);
+      void resume(Connection* conn);
 
       void addConnection(Connection* connection);
       void removeConnection(Connection* connection);
-      void closeConnections();
 
       /// release excessively old connections (free up file descriptors)
       /// set maxToRemove to 0 for no-max
@@ -69,8 +72,8 @@ class ConnectionManager
       void touch(Connection* connection);
       void moveToFlowTimerLru(Connection *connection);
       
-      AddrMap mAddrMap;
-      IdMap mIdMap;
+      /// by Tuple and by flow key
+      ConnectionIndex mIndex;
 
       /// all intrusive lists based on the same element type
       Connection mHead;
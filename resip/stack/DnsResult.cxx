@@ -92,7 +92,8 @@ EnumResult::onDnsResult(const DNSResult<DnsCnameRecord>&)
 }
 
 DnsResult::DnsResult(DnsInterface& interfaceObj, DnsStub& dns, RRVip& vip, DnsHandler* handler) 
-   : mInterface(interfaceObj),
+   : mCachedQueries(0),
+     mInterface(interfaceObj),
      mDnsStub(dns),
      mVip(vip),
      mHandler(handler),
@@ -260,6 +261,42 @@ DnsResult::lookup(const Uri& uri)
 {
    DebugLog (<< "DnsResult::lookup " << uri);
 
+   // ENUM settings may only be read on the DnsThread; everything else that
+   // lookupInternal() touches is safe here, so answer what the cache can on
+   // this thread and only queue the queries it can't.
+   if (mDnsStub.isCacheReadable() && !uri.isEnumSearchable())
+   {
+      DnsStub& stub = mDnsStub;
+      std::deque<CachedQuery*> queries;
+      std::vector<CachedQuery*> misses;
+      mCachedQueries = &queries;
+      mDoingEnum = 0;
+      lookupInternal(uri);
+      while (!queries.empty())
+      {
+         CachedQuery* cached = queries.front();
+         queries.pop_front();
+         if (cached->answer(stub, *this))
+         {
+            delete cached;
+         }
+         else
+         {
+            misses.push_back(cached);
+         }
+      }
+      mCachedQueries = 0;
+
+      // Once the first of these is queued, this may be finished (and
+      // destroyed) on the DnsThread, so don't touch members from here on.
+      for (std::vector<CachedQuery*>::iterator it = misses.begin(); it != misses.end(); ++it)
+      {
+         (*it)->send(stub, this);
+         delete *it;
+      }
+      return;
+   }
+
    // Dispatch lookup request to DnsThread
    LookupCommand *command = new LookupCommand(*this, uri);
    mDnsStub.queueCommand(command);
@@ -364,7 +401,7 @@ DnsResult::lookupInternal(const Uri& uri)
                else
                {
                   mSRVCount++;
-                  mDnsStub.lookup<RR_SRV>("_sips._udp." + mTarget, Protocol::Sip, this);
+                  query<RR_SRV>("_sips._udp." + mTarget);
                   StackLog (<< "Doing SRV lookup of _sips._udp." << mTarget);
                }
             }
@@ -387,7 +424,7 @@ DnsResult::lookupInternal(const Uri& uri)
                else
                {
                   mSRVCount++;
-                  mDnsStub.lookup<RR_SRV>("_sips._tcp." + mTarget, Protocol::Sip,  this);
+                  query<RR_SRV>("_sips._tcp." + mTarget);
                   StackLog (<< "Doing SRV lookup of _sips._tcp." << mTarget);
                }
             }
@@ -413,17 +450,17 @@ DnsResult::lookupInternal(const Uri& uri)
             {
                case TLS: //deprecated, mean TLS over TCP
                   mSRVCount++;
-                  mDnsStub.lookup<RR_SRV>("_sips._tcp." + mTarget, Protocol::Sip, this);
+                  query<RR_SRV>("_sips._tcp." + mTarget);
                   StackLog (<< "Doing SRV lookup of _sips._tcp." << mTarget);
                   break;
                case DTLS: //deprecated, mean TLS over TCP
                   mSRVCount++;
-                  mDnsStub.lookup<RR_SRV>("_sip._dtls." + mTarget, Protocol::Sip, this);
+                  query<RR_SRV>("_sip._dtls." + mTarget);
                   StackLog (<< "Doing SRV lookup of _sip._dtls." << mTarget);
                   break;
                case TCP:
                   mSRVCount++;
-                  mDnsStub.lookup<RR_SRV>("_sip._tcp." + mTarget, Protocol::Sip, this);
+                  query<RR_SRV>("_sip._tcp." + mTarget);
                   StackLog (<< "Doing SRV lookup of _sip._tcp." << mTarget);
                   break;
                case SCTP:
@@ -431,7 +468,7 @@ DnsResult::lookupInternal(const Uri& uri)
                case UDP:
                default: //fall through to UDP for unimplemented & unknown
                   mSRVCount++;
-                  mDnsStub.lookup<RR_SRV>("_sip._udp." + mTarget, Protocol::Sip, this);
+                  query<RR_SRV>("_sip._udp." + mTarget);
                   StackLog (<< "Doing SRV lookup of _sip._udp." << mTarget);
             }
          }
@@ -581,7 +618,7 @@ DnsResult::lookupInternal(const Uri& uri)
       }
       else // do NAPTR
       {
-         mDnsStub.lookup<RR_NAPTR>(mTarget, Protocol::Sip, this); // for current target
+         query<RR_NAPTR>(mTarget); // for current target
       }
    }
 }
@@ -593,15 +630,15 @@ void DnsResult::lookupHost(const Data& target)
 #ifdef USE_IPV6
       DebugLog(<< "Doing host (AAAA) lookup: " << target);
       mPassHostFromAAAAtoA = target;
-      mDnsStub.lookup<RR_AAAA>(target, Protocol::Sip, this);
+      query<RR_AAAA>(target);
 #else
       resip_assert(0);
-      mDnsStub.lookup<RR_A>(target, Protocol::Sip, this);
+      query<RR_A>(target);
 #endif
    }
    else if (mInterface.isSupported(mTransport, V4))
    {
-      mDnsStub.lookup<RR_A>(target, Protocol::Sip, this);
+      query<RR_A>(target);
    }
    else
    {
@@ -1085,7 +1122,7 @@ void DnsResult::onDnsResult(const DNSResult<DnsAAAARecord>& result)
       StackLog (<< "Failed async AAAA query: " << result.msg);
    }
    // funnel through to host processing
-   mDnsStub.lookup<RR_A>(mPassHostFromAAAAtoA, Protocol::Sip, this);
+   query<RR_A>(mPassHostFromAAAAtoA);
 #else
    resip_assert(0);
 #endif
@@ -1369,7 +1406,7 @@ DnsResult::onNaptrResult(const DNSResult<DnsNaptrRecord>& result)
                StackLog (<< "NAPTR record is supported and matches highes priority order. doing SRV query: " << (*it));
                mTopOrderedNAPTRs[(*it).replacement] = (*it);
                mSRVCount++;
-               mDnsStub.lookup<RR_SRV>((*it).replacement, Protocol::Sip, this);
+               query<RR_SRV>((*it).replacement);
             }
          }
       }
@@ -1399,32 +1436,32 @@ DnsResult::onNaptrResult(const DNSResult<DnsNaptrRecord>& result)
          }
 
          mSRVCount++;
-         mDnsStub.lookup<RR_SRV>("_sips._tcp." + mTarget, Protocol::Sip, this);
+         query<RR_SRV>("_sips._tcp." + mTarget);
          StackLog (<< "Doing SRV lookup of _sips._tcp." << mTarget);
       }
       else
       {
          if (mInterface.isSupportedProtocol(TLS))
          {
-            mDnsStub.lookup<RR_SRV>("_sips._tcp." + mTarget, Protocol::Sip, this);
+            query<RR_SRV>("_sips._tcp." + mTarget);
             ++mSRVCount;
             StackLog (<< "Doing SRV lookup of _sips._tcp." << mTarget);
          }
          if (mInterface.isSupportedProtocol(DTLS))
          {
-            mDnsStub.lookup<RR_SRV>("_sips._udp." + mTarget, Protocol::Sip, this);
+            query<RR_SRV>("_sips._udp." + mTarget);
             ++mSRVCount;
             StackLog (<< "Doing SRV lookup of _sips._udp." << mTarget);
          }
          if (mInterface.isSupportedProtocol(TCP))
          {
-            mDnsStub.lookup<RR_SRV>("_sip._tcp." + mTarget, Protocol::Sip, this);
+            query<RR_SRV>("_sip._tcp." + mTarget);
             ++mSRVCount;
             StackLog (<< "Doing SRV lookup of _sip._tcp." << mTarget);
          }
          if (mInterface.isSupportedProtocol(UDP))
          {
-            mDnsStub.lookup<RR_SRV>("_sip._udp." + mTarget, Protocol::Sip, this);
+            query<RR_SRV>("_sip._udp." + mTarget);
             ++mSRVCount;
             StackLog (<< "Doing SRV lookup of _sip._udp." << mTarget);
          }
@@ -202,7 +202,9 @@ class DnsResult : public DnsResultSink, public EnumResultSink
          The following command is used to ensure that all DnsInterface mRRVip and 
          mTupleMarkManager, and enum setting accesses are done from the DnsThread.  
          This gets the initial call * lookupInternalWithEnum to occur on the 
-         DnsThread (using the DnsStub command fifo).
+         DnsThread (using the DnsStub command fifo).  lookup() only uses it
+         for ENUM and when the DnsStub cache can't be read off the DnsThread
+         (see DnsStub::isCacheReadable()).
        */
       class LookupCommand : public DnsStub::Command
       {
@@ -218,6 +220,56 @@ class DnsResult : public DnsResultSink, public EnumResultSink
           Uri mUri;
       };
       friend class LookupCommand;
+
+      /*
+         A query made while lookup() is answering from the DnsStub cache on
+         the calling thread: queued rather than made at once so that answers
+         are never delivered re-entrantly, then either answered from the
+         cache or sent to the DnsThread once that pass is over.
+       */
+      class CachedQuery
+      {
+      public:
+          CachedQuery(const Data& target) : mTarget(target) {}
+          virtual ~CachedQuery() {}
+          virtual bool answer(DnsStub& stub, DnsResult& result) = 0;
+          virtual void send(DnsStub& stub, DnsResultSink* sink) = 0;
+      protected:
+          Data mTarget;
+      };
+      template<class QueryType> class CachedQueryT : public CachedQuery
+      {
+      public:
+          CachedQueryT(const Data& target) : CachedQuery(target) {}
+          virtual bool answer(DnsStub& stub, DnsResult& result)
+          {
+             DNSResult<typename QueryType::Type> dnsResult;
+             if (!stub.lookupCached<QueryType>(mTarget, dnsResult))
+             {
+                return false;
+             }
+             result.onDnsResult(dnsResult);
+             return true;
+          }
+          virtual void send(DnsStub& stub, DnsResultSink* sink)
+          {
+             stub.lookup<QueryType>(mTarget, Protocol::Sip, sink);
+          }
+      };
+      template<class QueryType> void query(const Data& target)
+      {
+         if (mCachedQueries)
+         {
+            mCachedQueries->push_back(new CachedQueryT<QueryType>(target));
+         }
+         else
+         {
+            mDnsStub.lookup<QueryType>(target, Protocol::Sip, this);
+         }
+      }
+      // Set only while lookup() is answering from the cache
+      std::deque<CachedQuery*>* mCachedQueries;
+
       void lookupInternalWithEnum(const Uri& uri);
       void lookupInternal(const Uri& uri);
 
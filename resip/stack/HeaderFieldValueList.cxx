@@ -72,6 +72,23 @@ HeaderFieldValueList::operator=(const HeaderFieldValueList& rhs)
    return *this;
 }
 
+void
+HeaderFieldValueList::grow()
+{
+   // Letting the vector reallocate would copy-construct every value, and the
+   // copy c'tor takes a private copy of the text. Values that still point
+   // into the receive buffers should keep doing so (so that they can be sent
+   // from there, see SipMessage::encodeGathered()), so swap them across.
+   ListImpl grown(mHeaders.get_allocator());
+   grown.reserve(mHeaders.empty() ? 2 : mHeaders.size()*2);
+   for (iterator i = mHeaders.begin(); i != mHeaders.end(); ++i)
+   {
+      grown.push_back(HeaderFieldValue::Empty);
+      grown.back().swap(*i);
+   }
+   mHeaders.swap(grown);
+}
+
 EncodeStream&
 HeaderFieldValueList::encode(int headerEnum, EncodeStream& str) const
 {
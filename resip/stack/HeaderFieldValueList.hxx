@@ -65,6 +65,10 @@ class HeaderFieldValueList
       */
       void push_back(const char* buffer, size_t length, bool own) 
       {
+         if (mHeaders.size() == mHeaders.capacity())
+         {
+            grow();
+         }
          mHeaders.push_back(HeaderFieldValue::Empty); 
          mHeaders.back().init(buffer,length,own);
       }
@@ -99,6 +103,7 @@ class HeaderFieldValueList
       ParserContainerBase* mParserContainer;
 
       void freeParserContainer();
+      void grow();
 };
 
 }
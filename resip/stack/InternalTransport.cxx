@@ -11,6 +11,7 @@
 #include "resip/stack/Helper.hxx"
 #include "resip/stack/InternalTransport.hxx"
 #include "resip/stack/SipMessage.hxx"
+#include "resip/stack/TransportThread.hxx"
 #include "rutil/DnsUtil.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/WinLeakCheck.hxx"
@@ -35,11 +36,14 @@ InternalTransport::InternalTransport(Fifo<TransactionMessage>& rxFifo,
    mInterruptorHandle(0),
    mTxFifoOutBuffer(mTxFifo),
    mPollGrp(NULL),
-   mPollItemHandle(NULL)
+   mPollItemHandle(NULL),
+   mRunOwnThread(false)
 {}
 
 InternalTransport::~InternalTransport()
 {
+   // the derived class should have done this already
+   resip_assert(!mOwnThread.get());
    if (mPollItemHandle)
    {
       mPollGrp->delPollItem(mPollItemHandle);
@@ -62,6 +66,28 @@ InternalTransport::~InternalTransport()
    setCongestionManager(0);  // Clear out congestion manager
 }
 
+void
+InternalTransport::startOwnProcessing()
+{
+   if(mRunOwnThread && !mOwnThread.get())
+   {
+      resip_assert(!shareStackProcessAndSelect());
+      mOwnThread.reset(new TransportThread(*this));
+      mOwnThread->run();
+   }
+}
+
+void
+InternalTransport::stopOwnThread()
+{
+   if(mOwnThread.get())
+   {
+      mOwnThread->shutdown();
+      mOwnThread->join();
+      mOwnThread.reset();
+   }
+}
+
 bool
 InternalTransport::isFinished() const
 {
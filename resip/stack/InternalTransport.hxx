@@ -2,6 +2,7 @@
 #define RESIP_INTERNAL_TRANSPORT_HXX
 
 #include <exception>
+#include <memory>
 
 #include "rutil/BaseException.hxx"
 #include "rutil/ConsumerFifoBuffer.hxx"
@@ -23,6 +24,7 @@ class TransactionMessage;
 class SipMessage;
 class Connection;
 class FdPollGrp;
+class TransportThread;
 
 /**
    @internal
@@ -51,8 +53,14 @@ class InternalTransport : public Transport
 
       // No-op, even if this Transport is marked as having its own thread. It is the
       // responsibility of the app-writer to ensure that a TransportThread is 
-      // created for this Transport, and run it.
-      virtual void startOwnProcessing() {}
+      // created for this Transport, and run it. The exception is a transport
+      // on which setRunOwnThread(true) was called: it then starts its own
+      // TransportThread here, and stops it when it is destroyed.
+      virtual void startOwnProcessing();
+
+      // Must be called before the transport is added to the stack, and only
+      // together with RESIP_TRANSPORT_FLAG_OWNTHREAD.
+      void setRunOwnThread(bool runOwnThread) { mRunOwnThread = runOwnThread; }
 
       // shared by UDP, TCP, and TLS
       static Socket socket(TransportType type, IpVersion ipVer);
@@ -81,11 +89,20 @@ class InternalTransport : public Transport
          }
       }
 
+      virtual void setLockFreeTxFifo(bool lockFree)
+      {
+         mTxFifo.setLockFree(lockFree);
+      }
+
       virtual void invokeAfterSocketCreationFunc() const;
 
    protected:
       friend class SipStack;
 
+      // stops and deletes the thread started by startOwnProcessing(); must be
+      // called from the destructor of the most derived class
+      void stopOwnThread();
+
       Socket mFd; // this is a unix file descriptor or a windows SOCKET
 
       // .bwc. We use this to interrupt the select call when our tx fifo goes
@@ -100,6 +117,9 @@ class InternalTransport : public Transport
       FdPollGrp *mPollGrp;      // not owned by transport, just used
       // FdPollItemIf *mPollItem;	// owned by the transport
       FdPollItemHandle mPollItemHandle; // owned by the transport
+
+      bool mRunOwnThread;
+      std::auto_ptr<TransportThread> mOwnThread;
 };
 
 
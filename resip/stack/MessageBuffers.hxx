@@ -0,0 +1,105 @@
+#ifndef RESIP_MessageBuffers_hxx
+#define RESIP_MessageBuffers_hxx
+
+#include <cstddef>
+#include <vector>
+
+namespace resip
+{
+
+/**
+   @internal
+
+   The raw receive buffers a SipMessage was parsed out of. Unparsed header
+   values and the body of the message point straight into these, so they
+   have to live as long as the message does; once a gathered SendData
+   references them (see SipMessage::encodeGathered()) they are held through a
+   SharedPtr and outlive the message until the send completes.
+
+   A buffer added with a size of 0 is owned but never reported by contains().
+*/
+class MessageBuffers
+{
+   public:
+      MessageBuffers();
+      ~MessageBuffers();
+
+      /// takes ownership of {buf}, which must have been allocated with new[]
+      void add(char* buf, size_t size);
+
+      /// delete[]s every buffer
+      void clear();
+
+      bool empty() const { return mBuffers.empty(); }
+
+      /// true iff [ptr, ptr+len) lies entirely within one of the buffers
+      bool contains(const char* ptr, size_t len) const;
+
+      void swap(MessageBuffers& other);
+
+   private:
+      struct Buffer
+      {
+         char* mBuf;
+         size_t mSize;
+      };
+      std::vector<Buffer> mBuffers;
+
+      // no value semantics
+      MessageBuffers(const MessageBuffers&);
+      MessageBuffers& operator=(const MessageBuffers&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
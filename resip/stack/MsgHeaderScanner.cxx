@@ -10,6 +10,21 @@
 #include "resip/stack/MsgHeaderScanner.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESIP_MSG_HEADER_SCANNER_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+// AVX2 code is compiled per function with the target attribute and only
+// called when the CPU reports support for it.
+#define RESIP_MSG_HEADER_SCANNER_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 namespace resip 
 {
 
@@ -412,6 +427,297 @@ static void initStateMachine()
                   sMsgStart); // Arbitrary but possibly handy.
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//   Most of the time is spent in a few "run" states that loop on every
+//   character but a handful, e.g. scanning a value until its CR.  For each such
+//   state this records the characters that leave the loop, so that the scan can
+//   step over runs of value text a whole vector at a time.  The skipped
+//   characters still contribute their text property bits.  CR and LF never
+//   loop, so they are always among the stop characters.
+
+enum { maxNumRunStopChars = 6 };
+
+struct RunStopInfo
+{
+      int  numStopChars;                     // 0: not a run state.
+      char stopChars[maxNumRunStopChars];    // Unused slots repeat stopChars[0].
+};
+
+static RunStopInfo runStopInfoArray[numStates];
+
+static void initRunStopInfoArray()
+{
+   for (int state = 0; state < numStates; ++state)
+   {
+      RunStopInfo& info = runStopInfoArray[state];
+      info.numStopChars = 0;
+      for (unsigned int charIndex = 0; charIndex <= UCHAR_MAX; ++charIndex)
+      {
+         const TransitionInfo& transitionInfo =
+            stateMachine[state][c2i(charInfoArray[charIndex].category)];
+         if (transitionInfo.action == taNone && transitionInfo.nextState == state)
+         {
+            continue;
+         }
+         if (info.numStopChars == maxNumRunStopChars)
+         {
+            info.numStopChars = 0;
+            break;
+         }
+         info.stopChars[info.numStopChars++] = (char)charIndex;
+      }
+      for (int i = info.numStopChars; info.numStopChars && i < maxNumRunStopChars; ++i)
+      {
+         info.stopChars[i] = info.stopChars[0];
+      }
+   }
+}
+
+//   Returns the first stop character at or after "charPtr", or the start of
+//   the last partial vector before "termCharPtr" if there is none; the scalar
+//   loop picks up from there.  Never reads at or beyond "termCharPtr".
+typedef char* (*SkipRunFunction)(char* charPtr,
+                                 char* termCharPtr,
+                                 const RunStopInfo& info,
+                                 MsgHeaderScanner::TextPropBitMask& textPropBitMask);
+
+static MsgHeaderScanner::ScanImplementation scanImplementation =
+   MsgHeaderScanner::siScalar;
+static SkipRunFunction skipRunFunction = 0;
+static bool isScanImplementationSelected = false;
+
+#if defined(RESIP_MSG_HEADER_SCANNER_SSE2)
+
+static inline unsigned int lowestSetBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+   unsigned long index;
+   _BitScanForward(&index, mask);
+   return index;
+#else
+   return __builtin_ctz(mask);
+#endif
+}
+
+static inline MsgHeaderScanner::TextPropBitMask
+textPropBitMaskOf(const char* charPtr, const char* endCharPtr)
+{
+   MsgHeaderScanner::TextPropBitMask textPropBitMask = 0;
+   for (; charPtr != endCharPtr; ++charPtr)
+   {
+      textPropBitMask |= charInfoArray[(unsigned char)*charPtr].textPropBitMask;
+   }
+   return textPropBitMask;
+}
+
+static char*
+skipRunSse2(char* charPtr,
+            char* termCharPtr,
+            const RunStopInfo& info,
+            MsgHeaderScanner::TextPropBitMask& textPropBitMask)
+{
+   if (termCharPtr - charPtr < 16)
+   {
+      return charPtr;
+   }
+   const __m128i stop0 = _mm_set1_epi8(info.stopChars[0]);
+   const __m128i stop1 = _mm_set1_epi8(info.stopChars[1]);
+   const __m128i stop2 = _mm_set1_epi8(info.stopChars[2]);
+   const __m128i stop3 = _mm_set1_epi8(info.stopChars[3]);
+   const __m128i stop4 = _mm_set1_epi8(info.stopChars[4]);
+   const __m128i stop5 = _mm_set1_epi8(info.stopChars[5]);
+   __m128i whitespaceSeen = _mm_setzero_si128();
+   __m128i backslashSeen = _mm_setzero_si128();
+   __m128i percentSeen = _mm_setzero_si128();
+   __m128i semicolonSeen = _mm_setzero_si128();
+   __m128i parenSeen = _mm_setzero_si128();
+   do
+   {
+      const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(charPtr));
+      const __m128i stops =
+         _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, stop0),
+                                                _mm_cmpeq_epi8(chars, stop1)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(chars, stop2),
+                                                _mm_cmpeq_epi8(chars, stop3))),
+                      _mm_or_si128(_mm_cmpeq_epi8(chars, stop4),
+                                   _mm_cmpeq_epi8(chars, stop5)));
+      const unsigned int stopMask = (unsigned int)_mm_movemask_epi8(stops);
+      if (stopMask)
+      {
+         char* stopCharPtr = charPtr + lowestSetBit(stopMask);
+         textPropBitMask |= textPropBitMaskOf(charPtr, stopCharPtr);
+         charPtr = stopCharPtr;
+         break;
+      }
+      whitespaceSeen = _mm_or_si128(whitespaceSeen,
+                                    _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')),
+                                                 _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t'))));
+      backslashSeen = _mm_or_si128(backslashSeen, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\\')));
+      percentSeen = _mm_or_si128(percentSeen, _mm_cmpeq_epi8(chars, _mm_set1_epi8('%')));
+      semicolonSeen = _mm_or_si128(semicolonSeen, _mm_cmpeq_epi8(chars, _mm_set1_epi8(';')));
+      parenSeen = _mm_or_si128(parenSeen,
+                               _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('(')),
+                                            _mm_cmpeq_epi8(chars, _mm_set1_epi8(')'))));
+      charPtr += 16;
+   } while (termCharPtr - charPtr >= 16);
+
+   if (_mm_movemask_epi8(whitespaceSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsWhitespace;
+   }
+   if (_mm_movemask_epi8(backslashSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsBackslash;
+   }
+   if (_mm_movemask_epi8(percentSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsPercent;
+   }
+   if (_mm_movemask_epi8(semicolonSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsSemicolon;
+   }
+   if (_mm_movemask_epi8(parenSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsParen;
+   }
+   return charPtr;
+}
+
+#endif // RESIP_MSG_HEADER_SCANNER_SSE2
+
+#if defined(RESIP_MSG_HEADER_SCANNER_AVX2)
+
+__attribute__((target("avx2"))) static char*
+skipRunAvx2(char* charPtr,
+            char* termCharPtr,
+            const RunStopInfo& info,
+            MsgHeaderScanner::TextPropBitMask& textPropBitMask)
+{
+   if (termCharPtr - charPtr < 32)
+   {
+      // Runs are often short; 16 at a time still beats 1 at a time.
+      return skipRunSse2(charPtr, termCharPtr, info, textPropBitMask);
+   }
+   const __m256i stop0 = _mm256_set1_epi8(info.stopChars[0]);
+   const __m256i stop1 = _mm256_set1_epi8(info.stopChars[1]);
+   const __m256i stop2 = _mm256_set1_epi8(info.stopChars[2]);
+   const __m256i stop3 = _mm256_set1_epi8(info.stopChars[3]);
+   const __m256i stop4 = _mm256_set1_epi8(info.stopChars[4]);
+   const __m256i stop5 = _mm256_set1_epi8(info.stopChars[5]);
+   __m256i whitespaceSeen = _mm256_setzero_si256();
+   __m256i backslashSeen = _mm256_setzero_si256();
+   __m256i percentSeen = _mm256_setzero_si256();
+   __m256i semicolonSeen = _mm256_setzero_si256();
+   __m256i parenSeen = _mm256_setzero_si256();
+   do
+   {
+      const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(charPtr));
+      const __m256i stops =
+         _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chars, stop0),
+                                                         _mm256_cmpeq_epi8(chars, stop1)),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(chars, stop2),
+                                                         _mm256_cmpeq_epi8(chars, stop3))),
+                         _mm256_or_si256(_mm256_cmpeq_epi8(chars, stop4),
+                                         _mm256_cmpeq_epi8(chars, stop5)));
+      const unsigned int stopMask = (unsigned int)_mm256_movemask_epi8(stops);
+      if (stopMask)
+      {
+         char* stopCharPtr = charPtr + lowestSetBit(stopMask);
+         textPropBitMask |= textPropBitMaskOf(charPtr, stopCharPtr);
+         charPtr = stopCharPtr;
+         break;
+      }
+      whitespaceSeen = _mm256_or_si256(whitespaceSeen,
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' ')),
+                                                       _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\t'))));
+      backslashSeen = _mm256_or_si256(backslashSeen, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\\')));
+      percentSeen = _mm256_or_si256(percentSeen, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('%')));
+      semicolonSeen = _mm256_or_si256(semicolonSeen, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(';')));
+      parenSeen = _mm256_or_si256(parenSeen,
+                                  _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('(')),
+                                                  _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(')'))));
+      charPtr += 32;
+   } while (termCharPtr - charPtr >= 32);
+
+   if (_mm256_movemask_epi8(whitespaceSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsWhitespace;
+   }
+   if (_mm256_movemask_epi8(backslashSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsBackslash;
+   }
+   if (_mm256_movemask_epi8(percentSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsPercent;
+   }
+   if (_mm256_movemask_epi8(semicolonSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsSemicolon;
+   }
+   if (_mm256_movemask_epi8(parenSeen))
+   {
+      textPropBitMask |= MsgHeaderScanner::tpbmContainsParen;
+   }
+   return charPtr;
+}
+
+#endif // RESIP_MSG_HEADER_SCANNER_AVX2
+
+static MsgHeaderScanner::ScanImplementation
+bestScanImplementation()
+{
+#if defined(RESIP_MSG_HEADER_SCANNER_AVX2)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+   {
+      return MsgHeaderScanner::siAvx2;
+   }
+#endif
+#if defined(RESIP_MSG_HEADER_SCANNER_SSE2)
+   return MsgHeaderScanner::siSse2;
+#else
+   return MsgHeaderScanner::siScalar;
+#endif
+}
+
+MsgHeaderScanner::ScanImplementation
+MsgHeaderScanner::setScanImplementation(ScanImplementation impl)
+{
+   ScanImplementation best = bestScanImplementation();
+   if (impl > best)
+   {
+      impl = best;
+   }
+   switch (impl)
+   {
+#if defined(RESIP_MSG_HEADER_SCANNER_AVX2)
+      case siAvx2:
+         skipRunFunction = skipRunAvx2;
+         break;
+#endif
+#if defined(RESIP_MSG_HEADER_SCANNER_SSE2)
+      case siSse2:
+         skipRunFunction = skipRunSse2;
+         break;
+#endif
+      default:
+         impl = siScalar;
+         skipRunFunction = 0;
+         break;
+   }
+   scanImplementation = impl;
+   isScanImplementationSelected = true;
+   return impl;
+}
+
+MsgHeaderScanner::ScanImplementation
+MsgHeaderScanner::getScanImplementation()
+{
+   return scanImplementation;
+}
+
 // Debug follows
 #if defined(RESIP_MSG_HEADER_SCANNER_DEBUG)  
 
@@ -917,6 +1223,8 @@ MsgHeaderScanner::scanChunk(char * chunk,
    MsgHeaderScanner::ScanChunkResult result;
    CharInfo* localCharInfoArray = charInfoArray;
    TransitionInfo (*localStateMachine)[numCharCategories] = stateMachine;
+   RunStopInfo* localRunStopInfoArray = runStopInfoArray;
+   SkipRunFunction localSkipRunFunction = skipRunFunction;
    State localState = mState;
    char *charPtr = chunk + mPrevScanChunkNumSavedTextChars;
    char *termCharPtr = chunk + chunkLength;
@@ -939,6 +1247,14 @@ MsgHeaderScanner::scanChunk(char * chunk,
       // The code in this block is executed once per message header character.
       // This entire file is designed specifically to minimize this block's size.
       ++charPtr;
+      if (localSkipRunFunction &&
+          localRunStopInfoArray[(unsigned)localState].numStopChars)
+      {
+         charPtr = localSkipRunFunction(charPtr,
+                                        termCharPtr,
+                                        localRunStopInfoArray[(unsigned)localState],
+                                        localTextPropBitMask);
+      }
       CharInfo *charInfo = &localCharInfoArray[((unsigned char) (*charPtr))];
       CharCategory charCategory = charInfo->category;
       localTextPropBitMask |= charInfo->textPropBitMask;
@@ -1067,6 +1383,11 @@ MsgHeaderScanner::initialize()
 {
    initCharInfoArray();
    initStateMachine();
+   initRunStopInfoArray();
+   if (!isScanImplementationSelected)
+   {
+      setScanImplementation(bestScanImplementation());
+   }
    return true;
 }
 
@@ -121,6 +121,20 @@ class MsgHeaderScanner
       // !ah! for documentation generation
       static int dumpStateMachine(int fd); 
 
+      enum ScanImplementation
+      {
+         siScalar,   // One character at a time.
+         siSse2,     // Runs of value text 16 characters at a time.
+         siAvx2      // Runs of value text 32 characters at a time.
+      };
+
+      // The fastest implementation the CPU supports is selected when the
+      // first scanner is constructed.  Asking for one the CPU does not
+      // support selects the fastest one it does; returns the one selected.
+      // Meant for tests and benchmarks, not for use while scanning.
+      static ScanImplementation setScanImplementation(ScanImplementation impl);
+      static ScanImplementation getScanImplementation();
+
    private:
 
 
@@ -1,7 +1,11 @@
 #ifndef RESIP_SendData_HXX
 #define RESIP_SendData_HXX
 
+#include <vector>
+
 #include "rutil/Data.hxx"
+#include "rutil/SharedPtr.hxx"
+#include "resip/stack/MessageBuffers.hxx"
 #include "resip/stack/Tuple.hxx"
 
 namespace resip
@@ -9,6 +13,13 @@ namespace resip
 
 /**
    @internal
+
+   The wire form of an outbound message. Normally this is just {data}; a
+   gathered SendData (see SipMessage::encodeGathered()) instead describes the
+   message as a list of segments, each either a range of {data} or a run of
+   bytes still sitting in the receive buffers of the message it was encoded
+   from, which {buffers} keeps alive. Transports that cannot send a gathered
+   SendData directly call flatten() first.
 */
 class SendData
 {
@@ -20,6 +31,27 @@ class SendData
          EnableFlowTimer
       };
 
+      /// the most segments that refer to {buffers}; each may be followed
+      /// by a segment of {data}, so a SendData has at most
+      /// 2*MaxExternalSegments+1 segments
+      static const size_t MaxExternalSegments = 64;
+
+      class Segment
+      {
+         public:
+            Segment(const char* ext, size_t off, size_t len) :
+               external(ext),
+               offset(off),
+               length(len)
+            {}
+
+            /// 0 if the segment is a range of SendData::data
+            const char* external;
+            /// offset into SendData::data, if not external
+            size_t offset;
+            size_t length;
+      };
+
       SendData() : isAlreadyCompressed(false), command(NoCommand)
       {}
 
@@ -56,11 +88,86 @@ class SendData
       void clear()
       {
          data.clear();
+         segments.clear();
+         buffers.reset();
       }
 
       bool empty() const
       {
-         return data.empty();
+         return segments.empty() ? data.empty() : size() == 0;
+      }
+
+      bool isGathered() const
+      {
+         return !segments.empty();
+      }
+
+      /// number of bytes on the wire
+      size_t size() const
+      {
+         if (segments.empty())
+         {
+            return data.size();
+         }
+         size_t total = 0;
+         for (std::vector<Segment>::const_iterator i = segments.begin(); i != segments.end(); ++i)
+         {
+            total += i->length;
+         }
+         return total;
+      }
+
+      const char* segmentData(const Segment& segment) const
+      {
+         return segment.external ? segment.external : data.data() + segment.offset;
+      }
+
+      /// the message as one contiguous Data; shares {data} if not gathered
+      Data flat() const
+      {
+         if (segments.empty())
+         {
+            return data;
+         }
+         Data result(Data::size_type(size()), Data::Preallocate);
+         for (std::vector<Segment>::const_iterator i = segments.begin(); i != segments.end(); ++i)
+         {
+            result.append(segmentData(*i), (Data::size_type)i->length);
+         }
+         return result;
+      }
+
+      /// Fills {iov} (struct iovec, or anything with iov_base/iov_len) with
+      /// the segments past the first {offset} bytes; {iov} must have room
+      /// for 2*MaxExternalSegments+1 entries. Returns the number filled.
+      template<typename IoVec>
+      int toIoVecs(IoVec* iov, size_t offset) const
+      {
+         int count = 0;
+         for (std::vector<Segment>::const_iterator i = segments.begin(); i != segments.end(); ++i)
+         {
+            if (offset >= i->length)
+            {
+               offset -= i->length;
+               continue;
+            }
+            iov[count].iov_base = const_cast<char*>(segmentData(*i) + offset);
+            iov[count].iov_len = i->length - offset;
+            offset = 0;
+            ++count;
+         }
+         return count;
+      }
+
+      /// turn a gathered SendData back into the classic form
+      void flatten()
+      {
+         if (!segments.empty())
+         {
+            data = flat();
+            segments.clear();
+            buffers.reset();
+         }
       }
 
       Tuple destination;
@@ -71,6 +178,10 @@ class SendData
 
       // .bwc. Used for special commands: ie. to close connections, and enable flow timers
       SendDataCommand command;
+
+      // empty unless gathered
+      std::vector<Segment> segments;
+      SharedPtr<MessageBuffers> buffers;
 };
 
 }
@@ -18,6 +18,8 @@
 #include "rutil/Random.hxx"
 #include "rutil/ParseBuffer.hxx"
 #include "resip/stack/MsgHeaderScanner.hxx"
+#include "resip/stack/SendData.hxx"
+#include "rutil/DataStream.hxx"
 //#include "rutil/WinLeakCheck.hxx"  // not compatible with placement new used below
 
 using namespace resip;
@@ -85,9 +87,9 @@ SipMessage::~SipMessage()
 {
 //#define DINKYPOOL_PROFILING
 #ifdef DINKYPOOL_PROFILING
-   if (mPool.getHeapBytes() > 0)
+   if (mPool.getHeapBytes() > 0 || mPool.getSlabCount() > 0)
    {
-       InfoLog(<< "SipMessage mPool filled up and used " << mPool.getHeapBytes() << " bytes on the heap, consider increasing the mPool size (sizeof SipMessage is " << sizeof(SipMessage) << " bytes): msg="
+       InfoLog(<< "SipMessage mPool filled up and used " << mPool.getSlabCount() << " slabs and " << mPool.getHeapBytes() << " bytes on the heap, consider increasing the mPool size (sizeof SipMessage is " << sizeof(SipMessage) << " bytes): msg="
            << std::endl << *this);
    }
    else
@@ -110,6 +112,7 @@ SipMessage::clear(bool leaveResponseStuff)
       // !bwc! The "invalid" 0 index.
       mHeaders.push_back(getEmptyHfvl());
       mBufferList.clear();
+      mSharedBuffers.reset();
    }
 
    mUnknownHeaders.clear();
@@ -232,11 +235,8 @@ SipMessage::freeMem(bool leaveResponseStuff)
    {
       clearHeaders();
 
-      for (vector<char*>::iterator i = mBufferList.begin();
-           i != mBufferList.end(); i++)
-      {
-         delete [] *i;
-      }
+      mBufferList.clear();
+      mSharedBuffers.reset();
    }
 
    if(mStartLine)
@@ -276,7 +276,7 @@ SipMessage::make(const Data& data, bool isExternal)
    size_t len = data.size();
    char *buffer = new char[len + 5];
 
-   msg->addBuffer(buffer);
+   msg->addBuffer(buffer, len);
    memcpy(buffer,data.data(), len);
    MsgHeaderScanner msgHeaderScanner;
    msgHeaderScanner.prepareForMessage(msg);
@@ -381,6 +381,22 @@ SipMessage::getTransactionId() const
    }
 }
 
+size_t
+SipMessage::getTransactionIdHash() const
+{
+   if (!empty(h_Vias))
+   {
+      const Via& via = header(h_Vias).front();
+      if (via.exists(p_branch) &&
+          via.param(p_branch).hasMagicCookie() &&
+          !via.param(p_branch).getTransactionId().empty())
+      {
+         return via.param(p_branch).getTransactionIdHash();
+      }
+   }
+   return getTransactionId().caseInsensitiveTokenHash();
+}
+
 void
 SipMessage::compute2543TransactionHash() const
 {
@@ -859,10 +875,153 @@ SipMessage::encodeEmbedded(EncodeStream& str) const
    return str;
 }
 
+namespace
+{
+
+// Runs shorter than this are cheaper to copy than to send from their own
+// iovec.
+const size_t MinGatherSegment = 64;
+
+/**
+   DataBuffer that, instead of copying them, records writes of text that lies
+   in a message's receive buffers as external segments of a SendData. Every
+   other write is appended to SendData::data as usual and becomes an
+   internal segment.
+*/
+class GatherBuffer : public DataBuffer
+{
+   public:
+      GatherBuffer(SendData& sendData, const MessageBuffers& buffers)
+         : DataBuffer(sendData.data),
+           mSendData(sendData),
+           mBuffers(buffers),
+           mMark(0),
+           mExternal(0)
+      {}
+
+      /// closes the trailing internal segment; leaves the SendData in the
+      /// classic form if nothing was referenced
+      void finish()
+      {
+#ifdef RESIP_USE_STL_STREAMS
+         sync();
+#endif
+         if (mExternal == 0)
+         {
+            mSendData.segments.clear();
+         }
+         else
+         {
+            closeInternal();
+         }
+      }
+
+   protected:
+#ifdef RESIP_USE_STL_STREAMS
+      virtual std::streamsize xsputn(const char* s, std::streamsize n)
+      {
+         if (n > 0 && reference(s, (size_t)n))
+         {
+            return n;
+         }
+         return DataBuffer::xsputn(s, n);
+      }
+#else
+      virtual size_t writebuf(const char* s, size_t count)
+      {
+         if (reference(s, count))
+         {
+            return count;
+         }
+         return DataBuffer::writebuf(s, count);
+      }
+#endif
+
+   private:
+      bool reference(const char* s, size_t n)
+      {
+         if (n < MinGatherSegment ||
+             mExternal == SendData::MaxExternalSegments ||
+             !mBuffers.contains(s, n))
+         {
+            return false;
+         }
+#ifdef RESIP_USE_STL_STREAMS
+         // commit the put area so mStr.size() is current
+         sync();
+#endif
+         closeInternal();
+         mSendData.segments.push_back(SendData::Segment(s, 0, n));
+         ++mExternal;
+         return true;
+      }
+
+      void closeInternal()
+      {
+         size_t end = mStr.size();
+         if (end > mMark)
+         {
+            mSendData.segments.push_back(SendData::Segment(0, mMark, end - mMark));
+            mMark = end;
+         }
+      }
+
+      SendData& mSendData;
+      const MessageBuffers& mBuffers;
+      size_t mMark;
+      size_t mExternal;
+};
+
+}
+
 void
-SipMessage::addBuffer(char* buf)
+SipMessage::encodeGathered(SendData& sendData) const
 {
-   mBufferList.push_back(buf);
+   sendData.segments.clear();
+   sendData.buffers.reset();
+
+   if (mBufferList.empty() && !mSharedBuffers.get())
+   {
+      DataStream str(sendData.data);
+      encode(str);
+      return;
+   }
+
+   if (!mSharedBuffers.get())
+   {
+      mSharedBuffers.reset(new MessageBuffers);
+      mSharedBuffers->swap(mBufferList);
+   }
+
+   GatherBuffer buf(sendData, *mSharedBuffers);
+   {
+#ifdef RESIP_USE_STL_STREAMS
+      std::ostream str(&buf);
+#else
+      ResipFastOStream str(&buf);
+#endif
+      encode(str);
+      str.flush();
+   }
+   buf.finish();
+
+   if (sendData.isGathered())
+   {
+      sendData.buffers = mSharedBuffers;
+   }
+}
+
+void
+SipMessage::addBuffer(char* buf, size_t size)
+{
+   if (mSharedBuffers.get())
+   {
+      mSharedBuffers->add(buf, size);
+   }
+   else
+   {
+      mBufferList.add(buf, size);
+   }
 }
 
 void 
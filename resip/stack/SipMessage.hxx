@@ -19,9 +19,10 @@
 #include "resip/stack/MessageDecorator.hxx"
 #include "resip/stack/Cookie.hxx"
 #include "resip/stack/WsCookieContext.hxx"
+#include "resip/stack/MessageBuffers.hxx"
 #include "rutil/BaseException.hxx"
 #include "rutil/Data.hxx"
-#include "rutil/DinkyPool.hxx"
+#include "rutil/SlabPool.hxx"
 #include "rutil/StlPoolAllocator.hxx"
 #include "rutil/Timer.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
@@ -33,6 +34,7 @@ namespace resip
 class Contents;
 class ExtensionHeader;
 class SecurityAttributes;
+class SendData;
 
 /**
    @ingroup resip_crit
@@ -173,6 +175,10 @@ class SipMessage : public TransactionMessage
       /// Returns the transaction id from the branch or if 2543, the computed hash.
       virtual const Data& getTransactionId() const;
 
+      /// Returns the hash of getTransactionId(); for RFC 3261 branches this was
+      /// computed when the top Via was parsed.
+      virtual size_t getTransactionIdHash() const;
+
       /**
          @brief Calculates an MD5 hash over the Request-URI, To tag (for
          non-INVITE transactions), From tag, Call-ID, CSeq (including
@@ -268,6 +274,18 @@ class SipMessage : public TransactionMessage
       //friendship to hide this?
       virtual EncodeStream& encodeSipFrag(EncodeStream& str) const;
       EncodeStream& encodeEmbedded(EncodeStream& str) const;
+
+      /** @brief Encode into a gathered SendData for the transports.
+
+          Produces the same bytes as encode(), except that header values and
+          body text still sitting unmodified in this message's receive
+          buffers are referenced instead of copied; sendData.data only holds
+          what had to be freshly encoded. The buffers are shared with
+          sendData, so it stays valid after this message is deleted. Falls
+          back to a plain encode into sendData.data when nothing is worth
+          referencing.
+      */
+      void encodeGathered(SendData& sendData) const;
       
       virtual EncodeStream& encodeBrief(EncodeStream& str) const;
       EncodeStream& encodeSingleHeader(Headers::Type type, EncodeStream& str) const;
@@ -534,7 +552,11 @@ class SipMessage : public TransactionMessage
       void setDestination(const Tuple& tuple) { mDestination = tuple; }
       Tuple& getDestination() { return mDestination; }
 
-      void addBuffer(char* buf);
+      /// takes ownership of a receive buffer (allocated with new[]) of
+      /// {size} bytes that header values or the body point into; a size of
+      /// 0 keeps the buffer out of encodeGathered()
+      void addBuffer(char* buf, size_t size);
+      void addBuffer(char* buf) { addBuffer(buf, 0); }
 
       UInt64 getCreatedTimeMicroSec() {return mCreatedTime;}
 
@@ -563,6 +585,9 @@ class SipMessage : public TransactionMessage
       void setSecurityAttributes(std::auto_ptr<SecurityAttributes>);
       const SecurityAttributes* getSecurityAttributes() const { return mSecurityAttributes.get(); }
 
+      /// Slabs taken by this message's pool once its inline buffer filled up
+      size_t getPoolSlabCount() const { return mPool.getSlabCount(); }
+
       /// @brief Call a MessageDecorator to process the message before it is
       /// sent to the transport
       void addOutboundDecorator(std::auto_ptr<MessageDecorator> md){mOutboundDecorators.push_back(md.release());}
@@ -663,11 +688,13 @@ class SipMessage : public TransactionMessage
       // generated request), set by the Transport and setFromTu and setFromExternal APIs
       bool mIsExternal;
 
-      // Sizing so that average SipMessages don't need to allocate heap memory
-      // To profile current sizing, enable DINKYPOOL_PROFILING in SipMessage.cxx 
-      // and look for DebugLog message in SipMessage destructor to know when heap
-      // allocations are occuring and how much of the pool is used.
-      DinkyPool<3732> mPool;
+      // Sizing so that average SipMessages don't need to allocate heap memory;
+      // larger ones continue in slabs from a per-thread cache (see
+      // SlabCache::dump() for totals). To profile current sizing, enable
+      // DINKYPOOL_PROFILING in SipMessage.cxx and look for DebugLog message in
+      // SipMessage destructor to know when slabs or heap allocations are being
+      // used and how much of the pool is used.
+      SlabPool<3732> mPool;
 
       typedef std::vector<HeaderFieldValueList*, 
                            StlPoolAllocator<HeaderFieldValueList*, 
@@ -692,8 +719,11 @@ class SipMessage : public TransactionMessage
       // Used by the TU to specify where a message is to go
       Tuple mDestination;
       
-      // Raw buffers coming from the Transport. message manages the memory
-      std::vector<char*> mBufferList;
+      // Raw buffers coming from the Transport. message manages the memory;
+      // moved into mSharedBuffers the first time encodeGathered() references
+      // them
+      mutable MessageBuffers mBufferList;
+      mutable SharedPtr<MessageBuffers> mSharedBuffers;
 
       // special case for the first line of message
       StartLine* mStartLine;
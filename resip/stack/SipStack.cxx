@@ -9,6 +9,8 @@
 #include <arpa/inet.h>
 #endif
 
+#include <algorithm>
+
 #include "rutil/compat.hxx"
 #include "rutil/Data.hxx"
 #include "rutil/DnsUtil.hxx"
@@ -17,6 +19,7 @@
 #include "rutil/Random.hxx"
 #include "rutil/Socket.hxx"
 #include "rutil/Timer.hxx"
+#include "rutil/SlabPool.hxx"
 #include "rutil/FdPoll.hxx"
 
 #include "rutil/dns/DnsThread.hxx"
@@ -34,6 +37,7 @@
 #include "resip/stack/TransactionUser.hxx"
 #include "resip/stack/TransactionUserMessage.hxx"
 #include "resip/stack/TransactionControllerThread.hxx"
+#include "resip/stack/TransactionState.hxx"
 #include "resip/stack/TransportSelectorThread.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
@@ -108,6 +112,7 @@ SipStack::SipStack(Security* pSecurity,
    mShuttingDown(false),
    mStatisticsManagerEnabled(true),
    mSocketFunc(socketFunc),
+   mLockFreeFifos(false),
    mNextTransportKey(1)
 {
    Timer::getTimeMs(); // initalize time offsets
@@ -213,6 +218,13 @@ SipStack::init(const SipStackOptions& options)
    mStatisticsManagerEnabled = true;
    mSocketFunc = options.mSocketFunc;
 
+   mLockFreeFifos = options.mLockFreeFifos;
+   if(mLockFreeFifos)
+   {
+      mTUFifo.setLockFree(true);
+      mTransactionController->transportSelector().stateMacFifo().setLockFree(true);
+   }
+
    // .kw. note that stats manager has already called getTimeMs()
    Timer::getTimeMs(); // initalize time offsets
    Random::initialize();
@@ -472,6 +484,58 @@ SipStack::addTransport( TransportType protocol,
    return transport;
 }
 
+Transport*
+SipStack::addShardedUdpTransport(int port,
+                                 unsigned int numShards,
+                                 IpVersion version,
+                                 StunSetting stun,
+                                 const Data& ipInterface,
+                                 unsigned transportFlags,
+                                 std::vector<Transport*>* shards)
+{
+   resip_assert(!mShuttingDown);
+   resip_assert(numShards > 0);
+
+   transportFlags |= RESIP_TRANSPORT_FLAG_REUSEPORT | RESIP_TRANSPORT_FLAG_OWNTHREAD;
+   Fifo<TransactionMessage>& stateMacFifo = mTransactionController->transportSelector().stateMacFifo();
+   Transport* first = 0;
+   for(unsigned int i = 0; i < numShards; ++i)
+   {
+      UdpTransport* transport = 0;
+      try
+      {
+         transport = new UdpTransport(stateMacFifo, port, version, stun, ipInterface, mSocketFunc, *mCompression, transportFlags);
+      }
+      catch (BaseException& e)
+      {
+         ErrLog(<< "Failed to create UDP transport shard " << i << ": "
+                << (version == V4 ? "V4" : "V6") << " " << port << " on "
+                << (ipInterface.empty() ? "ANY" : ipInterface.c_str())
+                << ": " << e);
+         throw;
+      }
+
+      transport->setRunOwnThread(true);
+      if(first)
+      {
+         transport->setShardGroup(first->getKey());
+      }
+      addTransport(std::auto_ptr<Transport>(transport));
+      if(shards)
+      {
+         shards->push_back(transport);
+      }
+      if(!first)
+      {
+         first = transport;
+         // if an ephemeral port was requested, the other shards must share it
+         port = first->port();
+      }
+   }
+   InfoLog(<< "Added " << numShards << " UDP transport shards on " << first->getTuple());
+   return first;
+}
+
 void
 SipStack::addTransport(std::auto_ptr<Transport> transport)
 {
@@ -482,6 +546,41 @@ SipStack::addTransport(std::auto_ptr<Transport> transport)
                transport->ipVersion(), transport->transport(),
                Data::Empty, // target domain
                transport->netNs());
+   if(transport->getShardGroup())
+   {
+      // Additional shard of a transport that is already registered under this
+      // tuple; aliases and ports were accounted for by the first shard.
+      NonSecureTransportMap::iterator it = mNonSecureTransports.find(tuple);
+      if(it == mNonSecureTransports.end() || it->second->getKey() != transport->getShardGroup())
+      {
+         ErrLog(<< "Failed to add transport shard, no matching first shard: " << tuple);
+         throw Transport::Exception("Failed to add transport shard, no matching first shard.", __FILE__,__LINE__);
+      }
+      transport->setKey(mNextTransportKey++);
+      mTransportShards[transport->getShardGroup()].push_back(transport->getKey());
+      if(mCongestionManager)
+      {
+         transport->setCongestionManager(mCongestionManager);
+      }
+      if(mLockFreeFifos)
+      {
+         transport->setLockFreeTxFifo(true);
+      }
+      if(mTransportSipMessageLoggingHandler.get())
+      {
+         transport->setSipMessageLoggingHandler(mTransportSipMessageLoggingHandler);
+      }
+      if(mProcessingHasStarted)
+      {
+         mTransactionController->addTransport(transport);
+      }
+      else
+      {
+         mTransactionController->transportSelector().addTransport(transport, false /* isStackRunning */);
+      }
+      return;
+   }
+
    if(!isSecure(transport->transport()))
    {
       if(mNonSecureTransports.count(tuple) == 0)
@@ -551,6 +650,11 @@ SipStack::addTransport(std::auto_ptr<Transport> transport)
        transport->setCongestionManager(mCongestionManager);
    }
 
+   if(mLockFreeFifos)
+   {
+      transport->setLockFreeTxFifo(true);
+   }
+
    // Set Sip Message Logging Handler if one was provided
    if(mTransportSipMessageLoggingHandler.get())
    {
@@ -575,6 +679,29 @@ SipStack::removeTransport(unsigned int transportKey)
    Tuple removeTuple;
    Transport* transportToRemove = 0;
 
+   // Removing a single additional shard of a sharded transport?
+   for(TransportShardMap::iterator itSh = mTransportShards.begin(); itSh != mTransportShards.end(); itSh++)
+   {
+      std::list<unsigned int>::iterator itKey = std::find(itSh->second.begin(), itSh->second.end(), transportKey);
+      if(itKey != itSh->second.end())
+      {
+         itSh->second.erase(itKey);
+         if(itSh->second.empty())
+         {
+            mTransportShards.erase(itSh);
+         }
+         if(mProcessingHasStarted)
+         {
+            mTransactionController->removeTransport(transportKey);
+         }
+         else
+         {
+            mTransactionController->transportSelector().removeTransport(transportKey);
+         }
+         return;
+      }
+   }
+
    // Find transport using Key in SipStack lists(sets)
    for(NonSecureTransportMap::iterator itNS = mNonSecureTransports.begin(); itNS != mNonSecureTransports.end(); itNS++)
    {
@@ -606,6 +733,26 @@ SipStack::removeTransport(unsigned int transportKey)
       return;
    }
 
+   // Removing the first shard takes the other shards down with it
+   TransportShardMap::iterator itShards = mTransportShards.find(transportKey);
+   if(itShards != mTransportShards.end())
+   {
+      std::list<unsigned int> shards;
+      shards.swap(itShards->second);
+      mTransportShards.erase(itShards);
+      for(std::list<unsigned int>::iterator itKey = shards.begin(); itKey != shards.end(); itKey++)
+      {
+         if(mProcessingHasStarted)
+         {
+            mTransactionController->removeTransport(*itKey);
+         }
+         else
+         {
+            mTransactionController->transportSelector().removeTransport(*itKey);
+         }
+      }
+   }
+
    if(mSecureTransports.size() == 0 && mNonSecureTransports.size() == 0)
    {
       // If we have no more transports we can just clear out the mDomains map and mUri
@@ -1246,8 +1393,20 @@ SipStack::dump(EncodeStream& strm)  const
       Lock lock(mAppTimerMutex);
       strm << " AppTimers size=" << this->mAppTimers.size() << std::endl;
    }
-   strm << " ServerTransactionMap size=" << this->mTransactionController->mServerTransactionMap.size() << std::endl
-        << " ClientTransactionMap size=" << this->mTransactionController->mClientTransactionMap.size() << std::endl
+   const TransactionMap& serverMap = this->mTransactionController->mServerTransactionMap;
+   const TransactionMap& clientMap = this->mTransactionController->mClientTransactionMap;
+   strm << " ServerTransactionMap size=" << serverMap.size()
+        << " indexBytes=" << serverMap.getMemoryUsage()
+        << " bytesPerTransaction=" << (serverMap.size() ? serverMap.getMemoryUsage()/serverMap.size() : 0) << std::endl
+        << " ClientTransactionMap size=" << clientMap.size()
+        << " indexBytes=" << clientMap.getMemoryUsage()
+        << " bytesPerTransaction=" << (clientMap.size() ? clientMap.getMemoryUsage()/clientMap.size() : 0) << std::endl
+        << " TransactionState size=" << sizeof(TransactionState) << std::endl;
+   SlabCache::Stats slabStats(SlabCache::getStats());
+   strm << " SipMessage pools=" << slabStats.mPools
+        << " pooledBytesPerMessage=" << (slabStats.mPools ? slabStats.mPooledBytes/slabStats.mPools : 0)
+        << " heapBytesPerMessage=" << (slabStats.mPools ? slabStats.mHeapBytes/slabStats.mPools : 0)
+        << " slabs=" << slabStats.mSlabs << " slabsFromHeap=" << slabStats.mSlabsFromHeap << std::endl
         // !slg! TODO - There is technically a threading concern with the following three lines and the runtime addTransport or removeTransport call
         << " Exact interface / Specific port=" << Inserter(this->mTransactionController->mTransportSelector.mExactTransports) << std::endl
         << " Any interface / Specific port=" << Inserter(this->mTransactionController->mTransportSelector.mAnyInterfaceTransports) << std::endl
@@ -6,6 +6,7 @@
 #endif
 
 #include <set>
+#include <list>
 #include <iosfwd>
 
 #include "rutil/CongestionManager.hxx"
@@ -109,7 +110,7 @@ class SipStackOptions
          : mSecurity(0), mExtraNameserverList(0),
            mAsyncProcessHandler(0), mStateless(false),
            mSocketFunc(0), mCompression(0), mPollGrp(0),
-           mUseDnsVip(false)
+           mUseDnsVip(false), mLockFreeFifos(false)
       {
       }
 
@@ -121,6 +122,10 @@ class SipStackOptions
       Compression *mCompression;
       FdPollGrp* mPollGrp;
       bool mUseDnsVip;
+      // Put the stack's multi-producer fifos (the TU fifo, the transaction
+      // fifo and each transport's tx fifo) in lock-free mode; see
+      // AbstractFifo::setLockFree().
+      bool mLockFreeFifos;
 };
 
 
@@ -362,6 +367,38 @@ class SipStack : public FdSetIOObserver
       */
       void addTransport(std::auto_ptr<Transport> transport);
 
+      /**
+         Adds a UDP transport that is opened {numShards} times on the same
+         interface and port using SO_REUSEPORT.  Each shard is a separate
+         UdpTransport with its own socket, receive buffer, tx fifo and
+         TransportThread, and the kernel spreads inbound datagrams across
+         the shards by flow.  Responses leave through the shard that received
+         the request; new outbound requests are spread across the shards by
+         destination.
+
+         @throws Transport::Exception If a shard couldn't be added, or if
+                                      SO_REUSEPORT is not supported.
+
+         @param numShards             Number of sockets/threads to open.
+
+         @param transportFlags        RESIP_TRANSPORT_FLAG_REUSEPORT and
+                                      RESIP_TRANSPORT_FLAG_OWNTHREAD are
+                                      always added.
+
+         @param shards                If not null, receives all the shards
+                                      (e.g. to call setRcvBufLen() on each).
+
+         @returns                     The first shard.  Passing its key to
+                                      removeTransport() removes all shards.
+      */
+      Transport* addShardedUdpTransport(int port,
+                                        unsigned int numShards,
+                                        IpVersion version=V4,
+                                        StunSetting stun=StunDisabled,
+                                        const Data& ipInterface = Data::Empty,
+                                        unsigned transportFlags = 0,
+                                        std::vector<Transport*>* shards = 0);
+
       /**
           Used to remove a previously added transport.
 
@@ -1165,12 +1202,16 @@ class SipStack : public FdSetIOObserver
       NonSecureTransportMap mNonSecureTransports;
       typedef std::map<TransportSelector::TlsTransportKey, Transport*> SecureTransportMap;
       SecureTransportMap mSecureTransports;
+      // keys of the additional shards of a sharded transport, by first shard key
+      typedef std::map<unsigned int, std::list<unsigned int> > TransportShardMap;
+      TransportShardMap mTransportShards;
 
       bool mShuttingDown;
       mutable Mutex mShutdownMutex;
       volatile bool mStatisticsManagerEnabled;
 
       AfterSocketCreationFuncPtr mSocketFunc;
+      bool mLockFreeFifos;
 
       unsigned int mNextTransportKey;
 
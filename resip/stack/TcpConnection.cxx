@@ -7,6 +7,10 @@
 #include "resip/stack/TcpConnection.hxx"
 #include "resip/stack/Tuple.hxx"
 
+#if !defined(WIN32)
+#include <sys/uio.h>
+#endif
+
 using namespace resip;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
@@ -108,6 +112,45 @@ TcpConnection::write( const char* buf, const int count )
    return bytesWritten;
 }
 
+bool
+TcpConnection::canWriteGathered() const
+{
+#if defined(WIN32)
+   return false;
+#else
+   return true;
+#endif
+}
+
+int
+TcpConnection::writeGathered(const SendData& data, size_t offset)
+{
+#if defined(WIN32)
+   resip_assert(0);
+   return -1;
+#else
+   struct iovec iov[2*SendData::MaxExternalSegments + 1];
+   int iovcnt = data.toIoVecs(iov, offset);
+   resip_assert(iovcnt > 0);
+
+   int bytesWritten = (int)::writev(getSocket(), iov, iovcnt);
+
+   if (bytesWritten == INVALID_SOCKET)
+   {
+      int e = getErrno();
+      if (e == EAGAIN || e == EWOULDBLOCK)
+      {
+          return 0;
+      }
+      InfoLog (<< "Failed writev on " << getSocket() << " " << strerror(e));
+      Transport::error(e);
+      return -1;
+   }
+
+   return bytesWritten;
+#endif
+}
+
 bool 
 TcpConnection::hasDataToRead()
 {
@@ -54,6 +54,16 @@ TcpTransport::createConnection(const Tuple& who, Socket fd, bool server)
    return conn;
 }
 
+bool
+TcpTransport::supportsGatheredSend() const
+{
+#ifdef WIN32
+   return false;
+#else
+   return true;
+#endif
+}
+
 
 /* ====================================================================
  * The Vovida Software License, Version 1.0
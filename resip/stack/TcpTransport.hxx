@@ -22,6 +22,9 @@ class TcpTransport : public TcpBaseTransport
                    const Data& netNs = Data::Empty);
       virtual  ~TcpTransport();
 
+      /// gathered SendData are written with writev() by TcpConnection
+      virtual bool supportsGatheredSend() const;
+
    protected:
       Connection* createConnection(const Tuple& who, Socket fd, bool server=false);
 };
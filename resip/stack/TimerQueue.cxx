@@ -33,52 +33,47 @@ DtlsTimerQueue::DtlsTimerQueue( Fifo<DtlsMessage>& fifo )
 
 DtlsTimerQueue::~DtlsTimerQueue()
 {
-   while(!mTimers.empty())
-   {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
-   }
+   clear();
 }
 
 #endif
 
-UInt64
+TransactionTimerQueue::Id
 TransactionTimerQueue::add(Timer::Type type, const Data& transactionId, unsigned long msOffset)
 {
    TransactionTimer t(msOffset, type, transactionId);
-   mTimers.push(t);
    DebugLog (<< "Adding timer: " << Timer::toData(type) << " tid=" << transactionId << " ms=" << msOffset);
-   return mTimers.top().getWhen();
+   return mTimers.add(t);
 }
 
 #ifdef USE_DTLS
 
-UInt64
+DtlsTimerQueue::Id
 DtlsTimerQueue::add( SSL *ssl, unsigned long msOffset )
 {
    TimerWithPayload t( msOffset, new DtlsMessage( ssl ) ) ;
-   mTimers.push( t ) ;
-   return mTimers.top().getWhen();
+   return mTimers.add( t ) ;
 }
 
 #endif
 
 BaseTimeLimitTimerQueue::~BaseTimeLimitTimerQueue()
 {
-   while(!mTimers.empty())
-   {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
-   }
+   clear();
 }
 
-UInt64
+BaseTimeLimitTimerQueue::Id
 BaseTimeLimitTimerQueue::add(unsigned int timeMs,Message* payload)
 {
    resip_assert(payload);
    DebugLog(<< "Adding application timer: " << payload->brief() << " ms=" << timeMs);
-   mTimers.push(TimerWithPayload(timeMs,payload));
-   return mTimers.top().getWhen();
+   return mTimers.add(TimerWithPayload(timeMs,payload));
+}
+
+void
+BaseTimeLimitTimerQueue::discardTimer(const TimerWithPayload& timer)
+{
+   delete timer.getMessage();
 }
 
 void
@@ -110,20 +105,21 @@ TuSelectorTimerQueue::TuSelectorTimerQueue(TuSelector& sel) : mFifoSelector(sel)
 
 TuSelectorTimerQueue::~TuSelectorTimerQueue()
 {
-   while(!mTimers.empty())
-   {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
-   }
+   clear();
 }
 
-UInt64
+TuSelectorTimerQueue::Id
 TuSelectorTimerQueue::add(unsigned int timeMs,Message* payload)
 {
    resip_assert(payload);
    DebugLog(<< "Adding application timer: " << payload->brief() << " ms=" << timeMs);
-   mTimers.push(TimerWithPayload(timeMs,payload));
-   return mTimers.top().getWhen();
+   return mTimers.add(TimerWithPayload(timeMs,payload));
+}
+
+void
+TuSelectorTimerQueue::discardTimer(const TimerWithPayload& timer)
+{
+   delete timer.getMessage();
 }
 
 void
@@ -141,6 +137,12 @@ DtlsTimerQueue::processTimer(const TimerWithPayload& timer)
    mFifo.add( (DtlsMessage *)timer.getMessage() ) ;
 }
 
+void
+DtlsTimerQueue::discardTimer(const TimerWithPayload& timer)
+{
+   delete timer.getMessage();
+}
+
 #endif
 
 /* ====================================================================
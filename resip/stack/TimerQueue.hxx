@@ -14,10 +14,7 @@
 #include "rutil/Fifo.hxx"
 #include "rutil/TimeLimitFifo.hxx"
 #include "rutil/Timer.hxx"
-
-// .dlb. 
-// to do: timer wheel for transaction-bound timers and a heap for
-// everything longer.
+#include "rutil/TimerWheel.hxx"
 
 namespace resip
 {
@@ -31,27 +28,26 @@ class TuSelector;
   * @brief This class takes a fifo as a place to where you can write your stuff.
   * When using this in the main loop, call process() on this.
   * During Transaction processing, TimerMessages and SIP messages are generated.
-  * 
-    @todo .dlb. timer wheel for transaction-bound timers and a heap for 
-      everything longer.
+  *
+  * Timers are kept in a TimerWheel, so adding a timer costs the same no
+  * matter how many are pending, and a timer that is no longer needed can be
+  * removed with cancel() instead of being left to fire.
   */
 template <class T>
 class TimerQueue
 {
    public:
+      /// identifies a timer added to this queue; see cancel()
+      typedef typename TimerWheel<T>::Id Id;
+
       // This is the logic that runs when a timer goes off. This is the only
       // thing subclasses must implement.
       virtual void processTimer(const T& timer)=0;
 
-      /// @brief deletes the message associated with the timer as well.
+      /// @brief subclasses that own a payload must call clear() from their
+      /// destructor
       virtual ~TimerQueue()
       {
-         //xkd-2004-11-4
-         // delete the message associated with the timer
-         while (!mTimers.empty())
-         {
-            mTimers.pop();
-         }
       }
 
       /// @brief provides the time in milliseconds before the next timer will fire
@@ -63,7 +59,7 @@ class TimerQueue
       {
          if (!mTimers.empty())
          {
-            UInt64 next = mTimers.top().getWhen();
+            UInt64 next = mTimers.nextWhen();
             UInt64 now = Timer::getTimeMs();
             if (now > next) 
             {
@@ -95,21 +91,36 @@ class TimerQueue
       {
          if (!mTimers.empty())
          {
-            UInt64 now=Timer::getTimeMs();
-            while (!mTimers.empty() && !(mTimers.top().getWhen() > now))
-            {
-               processTimer(mTimers.top());
-               mTimers.pop();
-            }
+            Expire expire(*this);
+            mTimers.expire(Timer::getTimeMs(), expire);
 
             if(!mTimers.empty())
             {
-               return mTimers.top().getWhen();
+               return mTimers.nextWhen();
             }
          }
          return 0;
       }
 
+      /// @brief removes a timer before it fires; any payload is released.
+      /// @retval false the timer has already fired or been cancelled
+      bool cancel(Id id)
+      {
+         const T* timer = mTimers.find(id);
+         if (!timer)
+         {
+            return false;
+         }
+         discardTimer(*timer);
+         return mTimers.cancel(id);
+      }
+
+      /// @brief true if the timer has neither fired nor been cancelled
+      bool isPending(Id id) const
+      {
+         return mTimers.find(id) != 0;
+      }
+
       int size() const
       {
          return (int)mTimers.size();
@@ -149,8 +160,39 @@ class TimerQueue
 #endif
 
    protected:
-      typedef std::vector<T, std::allocator<T> > TimerVector;
-      std::priority_queue<T, TimerVector, std::greater<T> > mTimers;
+      /// @brief called for a timer that is dropped without firing, by cancel()
+      /// or clear()
+      virtual void discardTimer(const T&)
+      {
+      }
+
+      /// @brief drops every pending timer, passing each to discardTimer()
+      void clear()
+      {
+         Discard discard(*this);
+         mTimers.clear(discard);
+      }
+
+      TimerWheel<T> mTimers;
+
+   private:
+      class Expire
+      {
+         public:
+            Expire(TimerQueue& queue) : mQueue(queue) {}
+            void operator()(const T& timer) { mQueue.processTimer(timer); }
+         private:
+            TimerQueue& mQueue;
+      };
+
+      class Discard
+      {
+         public:
+            Discard(TimerQueue& queue) : mQueue(queue) {}
+            void operator()(const T& timer) { mQueue.discardTimer(timer); }
+         private:
+            TimerQueue& mQueue;
+      };
 };
 
 /**
@@ -160,9 +202,10 @@ class BaseTimeLimitTimerQueue : public TimerQueue<TimerWithPayload>
 {
    public:
       ~BaseTimeLimitTimerQueue();
-      UInt64 add(unsigned int timeMs,Message* payload);
+      Id add(unsigned int timeMs,Message* payload);
       virtual void processTimer(const TimerWithPayload& timer);
    protected:
+      virtual void discardTimer(const TimerWithPayload& timer);
       virtual void addToFifo(Message*, TimeLimitFifo<Message>::DepthUsage)=0;      
 };
 
@@ -189,8 +232,10 @@ class TuSelectorTimerQueue : public TimerQueue<TimerWithPayload>
    public:
       TuSelectorTimerQueue(TuSelector& sel);
       ~TuSelectorTimerQueue();
-      UInt64 add(unsigned int timeMs,Message* payload);
+      Id add(unsigned int timeMs,Message* payload);
       virtual void processTimer(const TimerWithPayload& timer);
+   protected:
+      virtual void discardTimer(const TimerWithPayload& timer);
    private:
       TuSelector& mFifoSelector;
 };
@@ -203,7 +248,7 @@ class TransactionTimerQueue : public TimerQueue<TransactionTimer>
 {
    public:
       TransactionTimerQueue(Fifo<TimerMessage>& fifo);
-      UInt64 add(Timer::Type type, const Data& transactionId, unsigned long msOffset);
+      Id add(Timer::Type type, const Data& transactionId, unsigned long msOffset);
       virtual void processTimer(const TransactionTimer& timer);
    private:
       Fifo<TimerMessage>& mFifo;
@@ -221,9 +266,12 @@ class DtlsTimerQueue : public TimerQueue<TimerWithPayload>
    public:
       DtlsTimerQueue(Fifo<DtlsMessage>& fifo);
       ~DtlsTimerQueue();
-      UInt64 add(SSL *, unsigned long msOffset);
+      Id add(SSL *, unsigned long msOffset);
       virtual void processTimer(const TimerWithPayload& timer) ;
-      
+
+   protected:
+      virtual void discardTimer(const TimerWithPayload& timer);
+
    private:
       Fifo<DtlsMessage>& mFifo ;
 };
@@ -142,14 +142,15 @@ class TransactionController
       // Used to decide which transport to send a sip message on. 
       TransportSelector mTransportSelector;
 
+      // timers associated with the transactions. When a timer fires, it is
+      // placed in the mStateMacFifo. Declared ahead of the transaction maps
+      // since TransactionStates cancel their timers when they are destroyed.
+      TransactionTimerQueue  mTimers;
+
       // stores all of the transactions that are currently active in this stack 
       TransactionMap mClientTransactionMap;
       TransactionMap mServerTransactionMap;
 
-      // timers associated with the transactions. When a timer fires, it is
-      // placed in the mStateMacFifo
-      TransactionTimerQueue  mTimers;
-
       bool mShuttingDown;
       
       StatisticsManager& mStatsManager;
@@ -163,6 +164,7 @@ class TransactionController
 
       friend class TestDnsResolver;
       friend class TestFSM;
+      friend class TestTransactionMap;
 };
 
 
@@ -10,23 +10,47 @@ using namespace resip;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSACTION
 
+static const size_t NotFound = (size_t)-1;
+static const size_t MinSlots = 64;
+
+TransactionMap::TransactionMap()
+   : mMask(0),
+     mCount(0)
+{
+}
+
 TransactionMap::~TransactionMap()
 {
-   //DebugLog (<< "Deleting TransactionMap: " << this << " " << mMap.size() << " entries");
-   while (!mMap.empty())
+   //DebugLog (<< "Deleting TransactionMap: " << this << " " << mCount << " entries");
+   for (size_t i = 0; i < mSlots.size(); )
    {
-      DebugLog (<< mMap.begin()->first << " -> " << mMap.begin()->second << ": " << *mMap.begin()->second);
-      delete mMap.begin()->second;
+      if (mSlots[i].mState)
+      {
+         // ~TransactionState removes itself from the map, which may shift
+         // another entry into this slot; look at it again
+         DebugLog (<< mSlots[i].mState->mId << " -> " << mSlots[i].mState << ": " << *mSlots[i].mState);
+         delete mSlots[i].mState;
+      }
+      else
+      {
+         ++i;
+      }
    }
 }
 
 TransactionState* 
 TransactionMap::find( const Data& tid ) const
 {
-   MapConstIterator i = mMap.find(tid);
-   if (i != mMap.end())
+   return find(tid, tid.caseInsensitiveTokenHash());
+}
+
+TransactionState* 
+TransactionMap::find( const Data& tid, size_t hash ) const
+{
+   size_t i = findSlot(tid, hash);
+   if (i != NotFound)
    {
-      return i->second;
+      return mSlots[i].mState;
    }
    else
    {
@@ -37,46 +61,128 @@ TransactionMap::find( const Data& tid ) const
 void 
 TransactionMap::add(const Data& tid, TransactionState* state  )
 {
-   MapIterator i = mMap.find(tid);
-   if (i != mMap.end())
+   // the state's own id is what lookups compare against
+   resip_assert(isEqualNoCase(tid, state->mId));
+
+   const size_t hash = tid.caseInsensitiveTokenHash();
+   size_t i = findSlot(tid, hash);
+   if (i != NotFound)
    {
-      if (i->second != state)
+      if (mSlots[i].mState == state)
       {
-         // .bwc. ~TransactionState will remove itself from the map.
-         delete i->second;
-         //DebugLog (<< "Replacing TMAP[" << tid << "] = " << state << " : " << *state);
-         mMap[tid] = state;
+         return;
       }
+      // .bwc. ~TransactionState will remove itself from the map.
+      //DebugLog (<< "Replacing TMAP[" << tid << "] = " << state << " : " << *state);
+      delete mSlots[i].mState;
    }
-   else
+
+   //DebugLog (<< "Inserting TMAP[" << tid << "] = " << state << " : " << *state);
+   if ((mCount + 1)*10 > mSlots.size()*7)
    {
-      //DebugLog (<< "Inserting TMAP[" << tid << "] = " << state << " : " << *state);
-      mMap[tid] = state;
+      grow();
    }
+   insert(hash, state);
 }
  
 void 
 TransactionMap::erase(const Data& tid )
 {
-   MapIterator i = mMap.find(tid);
-   if (i != mMap.end())
-   {
-      // don't delete it here, the TransactionState deletes itself and removes
-      // itself from the map
-      //DebugLog (<< "Erasing " << tid << "(" << i->second << ")");
-      mMap.erase(i);
-   }
-   else
+   size_t i = findSlot(tid, tid.caseInsensitiveTokenHash());
+   if (i == NotFound)
    {
       InfoLog (<< "Couldn't find " << tid << " to remove");
       resip_assert(0);
+      return;
+   }
+
+   // don't delete it here, the TransactionState deletes itself and removes
+   // itself from the map
+   //DebugLog (<< "Erasing " << tid << "(" << mSlots[i].mState << ")");
+
+   // Close the gap: walk the rest of the probe run and move back any entry
+   // whose home slot is not between the gap and where it sits now.
+   size_t j = i;
+   for (;;)
+   {
+      j = (j + 1) & mMask;
+      if (!mSlots[j].mState)
+      {
+         break;
+      }
+      const size_t home = mSlots[j].mHash & mMask;
+      const bool stays = (i < j) ? (i < home && home <= j) : (i < home || home <= j);
+      if (!stays)
+      {
+         mSlots[i] = mSlots[j];
+         i = j;
+      }
    }
+   mSlots[i].mState = 0;
+   --mCount;
 }
  
 int
 TransactionMap::size() const
 {
-   return (int)mMap.size();
+   return (int)mCount;
+}
+
+size_t
+TransactionMap::getMemoryUsage() const
+{
+   return sizeof(*this) + mSlots.capacity()*sizeof(Slot);
+}
+
+size_t
+TransactionMap::findSlot(const Data& tid, size_t hash) const
+{
+   if (mCount == 0)
+   {
+      return NotFound;
+   }
+   for (size_t i = hash & mMask; mSlots[i].mState; i = (i + 1) & mMask)
+   {
+      if (mSlots[i].mHash == hash && isEqualNoCase(mSlots[i].mState->mId, tid))
+      {
+         return i;
+      }
+   }
+   return NotFound;
+}
+
+void
+TransactionMap::insert(size_t hash, TransactionState* state)
+{
+   size_t i = hash & mMask;
+   while (mSlots[i].mState)
+   {
+      i = (i + 1) & mMask;
+   }
+   mSlots[i].mHash = hash;
+   mSlots[i].mState = state;
+   ++mCount;
+}
+
+void
+TransactionMap::grow()
+{
+   std::vector<Slot> old;
+   old.swap(mSlots);
+
+   Slot empty;
+   empty.mHash = 0;
+   empty.mState = 0;
+   mSlots.resize(old.empty() ? MinSlots : old.size()*2, empty);
+   mMask = mSlots.size() - 1;
+   mCount = 0;
+   for (std::vector<Slot>::const_iterator i = old.begin(); i != old.end(); ++i)
+   {
+      if (i->mState)
+      {
+         insert(i->mHash, i->mState);
+      }
+   }
 }
 
 
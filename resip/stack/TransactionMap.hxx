@@ -1,8 +1,8 @@
 #if !defined(RESIP_TRANSACTIONMAP_HXX)
 #define RESIP_TRANSACTIONMAP_HXX
 
+#include <vector>
 #include "rutil/Data.hxx"
-#include "rutil/HashMap.hxx"
 
 namespace resip
 {
@@ -10,16 +10,31 @@ namespace resip
 
 /**
    @internal
+
+   Index of the live transactions by transaction id. This is a flat
+   open-addressing table (linear probing) of (hash, TransactionState*) pairs,
+   so a lookup is usually a single cache line plus one compare against the
+   matching TransactionState's id. Messages carry the hash of their tid (see
+   TransactionMessage::getTransactionIdHash()), which for a SipMessage is
+   computed once when the top Via's branch is parsed. Removal shifts the rest
+   of the probe run back instead of leaving a tombstone, so lookups do not
+   degrade as transactions come and go.
 */
 class TransactionMap 
 {
   public:
+     TransactionMap();
      ~TransactionMap();
      
      TransactionState* find( const Data& transactionId ) const;
+     // {hash} must be transactionId.caseInsensitiveTokenHash()
+     TransactionState* find( const Data& transactionId, size_t hash ) const;
      void add( const Data& transactionId, TransactionState* state  );
      void erase( const Data& transactionId );
      int size() const;
+
+     // bytes held by the index itself, not counting the TransactionStates
+     size_t getMemoryUsage() const;
      
   private:
 
@@ -32,77 +47,20 @@ class TransactionMap
      //    values are case-insensitive.Tokens are always case-insensitive.
      //    Unless specified otherwise, values expressed as quoted strings are
      //    case-sensitive.
-#if  defined(__INTEL_COMPILER ) || (defined(WIN32) && defined(_MSC_VER) && (_MSC_VER >= 1310) && (_MSC_VER < 1900))  // !slg! not sure if this works on __INTEL_COMPILER 
-      /**
-         @internal
-      */
-      class BranchCompare
-      {
-         public:
-            enum { bucket_size = 4, min_buckets = 8 };
-
-            inline size_t operator()(const Data& branch) const
-            {
-               return branch.caseInsensitiveTokenHash();
-            }
-
-            inline bool operator()(const Data& branch1, const Data& branch2) const
-            {
-               return isLessThanNoCase(branch1,branch2);
-            }
-      };
-#elif defined(HASH_MAP_NAMESPACE)
-      /**
-         @internal
-      */
-      class BranchHasher
-      {
-         public:
-            inline size_t operator()(const Data& branch) const
-            {
-               return branch.caseInsensitiveTokenHash();
-            }
-      };
+     // Hence Data::caseInsensitiveTokenHash() and isEqualNoCase().
+     struct Slot
+     {
+        size_t mHash;
+        TransactionState* mState; // 0 if the slot is free
+     };
 
-      /**
-         @internal
-      */
-      class BranchEqual
-      {
-         public:
-            inline bool operator()(const Data& branch1, const Data& branch2) const
-            {
-               return isEqualNoCase(branch1,branch2);
-            }
-      };
-#else
-      /**
-         @internal
-      */
-      class BranchCompare
-      {
-         public:
-            inline bool operator()(const Data& branch1, const Data& branch2) const
-            {
-               return isLessThanNoCase(branch1,branch2);
-            }
-      };
-#endif
-
-      // .bwc. If rutil/HashMap.hxx fails to find a hash_map impl for the 
-      // platform we're using, it will #define HashMap to a std::map, which
-      // takes different template args. We try to compensate for this here.
-#if  defined(__INTEL_COMPILER ) || (defined(WIN32) && defined(_MSC_VER) && (_MSC_VER >= 1310) && (_MSC_VER < 1900))
-     typedef HashMap<Data, TransactionState*, BranchCompare> Map;
-#elif defined(HASH_MAP_NAMESPACE)
-     typedef HashMap<Data, TransactionState*, BranchHasher, BranchEqual> Map;
-#else
-     typedef std::map<Data, TransactionState*, BranchCompare> Map;
-#endif
+     size_t findSlot(const Data& tid, size_t hash) const;
+     void insert(size_t hash, TransactionState* state);
+     void grow();
 
-     Map mMap;
-     typedef Map::iterator MapIterator;
-     typedef Map::const_iterator MapConstIterator;
+     std::vector<Slot> mSlots;
+     size_t mMask;
+     size_t mCount;
 };
 }
 
@@ -3,6 +3,7 @@
 
 #include "rutil/ResipAssert.h"
 #include "resip/stack/Message.hxx"
+#include "rutil/Data.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
 
 namespace resip
@@ -15,6 +16,14 @@ class TransactionMessage : public Message
 
       virtual const Data& getTransactionId() const=0; 
 
+      // Data::caseInsensitiveTokenHash() of getTransactionId(), which is what
+      // TransactionMap is keyed on. Subclasses that already have it to hand
+      // should return it from here.
+      virtual size_t getTransactionIdHash() const
+      {
+         return getTransactionId().caseInsensitiveTokenHash();
+      }
+
       // indicates this message is associated with a Client Transaction for the
       // purpose of determining which TransactionMap to use
       virtual bool isClientTransaction() const = 0; 
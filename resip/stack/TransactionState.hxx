@@ -3,11 +3,14 @@
 
 #include <iosfwd>
 #include <memory>
+#include <vector>
 #include "rutil/dns/DnsHandler.hxx"
 #include "resip/stack/MethodTypes.hxx"
 #include "resip/stack/SipMessage.hxx"
+#include "resip/stack/TimerQueue.hxx"
 #include "resip/stack/Transport.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
+#include "rutil/Timer.hxx"
 
 namespace resip
 {
@@ -120,7 +123,10 @@ class TransactionState : public DnsHandler
       void terminateServerTransaction(const Data& tid); 
       const Data& tid(SipMessage* sip) const;
 
-      void startServerNonInviteTimerTrying(SipMessage& sip, const Data& tid);
+      void startServerNonInviteTimerTrying(SipMessage& sip);
+      // Starts a timer for this transaction. Any that have not fired by the
+      // time the transaction is destroyed are cancelled.
+      void startTimer(Timer::Type type, unsigned long msOffset);
 
       static TransactionState* makeCancelTransaction(TransactionState* tran, Machine machine, const Data& tid);
       static void handleInternalCancel(SipMessage* cancel,
@@ -193,11 +199,14 @@ class TransactionState : public DnsHandler
       TransportFailure::FailureReason mFailureReason;      
       int mFailureSubCode;
       bool mTcpConnectTimerStarted;
+      std::vector<TransactionTimerQueue::Id> mTimerIds; // from startTimer()
 
       static UInt32 StatelessIdCounter;
       
       friend EncodeStream& operator<<(EncodeStream& strm, const TransactionState& state);
       friend class TransactionController;
+      friend class TransactionMap;
+      friend class TestTransactionMap;
 };
 
 
@@ -42,6 +42,7 @@ Transport::Transport(Fifo<TransactionMessage>& rxFifo,
    mStateMachineFifo(rxFifo, 8),
    mShuttingDown(false),
    mTlsDomain(tlsDomain),
+   mShardGroup(0),
    mSocketFunc(socketFunc),
    mCompression(compression),
    mTransportFlags(0)
@@ -68,6 +69,7 @@ Transport::Transport(Fifo<TransactionMessage>& rxFifo,
    mStateMachineFifo(rxFifo,8),
    mShuttingDown(false),
    mTlsDomain(tlsDomain),
+   mShardGroup(0),
    mSocketFunc(socketFunc),
    mCompression(compression),
    mTransportFlags(transportFlags)
@@ -52,6 +52,11 @@ class FdPollGrp;
  *    Specifies whether this Transport object has its own thread (ie; if
  *    set, the TransportSelector should not run the select/poll loop for
  *    this transport, since that is another thread's job)
+ * REUSEPORT:
+ *    On transports that support it (UDP), set SO_REUSEPORT before binding
+ *    so that several transports can share the same interface and port.
+ *    The kernel then spreads inbound flows across them. Normally set via
+ *    SipStack::addShardedUdpTransport().
  */
 #define RESIP_TRANSPORT_FLAG_NOBIND      (1<<0)
 #define RESIP_TRANSPORT_FLAG_RXALL       (1<<1)
@@ -59,6 +64,7 @@ class FdPollGrp;
 #define RESIP_TRANSPORT_FLAG_KEEP_BUFFER (1<<3)
 #define RESIP_TRANSPORT_FLAG_TXNOW       (1<<4)
 #define RESIP_TRANSPORT_FLAG_OWNTHREAD   (1<<5)
+#define RESIP_TRANSPORT_FLAG_REUSEPORT   (1<<6)
 
 /**
    @brief The base class for Transport classes.
@@ -377,9 +383,27 @@ class Transport : public FdSetIOObserver
       // set the receive buffer length (SO_RCVBUF)
       virtual void setRcvBufLen(int buflen) { };	// make pure?
 
+      // set the max number of datagrams moved per socket call (recvmmsg/
+      // sendmmsg); 0 or 1 disables batching. Ignored by stream transports.
+      virtual void setBatchSize(unsigned int batchSize) { };
+
+      // put the tx fifo in lock-free mode (see AbstractFifo::setLockFree());
+      // must be called before the transport is added to the stack.
+      virtual void setLockFreeTxFifo(bool lockFree) { };
+
+      // true if send() accepts a gathered SendData (see
+      // SipMessage::encodeGathered()) and writes it without flattening.
+      virtual bool supportsGatheredSend() const { return false; }
+
       inline unsigned int getKey() const {return mTuple.mTransportKey;} 
       inline void setKey(unsigned int pKey) { mTuple.mTransportKey = pKey;} // should only be called once after creation
 
+      // For the 2nd..Nth shard of a transport opened several times on the same
+      // port (see RESIP_TRANSPORT_FLAG_REUSEPORT), the key of the first shard;
+      // 0 otherwise. Should only be set before the transport is added.
+      inline unsigned int getShardGroup() const { return mShardGroup; }
+      inline void setShardGroup(unsigned int groupKey) { mShardGroup = groupKey; }
+
    protected:
 
       Data mInterface;
@@ -396,6 +420,7 @@ class Transport : public FdSetIOObserver
 
       Data mTlsDomain;
       SharedPtr<SipMessageLoggingHandler> mSipMessageLoggingHandler;
+      unsigned int mShardGroup;
 
    protected:
       AfterSocketCreationFuncPtr mSocketFunc;
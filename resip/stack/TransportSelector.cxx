@@ -213,7 +213,25 @@ TransportSelector::addTransport(std::auto_ptr<Transport> autoTransport, bool isS
                transport->netNs());
    tuple.mTransportKey = transport->getKey();
 
-   if(!isSecure(transport->transport()))
+   if(transport->getShardGroup())
+   {
+      // Additional shard of a transport we already have; it is only reached
+      // through its key (flows it received) or through selectShard().
+      TransportKeyMap::iterator first = mTransports.find(transport->getShardGroup());
+      if(first == mTransports.end())
+      {
+         WarningLog (<< "Can't add transport shard, first shard not found: " << tuple);
+         resip_assert(false); // should never get here - checked in SipStack first
+         return;
+      }
+      TransportList& shards = mTransportShards[transport->getShardGroup()];
+      if(shards.empty())
+      {
+         shards.push_back(first->second);
+      }
+      shards.push_back(transport);
+   }
+   else if(!isSecure(transport->transport()))
    {
       if(mExactTransports.find(tuple) == mExactTransports.end() &&
          mAnyInterfaceTransports.find(tuple) == mAnyInterfaceTransports.end())
@@ -286,7 +304,10 @@ TransportSelector::addTransport(std::auto_ptr<Transport> autoTransport, bool isS
       mHasOwnProcessTransports.back()->startOwnProcessing();
    }
 
-   mTypeToTransportMap.insert(TypeToTransportMap::value_type(tuple,transport));
+   if(!transport->getShardGroup())
+   {
+      mTypeToTransportMap.insert(TypeToTransportMap::value_type(tuple,transport));
+   }
    mDns.addTransportType(transport->transport(), transport->ipVersion());
    mTransports[transport->getKey()] = transport;
 
@@ -314,8 +335,22 @@ TransportSelector::removeTransport(unsigned int transportKey)
       // notify transport to shutdown
       transportToRemove->shutdown();
 
-      if(!isSecure(transportToRemove->transport()))
+      if(transportToRemove->getShardGroup())
       {
+         ShardMap::iterator itShards = mTransportShards.find(transportToRemove->getShardGroup());
+         if(itShards != mTransportShards.end())
+         {
+            itShards->second.remove(transportToRemove);
+            if(itShards->second.size() <= 1)
+            {
+               mTransportShards.erase(itShards);
+            }
+         }
+      }
+      else if(!isSecure(transportToRemove->transport()))
+      {
+         mTransportShards.erase(transportKey);
+
          // Ensure transport is removed from all containers
          mExactTransports.erase(transportToRemove->getTuple());
          mAnyInterfaceTransports.erase(transportToRemove->getTuple());
@@ -385,7 +420,7 @@ TransportSelector::rebuildAnyPortTransportMaps()
 
     for (TransportKeyMap::iterator it = mTransports.begin(); it != mTransports.end(); it++)
     {
-        if (!isSecure(it->second->transport()))
+        if (!isSecure(it->second->transport()) && !it->second->getShardGroup())
         {
             // Store the transport in the ANY interface maps if the tuple specifies ANY
             // interface. Store the transport in the specific interface maps if the tuple
@@ -973,6 +1008,7 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
 
       if (msg->isRequest())
       {
+         const bool flowSpecified = target.mTransportKey != 0;
          transport = findTransportByVia(msg, target, source);
          if (!transport)
          {
@@ -1032,6 +1068,12 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
             }
          }
 
+         // Spread new requests across the shards of a sharded transport
+         if(transport && !flowSpecified && !mTransportShards.empty())
+         {
+            transport = selectShard(transport, target);
+         }
+
          target.mTransportKey = transport ? transport->getKey() : 0;
 
          // .bwc. Topmost Via is only filled out in the request case. Also, if
@@ -1318,20 +1360,34 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
 
          send->data.reserve(mAvgBufferSize + mAvgBufferSize/4);
 
-         DataStream str(send->data);
-         msg->encode(str);
-         str.flush();
+         // Header values and body text that are still untouched in the
+         // buffers the message was received into are handed to the
+         // transport by reference rather than copied, where it can write
+         // them with sendmsg()/writev(). SigComp and the logging handler
+         // want the message in one piece.
+         if (transport->supportsGatheredSend() &&
+             remoteSigcompId.empty() &&
+             !handler)
+         {
+            msg->encodeGathered(*send);
+         }
+         else
+         {
+            DataStream str(send->data);
+            msg->encode(str);
+            str.flush();
+         }
 
          // !bwc! Moving average of message size. (Used to intelligently
          // predict how much space to reserve in the buffer, to minimize
          // dynamic resizing.)
          mAvgBufferSize = (255*mAvgBufferSize + send->data.size()+128)/256;
 
-         resip_assert(!send->data.empty());
+         resip_assert(!send->empty());
          DebugLog (<< "Transmitting to " << target
                    << " tlsDomain=" << msg->getTlsDomain()
                    << " via " << source
-                   << std::endl << std::endl << send->data.escaped()
+                   << std::endl << std::endl << send->flat().escaped()
                    << "sigcomp id=" << remoteSigcompId);
 
          if(sendData)
@@ -1392,7 +1448,16 @@ TransportSelector::retransmit(const SendData& data)
       Transport::SipMessageLoggingHandler* handler = transport->getSipMessageLoggingHandler();
       if(handler)
       {
-         handler->outboundRetransmit(transport->getTuple(), data.destination, data);
+         if (data.isGathered())
+         {
+            SendData flat(data);
+            flat.flatten();
+            handler->outboundRetransmit(transport->getTuple(), data.destination, flat);
+         }
+         else
+         {
+            handler->outboundRetransmit(transport->getTuple(), data.destination, data);
+         }
       }
        
       transport->send(std::auto_ptr<SendData>(data.clone()));
@@ -1463,6 +1528,21 @@ TransportSelector::invokeAfterSocketCreationFunc(TransportType type)
     }
 }
 
+Transport*
+TransportSelector::selectShard(Transport* transport, const Tuple& target) const
+{
+   ShardMap::const_iterator it = mTransportShards.find(transport->getKey());
+   if(it == mTransportShards.end())
+   {
+      return transport;
+   }
+   const TransportList& shards = it->second;
+   size_t n = target.hash() % shards.size();
+   TransportList::const_iterator i = shards.begin();
+   std::advance(i, n);
+   return *i;
+}
+
 Transport*
 TransportSelector::findTransportByDest(const Tuple& target)
 {
@@ -199,6 +199,7 @@ class TransportSelector
       Transport* findTransportBySource(Tuple& src, const SipMessage* msg) const;
       Transport* findLoopbackTransportBySource(bool ignorePort, Tuple& src) const;
       Transport* findTransportByDest(const Tuple& dest);
+      Transport* selectShard(Transport* transport, const Tuple& dest) const;
       Transport* findTransportByVia(SipMessage* msg, const Tuple& dest, Tuple& src) const;
       Transport* findTlsTransport(const Data& domain,TransportType type,IpVersion ipv) const;
       Tuple determineSourceInterface(SipMessage* msg, const Tuple& dest) const;
@@ -234,6 +235,11 @@ class TransportSelector
       TransportList mSharedProcessTransports;  // Warning - only access this from the TransportSelector process loop / thread
       TransportList mHasOwnProcessTransports;
 
+      // all shards (first shard included) of SO_REUSEPORT transports, by key
+      // of the first shard
+      typedef std::map<unsigned int, TransportList> ShardMap;
+      ShardMap mTransportShards;
+
       typedef std::multimap<Tuple, Transport*, Tuple::AnyPortAnyInterfaceCompare> TypeToTransportMap;
       TypeToTransportMap mTypeToTransportMap;
 
@@ -10,6 +10,7 @@ namespace resip
 TupleMarkManager::MarkType 
 TupleMarkManager::getMarkType(const Tuple& tuple)
 {
+   Lock lock(mMutex);
    ListEntry entry(tuple,0);
    TupleList::iterator i=mList.find(entry);
    
@@ -35,6 +36,7 @@ TupleMarkManager::getMarkType(const Tuple& tuple)
 
 void TupleMarkManager::mark(const Tuple& tuple,UInt64 expiry,MarkType mark)
 {
+   Lock lock(mMutex);
    // .amr. Notify listeners first so they can change the entry if they want
    notifyListeners(tuple,expiry,mark);
    ListEntry entry(tuple,expiry);
@@ -43,11 +45,13 @@ void TupleMarkManager::mark(const Tuple& tuple,UInt64 expiry,MarkType mark)
 
 void TupleMarkManager::registerMarkListener(MarkListener* listener)
 {
+   Lock lock(mMutex);
    mListeners.insert(listener);
 }
 
 void TupleMarkManager::unregisterMarkListener(MarkListener* listener)
 {
+   Lock lock(mMutex);
    mListeners.erase(listener);
 }
 
@@ -54,6 +54,10 @@ class TupleMarkManager
             
       typedef std::set<MarkListener*> Listeners;
       Listeners mListeners;
+
+      // DnsResult reads marks on the thread calling DnsInterface::lookup()
+      // as well as on the DnsThread
+      Mutex mMutex;
       
       void notifyListeners(const resip::Tuple& tuple, UInt64& expiry, MarkType& mark);
 };
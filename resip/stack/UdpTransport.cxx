@@ -3,6 +3,7 @@
 #endif
 
 #include <memory>
+#include <vector>
 
 #include "resip/stack/Helper.hxx"
 #include "resip/stack/SendData.hxx"
@@ -22,11 +23,131 @@
 #include <osc/SigcompMessage.h>
 #endif
 
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define RESIP_UDP_HAVE_MMSG
+#endif
+
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
 
 using namespace std;
 using namespace resip;
 
+// Linux caps the vlen of recvmmsg()/sendmmsg() at UIO_MAXIOV
+static const unsigned int MaxBatchSize = 1024;
+
+#ifdef RESIP_UDP_HAVE_MMSG
+/**
+   Per-transport scratch state for batched socket I/O. Kept across calls so
+   the hot path does no allocation other than replacing receive buffers that
+   were handed off to a SipMessage.
+*/
+class UdpTransport::BatchIo
+{
+   public:
+      BatchIo(unsigned int size, const Tuple& proto)
+         : mRxHdrs(size),
+           mRxIovs(size),
+           mRxBuffers(size, (char*)0),
+           mRxSenders(size, proto),
+           mTxHdrs(size),
+           mTxIovs(size),
+           mTxIovFirst(size),
+           mTxIovCount(0),
+           mTxData(size, (SendData*)0)
+      {
+         for (unsigned int i = 0; i < size; ++i)
+         {
+            primeRx(i, proto);
+         }
+      }
+
+      ~BatchIo()
+      {
+         for (std::vector<char*>::iterator i = mRxBuffers.begin(); i != mRxBuffers.end(); ++i)
+         {
+            delete [] *i;
+         }
+      }
+
+      // (re)arm receive slot {i}, allocating a new buffer if the previous
+      // one was consumed
+      void primeRx(unsigned int i, const Tuple& proto)
+      {
+         if (mRxBuffers[i] == 0)
+         {
+            mRxBuffers[i] = MsgHeaderScanner::allocateBuffer(UdpTransport::MaxBufferSize);
+         }
+         mRxSenders[i] = proto;
+         mRxIovs[i].iov_base = mRxBuffers[i];
+         mRxIovs[i].iov_len = UdpTransport::MaxBufferSize;
+         memset(&mRxHdrs[i], 0, sizeof(struct mmsghdr));
+         mRxHdrs[i].msg_hdr.msg_name = &mRxSenders[i].getMutableSockaddr();
+         mRxHdrs[i].msg_hdr.msg_namelen = mRxSenders[i].length();
+         mRxHdrs[i].msg_hdr.msg_iov = &mRxIovs[i];
+         mRxHdrs[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      // queue {data} as message {i} of the next sendmmsg(); a gathered
+      // SendData takes one iovec per segment. msg_iov is only filled in by
+      // bindTx(), as mTxIovs may grow while the batch is assembled.
+      void primeTx(unsigned int i, SendData* data)
+      {
+         if (i == 0)
+         {
+            mTxIovCount = 0;
+         }
+         mTxData[i] = data;
+         mTxIovFirst[i] = mTxIovCount;
+         memset(&mTxHdrs[i], 0, sizeof(struct mmsghdr));
+         mTxHdrs[i].msg_hdr.msg_name = const_cast<sockaddr*>(&data->destination.getSockaddr());
+         mTxHdrs[i].msg_hdr.msg_namelen = data->destination.length();
+         if (data->isGathered())
+         {
+            size_t needed = mTxIovCount + 2*SendData::MaxExternalSegments + 1;
+            if (mTxIovs.size() < needed)
+            {
+               mTxIovs.resize(needed);
+            }
+            mTxHdrs[i].msg_hdr.msg_iovlen = data->toIoVecs(&mTxIovs[mTxIovCount], 0);
+         }
+         else
+         {
+            if (mTxIovs.size() <= mTxIovCount)
+            {
+               mTxIovs.resize(mTxIovCount + 1);
+            }
+            mTxIovs[mTxIovCount].iov_base = const_cast<char*>(data->data.data());
+            mTxIovs[mTxIovCount].iov_len = data->data.size();
+            mTxHdrs[i].msg_hdr.msg_iovlen = 1;
+         }
+         mTxIovCount += mTxHdrs[i].msg_hdr.msg_iovlen;
+      }
+
+      void bindTx(unsigned int count)
+      {
+         for (unsigned int i = 0; i < count; ++i)
+         {
+            mTxHdrs[i].msg_hdr.msg_iov = &mTxIovs[mTxIovFirst[i]];
+         }
+      }
+
+      std::vector<struct mmsghdr> mRxHdrs;
+      std::vector<struct iovec> mRxIovs;
+      std::vector<char*> mRxBuffers;
+      std::vector<Tuple> mRxSenders;
+
+      std::vector<struct mmsghdr> mTxHdrs;
+      std::vector<struct iovec> mTxIovs;
+      std::vector<size_t> mTxIovFirst;
+      size_t mTxIovCount;
+      std::vector<SendData*> mTxData;
+};
+#else
+class UdpTransport::BatchIo
+{
+};
+#endif
+
 UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
                            int portNum,
                            IpVersion version,
@@ -38,15 +159,33 @@ UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
    : InternalTransport(fifo, portNum, version, pinterface, socketFunc, compression, transportFlags),
      mSigcompStack(0),
      mRxBuffer(0),
+     mBatchSize(0),
+     mBatchIo(0),
      mExternalUnknownDatagramHandler(0),
      mInWritable(false)
 {
    mPollEventCnt = 0;
    mTxTryCnt = mTxMsgCnt = mTxFailCnt = 0;
    mRxTryCnt = mRxMsgCnt = mRxKeepaliveCnt = mRxTransactionCnt = 0;
+   mRxSyscallCnt = mTxSyscallCnt = 0;
    mTuple.setType(UDP);
    mFd = InternalTransport::socket(transport(), version);
    mTuple.mFlowKey=(FlowKey)mFd;
+   if ( (mTransportFlags & RESIP_TRANSPORT_FLAG_REUSEPORT)!=0 )
+   {
+#if defined(SO_REUSEPORT)
+      int on = 1;
+      if ( ::setsockopt ( mFd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) )
+      {
+         int e = getErrno();
+         InfoLog (<< "Couldn't set sockoption SO_REUSEPORT: " << strerror(e));
+         error(e);
+         throw Exception("Failed setsockopt", __FILE__,__LINE__);
+      }
+#else
+      throw Exception("SO_REUSEPORT not supported on this platform", __FILE__,__LINE__);
+#endif
+   }
    bind();      // also makes it non-blocking
 
    InfoLog (<< "Creating UDP transport host=" << pinterface
@@ -72,6 +211,7 @@ UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
 
 UdpTransport::~UdpTransport()
 {
+   stopOwnThread();
    InfoLog(<< "Shutting down " << mTuple
            <<" tf="<<mTransportFlags<<" evt="<<(mPollGrp?1:0)
            <<" stats:"
@@ -83,6 +223,9 @@ UdpTransport::~UdpTransport()
            <<" rxmsg="<<mRxMsgCnt
            <<" rxka="<<mRxKeepaliveCnt
            <<" rxtr="<<mRxTransactionCnt
+           <<" rxsys="<<mRxSyscallCnt
+           <<" txsys="<<mTxSyscallCnt
+           <<" batch="<<mBatchSize
            );
 #ifdef USE_SIGCOMP
    delete mSigcompStack;
@@ -91,6 +234,7 @@ UdpTransport::~UdpTransport()
    {
       delete[] mRxBuffer;
    }
+   delete mBatchIo;
    setPollGrp(0);
 }
 
@@ -224,6 +368,12 @@ UdpTransport::process(FdSet& fdset)
 void
 UdpTransport::processTxAll()
 {
+   if ( mBatchIo )
+   {
+      processTxBatch();
+      return;
+   }
+
    SendData *msg;
    ++mTxTryCnt;
    while ( (msg=mTxFifoOutBuffer.getNext(RESIP_FIFO_NOWAIT)) != NULL )
@@ -262,6 +412,7 @@ UdpTransport::processTxOne(SendData *data)
        sendData->sigcompId.size() > 0 &&
        !sendData->isAlreadyCompressed )
    {
+       sendData->flatten();
        osc::SigcompMessage *sm = mSigcompStack->compressMessage
          (sendData->data.data(), sendData->data.size(),
           sendData->sigcompId.data(), sendData->sigcompId.size(),
@@ -273,6 +424,7 @@ UdpTransport::processTxOne(SendData *data)
 
        expected = sm->getDatagramLength();
 
+       ++mTxSyscallCnt;
        count = sendto(mFd,
                       sm->getDatagramMessage(),
                       sm->getDatagramLength(),
@@ -281,21 +433,138 @@ UdpTransport::processTxOne(SendData *data)
        delete sm;
    }
    else
+#endif
+#ifndef WIN32
+   if (sendData->isGathered())
+   {
+       struct iovec iov[2*SendData::MaxExternalSegments + 1];
+       struct msghdr hdr;
+       memset(&hdr, 0, sizeof(hdr));
+       hdr.msg_name = const_cast<sockaddr*>(&addr);
+       hdr.msg_namelen = sendData->destination.length();
+       hdr.msg_iov = iov;
+       hdr.msg_iovlen = sendData->toIoVecs(iov, 0);
+
+       expected = (int)sendData->size();
+       ++mTxSyscallCnt;
+       count = sendmsg(mFd, &hdr, 0);
+   }
+   else
 #endif
    {
        expected = (int)sendData->data.size();
+       ++mTxSyscallCnt;
        count = sendto(mFd,
                       sendData->data.data(), (int)sendData->data.size(),
                       0, // flags
                       &addr, (int)sendData->destination.length());
    }
 
+   processTxResult(*sendData, count, expected);
+}
+
+/**
+ * Sends up to mBatchSize messages from the tx fifo per sendmmsg() call.
+ * Control commands and messages that need SigComp compression are
+ * handed to processTxOne() instead, after flushing whatever has been
+ * batched ahead of them so the fifo order is kept on the wire.
+ */
+void
+UdpTransport::processTxBatch()
+{
+#ifdef RESIP_UDP_HAVE_MMSG
+   BatchIo& io = *mBatchIo;
+   ++mTxTryCnt;
+   for (;;)
+   {
+      unsigned int count = 0;
+      unsigned int taken = 0;
+      SendData* data;
+      while ( count < mBatchSize &&
+              (data=mTxFifoOutBuffer.getNext(RESIP_FIFO_NOWAIT)) != NULL )
+      {
+         ++taken;
+         if (data->command != SendData::NoCommand
+#ifdef USE_SIGCOMP
+             || (mSigcompStack &&
+                 data->sigcompId.size() > 0 &&
+                 !data->isAlreadyCompressed)
+#endif
+            )
+         {
+            // send what is batched so far first, to keep fifo order
+            sendTxBatch(count);
+            count = 0;
+            processTxOne(data);
+            continue;
+         }
+         resip_assert( data->destination.getPort() != 0 );
+         ++mTxMsgCnt;
+         io.primeTx(count++, data);
+      }
+      if ( taken == 0 )
+      {
+         break;
+      }
+      sendTxBatch(count);
+
+      if ( (mTransportFlags & RESIP_TRANSPORT_FLAG_TXALL)==0 )
+      {
+         break;
+      }
+   }
+#endif
+}
+
+void
+UdpTransport::sendTxBatch(unsigned int count)
+{
+#ifdef RESIP_UDP_HAVE_MMSG
+   if ( count == 0 )
+   {
+      return;
+   }
+   BatchIo& io = *mBatchIo;
+   io.bindTx(count);
+
+   unsigned int done = 0;
+   while ( done < count )
+   {
+      ++mTxSyscallCnt;
+      int sent = sendmmsg(mFd, &io.mTxHdrs[done], count - done, 0);
+      if ( sent <= 0 )
+      {
+         // the first message of the remainder could not be sent; report
+         // it and carry on with the rest
+         processTxResult(*io.mTxData[done], SOCKET_ERROR, (int)io.mTxData[done]->size());
+         ++done;
+         continue;
+      }
+      for (int i = 0; i < sent; ++i, ++done)
+      {
+         processTxResult(*io.mTxData[done],
+                         (int)io.mTxHdrs[done].msg_len,
+                         (int)io.mTxData[done]->size());
+      }
+   }
+
+   for (unsigned int i = 0; i < count; ++i)
+   {
+      delete io.mTxData[i];
+      io.mTxData[i] = 0;
+   }
+#endif
+}
+
+void
+UdpTransport::processTxResult(SendData& data, int count, int expected)
+{
    if ( count == SOCKET_ERROR )
    {
       int e = getErrno();
       error(e);
-      InfoLog (<< "Failed (" << e << ") sending to " << sendData->destination);
-      fail(sendData->transactionId);
+      InfoLog (<< "Failed (" << e << ") sending to " << data.destination);
+      fail(data.transactionId);
       ++mTxFailCnt;
    }
    else
@@ -303,7 +572,7 @@ UdpTransport::processTxOne(SendData *data)
       if (count != expected)
       {
          ErrLog (<< "UDPTransport - send buffer full" );
-         fail(sendData->transactionId);
+         fail(data.transactionId);
       }
    }
 }
@@ -319,6 +588,12 @@ UdpTransport::processTxOne(SendData *data)
 void
 UdpTransport::processRxAll()
 {
+   if ( mBatchIo )
+   {
+      processRxBatch();
+      return;
+   }
+
    char *buffer = mRxBuffer;
    mRxBuffer = NULL;
    ++mRxTryCnt;
@@ -353,6 +628,60 @@ UdpTransport::processRxAll()
    }
 }
 
+/**
+ * Batched variant of processRxAll(): receives up to mBatchSize datagrams
+ * per recvmmsg() call into the pre-allocated buffer ring. Buffers absorbed
+ * into a SipMessage are replaced; the others are reused for the next call.
+ * With RXALL we keep reading for as long as the kernel fills a whole batch.
+ */
+void
+UdpTransport::processRxBatch()
+{
+#ifdef RESIP_UDP_HAVE_MMSG
+   BatchIo& io = *mBatchIo;
+   ++mRxTryCnt;
+   for (;;)
+   {
+      ++mRxSyscallCnt;
+      int got = recvmmsg(mFd, &io.mRxHdrs[0], mBatchSize, 0, 0);
+      if ( got == SOCKET_ERROR )
+      {
+         int err = getErrno();
+         if ( err != EAGAIN && err != EWOULDBLOCK )
+         {
+            error( err );
+         }
+         break;
+      }
+
+      for (int i = 0; i < got; ++i)
+      {
+         int len = (int)io.mRxHdrs[i].msg_len;
+         if ( len+1 >= MaxBufferSize ||
+              (io.mRxHdrs[i].msg_hdr.msg_flags & MSG_TRUNC) )
+         {
+            InfoLog(<<"Datagram exceeded max length "<<MaxBufferSize);
+         }
+         else if ( len > 0 )
+         {
+            ++mRxMsgCnt;
+            if ( processRxParse(io.mRxBuffers[i], len, io.mRxSenders[i]) )
+            {
+               io.mRxBuffers[i] = 0;
+            }
+         }
+         io.primeRx(i, mTuple);
+      }
+
+      if ( got < (int)mBatchSize ||
+           (mTransportFlags & RESIP_TRANSPORT_FLAG_RXALL) == 0 )
+      {
+         break;
+      }
+   }
+#endif
+}
+
 /*
  * Receive from socket and store results into {buffer}. Updates
  * {buffer} with actual buffer (in case allocation required),
@@ -382,6 +711,7 @@ UdpTransport::processRxRecv(char*& buffer, Tuple& sender)
       // !jf! how do we tell if it discarded bytes
       // !ah! we use the len-1 trick :-(
       socklen_t slen = sender.length();
+      ++mRxSyscallCnt;
       int len = recvfrom( mFd,
                           buffer,
                           MaxBufferSize,
@@ -583,7 +913,7 @@ UdpTransport::processRxParse(char *buffer, int len, Tuple& sender)
 
    // Tell the SipMessage about this datagram buffer.
    // WATCHOUT: below here buffer is consumed by message
-   message->addBuffer(buffer);
+   message->addBuffer(buffer, len);
 
    mMsgHeaderScanner.prepareForMessage(message);
 
@@ -762,6 +1092,43 @@ UdpTransport::setRcvBufLen(int buflen)
    setSocketRcvBufLen(mFd, buflen);
 }
 
+void
+UdpTransport::setBatchSize(unsigned int batchSize)
+{
+   if (batchSize > MaxBatchSize)
+   {
+      batchSize = MaxBatchSize;
+   }
+#ifdef RESIP_UDP_HAVE_MMSG
+   delete mBatchIo;
+   mBatchIo = 0;
+   mBatchSize = 0;
+   if (batchSize > 1)
+   {
+      mBatchIo = new BatchIo(batchSize, mTuple);
+      mBatchSize = batchSize;
+   }
+   InfoLog(<< "Batched I/O " << (mBatchIo ? "enabled" : "disabled")
+           << " (batchSize=" << mBatchSize << ") on " << mTuple);
+#else
+   if (batchSize > 1)
+   {
+      WarningLog(<< "recvmmsg/sendmmsg not available, ignoring batch size of "
+                 << batchSize << " on " << mTuple);
+   }
+#endif
+}
+
+bool
+UdpTransport::supportsGatheredSend() const
+{
+#ifdef WIN32
+   return false;
+#else
+   return true;
+#endif
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0
  *
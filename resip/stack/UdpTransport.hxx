@@ -76,6 +76,19 @@ public:
    virtual void setPollGrp(FdPollGrp *grp);
    virtual void setRcvBufLen(int buflen);
 
+   /** Enables batched socket I/O: up to {batchSize} datagrams are read per
+       recvmmsg() call into a ring of pre-allocated receive buffers, and up to
+       {batchSize} queued SendData are written per sendmmsg() call. Values of
+       0 or 1 restore the one-datagram-per-syscall behavior. Only has an
+       effect on platforms providing recvmmsg()/sendmmsg(); should be called
+       before the transport is started. The RXALL/TXALL flags still control
+       whether we keep draining the socket/fifo after the first batch. */
+   virtual void setBatchSize(unsigned int batchSize);
+   unsigned int getBatchSize() const { return mBatchSize; }
+
+   /// gathered SendData go out through sendmsg()/sendmmsg() iovecs
+   virtual bool supportsGatheredSend() const;
+
    // FdPollItemIf
    // virtual Socket getPollSocket() const;
    virtual void processPollEvent(FdPollEventMask mask);
@@ -92,10 +105,14 @@ public:
 protected:
 
    void processRxAll();
+   void processRxBatch();
    int processRxRecv(char*& buffer, Tuple& sender);
    bool processRxParse(char *buffer, int len, Tuple& sender);
    void processTxAll();
+   void processTxBatch();
+   void sendTxBatch(unsigned int count);
    void processTxOne(SendData *data);
+   void processTxResult(SendData& data, int count, int expected);
    void updateEvents();
 
    osc::Stack *mSigcompStack;
@@ -109,8 +126,14 @@ protected:
    unsigned mRxMsgCnt;
    unsigned mRxKeepaliveCnt;
    unsigned mRxTransactionCnt;
+   unsigned mRxSyscallCnt;   // recvfrom/recvmmsg calls
+   unsigned mTxSyscallCnt;   // sendto/sendmmsg calls
 private:
+   class BatchIo;
+
    char* mRxBuffer;
+   unsigned int mBatchSize;
+   BatchIo* mBatchIo;
    MsgHeaderScanner mMsgHeaderScanner;
    mutable resip::Mutex  myMutex;
    Tuple mStunMappedAddress;
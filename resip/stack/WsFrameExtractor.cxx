@@ -1,4 +1,6 @@
 
+#include <string.h>
+
 #include "rutil/Logger.hxx"
 #include "resip/stack/WsFrameExtractor.hxx"
 #include "rutil/WinLeakCheck.hxx"
@@ -12,9 +14,12 @@ const int WsFrameExtractor::mMaxHeaderLen = 14;
 
 WsFrameExtractor::WsFrameExtractor(Data::size_type maxMessage)
    : mMaxMessage(maxMessage),
+     mMessageBuffer(0),
+     mMessageCapacity(0),
      mMessageSize(0),
      mHaveHeader(false),
-     mHeaderLen(0)
+     mHeaderLen(0),
+     mPayload(0)
 {
    // we re-use this for multiple messages throughout
    // the lifetime of this parser object
@@ -25,14 +30,8 @@ WsFrameExtractor::~WsFrameExtractor()
 {
    // FIXME - delete any objects left in the queues
    delete [] mWsHeader;
+   delete [] mMessageBuffer;
 
-   while(!mFrames.empty()) 
-   {
-      delete [] mFrames.front()->data();
-      delete mFrames.front();
-      mFrames.pop();
-   }
-      
    while(!mMessages.empty())
    {
       delete [] mMessages.front()->data();
@@ -55,7 +54,9 @@ WsFrameExtractor::processBytes(UInt8 *input, Data::size_type len, bool& dropConn
          StackLog(<<"Need a header, parsing bytes...");
          // Append bytes to the header buffer
          int needed = parseHeader();
-         if(mHeaderLen >= mMaxHeaderLen)
+         // a masked frame with a 64 bit length has a header of exactly
+         // mMaxHeaderLen bytes
+         if(mHeaderLen + needed > mMaxHeaderLen)
          {
             WarningLog(<<"WS Frame header too long");
             dropConnection = true;
@@ -75,7 +76,9 @@ WsFrameExtractor::processBytes(UInt8 *input, Data::size_type len, bool& dropConn
       {
          StackLog(<<"have header, parsing payload data...");
          // Process input bytes to output buffer, unmasking if necessary
-         if(mMessageSize + mPayloadLength > mMaxMessage)
+         // mMessageSize never exceeds mMaxMessage; no addition, so that
+         // a 64 bit length can't wrap it past the check
+         if(mPayloadLength > mMaxMessage - mMessageSize)
          {
             WarningLog(<<"WS frame header describes a payload size bigger than messageSizeMax, max = " << mMaxMessage 
                  << ", dropping connection");
@@ -85,45 +88,36 @@ WsFrameExtractor::processBytes(UInt8 *input, Data::size_type len, bool& dropConn
 
          if(mPayload == 0)
          {
-            StackLog(<<"starting new frame buffer");
-            // Include an extra byte at the end for null terminator
-            mPayload = (UInt8*)new char[mPayloadLength + 1];
-            mPayloadPos = 0;
+            startFrame();
          }
 
          Data::size_type takeBytes = len - pos;
          if(takeBytes > mPayloadLength - mPayloadPos)
          {
-            takeBytes = mPayloadLength - mPayloadPos;
+            takeBytes = (Data::size_type)(mPayloadLength - mPayloadPos);
          }
 
          if(mMasked)
          {
-            Data::size_type endOffset = mPayloadPos + takeBytes;
-            for( ; mPayloadPos < endOffset; mPayloadPos++)
-            {
-               mPayload[mPayloadPos] = (input[pos++] ^ mWsMaskKey[(mPayloadPos & 3)]);
-            }
+            unmask(&mPayload[mPayloadPos], &input[pos], takeBytes, mWsMaskKey, mPayloadPos);
          }
          else
          {
-            memmove(&mPayload[mPayloadPos], &input[pos], takeBytes);
-            pos += takeBytes;
-            mPayloadPos += takeBytes;
+            memcpy(&mPayload[mPayloadPos], &input[pos], takeBytes);
          }
+         pos += takeBytes;
+         mPayloadPos += takeBytes;
 
          if(mPayloadPos == mPayloadLength)
          {
-            StackLog(<<"Got a whole frame, queueing it");
-            mMessageSize += mPayloadLength;
-            Data *mFrame = new Data(Data::Borrow, (char *)mPayload, mPayloadLength, mPayloadLength + 1);
-            mFrames.push(mFrame);
+            StackLog(<<"Got a whole frame");
+            mMessageSize += (Data::size_type)mPayloadLength;
             mHaveHeader = false;
             mHeaderLen = 0;
             mPayload = 0;
             if(mFinalFrame)
             {
-               joinFrames();
+               finishMessage();
             }
          }
       }
@@ -172,12 +166,12 @@ WsFrameExtractor::parseHeader()
    }
    else if(mPayloadLength == 127)
    {
-      if(mHeaderLen < 8)
+      if(mHeaderLen < 10)
       {
          StackLog(<< "Too short to contain ws data [2]");
-         return (8 - mHeaderLen) + (mMasked ? 4 : 0);
+         return (10 - mHeaderLen) + (mMasked ? 4 : 0);
       }
-      mPayloadLength = (((UInt64)mWsHeader[hdrPos]) << 56 | ((UInt64)mWsHeader[hdrPos + 1]) << 48 | ((UInt64)mWsHeader[hdrPos + 2]) << 40 | ((UInt64)mWsHeader[hdrPos + 3]) << 32 | ((UInt64)mWsHeader[hdrPos + 4]) << 24 | ((UInt64)mWsHeader[hdrPos + 5]) << 16 | ((UInt64)mWsHeader[hdrPos + 6]) << 8 || ((UInt64)mWsHeader[hdrPos + 7]));
+      mPayloadLength = (((UInt64)mWsHeader[hdrPos]) << 56 | ((UInt64)mWsHeader[hdrPos + 1]) << 48 | ((UInt64)mWsHeader[hdrPos + 2]) << 40 | ((UInt64)mWsHeader[hdrPos + 3]) << 32 | ((UInt64)mWsHeader[hdrPos + 4]) << 24 | ((UInt64)mWsHeader[hdrPos + 5]) << 16 | ((UInt64)mWsHeader[hdrPos + 6]) << 8 | ((UInt64)mWsHeader[hdrPos + 7]));
       hdrPos += 8;
    }
 
@@ -204,52 +198,110 @@ WsFrameExtractor::parseHeader()
 }
 
 void
-WsFrameExtractor::joinFrames()
+WsFrameExtractor::startFrame()
 {
-   StackLog(<<"trying to join frames");
-   if(mFrames.empty())
+   // Fragments are unmasked into the same buffer, after the frames before
+   // them.  A message in one frame (the usual case) gets a buffer of
+   // exactly its size; one that is fragmented grows it geometrically, up
+   // to mMaxMessage, so that reassembly doesn't copy it once per frame.
+   // processBytes() has checked this is at most mMaxMessage + 1
+   Data::size_type needed = mMessageSize + (Data::size_type)mPayloadLength + 1;
+   if(needed > mMessageCapacity)
    {
-      ErrLog(<<"No frames to join!");
-      return;
+      Data::size_type capacity = needed;
+      if(mMessageSize > 0 && mMessageCapacity * 2 > capacity)
+      {
+         capacity = resipMin(mMessageCapacity * 2, mMaxMessage + 1);
+      }
+      StackLog(<<"growing message buffer to " << capacity);
+      UInt8 *buffer = (UInt8*)new char[capacity];
+      if(mMessageSize > 0)
+      {
+         memcpy(buffer, mMessageBuffer, mMessageSize);
+      }
+      delete [] mMessageBuffer;
+      mMessageBuffer = buffer;
+      mMessageCapacity = capacity;
    }
+   mPayload = mMessageBuffer + mMessageSize;
+   mPayloadPos = 0;
+}
 
-   Data *msg = mFrames.front();
-   mFrames.pop();
-   if(!mFrames.empty())
-   {
-      // must expand buffer because there are multiple frames
-      // can't use Data::reserve() to increase the buffer, because the
-      // ShareEnum will change to Take when expanded
-      char *_msg = (char *)msg->data();
-      Data::size_type frameSize = msg->size();
-      delete msg;
-
-      // allow extra byte for null terminator
-      char *newBuf = new char [mMessageSize + 1]; 
-      memcpy(newBuf, _msg, frameSize);
-
-      msg = new Data(Data::Borrow, newBuf, frameSize, mMessageSize + 1);
-   }
-   while(!mFrames.empty())
+void
+WsFrameExtractor::finishMessage()
+{
+   StackLog(<<"got the final frame, queueing message, size = " << mMessageSize);
+   if(mMessageBuffer == 0)
    {
-      Data *mFrame = mFrames.front();
-      mFrames.pop();
-      msg->append(mFrame->data(), mFrame->size());
-      delete [] mFrame->data();
-      delete mFrame;
+      ErrLog(<<"No frames to join!");
+      return;
    }
 
-   // It is safe to cast because we used Borrow:
-   char *_msg = (char *)msg->data();
    // MsgHeaderScanner expects space for an extra byte at the end:
-   _msg[mMessageSize] = 0;
+   mMessageBuffer[mMessageSize] = 0;
 
-   mMessages.push(msg);
+   // the buffer is handed on with the message, which is Borrowed so
+   // that it can be passed to SipMessage::addBuffer()
+   mMessages.push(new Data(Data::Borrow, (char *)mMessageBuffer, mMessageSize, mMessageCapacity));
 
    // Ready to start examinging first frame of next message...
+   mMessageBuffer = 0;
+   mMessageCapacity = 0;
    mMessageSize = 0;
 }
 
+void
+WsFrameExtractor::unmask(UInt8 *dst, const UInt8 *src, Data::size_type len,
+                         const UInt8 *key, Data::size_type keyPos)
+{
+   Data::size_type i = 0;
+
+   // byte at a time until dst is aligned for word stores
+   for( ; i < len && ((size_t)(dst + i) & (sizeof(UInt64) - 1)) != 0; i++)
+   {
+      dst[i] = src[i] ^ key[(keyPos + i) & 3];
+   }
+
+   if(len - i >= sizeof(UInt64))
+   {
+      // The key repeated across a word, starting with the key byte for
+      // dst[i].  It is built in memory order, so it doesn't depend on the
+      // byte order, and it stays in phase because the word size is a
+      // multiple of the key size.  src may be unaligned, so it is read
+      // through memcpy, which compilers turn into a plain load.
+      UInt8 keyBytes[sizeof(UInt64)];
+      for(unsigned int k = 0; k < sizeof(UInt64); k++)
+      {
+         keyBytes[k] = key[(keyPos + i + k) & 3];
+      }
+      UInt64 keyWord;
+      memcpy(&keyWord, keyBytes, sizeof(keyWord));
+
+      for( ; len - i >= 4 * sizeof(UInt64); i += 4 * sizeof(UInt64))
+      {
+         UInt64 words[4];
+         memcpy(words, src + i, sizeof(words));
+         words[0] ^= keyWord;
+         words[1] ^= keyWord;
+         words[2] ^= keyWord;
+         words[3] ^= keyWord;
+         memcpy(dst + i, words, sizeof(words));
+      }
+      for( ; len - i >= sizeof(UInt64); i += sizeof(UInt64))
+      {
+         UInt64 word;
+         memcpy(&word, src + i, sizeof(word));
+         word ^= keyWord;
+         memcpy(dst + i, &word, sizeof(word));
+      }
+   }
+
+   for( ; i < len; i++)
+   {
+      dst[i] = src[i] ^ key[(keyPos + i) & 3];
+   }
+}
+
 /* ====================================================================
  *
  * Copyright 2013 Daniel Pocock.  All rights reserved.
@@ -18,14 +18,24 @@ class WsFrameExtractor
       ~WsFrameExtractor();
       std::auto_ptr<Data> processBytes(UInt8 *input, Data::size_type len, bool& dropConnection);
 
+      // XORs len bytes of src with the 4 byte masking key into dst (which
+      // may be src), a word at a time.  keyPos is the payload offset of
+      // src[0], which selects the key byte it is masked with.
+      static void unmask(UInt8 *dst, const UInt8 *src, Data::size_type len,
+                         const UInt8 *key, Data::size_type keyPos);
+
    private:
 
       static const int mMaxHeaderLen;
 
       Data::size_type mMaxMessage;
 
-      std::queue<Data*> mFrames;
       std::queue<Data*> mMessages;
+      // the frames of the message being received are unmasked straight
+      // into this buffer, which always has room for a null terminator
+      // after them (required by MsgHeaderScanner):
+      UInt8 *mMessageBuffer;
+      Data::size_type mMessageCapacity;
       // for tracking the cumulative size of all full frames
       // not yet assembled into a message:
       Data::size_type mMessageSize;
@@ -37,13 +47,15 @@ class WsFrameExtractor
       bool mFinalFrame;
       bool mMasked;
       UInt8 mWsMaskKey[4];
-      Data::size_type mPayloadLength;
+      // as sent, so that a length that doesn't fit in a Data is still seen
+      UInt64 mPayloadLength;
 
       UInt8 *mPayload;
       Data::size_type mPayloadPos;
 
       int parseHeader();
-      void joinFrames();
+      void startFrame();
+      void finishMessage();
 
 };
 
@@ -133,6 +133,7 @@ class DtlsTransport : public UdpTransport
       void process(FdSet& fdset);
       bool isReliable() const { return false; }
       bool isDatagram() const { return true; }
+      virtual bool supportsGatheredSend() const { return false; }
       virtual void buildFdSet( FdSet& fdset);
 
       static const unsigned long DtlsReceiveTimeout = 250000 ;
@@ -20,6 +20,7 @@
 #include "rutil/ResipAssert.h"
 #include "rutil/BaseException.hxx"
 #include "rutil/DataStream.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/Random.hxx"
 #include "rutil/Socket.hxx"
@@ -47,12 +48,17 @@
 #include <openssl/evp.h>
 #include <openssl/crypto.h>
 #include <openssl/err.h>
+#include <openssl/hmac.h>
 #include <openssl/pem.h>
 #include <openssl/pkcs7.h>
 #include <openssl/ossl_typ.h>
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
+#include <openssl/rand.h>
 #include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
 
 using namespace resip;
 using namespace std;
@@ -87,6 +93,9 @@ pemTypePrefixes(  Security::PEMType pType )
    return unknownKey;
 }
 
+// SSL_CTX ex_data slot holding the BaseSecurity that configured the context
+static int sessionExIndex = -1;
+
 static Data
 getAor(const Data& filename, const  Security::PEMType &pemType )
 {
@@ -121,6 +130,76 @@ verifyCallback(int iInCode, X509_STORE_CTX *pInStore)
  
    return iInCode;
 }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L || defined(SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB)
+// Session tickets are encrypted with AES-256-CBC and authenticated with
+// HMAC-SHA256 under the keys held (and rotated) by BaseSecurity
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int
+ticketKeyCallback(SSL* ssl, unsigned char* keyName, unsigned char* iv,
+                  EVP_CIPHER_CTX* cipherCtx, EVP_MAC_CTX* macCtx, int enc)
+#else
+static int
+ticketKeyCallback(SSL* ssl, unsigned char* keyName, unsigned char* iv,
+                  EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* macCtx, int enc)
+#endif
+{
+   BaseSecurity* security = static_cast<BaseSecurity*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), sessionExIndex));
+   if(!security)
+   {
+      return -1;
+   }
+
+   unsigned char aesKey[32];
+   unsigned char hmacKey[32];
+   int ret = security->getSessionTicketKey(enc != 0, keyName, aesKey, hmacKey);
+#if defined(TLS1_3_VERSION)
+   // TLS 1.3 tickets are meant to be used once, so always issue a new one
+   if(!enc && ret == 1 && SSL_version(ssl) >= TLS1_3_VERSION)
+   {
+      ret = 2;
+   }
+#endif
+   if(ret > 0)
+   {
+      if(enc)
+      {
+         if(RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1 ||
+            EVP_EncryptInit_ex(cipherCtx, EVP_aes_256_cbc(), 0, aesKey, iv) != 1)
+         {
+            ret = -1;
+         }
+      }
+      else if(EVP_DecryptInit_ex(cipherCtx, EVP_aes_256_cbc(), 0, aesKey, iv) != 1)
+      {
+         ret = -1;
+      }
+   }
+   if(ret > 0)
+   {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+      OSSL_PARAM params[3];
+      params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, hmacKey, sizeof(hmacKey));
+      params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0);
+      params[2] = OSSL_PARAM_construct_end();
+      if(EVP_MAC_CTX_set_params(macCtx, params) != 1)
+      {
+         ret = -1;
+      }
+#elif OPENSSL_VERSION_NUMBER >= 0x10000000L
+      if(HMAC_Init_ex(macCtx, hmacKey, sizeof(hmacKey), EVP_sha256(), 0) != 1)
+      {
+         ret = -1;
+      }
+#else
+      HMAC_Init_ex(macCtx, hmacKey, sizeof(hmacKey), EVP_sha256(), 0);
+#endif
+   }
+   OPENSSL_cleanse(aesKey, sizeof(aesKey));
+   OPENSSL_cleanse(hmacKey, sizeof(hmacKey));
+   return ret;
+}
+#endif
  
 }
 
@@ -144,6 +223,10 @@ BaseSecurity::CipherList BaseSecurity::StrongestSuite("HIGH:-COMPLEMENTOFDEFAULT
 long BaseSecurity::OpenSSLCTXSetOptions = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3;
 long BaseSecurity::OpenSSLCTXClearOptions = 0;
 
+long BaseSecurity::TlsSessionCacheSize = SSL_SESSION_CACHE_MAX_SIZE_DEFAULT;
+long BaseSecurity::TlsSessionTimeout = 3600;
+bool BaseSecurity::TlsSessionTickets = true;
+
 Security::Security(const CipherList& cipherSuite, const Data& defaultPrivateKeyPassPhrase, const Data& dHParamsFilename) :
    BaseSecurity(cipherSuite, defaultPrivateKeyPassPhrase, dHParamsFilename)
 {
@@ -445,6 +528,7 @@ Security::createDomainCtx(const SSL_METHOD* method, const Data& domain, const Da
    setDHParams(ctx);
    SSL_CTX_set_options(ctx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(ctx, BaseSecurity::OpenSSLCTXClearOptions);
+   setSessionCache(ctx, domain);
 
    return ctx;
 }
@@ -1169,6 +1253,7 @@ BaseSecurity::BaseSecurity (const CipherList& cipherSuite, const Data& defaultPr
    setDHParams(mTlsCtx);
    SSL_CTX_set_options(mTlsCtx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(mTlsCtx, BaseSecurity::OpenSSLCTXClearOptions);
+   setSessionCache(mTlsCtx, Data::Empty);
    
    mSslCtx = SSL_CTX_new( SSLv23_method() );
    resip_assert(mSslCtx);
@@ -1180,6 +1265,7 @@ BaseSecurity::BaseSecurity (const CipherList& cipherSuite, const Data& defaultPr
    setDHParams(mSslCtx);
    SSL_CTX_set_options(mSslCtx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(mSslCtx, BaseSecurity::OpenSSLCTXClearOptions);
+   setSessionCache(mSslCtx, Data::Empty);
 }
 
 
@@ -1226,6 +1312,10 @@ BaseSecurity::~BaseSecurity ()
       SSL_CTX_free(mSslCtx);mSslCtx=0;  // This free's X509_STORE (mRootSslCerts)
    }
 
+   for (std::vector<SessionTicketKey>::iterator it = mSessionTicketKeys.begin(); it != mSessionTicketKeys.end(); it++)
+   {
+      OPENSSL_cleanse(&(*it), sizeof(SessionTicketKey));
+   }
 }
 
 void
@@ -3173,6 +3263,158 @@ BaseSecurity::setDHParams(SSL_CTX* ctx)
    }
 }
 
+void
+BaseSecurity::setSessionCache(SSL_CTX* ctx, const Data& sessionIdContext)
+{
+   if(TlsSessionCacheSize <= 0)
+   {
+      DebugLog(<<"TLS session resumption disabled");
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+      SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+      return;
+   }
+
+   if(sessionExIndex < 0)
+   {
+      sessionExIndex = SSL_CTX_get_ex_new_index(0, 0, 0, 0, 0);
+   }
+   SSL_CTX_set_ex_data(ctx, sessionExIndex, this);
+
+   // Client sessions are only cached so that the new session callback fires,
+   // TlsBaseTransport keeps them per peer and offers them on reconnection
+   SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_BOTH);
+   SSL_CTX_sess_set_cache_size(ctx, TlsSessionCacheSize);
+   SSL_CTX_set_timeout(ctx, TlsSessionTimeout);
+
+   // Required for resumption whenever client certificates are verified, and
+   // keeps sessions from one domain's context being resumed in another's
+   Data context = (sessionIdContext.empty() ? Data("resip") : sessionIdContext).md5();
+   resip_assert(context.size() <= SSL_MAX_SID_CTX_LENGTH);
+   SSL_CTX_set_session_id_context(ctx, (const unsigned char*)context.data(), (unsigned int)context.size());
+
+   if(TlsSessionTickets)
+   {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+      SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticketKeyCallback);
+#elif defined(SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB)
+      SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticketKeyCallback);
+#endif
+   }
+   else
+   {
+      SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+   }
+}
+
+bool
+BaseSecurity::addSessionTicketKey()
+{
+   SessionTicketKey key;
+   if(RAND_bytes(key.mName, sizeof(key.mName)) != 1 ||
+      RAND_bytes(key.mAesKey, sizeof(key.mAesKey)) != 1 ||
+      RAND_bytes(key.mHmacKey, sizeof(key.mHmacKey)) != 1)
+   {
+      ErrLog(<< "unable to generate a session ticket key: RAND_bytes failed");
+      OPENSSL_cleanse(&key, sizeof(key));
+      return false;
+   }
+   key.mCreated = Timer::getTimeSecs();
+   mSessionTicketKeys.insert(mSessionTicketKeys.begin(), key);
+   OPENSSL_cleanse(&key, sizeof(key));
+
+   while(mSessionTicketKeys.size() > 2)
+   {
+      OPENSSL_cleanse(&mSessionTicketKeys.back(), sizeof(SessionTicketKey));
+      mSessionTicketKeys.pop_back();
+   }
+   DebugLog(<< "new session ticket key generated");
+   return true;
+}
+
+void
+BaseSecurity::rotateSessionTicketKeys()
+{
+   Lock lock(mSessionMutex);
+   addSessionTicketKey();
+}
+
+int
+BaseSecurity::getSessionTicketKey(bool encrypt, unsigned char* keyName,
+                                  unsigned char* aesKey, unsigned char* hmacKey)
+{
+   Lock lock(mSessionMutex);
+   const SessionTicketKey* key = 0;
+   int ret = 0;
+   if(encrypt)
+   {
+      if(mSessionTicketKeys.empty() ||
+         Timer::getTimeSecs() >= mSessionTicketKeys.front().mCreated + TlsSessionTimeout)
+      {
+         // on failure the current key, if any, stays in use
+         addSessionTicketKey();
+      }
+      if(mSessionTicketKeys.empty())
+      {
+         return -1;
+      }
+      key = &mSessionTicketKeys.front();
+      memcpy(keyName, key->mName, sizeof(key->mName));
+      ret = 1;
+   }
+   else
+   {
+      for(std::vector<SessionTicketKey>::const_iterator it = mSessionTicketKeys.begin(); it != mSessionTicketKeys.end(); it++)
+      {
+         if(memcmp(keyName, it->mName, sizeof(it->mName)) == 0)
+         {
+            key = &(*it);
+            // tickets under the previous key are reissued under the current one
+            ret = (it == mSessionTicketKeys.begin()) ? 1 : 2;
+            break;
+         }
+      }
+   }
+   if(key)
+   {
+      memcpy(aesKey, key->mAesKey, sizeof(key->mAesKey));
+      memcpy(hmacKey, key->mHmacKey, sizeof(key->mHmacKey));
+   }
+   return ret;
+}
+
+BaseSecurity::TlsSessionStats
+BaseSecurity::getTlsSessionStats() const
+{
+   Lock lock(mSessionMutex);
+   return mTlsSessionStats;
+}
+
+void
+BaseSecurity::recordTlsHandshake(bool server, bool sessionOffered, bool resumed)
+{
+   Lock lock(mSessionMutex);
+   if(server)
+   {
+      mTlsSessionStats.mServerHandshakes++;
+      if(resumed)
+      {
+         mTlsSessionStats.mServerResumed++;
+      }
+   }
+   else
+   {
+      mTlsSessionStats.mClientHandshakes++;
+      if(sessionOffered)
+      {
+         mTlsSessionStats.mClientOffered++;
+      }
+      if(resumed)
+      {
+         mTlsSessionStats.mClientResumed++;
+      }
+   }
+}
+
 #endif
 
 
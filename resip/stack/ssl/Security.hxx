@@ -12,6 +12,7 @@
 
 #include "rutil/Socket.hxx"
 #include "rutil/BaseException.hxx"
+#include "rutil/Mutex.hxx"
 #include "resip/stack/SecurityTypes.hxx"
 #include "resip/stack/SecurityAttributes.hxx"
 
@@ -90,6 +91,19 @@ class BaseSecurity
       static long OpenSSLCTXSetOptions;
       static long OpenSSLCTXClearOptions;
 
+      /**
+       * TLS session resumption, applied to each SSL_CTX as it is created.
+       *
+       * TlsSessionCacheSize bounds the server session cache and the cache of
+       * client sessions kept by each TLS transport; 0 disables resumption.
+       * TlsSessionTimeout is the lifetime of a session in seconds, and also
+       * how often the session ticket keys are rotated.  TlsSessionTickets
+       * enables stateless session tickets (RFC 5077) on top of the cache.
+       */
+      static long TlsSessionCacheSize;
+      static long TlsSessionTimeout;
+      static bool TlsSessionTickets;
+
       BaseSecurity(const CipherList& cipherSuite = StrongestSuite, const Data& defaultPrivateKeyPassPhrase = Data::Empty, const Data& dHParamsFilename = Data::Empty);
       virtual ~BaseSecurity();
 
@@ -198,6 +212,29 @@ class BaseSecurity
    public:
       SSL_CTX*       getTlsCtx ();
       SSL_CTX*       getSslCtx ();
+
+      // counts of completed TLS handshakes, across all transports
+      struct TlsSessionStats
+      {
+         TlsSessionStats() : mServerHandshakes(0), mServerResumed(0),
+            mClientHandshakes(0), mClientOffered(0), mClientResumed(0) {}
+         UInt64 mServerHandshakes;
+         UInt64 mServerResumed;
+         UInt64 mClientHandshakes;
+         UInt64 mClientOffered;  // client handshakes offering a cached session
+         UInt64 mClientResumed;
+      };
+      TlsSessionStats getTlsSessionStats() const;
+      void recordTlsHandshake(bool server, bool sessionOffered, bool resumed);
+
+      // Starts issuing session tickets under a new key.  Tickets issued under
+      // the previous key are still accepted (and renewed); older ones are not.
+      void rotateSessionTicketKeys();
+      // Used by the OpenSSL ticket key callback: fills in the current key when
+      // encrypting, or the key named keyName when decrypting.  Returns 0 if
+      // there is no such key, 2 if the ticket should be renewed, 1 otherwise.
+      int getSessionTicketKey(bool encrypt, unsigned char* keyName,
+                              unsigned char* aesKey, unsigned char* hmacKey);
       
       X509*     getDomainCert( const Data& domain );
       EVP_PKEY* getDomainKey(  const Data& domain );
@@ -261,6 +298,21 @@ class BaseSecurity
       static bool mAllowWildcardCertificates;
 
       void setDHParams(SSL_CTX* ctx);
+      void setSessionCache(SSL_CTX* ctx, const Data& sessionIdContext);
+
+      struct SessionTicketKey
+      {
+         unsigned char mName[16];
+         unsigned char mAesKey[32];
+         unsigned char mHmacKey[32];
+         UInt64 mCreated;
+      };
+      bool addSessionTicketKey();
+
+      // current ticket key first, then the previous one
+      std::vector<SessionTicketKey> mSessionTicketKeys;
+      TlsSessionStats mTlsSessionStats;
+      mutable Mutex mSessionMutex;
 };
 
 class Security : public BaseSecurity
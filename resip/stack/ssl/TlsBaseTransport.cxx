@@ -9,8 +9,10 @@
 
 #include "rutil/compat.hxx"
 #include "rutil/Data.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Socket.hxx"
 #include "rutil/Logger.hxx"
+#include "rutil/CongestionManager.hxx"
 #include "resip/stack/ssl/TlsBaseTransport.hxx"
 #include "resip/stack/ssl/TlsConnection.hxx"
 #include "resip/stack/ssl/Security.hxx"
@@ -21,6 +23,35 @@
 using namespace std;
 using namespace resip;
 
+unsigned int TlsBaseTransport::HandshakeThreads = 0;
+
+extern "C"
+{
+
+// Hands client sessions (new ones, and TLS 1.3 tickets as they arrive) to the
+// transport's cache; server sessions are left to OpenSSL's own cache
+static int
+newSessionCallback(SSL* ssl, SSL_SESSION* session)
+{
+   TlsConnection* conn = static_cast<TlsConnection*>(SSL_get_ex_data(ssl, TlsBaseTransport::getConnectionExIndex()));
+   if(!conn || conn->isServer())
+   {
+      return 0;
+   }
+   TlsBaseTransport* t = dynamic_cast<TlsBaseTransport*>(conn->transport());
+   resip_assert(t);
+   t->storeClientSession(conn->who(), conn->who().getTargetDomain(), session);
+   return 1;
+}
+
+}
+
+static bool
+isExpired(SSL_SESSION* session, long now)
+{
+   return SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) <= now;
+}
+
 TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo, 
                            int portNum, 
                            IpVersion version,
@@ -42,7 +73,8 @@ TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo,
    mSslType(sslType),
    mDomainCtx(0),
    mClientVerificationMode(cvm),
-   mUseEmailAsSIP(useEmailAsSIP)
+   mUseEmailAsSIP(useEmailAsSIP),
+   mHandshakeInterruptorHandle(0)
 {
    setTlsDomain(sipDomain);   
    mTuple.setType(transportType);
@@ -67,17 +99,111 @@ TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo,
          throw invalid_argument("Unrecognised SecurityTypes::SSLType value");
       }
    }
+
+   getConnectionExIndex();
+   SSL_CTX_sess_set_new_cb(getCtx(), newSessionCallback);
+
+   if(HandshakeThreads > 0)
+   {
+      mHandshakePool.reset(new TlsHandshakePool(HandshakeThreads));
+   }
 }
 
 
 TlsBaseTransport::~TlsBaseTransport()
 {
+   if(mHandshakePool.get())
+   {
+      // connections may have a step with the pool, they must go first
+      getConnectionManager().closeConnections();
+      if(mHandshakeInterruptorHandle)
+      {
+         mPollGrp->delPollItem(mHandshakeInterruptorHandle);
+      }
+      if(mCongestionManager)
+      {
+         mCongestionManager->unregisterFifo(&mHandshakePool->getFifo());
+      }
+      mHandshakePool.reset();
+   }
+
+   for(ClientSessionMap::iterator it = mClientSessions.begin(); it != mClientSessions.end(); it++)
+   {
+      SSL_SESSION_free(it->second);
+   }
+
    if (mDomainCtx)
    {
       SSL_CTX_free(mDomainCtx);mDomainCtx=0;
    }
 }
 
+void
+TlsBaseTransport::process(FdSet& fdset)
+{
+   if(mHandshakePool.get())
+   {
+      mHandshakePool->getInterruptor().process(fdset);
+      mHandshakePool->process();
+   }
+   TcpBaseTransport::process(fdset);
+}
+
+void
+TlsBaseTransport::buildFdSet(FdSet& fdset)
+{
+   TcpBaseTransport::buildFdSet(fdset);
+   if(mHandshakePool.get())
+   {
+      mHandshakePool->getInterruptor().buildFdSet(fdset);
+   }
+}
+
+void
+TlsBaseTransport::process()
+{
+   if(mHandshakePool.get())
+   {
+      mHandshakePool->process();
+   }
+   TcpBaseTransport::process();
+}
+
+void
+TlsBaseTransport::setPollGrp(FdPollGrp *grp)
+{
+   if(mHandshakePool.get())
+   {
+      // unlike the transport's own interruptor this is needed even when the
+      // stack's thread runs the transport
+      if(mHandshakeInterruptorHandle)
+      {
+         mPollGrp->delPollItem(mHandshakeInterruptorHandle);
+         mHandshakeInterruptorHandle = 0;
+      }
+      if(grp)
+      {
+         SelectInterruptor& interruptor = mHandshakePool->getInterruptor();
+         mHandshakeInterruptorHandle = grp->addPollItem(interruptor.getReadSocket(), FPEM_Read, &interruptor);
+      }
+   }
+   TcpBaseTransport::setPollGrp(grp);
+}
+
+void
+TlsBaseTransport::setCongestionManager(CongestionManager* manager)
+{
+   if(mHandshakePool.get() && mCongestionManager)
+   {
+      mCongestionManager->unregisterFifo(&mHandshakePool->getFifo());
+   }
+   TcpBaseTransport::setCongestionManager(manager);
+   if(mHandshakePool.get() && mCongestionManager)
+   {
+      mCongestionManager->registerFifo(&mHandshakePool->getFifo());
+   }
+}
+
 SSL_CTX* 
 TlsBaseTransport::getCtx() const 
 { 
@@ -114,10 +240,120 @@ TlsBaseTransport::setPeerCertificateVerificationCallback(
    return true;
 }
 
+bool
+TlsBaseTransport::setClientSession(SSL* ssl, const Tuple& peer, const Data& serverName)
+{
+   Lock lock(mClientSessionMutex);
+   ClientSessionMap::iterator it = mClientSessions.find(make_pair(peer, serverName));
+   if(it == mClientSessions.end())
+   {
+      return false;
+   }
+   if(isExpired(it->second, (long)time(0)))
+   {
+      SSL_SESSION_free(it->second);
+      mClientSessions.erase(it);
+      return false;
+   }
+   DebugLog(<< "Offering cached TLS session to " << peer << " (" << serverName << ")");
+   bool offered = SSL_set_session(ssl, it->second) == 1;
+#if defined(TLS1_3_VERSION)
+   // TLS 1.3 tickets are single use, the server sends a new one to keep
+   if(SSL_SESSION_get_protocol_version(it->second) >= TLS1_3_VERSION)
+   {
+      SSL_SESSION_free(it->second);
+      mClientSessions.erase(it);
+   }
+#endif
+   return offered;
+}
+
+void
+TlsBaseTransport::storeClientSession(const Tuple& peer, const Data& serverName, SSL_SESSION* session)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+   if(!SSL_SESSION_is_resumable(session))
+   {
+      SSL_SESSION_free(session);
+      return;
+   }
+#endif
+   Lock lock(mClientSessionMutex);
+   pair<ClientSessionMap::iterator, bool> inserted = mClientSessions.insert(make_pair(make_pair(peer, serverName), session));
+   if(!inserted.second)
+   {
+      // TLS 1.3 servers may issue several tickets, keep the latest
+      SSL_SESSION_free(inserted.first->second);
+      inserted.first->second = session;
+      return;
+   }
+
+   if(mClientSessions.size() > (size_t)BaseSecurity::TlsSessionCacheSize)
+   {
+      long now = (long)time(0);
+      for(ClientSessionMap::iterator it = mClientSessions.begin(); it != mClientSessions.end();)
+      {
+         if(it != inserted.first && isExpired(it->second, now))
+         {
+            SSL_SESSION_free(it->second);
+            mClientSessions.erase(it++);
+         }
+         else
+         {
+            it++;
+         }
+      }
+      // still full of live sessions: drop one other than the new one
+      if(mClientSessions.size() > (size_t)BaseSecurity::TlsSessionCacheSize)
+      {
+         ClientSessionMap::iterator victim = (mClientSessions.begin() == inserted.first) ? ++mClientSessions.begin() : mClientSessions.begin();
+         SSL_SESSION_free(victim->second);
+         mClientSessions.erase(victim);
+      }
+   }
+}
+
+void
+TlsBaseTransport::removeClientSession(const Tuple& peer, const Data& serverName)
+{
+   Lock lock(mClientSessionMutex);
+   ClientSessionMap::iterator it = mClientSessions.find(make_pair(peer, serverName));
+   if(it != mClientSessions.end())
+   {
+      SSL_SESSION_free(it->second);
+      mClientSessions.erase(it);
+   }
+}
+
+int
+TlsBaseTransport::getConnectionExIndex()
+{
+   // first called from the constructor, before any connection exists
+   static int index = SSL_get_ex_new_index(0, 0, 0, 0, 0);
+   return index;
+}
+
+bool
+TlsBaseTransport::refuseConnection(const Tuple& who, Socket fd)
+{
+   if(mHandshakePool.get() && mCongestionManager &&
+      mCongestionManager->getRejectionBehavior(&mHandshakePool->getFifo()) != CongestionManager::NORMAL)
+   {
+      InfoLog(<< "TLS handshake queue congested, refusing connection from " << who);
+      closeSocket(fd);
+      return true;
+   }
+   return false;
+}
+
 Connection* 
 TlsBaseTransport::createConnection(const Tuple& who, Socket fd, bool server)
 {
    resip_assert(this);
+   if(server && refuseConnection(who, fd))
+   {
+      return 0;
+   }
    Connection* conn = new TlsConnection(this,who, fd, mSecurity, server,
                                         tlsDomain(), mSslType, mCompression );
    return conn;
@@ -6,10 +6,15 @@
 #endif
 
 
+#include <map>
+#include <memory>
+
 #include "resip/stack/TcpBaseTransport.hxx"
 #include "resip/stack/SecurityTypes.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
+#include "rutil/Mutex.hxx"
 #include "resip/stack/Compression.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
 
 #include <openssl/ssl.h>
 
@@ -42,6 +47,17 @@ class TlsBaseTransport : public TcpBaseTransport
                    const Data& privateKeyPassPhrase = "");
       virtual  ~TlsBaseTransport();
 
+      /** Number of threads each TLS transport created afterwards runs its
+          handshakes on.  0 (the default) runs them on the transport
+          thread. */
+      static unsigned int HandshakeThreads;
+
+      virtual void process(FdSet& fdset);
+      virtual void buildFdSet(FdSet& fdset);
+      virtual void process();
+      virtual void setPollGrp(FdPollGrp *grp);
+      virtual void setCongestionManager(CongestionManager* manager);
+
       SSL_CTX* getCtx() const;
 
       SecurityTypes::TlsClientVerificationMode getClientVerificationMode() 
@@ -74,8 +90,27 @@ class TlsBaseTransport : public TcpBaseTransport
          void *func,
          void *arg);
 
+      /** @brief Offers the session last established with peer under the SNI
+          name serverName, if any, for resumption on ssl.
+          @return true if a session was offered
+      */
+      bool setClientSession(SSL* ssl, const Tuple& peer, const Data& serverName);
+      /// Keeps session (taking over the caller's reference) for the next
+      /// connection to peer under serverName
+      void storeClientSession(const Tuple& peer, const Data& serverName, SSL_SESSION* session);
+      void removeClientSession(const Tuple& peer, const Data& serverName);
+
+      /// ex_data slot holding the TlsConnection an SSL belongs to
+      static int getConnectionExIndex();
+
+      /// 0 if handshakes are run on the transport thread
+      TlsHandshakePool* getHandshakePool() const { return mHandshakePool.get(); }
+
    protected:
       Connection* createConnection(const Tuple& who, Socket fd, bool server=false);
+      /// true (having closed fd) if the CongestionManager says the
+      /// handshake pool should not take on another inbound connection
+      bool refuseConnection(const Tuple& who, Socket fd);
 
       Security* mSecurity;
       SecurityTypes::SSLType mSslType;
@@ -85,6 +120,14 @@ class TlsBaseTransport : public TcpBaseTransport
          as if it were a SIP URI.  This is convenient because many commercial
          CAs offer email certificates but not sip: certificates */
       bool mUseEmailAsSIP;
+
+      // client sessions for resumption, by peer and SNI name
+      typedef std::map<std::pair<Tuple, Data>, SSL_SESSION*> ClientSessionMap;
+      ClientSessionMap mClientSessions;
+      Mutex mClientSessionMutex;
+
+      std::auto_ptr<TlsHandshakePool> mHandshakePool;
+      FdPollItemHandle mHandshakeInterruptorHandle;
 };
 
 }
@@ -6,6 +6,7 @@
 
 #include "resip/stack/ssl/TlsConnection.hxx"
 #include "resip/stack/ssl/TlsTransport.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
 #include "resip/stack/ssl/Security.hxx"
 #include "rutil/Logger.hxx"
 #include "resip/stack/Uri.hxx"
@@ -96,6 +97,7 @@ TlsConnection::TlsConnection( Transport* transport, const Tuple& tuple,
    
    mSsl = SSL_new(ctx);
    resip_assert(mSsl);
+   SSL_set_ex_data(mSsl, TlsBaseTransport::getConnectionExIndex(), this);
 
    resip_assert( mSecurity );
 
@@ -134,6 +136,9 @@ TlsConnection::TlsConnection( Transport* transport, const Tuple& tuple,
 
    mTlsState = Initial;
    mHandShakeWantsRead = false;
+   mSessionOffered = false;
+   mHandshakePool = t->getHandshakePool();
+   mHandshakeJob = 0;
 
 #endif // USE_SSL   
 }
@@ -141,6 +146,11 @@ TlsConnection::TlsConnection( Transport* transport, const Tuple& tuple,
 TlsConnection::~TlsConnection()
 {
 #if defined(USE_SSL)
+   if (mHandshakeJob)
+   {
+      mHandshakePool->cancel(mHandshakeJob);
+   }
+
    ERR_clear_error();
    int ret = SSL_shutdown(mSsl);
    if(ret < 0)
@@ -191,10 +201,12 @@ TlsConnection::checkState()
       return mTlsState;
    }
    
-   int ok=0;
-   
-   ERR_clear_error();
-   
+   if (mHandshakeJob)
+   {
+      // a step is running on the crypto pool
+      return mTlsState;
+   }
+
    if (mTlsState != Handshaking)
    {
       if (mServer)
@@ -211,6 +223,9 @@ TlsConnection::checkState()
             DebugLog ( << "TLS SNI extension in Client Hello: " << who().getTargetDomain());
             SSL_set_tlsext_host_name(mSsl,who().getTargetDomain().c_str()); // set the SNI hostname
 #endif
+         TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
+         resip_assert(t);
+         mSessionOffered = t->setClientSession(mSsl, who(), who().getTargetDomain());
          SSL_set_connect_state(mSsl);
          mTlsState = Handshaking;
       }
@@ -219,120 +234,163 @@ TlsConnection::checkState()
       mTlsState = Handshaking;
    }
 
-   mHandShakeWantsRead = false;
-   ok = SSL_do_handshake(mSsl);
-      
-   if ( ok <= 0 )
+   if (mHandshakePool)
    {
-      int err = SSL_get_error(mSsl,ok);
-         
-      switch (err)
-      {
-         case SSL_ERROR_WANT_READ:
-            StackLog( << "TLS handshake want read" );
-            mHandShakeWantsRead = true;
-            return mTlsState;
+      // the transport thread gets on with its other connections meanwhile
+      suspendIo();
+      mHandshakeJob = mHandshakePool->post(this);
+      return mTlsState;
+   }
 
-         case SSL_ERROR_WANT_WRITE:
-            StackLog( << "TLS handshake want write" );
-            ensureWritable();
-            return mTlsState;
+   return finishHandshakeStep(doHandshakeStep());
+#endif // USE_SSL   
+   return mTlsState;
+}
 
-         case SSL_ERROR_ZERO_RETURN:
-            StackLog( << "TLS connection closed cleanly");
-            return mTlsState;
+TlsConnection::HandshakeStep
+TlsConnection::doHandshakeStep()
+{
+#if defined(USE_SSL)
+   ERR_clear_error();
 
-         case SSL_ERROR_WANT_CONNECT:
-            StackLog( << "BIO not connected, try later");
-            return mTlsState;
+   int ok = SSL_do_handshake(mSsl);
+   if ( ok > 0 )
+   {
+      InfoLog( << "TLS connected" );
+      return HandshakeDone;
+   }
+
+   int err = SSL_get_error(mSsl,ok);
+
+   switch (err)
+   {
+      case SSL_ERROR_WANT_READ:
+         StackLog( << "TLS handshake want read" );
+         return HandshakeWantRead;
+
+      case SSL_ERROR_WANT_WRITE:
+         StackLog( << "TLS handshake want write" );
+         return HandshakeWantWrite;
+
+      case SSL_ERROR_ZERO_RETURN:
+         StackLog( << "TLS connection closed cleanly");
+         return HandshakeRetry;
+
+      case SSL_ERROR_WANT_CONNECT:
+         StackLog( << "BIO not connected, try later");
+         return HandshakeRetry;
 
 #if  ( OPENSSL_VERSION_NUMBER >= 0x0090702fL )
-         case SSL_ERROR_WANT_ACCEPT:
-            StackLog( << "TLS connection want accept" );
-            return mTlsState;
+      case SSL_ERROR_WANT_ACCEPT:
+         StackLog( << "TLS connection want accept" );
+         return HandshakeRetry;
 #endif
 
-         case SSL_ERROR_WANT_X509_LOOKUP:
-            DebugLog( << "Try later / SSL_ERROR_WANT_X509_LOOKUP");
-            return mTlsState;
+      case SSL_ERROR_WANT_X509_LOOKUP:
+         DebugLog( << "Try later / SSL_ERROR_WANT_X509_LOOKUP");
+         return HandshakeRetry;
 
-         default:
-            if(err == SSL_ERROR_SYSCALL)
+      default:
+         if(err == SSL_ERROR_SYSCALL)
+         {
+            int e = getErrno();
+            switch(e)
             {
-               int e = getErrno();
-               switch(e)
-               {
-                  case EINTR:
-                  case EAGAIN:
+               case EINTR:
+               case EAGAIN:
 #if EAGAIN != EWOULDBLOCK
-                  case EWOULDBLOCK:  // Treat EGAIN and EWOULDBLOCK as the same: http://stackoverflow.com/questions/7003234/which-systems-define-eagain-and-ewouldblock-as-different-values
+               case EWOULDBLOCK:  // Treat EGAIN and EWOULDBLOCK as the same: http://stackoverflow.com/questions/7003234/which-systems-define-eagain-and-ewouldblock-as-different-values
 #endif
-                     StackLog( << "try later");
-                     return mTlsState;
+                  StackLog( << "try later");
+                  return HandshakeRetry;
+            }
+            ErrLog( << "socket error " << e);
+            Transport::error(e);
+            if(e == 0)
+            {
+               TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
+               resip_assert(t);
+               if(mServer && t->getClientVerificationMode() != SecurityTypes::None)
+               {
+                  DebugLog(<<"client may have disconnected to prompt for user certificate, because it can't supply a certificate (verification mode == " << (t->getClientVerificationMode() == SecurityTypes::Mandatory?"Mandatory":"Optional") << " for this transport) or because it does not support using client certificates over WebSockets");
                }
-               ErrLog( << "socket error " << e);
-               Transport::error(e);
-               if(e == 0)
+            }
+         }
+         else if (err == SSL_ERROR_SSL)
+         {
+            mFailureReason = TransportFailure::CertValidationFailure;
+            WarningLog(<<"SSL cipher or certificate failure SSL_ERROR_SSL");
+            if(SSL_get_peer_certificate(mSsl))
+            {
+               DebugLog(<<"a certificate was received from the peer");
+               int verifyErrorCode = SSL_get_verify_result(mSsl);
+               switch(verifyErrorCode)
                {
-                  TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
-                  resip_assert(t);
-                  if(mServer && t->getClientVerificationMode() != SecurityTypes::None)
-                  {
-                     DebugLog(<<"client may have disconnected to prompt for user certificate, because it can't supply a certificate (verification mode == " << (t->getClientVerificationMode() == SecurityTypes::Mandatory?"Mandatory":"Optional") << " for this transport) or because it does not support using client certificates over WebSockets");
-                  }
+                  case X509_V_OK:
+                     DebugLog(<<"peer supplied a ceritifcate, but it has not been checked or it was checked successfully");
+                     break;
+                  default:
+                     ErrLog(<<"peer certificate validation failure: " << X509_verify_cert_error_string(verifyErrorCode));
+                     DebugLog(<<"additional validation checks may have failed but only one is ever logged - please check peer certificate carefully");
+                     break;
                }
             }
-            else if (err == SSL_ERROR_SSL)
+            else
             {
-               mFailureReason = TransportFailure::CertValidationFailure;
-               WarningLog(<<"SSL cipher or certificate failure SSL_ERROR_SSL");
-               if(SSL_get_peer_certificate(mSsl))
+               DebugLog(<<"protocol did not reach certificate exchange phase, peer does not have a certificate or the certificate was not accepted");
+               if(mServer)
                {
-                  DebugLog(<<"a certificate was received from the peer");
-                  int verifyErrorCode = SSL_get_verify_result(mSsl);
-                  switch(verifyErrorCode)
+                  TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
+                  resip_assert(t);
+                  if(t->getClientVerificationMode() == SecurityTypes::Mandatory)
                   {
-                     case X509_V_OK:
-                        DebugLog(<<"peer supplied a ceritifcate, but it has not been checked or it was checked successfully");
-                        break;
-                     default:
-                        ErrLog(<<"peer certificate validation failure: " << X509_verify_cert_error_string(verifyErrorCode));
-                        DebugLog(<<"additional validation checks may have failed but only one is ever logged - please check peer certificate carefully");
-                        break;
+                     ErrLog(<<"Mandatory client certificate verification required, protocol failed, client did not send a certificate or it was not valid");
                   }
                }
                else
                {
-                  DebugLog(<<"protocol did not reach certificate exchange phase, peer does not have a certificate or the certificate was not accepted");
-                  if(mServer)
-                  {
-                     TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
-                     resip_assert(t);
-                     if(t->getClientVerificationMode() == SecurityTypes::Mandatory)
-                     {
-                        ErrLog(<<"Mandatory client certificate verification required, protocol failed, client did not send a certificate or it was not valid");
-                     }
-                  }
-                  else
-                  {
-                     ErrLog(<<"Server did not present any certificiate to us, certificate invalid or protocol did not reach certificate exchange");
-                  }
+                  ErrLog(<<"Server did not present any certificiate to us, certificate invalid or protocol did not reach certificate exchange");
                }
             }
-            else
-            {
-               DebugLog(<<"unrecognised/unhandled SSL_get_error result: " << err);
-            }
-            ErrLog( << "TLS handshake failed ");
-            handleOpenSSLErrorQueue(ok, err, "SSL_do_handshake");
-            mBio = NULL;
-            mTlsState = Broken;
-            return mTlsState;
-      }
+         }
+         else
+         {
+            DebugLog(<<"unrecognised/unhandled SSL_get_error result: " << err);
+         }
+         ErrLog( << "TLS handshake failed ");
+         handleOpenSSLErrorQueue(ok, err, "SSL_do_handshake");
+         return HandshakeFailed;
    }
-   else // ok > 1
+#endif // USE_SSL   
+   return HandshakeFailed;
+}
+
+TlsConnection::TlsState
+TlsConnection::finishHandshakeStep(HandshakeStep step)
+{
+#if defined(USE_SSL)
+   mHandShakeWantsRead = false;
+   switch (step)
    {
-      InfoLog( << "TLS connected" );
+      case HandshakeWantRead:
+         mHandShakeWantsRead = true;
+         return mTlsState;
+
+      case HandshakeWantWrite:
+         ensureWritable();
+         return mTlsState;
+
+      case HandshakeRetry:
+         return mTlsState;
+
+      case HandshakeFailed:
+         forgetClientSession();
+         mBio = NULL;
+         mTlsState = Broken;
+         return mTlsState;
+
+      case HandshakeDone:
+         break;
    }
 
    // force peer name to get checked and perhaps cert loaded
@@ -359,11 +417,14 @@ TlsConnection::checkState()
                  << "> remote cert domain(s) are <" 
                  << getPeerNamesData() << ">" );
          mFailureReason = TransportFailure::CertNameMismatch;         
+         forgetClientSession();
          return mTlsState;
       }
    }
 
-   InfoLog( << "TLS handshake done for peer " << getPeerNamesData()); 
+   bool resumed = SSL_session_reused(mSsl) != 0;
+   mSecurity->recordTlsHandshake(mServer, mSessionOffered, resumed);
+   InfoLog( << "TLS handshake done for peer " << getPeerNamesData() << (resumed ? " (session resumed)" : "")); 
    mTlsState = Up;
    if (!mOutstandingSends.empty())
    {
@@ -489,6 +550,11 @@ TlsConnection::transportWrite()
       case Handshaking:
       case Initial:
          checkState();
+         if (mHandshakeJob)
+         {
+            DebugLog(<< "Transportwrite--Handshake step on crypto pool--remove from write");
+            return true;
+         }
          if (mTlsState == Handshaking)
          {
             DebugLog(<< "Transportwrite--Handshaking--remove from write: " << mHandShakeWantsRead);
@@ -582,6 +648,10 @@ TlsConnection::hasDataToRead() // has data that can be read
    if(mTlsState == Initial)
       return false;
 
+   // with a crypto pool, handshake steps are only run when the socket is ready
+   if(mTlsState != Up && mHandshakePool)
+      return false;
+
    if (checkState() != Up)
    {
       return false;
@@ -629,7 +699,7 @@ TlsConnection::isWritable()
    switch(mTlsState)
    {
       case Handshaking:
-         return mHandShakeWantsRead ? false : true;
+         return (mHandShakeWantsRead || mHandshakeJob) ? false : true;
       case Initial:
       case Up:
          return isGood();
@@ -740,6 +810,38 @@ TlsConnection::computePeerName()
 #endif // USE_SSL
 }
 
+void
+TlsConnection::handshakeStepDone(HandshakeStep step)
+{
+#if defined(USE_SSL)
+   mHandshakeJob = 0;
+   TlsState state = finishHandshakeStep(step);
+   resumeIo();
+   if (state == Broken)
+   {
+      delete this;
+   }
+   else if (state == Up && hasDataToRead())
+   {
+      performReads();
+   }
+#endif // USE_SSL
+}
+
+void
+TlsConnection::forgetClientSession()
+{
+#if defined(USE_SSL)
+   // don't offer a session to a peer that has just failed with it again
+   if(!mServer && mSessionOffered)
+   {
+      TlsBaseTransport *t = dynamic_cast<TlsBaseTransport*>(transport());
+      resip_assert(t);
+      t->removeClientSession(who(), who().getTargetDomain());
+   }
+#endif // USE_SSL
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
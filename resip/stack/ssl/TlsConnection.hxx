@@ -28,6 +28,8 @@ namespace resip
 
 class Tuple;
 class Security;
+class TlsHandshakeJob;
+class TlsHandshakePool;
 
 class TlsConnection : public Connection
 {
@@ -55,11 +57,22 @@ class TlsConnection : public Connection
       static const char * fromState(TlsState);
    
    private:
+      friend class TlsHandshakePool;
+
+      /// outcome of one SSL_do_handshake() call
+      typedef enum HandshakeStep { HandshakeWantRead, HandshakeWantWrite, HandshakeRetry, HandshakeFailed, HandshakeDone } HandshakeStep;
+
       /// No default c'tor
       TlsConnection();
       void computePeerName();
       Data getPeerNamesData() const;
       TlsState checkState();
+      /// runs SSL_do_handshake(); may be called from a crypto pool thread
+      HandshakeStep doHandshakeStep();
+      TlsState finishHandshakeStep(HandshakeStep step);
+      /// a step run by mHandshakePool has finished; may delete this
+      void handshakeStepDone(HandshakeStep step);
+      void forgetClientSession();
 
       bool mServer;
       Security* mSecurity;
@@ -68,6 +81,9 @@ class TlsConnection : public Connection
       
       TlsState mTlsState;
       bool mHandShakeWantsRead;
+      bool mSessionOffered;
+      TlsHandshakePool* mHandshakePool;
+      TlsHandshakeJob* mHandshakeJob;
 
       SSL* mSsl;
       BIO* mBio;
@@ -0,0 +1,233 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#ifdef USE_SSL
+
+#include <algorithm>
+
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
+#include "resip/stack/ssl/TlsConnection.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
+
+using namespace resip;
+
+namespace resip
+{
+
+class TlsHandshakeWorker : public ThreadIf
+{
+   public:
+      explicit TlsHandshakeWorker(TlsHandshakePool& pool) : mPool(pool) {}
+      virtual ~TlsHandshakeWorker()
+      {
+         shutdown();
+         join();
+      }
+
+      virtual void thread()
+      {
+         while(!isShutdown())
+         {
+            mPool.runNext(100);
+         }
+      }
+
+   private:
+      TlsHandshakePool& mPool;
+};
+
+}
+
+TlsHandshakePool::TlsHandshakePool(unsigned int threads)
+{
+   mFifo.setDescription("TlsHandshakePool::mFifo");
+   InfoLog(<< "Running TLS handshakes on " << threads << " threads");
+   for(unsigned int i = 0; i < threads; i++)
+   {
+      mWorkers.push_back(new TlsHandshakeWorker(*this));
+      mWorkers.back()->run();
+   }
+}
+
+TlsHandshakePool::~TlsHandshakePool()
+{
+   for(std::vector<TlsHandshakeWorker*>::iterator it = mWorkers.begin(); it != mWorkers.end(); it++)
+   {
+      (*it)->shutdown();
+   }
+   for(std::vector<TlsHandshakeWorker*>::iterator it = mWorkers.begin(); it != mWorkers.end(); it++)
+   {
+      delete *it;
+   }
+   // the connections are gone, anything left in mFifo was cancelled
+   for(std::deque<TlsHandshakeJob*>::iterator it = mDone.begin(); it != mDone.end(); it++)
+   {
+      delete *it;
+   }
+}
+
+TlsHandshakeJob*
+TlsHandshakePool::post(TlsConnection* connection)
+{
+   TlsHandshakeJob* job = new TlsHandshakeJob(connection);
+   mFifo.add(job);
+   return job;
+}
+
+void
+TlsHandshakePool::cancel(TlsHandshakeJob* job)
+{
+   Lock lock(mMutex);
+   switch(job->mState)
+   {
+      case TlsHandshakeJob::Queued:
+         // deleted by the worker that takes it
+         job->mConnection = 0;
+         return;
+      case TlsHandshakeJob::Running:
+         job->mConnection = 0;
+         while(job->mState == TlsHandshakeJob::Running)
+         {
+            mFinished.wait(mMutex);
+         }
+         break;
+      case TlsHandshakeJob::Done:
+         {
+            std::deque<TlsHandshakeJob*>::iterator it = std::find(mDone.begin(), mDone.end(), job);
+            if(it != mDone.end())
+            {
+               mDone.erase(it);
+            }
+         }
+         break;
+   }
+   delete job;
+}
+
+void
+TlsHandshakePool::process()
+{
+   while(true)
+   {
+      TlsHandshakeJob* job;
+      {
+         Lock lock(mMutex);
+         if(mDone.empty())
+         {
+            return;
+         }
+         job = mDone.front();
+         mDone.pop_front();
+      }
+      TlsConnection* connection = job->mConnection;
+      TlsConnection::HandshakeStep step = (TlsConnection::HandshakeStep)job->mStep;
+      delete job;
+      connection->handshakeStepDone(step);
+   }
+}
+
+void
+TlsHandshakePool::runNext(int ms)
+{
+   TlsHandshakeJob* job = mFifo.getNext(ms);
+   if(!job)
+   {
+      return;
+   }
+
+   TlsConnection* connection;
+   {
+      Lock lock(mMutex);
+      connection = job->mConnection;
+      if(connection)
+      {
+         job->mState = TlsHandshakeJob::Running;
+      }
+   }
+   if(!connection)
+   {
+      delete job;
+      return;
+   }
+
+   int step = connection->doHandshakeStep();
+
+   bool wake = false;
+   {
+      Lock lock(mMutex);
+      job->mStep = step;
+      job->mState = TlsHandshakeJob::Done;
+      if(job->mConnection)
+      {
+         mDone.push_back(job);
+         wake = mDone.size() == 1;
+      }
+      else
+      {
+         // the connection's destructor is waiting in cancel()
+         mFinished.broadcast();
+      }
+   }
+   if(wake)
+   {
+      mInterruptor.interrupt();
+   }
+}
+
+#endif /* USE_SSL */
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,131 @@
+#if !defined(RESIP_TLSHANDSHAKEPOOL_HXX)
+#define RESIP_TLSHANDSHAKEPOOL_HXX
+
+#include <deque>
+#include <vector>
+
+#include "rutil/Condition.hxx"
+#include "rutil/Fifo.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/SelectInterruptor.hxx"
+
+namespace resip
+{
+
+class TlsConnection;
+class TlsHandshakeWorker;
+
+/// One step of a TLS handshake, queued with or being run by a TlsHandshakePool
+class TlsHandshakeJob
+{
+   public:
+      typedef enum State { Queued, Running, Done } State;
+
+      explicit TlsHandshakeJob(TlsConnection* connection)
+         : mConnection(connection), mState(Queued), mStep(0) {}
+
+      TlsConnection* mConnection; // 0 once cancelled
+      State mState;
+      int mStep;                  // TlsConnection::HandshakeStep result
+};
+
+/**
+   Runs the steps of the TLS handshakes of a TlsBaseTransport on a fixed
+   number of threads.  A step is one SSL_do_handshake() call, which is where
+   the key exchange and the verification of the peer's certificate chain are
+   done, so that they no longer hold up the reads and writes of every other
+   connection on the transport thread.
+
+   The socket of a connection with a step in the pool is out of the
+   transport's poll set.  Finished steps are handed back to their
+   connections on the transport thread by process(); getInterruptor() is
+   signalled when there are some.
+*/
+class TlsHandshakePool
+{
+   public:
+      explicit TlsHandshakePool(unsigned int threads);
+      ~TlsHandshakePool();
+
+      /// queues the next handshake step of connection
+      TlsHandshakeJob* post(TlsConnection* connection);
+      /// withdraws job, waiting for it if a worker is running it; job is
+      /// deleted
+      void cancel(TlsHandshakeJob* job);
+      /// hands finished steps back to their connections (which may delete
+      /// themselves); transport thread only
+      void process();
+
+      /// the steps waiting for a worker, for the CongestionManager
+      FifoStatsInterface& getFifo() { return mFifo; }
+      SelectInterruptor& getInterruptor() { return mInterruptor; }
+
+   private:
+      friend class TlsHandshakeWorker;
+      void runNext(int ms);
+
+      Fifo<TlsHandshakeJob> mFifo;
+      Mutex mMutex;
+      Condition mFinished;
+      std::deque<TlsHandshakeJob*> mDone;
+      SelectInterruptor mInterruptor;
+      std::vector<TlsHandshakeWorker*> mWorkers;
+
+      // no value semantics
+      TlsHandshakePool(const TlsHandshakePool&);
+      TlsHandshakePool& operator=(const TlsHandshakePool&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -58,6 +58,10 @@ Connection*
 WssTransport::createConnection(const Tuple& who, Socket fd, bool server)
 {
    resip_assert(this);
+   if(server && refuseConnection(who, fd))
+   {
+      return 0;
+   }
    Connection* conn = new WssConnection(this,who, fd, mSecurity, server,
                                         tlsDomain(), mSslType, mCompression,
                                         mConnectionValidator);
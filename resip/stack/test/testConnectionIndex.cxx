@@ -0,0 +1,288 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "resip/stack/Connection.hxx"
+#include "resip/stack/ConnectionIndex.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks ConnectionIndex against the std::maps ConnectionManager used to
+// keep (Tuple -> Connection*, flow key -> Connection*) under random
+// add/remove/find with fd reuse, then times both with 500k connections.
+
+typedef map<Tuple, Connection*> AddrMap;
+typedef map<FlowKey, Connection*> IdMap;
+
+// 4 source ports per address, the way clients behind a NAT show up
+Tuple
+makeTuple(UInt32 i)
+{
+   in_addr addr;
+   addr.s_addr = htonl(0x0a000000 + (i >> 2));
+   return Tuple(addr, 5060 + (i & 3), TCP);
+}
+
+// transport 0 keeps the Connection from registering with a manager
+Connection*
+makeConnection(UInt32 i, Socket fd)
+{
+   return new Connection(0, makeTuple(i), fd, Compression::Disabled, true);
+}
+
+// small deterministic generator, so failures reproduce
+UInt32
+nextRandom(UInt32& seed)
+{
+   seed = seed*1103515245 + 12345;
+   return seed >> 8;
+}
+
+void
+testAgainstMap()
+{
+   const UInt32 space = 4000;
+   ConnectionIndex index;
+   AddrMap byAddr;
+   IdMap byFd;
+   vector<Connection*> slots(space, (Connection*)0);
+   vector<Socket> freeFds;
+   Socket nextFd = 3;
+   UInt32 seed = 1;
+
+   for (int op = 0; op < 200000; ++op)
+   {
+      const UInt32 i = nextRandom(seed) % space;
+      if (!slots[i])
+      {
+         Socket fd;
+         if (!freeFds.empty() && nextRandom(seed) % 4)
+         {
+            fd = freeFds.back();
+            freeFds.pop_back();
+         }
+         else
+         {
+            fd = nextFd++;
+         }
+         Connection* conn = makeConnection(i, fd);
+         assert(index.find(conn->who()) == 0);
+         index.add(conn);
+         byAddr[conn->who()] = conn;
+         byFd[fd] = conn;
+         slots[i] = conn;
+      }
+      else if (nextRandom(seed) % 3 == 0)
+      {
+         Connection* conn = slots[i];
+         const FlowKey fd = conn->who().mFlowKey;
+         index.remove(conn);
+         byAddr.erase(conn->who());
+         byFd.erase(fd);
+         freeFds.push_back((Socket)fd);
+         slots[i] = 0;
+         delete conn;
+      }
+
+      // a lookup tuple carries no flow key, it has to match on address alone
+      const UInt32 probe = nextRandom(seed) % (space + 100);
+      const Tuple t = makeTuple(probe);
+      AddrMap::const_iterator a = byAddr.find(t);
+      assert(index.find(t) == (a == byAddr.end() ? 0 : a->second));
+
+      const FlowKey fd = nextRandom(seed) % (nextFd + 10);
+      IdMap::const_iterator f = byFd.find(fd);
+      assert(index.find(fd) == (f == byFd.end() ? 0 : f->second));
+
+      assert(index.size() == byAddr.size());
+   }
+
+   vector<Connection*> all;
+   index.getConnections(all);
+   assert(all.size() == byAddr.size());
+   for (vector<Connection*>::iterator i = all.begin(); i != all.end(); ++i)
+   {
+      assert(byAddr[(*i)->who()] == *i);
+      index.remove(*i);
+      delete *i;
+   }
+   assert(index.empty());
+   assert(index.find(makeTuple(0)) == 0);
+}
+
+void
+benchmark(UInt32 count)
+{
+   vector<Connection*> conns;
+   conns.reserve(count);
+   for (UInt32 i = 0; i < count; ++i)
+   {
+      conns.push_back(makeConnection(i, (Socket)(i + 3)));
+   }
+
+   // look up in an order unrelated to insertion, as the transports do
+   vector<Tuple> probes;
+   vector<FlowKey> fds;
+   probes.reserve(count);
+   fds.reserve(count);
+   UInt32 seed = 7;
+   for (UInt32 i = 0; i < count; ++i)
+   {
+      const UInt32 n = nextRandom(seed) % count;
+      probes.push_back(makeTuple(n));
+      fds.push_back(n + 3);
+   }
+
+   {
+      AddrMap byAddr;
+      IdMap byFd;
+      UInt64 start = Timer::getTimeMicroSec();
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         byAddr[conns[i]->who()] = conns[i];
+         byFd[conns[i]->who().mFlowKey] = conns[i];
+      }
+      UInt64 added = Timer::getTimeMicroSec();
+      UInt32 found = 0;
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         found += byAddr.find(probes[i]) != byAddr.end();
+      }
+      UInt64 byTuple = Timer::getTimeMicroSec();
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         found += byFd.find(fds[i]) != byFd.end();
+      }
+      UInt64 byKey = Timer::getTimeMicroSec();
+      for (UInt32 i = 0; i < count; i += 2)
+      {
+         byFd.erase(conns[i]->who().mFlowKey);
+         byAddr.erase(conns[i]->who());
+         byAddr[conns[i]->who()] = conns[i];
+         byFd[conns[i]->who().mFlowKey] = conns[i];
+      }
+      UInt64 churned = Timer::getTimeMicroSec();
+      assert(found == 2*count);
+      cerr << "std::map:        add " << count << " in " << (added - start)/1000 << "ms, "
+           << "find by tuple " << (byTuple - added)/1000 << "ms, "
+           << "by flow key " << (byKey - byTuple)/1000 << "ms, "
+           << "churn half " << (churned - byKey)/1000 << "ms" << endl;
+   }
+
+   {
+      ConnectionIndex index;
+      UInt64 start = Timer::getTimeMicroSec();
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         index.add(conns[i]);
+      }
+      UInt64 added = Timer::getTimeMicroSec();
+      UInt32 found = 0;
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         found += index.find(probes[i]) != 0;
+      }
+      UInt64 byTuple = Timer::getTimeMicroSec();
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         found += index.find(fds[i]) != 0;
+      }
+      UInt64 byKey = Timer::getTimeMicroSec();
+      for (UInt32 i = 0; i < count; i += 2)
+      {
+         index.remove(conns[i]);
+         index.add(conns[i]);
+      }
+      UInt64 churned = Timer::getTimeMicroSec();
+      assert(found == 2*count);
+      cerr << "ConnectionIndex: add " << count << " in " << (added - start)/1000 << "ms, "
+           << "find by tuple " << (byTuple - added)/1000 << "ms, "
+           << "by flow key " << (byKey - byTuple)/1000 << "ms, "
+           << "churn half " << (churned - byKey)/1000 << "ms, "
+           << index.getMemoryUsage()/count << " bytes/connection" << endl;
+   }
+
+   for (UInt32 i = 0; i < count; ++i)
+   {
+      delete conns[i];
+   }
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   UInt32 count = 500000;
+   if (argc > 1)
+   {
+      count = atoi(argv[1]);
+   }
+
+   testAgainstMap();
+   benchmark(count);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
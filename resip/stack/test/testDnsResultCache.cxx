@@ -0,0 +1,269 @@
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ParseBuffer.hxx"
+#include "rutil/Socket.hxx"
+#include "rutil/dns/DnsHandler.hxx"
+#include "rutil/dns/DnsStub.hxx"
+#include "resip/stack/DnsInterface.hxx"
+#include "resip/stack/DnsResult.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "resip/stack/Uri.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks that DnsResult::lookup() answers what the DnsStub cache holds on
+// the calling thread, without a round trip through the DnsStub command fifo,
+// and that what isn't cached is still looked up by DnsStub::process().
+
+namespace
+{
+
+class CacheStub : public DnsStub
+{
+   public:
+      // an A record, as if from the hosts file
+      void cacheHost(const Data& host, UInt32 address)
+      {
+         in_addr addr;
+         addr.s_addr = htonl(address);
+         cache(host, addr);
+      }
+
+      // a response holding an SRV record for name, in wire format
+      void cacheSrv(const Data& name, int port, const Data& target)
+      {
+         const unsigned char header[] = { 0, 0, 0x81, 0x80, 0, 0, 0, 1, 0, 0, 0, 0 };
+         Data response((const char*)header, sizeof(header));
+         response += wireName(name);
+         const Data rdataTarget = wireName(target);
+         const int rdlength = 6 + (int)rdataTarget.size();
+         const unsigned char fixed[] = { 0, 33, 0, 1,
+                                         0, 0, 0x0e, 0x10,
+                                         (unsigned char)(rdlength >> 8), (unsigned char)rdlength,
+                                         0, 10, 0, 1,
+                                         (unsigned char)(port >> 8), (unsigned char)port };
+         response.append((const char*)fixed, sizeof(fixed));
+         response += rdataTarget;
+         cache(name, (const unsigned char*)response.data(), (int)response.size());
+      }
+
+   private:
+      static Data wireName(const Data& name)
+      {
+         Data wire;
+         ParseBuffer pb(name);
+         while (!pb.eof())
+         {
+            const char* start = pb.position();
+            pb.skipToChar('.');
+            wire += (char)(pb.position() - start);
+            wire.append(start, pb.position() - start);
+            if (!pb.eof())
+            {
+               pb.skipChar();
+            }
+         }
+         wire += (char)0;
+         return wire;
+      }
+};
+
+class TestInterface : public DnsInterface
+{
+   public:
+      TestInterface(DnsStub& stub) : DnsInterface(stub)
+      {
+         addTransportType(UDP, V4);
+         addTransportType(TCP, V4);
+      }
+};
+
+class TestHandler : public DnsHandler
+{
+   public:
+      TestHandler() : mHandled(0) {}
+      virtual void handle(DnsResult*) { ++mHandled; }
+      virtual void rewriteRequest(const Uri&) {}
+      int mHandled;
+};
+
+// Takes every result from a lookup that has completed, then destroys it
+vector<Tuple>
+drain(DnsResult* result)
+{
+   vector<Tuple> tuples;
+   while (result->available() == DnsResult::Available)
+   {
+      tuples.push_back(result->next());
+   }
+   assert(result->available() == DnsResult::Finished);
+   result->destroy();
+   return tuples;
+}
+
+void
+processUntilHandled(DnsStub& stub, const TestHandler& handler)
+{
+   for (int i = 0; i < 100 && handler.mHandled == 0; ++i)
+   {
+      FdSet fdset;
+      stub.buildFdSet(fdset);
+      fdset.selectMilliSeconds(10);
+      stub.process(fdset);
+   }
+   assert(handler.mHandled > 0);
+}
+
+void
+testHostAndPort()
+{
+   CacheStub stub;
+   TestInterface dns(stub);
+   stub.cacheHost("host.example.com", 0x0a000001);
+
+   TestHandler handler;
+   DnsResult* result = dns.createDnsResult(&handler);
+   dns.lookup(result, Uri("sip:host.example.com:5070"));
+   // answered before lookup() returned, with nothing processed
+   assert(handler.mHandled > 0);
+   vector<Tuple> tuples = drain(result);
+   assert(tuples.size() == 1);
+   assert(Tuple::inet_ntop(tuples[0]) == "10.0.0.1");
+   assert(tuples[0].getPort() == 5070);
+   assert(tuples[0].getType() == UDP);
+}
+
+void
+testSrv()
+{
+   CacheStub stub;
+   TestInterface dns(stub);
+   stub.cacheSrv("_sip._tcp.example.com", 5080, "proxy.example.com");
+   stub.cacheHost("proxy.example.com", 0x0a000002);
+
+   TestHandler handler;
+   DnsResult* result = dns.createDnsResult(&handler);
+   dns.lookup(result, Uri("sip:example.com;transport=tcp"));
+   assert(handler.mHandled > 0);
+   vector<Tuple> tuples = drain(result);
+   assert(tuples.size() == 1);
+   assert(Tuple::inet_ntop(tuples[0]) == "10.0.0.2");
+   assert(tuples[0].getPort() == 5080);
+   assert(tuples[0].getType() == TCP);
+}
+
+void
+testMiss()
+{
+   CacheStub stub;
+   TestInterface dns(stub);
+
+   TestHandler handler;
+   DnsResult* result = dns.createDnsResult(&handler);
+   dns.lookup(result, Uri("sip:late.example.com:5070"));
+   assert(handler.mHandled == 0);
+   assert(result->available() == DnsResult::Pending);
+
+   // cached before the DnsStub gets to the query it queued
+   stub.cacheHost("late.example.com", 0x0a000003);
+   processUntilHandled(stub, handler);
+   vector<Tuple> tuples = drain(result);
+   assert(tuples.size() == 1);
+   assert(Tuple::inet_ntop(tuples[0]) == "10.0.0.3");
+}
+
+void
+testPartial()
+{
+   CacheStub stub;
+   TestInterface dns(stub);
+   stub.cacheSrv("_sip._tcp.partial.example.com", 5090, "target.example.com");
+
+   TestHandler handler;
+   DnsResult* result = dns.createDnsResult(&handler);
+   dns.lookup(result, Uri("sip:partial.example.com;transport=tcp"));
+   // the SRV was answered, but its target's A record has to be queued
+   assert(handler.mHandled == 0);
+   assert(result->available() == DnsResult::Pending);
+
+   stub.cacheHost("target.example.com", 0x0a000004);
+   processUntilHandled(stub, handler);
+   vector<Tuple> tuples = drain(result);
+   assert(tuples.size() == 1);
+   assert(Tuple::inet_ntop(tuples[0]) == "10.0.0.4");
+   assert(tuples[0].getPort() == 5090);
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+   initNetwork();
+
+   testHostAndPort();
+   testSrv();
+   testMiss();
+   testPartial();
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,304 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <iostream>
+#include <memory>
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "resip/stack/Helper.hxx"
+#include "resip/stack/SendData.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/Logger.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks that SipMessage::encodeGathered() produces the same bytes as
+// encode(), references the receive buffers only for untouched text, keeps
+// them alive past the message, and that the segments survive being written
+// with writev() from an arbitrary offset.
+
+namespace
+{
+
+const char* invite =
+   "INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP proxy.atlanta.example.com:5060;branch=z9hG4bK2d4790.1;received=192.0.2.101\r\n"
+   "Via: SIP/2.0/UDP client.atlanta.example.com:5060;branch=z9hG4bK74bf9;rport=5060;received=192.0.2.103\r\n"
+   "Max-Forwards: 70\r\n"
+   "From: \"Alice Liddell\" <sip:alice@atlanta.example.com>;tag=9fxced76sl\r\n"
+   "To: \"Bob\" <sip:bob@biloxi.example.com>\r\n"
+   "Call-ID: 3848276298220188511@atlanta.example.com\r\n"
+   "CSeq: 1 INVITE\r\n"
+   "Contact: <sip:alice@client.atlanta.example.com;transport=udp>;+sip.instance=\"<urn:uuid:00000000-0000-1000-8000-000A95A0E128>\"\r\n"
+   "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO\r\n"
+   "X-Long-Unknown-Header: this value is long enough to be referenced rather than copied by the encoder\r\n"
+   "Content-Type: application/sdp\r\n"
+   "Content-Length: 151\r\n"
+   "\r\n"
+   "v=0\r\n"
+   "o=alice 2890844526 2890844526 IN IP4 client.atlanta.example.com\r\n"
+   "s=-\r\n"
+   "c=IN IP4 192.0.2.101\r\n"
+   "t=0 0\r\n"
+   "m=audio 49172 RTP/AVP 0\r\n"
+   "a=rtpmap:0 PCMU/8000\r\n";
+
+Data
+encodeFlat(const SipMessage& msg)
+{
+   Data result;
+   {
+      DataStream str(result);
+      msg.encode(str);
+   }
+   return result;
+}
+
+size_t
+externalSegments(const SendData& sendData)
+{
+   size_t count = 0;
+   for (std::vector<SendData::Segment>::const_iterator i = sendData.segments.begin();
+        i != sendData.segments.end(); ++i)
+   {
+      if (i->external)
+      {
+         ++count;
+      }
+   }
+   return count;
+}
+
+bool
+check(bool condition, const char* what)
+{
+   if (!condition)
+   {
+      cerr << "FAILED: " << what << endl;
+   }
+   return condition;
+}
+
+bool
+testUnmodified()
+{
+   std::auto_ptr<SipMessage> msg(SipMessage::make(Data(invite)));
+   Data expected = encodeFlat(*msg);
+
+   SendData sendData;
+   msg->encodeGathered(sendData);
+
+   bool ok = check(sendData.isGathered(), "received message not gathered");
+   ok &= check(externalSegments(sendData) >= 3, "too few referenced segments");
+   ok &= check(sendData.data.size() < expected.size() / 2, "too much copied");
+   ok &= check(sendData.size() == expected.size(), "size mismatch");
+   ok &= check(sendData.flat() == expected, "gathered bytes differ");
+   ok &= check(sendData.buffers.get() != 0, "buffers not shared");
+
+   // the SendData owns a reference to the buffers
+   SendData copy(sendData);
+   msg.reset();
+   ok &= check(copy.flat() == expected, "bytes differ after message deleted");
+   copy.flatten();
+   ok &= check(!copy.isGathered() && copy.data == expected, "flatten failed");
+   return ok;
+}
+
+bool
+testModified()
+{
+   std::auto_ptr<SipMessage> msg(SipMessage::make(Data(invite)));
+   Via via;
+   via.transport() = "UDP";
+   via.sentHost() = "proxy.biloxi.example.com";
+   via.sentPort() = 5060;
+   via.param(p_branch).reset("z9hG4bKnashds8");
+   msg->header(h_Vias).push_front(via);
+   msg->header(h_RequestLine).uri().host() = "192.0.2.4";
+   msg->header(h_MaxForwards).value() = 69;
+   msg->header(h_Contacts).front().uri().param(p_transport) = "tcp";
+   Data expected = encodeFlat(*msg);
+
+   SendData sendData;
+   msg->encodeGathered(sendData);
+   bool ok = check(sendData.isGathered(), "modified message not gathered");
+   ok &= check(sendData.flat() == expected, "modified gathered bytes differ");
+
+   // encoding twice shares the same buffers
+   SendData again;
+   msg->encodeGathered(again);
+   ok &= check(again.buffers == sendData.buffers, "buffers shared twice");
+   ok &= check(again.flat() == expected, "second gathered encode differs");
+   return ok;
+}
+
+bool
+testNotReceived()
+{
+   // built in memory, so nothing to reference
+   std::auto_ptr<SipMessage> received(SipMessage::make(Data(invite)));
+   std::auto_ptr<SipMessage> msg(Helper::makeResponse(*received, 180));
+   Data expected = encodeFlat(*msg);
+
+   SendData sendData;
+   msg->encodeGathered(sendData);
+   bool ok = check(!sendData.isGathered(), "built message gathered");
+   ok &= check(sendData.data == expected, "built message bytes differ");
+
+   // a copy owns its header values, so neither is it gathered
+   SipMessage copy(*received);
+   SendData copyData;
+   copy.encodeGathered(copyData);
+   ok &= check(!copyData.isGathered(), "copied message gathered");
+   ok &= check(copyData.data == encodeFlat(*received), "copied message bytes differ");
+   return ok;
+}
+
+bool
+testIoVecs()
+{
+   std::auto_ptr<SipMessage> msg(SipMessage::make(Data(invite)));
+   Data expected = encodeFlat(*msg);
+   SendData sendData;
+   msg->encodeGathered(sendData);
+
+   struct Iov { void* iov_base; size_t iov_len; };
+   Iov iov[2*SendData::MaxExternalSegments + 1];
+   bool ok = true;
+   for (size_t offset = 0; offset < expected.size(); offset += 7)
+   {
+      int count = sendData.toIoVecs(iov, offset);
+      Data joined;
+      for (int i = 0; i < count; ++i)
+      {
+         joined.append((const char*)iov[i].iov_base, (Data::size_type)iov[i].iov_len);
+      }
+      if (!check(joined == expected.substr((Data::size_type)offset), "iovecs from offset differ"))
+      {
+         cerr << "offset=" << offset << endl;
+         return false;
+      }
+   }
+
+#ifndef WIN32
+   // and through a real writev(), a piece at a time
+   int fds[2];
+   ok &= check(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair");
+   if (ok)
+   {
+      Data received;
+      size_t sent = 0;
+      while (ok && sent < sendData.size())
+      {
+         struct iovec vecs[2*SendData::MaxExternalSegments + 1];
+         int count = sendData.toIoVecs(vecs, sent);
+         // cap each write so the offsets land mid-segment
+         size_t budget = 37;
+         int used = 0;
+         while (used < count && budget > 0)
+         {
+            if (vecs[used].iov_len > budget)
+            {
+               vecs[used].iov_len = budget;
+            }
+            budget -= vecs[used].iov_len;
+            ++used;
+         }
+         ssize_t n = writev(fds[0], vecs, used);
+         ok &= check(n > 0, "writev");
+         char buf[64];
+         ssize_t r = read(fds[1], buf, sizeof(buf));
+         ok &= check(r == n, "read");
+         received.append(buf, (Data::size_type)r);
+         sent += (size_t)n;
+      }
+      ok &= check(received == expected, "writev bytes differ");
+      close(fds[0]);
+      close(fds[1]);
+   }
+#endif
+   return ok;
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   bool ok = testUnmodified();
+   ok &= testModified();
+   ok &= testNotReceived();
+   ok &= testIoVecs();
+
+   if (!ok)
+   {
+      cerr << "FAILED" << endl;
+      return -1;
+   }
+   cout << "PASSED" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,325 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "resip/stack/MsgHeaderScanner.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/FileSystem.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks that every MsgHeaderScanner implementation the CPU supports scans
+// the message corpus (the *.dat files) and some messages built to stress the
+// vector code exactly like the scalar one, whole and split into chunks, then
+// compares their speed on a typical INVITE.
+
+namespace
+{
+
+const MsgHeaderScanner::ScanImplementation implementations[] =
+{
+   MsgHeaderScanner::siScalar,
+   MsgHeaderScanner::siSse2,
+   MsgHeaderScanner::siAvx2
+};
+const int numImplementations = sizeof(implementations) / sizeof(implementations[0]);
+
+const char* implementationNames[] = { "scalar", "sse2", "avx2" };
+
+const char* invite =
+   "INVITE sip:bob@biloxi.example.com;transport=tcp SIP/2.0\r\n"
+   "Via: SIP/2.0/TCP client.atlanta.example.com:5060;branch=z9hG4bK74bf9;rport\r\n"
+   "Via: SIP/2.0/UDP proxy.atlanta.example.com:5060;branch=z9hG4bK2d4790.1;received=192.0.2.101\r\n"
+   "Max-Forwards: 70\r\n"
+   "From: \"Alice Liddell\" <sip:alice@atlanta.example.com>;tag=9fxced76sl\r\n"
+   "To: \"Bob\" <sip:bob@biloxi.example.com>\r\n"
+   "Call-ID: 3848276298220188511@atlanta.example.com\r\n"
+   "CSeq: 1 INVITE\r\n"
+   "Contact: <sip:alice@client.atlanta.example.com;transport=tcp>;+sip.instance=\"<urn:uuid:00000000-0000-1000-8000-000A95A0E128>\"\r\n"
+   "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO\r\n"
+   "Supported: replaces, outbound, gruu, timer\r\n"
+   "User-Agent: resiprocate scanner benchmark\r\n"
+   "Content-Type: application/sdp\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+// Messages that put stop characters and text property characters at and
+// around vector boundaries, in quotes and angles, in long runs and folded
+// lines, plus a few malformed ones.
+vector<Data>
+syntheticMessages()
+{
+   vector<Data> messages;
+   messages.push_back(Data(invite));
+
+   for (int pad = 0; pad < 70; ++pad)
+   {
+      Data filler(Data::Share, "abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789", pad);
+      Data msg;
+      {
+         DataStream ds(msg);
+         ds << "OPTIONS sip:" << filler << "@example.com SIP/2.0\r\n"
+            << "Via: SIP/2.0/UDP " << filler << ".example.com;branch=z9hG4bK" << pad << "\r\n"
+            << "To: \"" << filler << " \\\" (quoted) %41;\" <sip:" << filler << "@a.com>, <sip:b@b.com>\r\n"
+            << "From: <sip:" << filler << "%20@example.com>;tag=" << filler << "\r\n"
+            << "Subject: " << filler << "\t(" << filler << ")\r\n"
+            << "Call-ID: " << filler << ";" << filler << "\r\n"
+            << "X-Folded: " << filler << "\r\n \t" << filler << ",\r\n " << filler << "\r\n"
+            << "Contact: \"" << filler << "\r\n " << filler << "\" <sip:x@y>;q=0.5 ,\r\n <sip:" << filler << ">\r\n"
+            << "Route: <sip:" << filler << ";lr\r\n >\r\n"
+            << "CSeq: 1 OPTIONS\r\n"
+            << "Content-Length: 0\r\n"
+            << "\r\n";
+      }
+      messages.push_back(msg);
+   }
+
+   Data nul("INVITE sip:a@b SIP/2.0\r\nSubject: nul follows 0123456789abcdef\r\n\r\n");
+   nul[33] = '\0';
+   messages.push_back(nul);
+   messages.push_back(Data("INVITE sip:a@b SIP/2.0\r\nSubject: bare line feed 0123456789abcdef\nTo: <sip:a@b>\r\n\r\n"));
+   messages.push_back(Data("INVITE sip:a@b SIP/2.0\r\nTo: \"unterminated quote 0123456789abcdef0123456789\r\nFrom: x\r\n\r\n"));
+   messages.push_back(Data("INVITE sip:a@b SIP/2.0\r\nTo: <sip:unterminated@angle 0123456789abcdef0123456789\r\n\r\n"));
+   messages.push_back(Data("INVITE sip:a@b SIP/2.0\r\nSubject: no end of header 0123456789abcdef0123456789abcdef"));
+   return messages;
+}
+
+struct Outcome
+{
+      Outcome() : result(MsgHeaderScanner::scrNextChunk), offset(0), numHeaders(0) {}
+
+      bool operator==(const Outcome& rhs) const
+      {
+         return result == rhs.result && offset == rhs.offset &&
+            numHeaders == rhs.numHeaders && encoded == rhs.encoded;
+      }
+
+      MsgHeaderScanner::ScanChunkResult result;
+      size_t offset;          // Of the unprocessed character.
+      unsigned int numHeaders;
+      Data encoded;
+};
+
+ostream&
+operator<<(ostream& strm, const Outcome& outcome)
+{
+   return strm << "result=" << outcome.result << " offset=" << outcome.offset
+               << " headers=" << outcome.numHeaders << endl << outcome.encoded;
+}
+
+// Feeds "text" to a scanner "chunkSize" characters at a time the way
+// ConnectionBase does; 0 scans it in one chunk.
+Outcome
+scan(const Data& text, size_t chunkSize)
+{
+   Outcome outcome;
+   SipMessage msg;
+   MsgHeaderScanner scanner;
+   scanner.prepareForMessage(&msg);
+
+   Data pending;
+   size_t position = 0;
+   for (;;)
+   {
+      size_t pieceSize = chunkSize ? chunkSize : text.size();
+      if (pieceSize > text.size() - position)
+      {
+         pieceSize = text.size() - position;
+      }
+      size_t chunkLength = pending.size() + pieceSize;
+      char* chunk = MsgHeaderScanner::allocateBuffer((int)chunkLength);
+      msg.addBuffer(chunk);
+      memcpy(chunk, pending.data(), pending.size());
+      memcpy(chunk + pending.size(), text.data() + position, pieceSize);
+      position += pieceSize;
+
+      char* unprocessedCharPtr;
+      outcome.result = scanner.scanChunk(chunk, (unsigned int)chunkLength, &unprocessedCharPtr);
+      outcome.offset = position - chunkLength + (unprocessedCharPtr - chunk);
+      if (outcome.result != MsgHeaderScanner::scrNextChunk || position == text.size())
+      {
+         break;
+      }
+      pending = Data(unprocessedCharPtr, (int)(chunk + chunkLength - unprocessedCharPtr));
+   }
+
+   outcome.numHeaders = scanner.getHeaderCount();
+   if (outcome.result == MsgHeaderScanner::scrEnd)
+   {
+      try
+      {
+         DataStream ds(outcome.encoded);
+         msg.encodeSipFrag(ds);
+      }
+      catch (BaseException& e)
+      {
+         outcome.encoded = Data("encode threw ") + e.getMessage();
+      }
+   }
+   return outcome;
+}
+
+bool
+check(const Data& name, const Data& text, int numSupported)
+{
+   MsgHeaderScanner::setScanImplementation(MsgHeaderScanner::siScalar);
+   Outcome expected = scan(text, 0);
+
+   const size_t chunkSizes[] = { 0, 1, 7, 16, 31, 33, 64 };
+   for (int i = 0; i < numSupported; ++i)
+   {
+      MsgHeaderScanner::setScanImplementation(implementations[i]);
+      for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); ++c)
+      {
+         Outcome outcome = scan(text, chunkSizes[c]);
+         if (!(outcome == expected))
+         {
+            cerr << name << ": " << implementationNames[i] << " with chunk size "
+                 << chunkSizes[c] << " gave" << endl << outcome << endl
+                 << "instead of" << endl << expected << endl;
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+void
+benchmark(int numSupported, int runs)
+{
+   Data text(invite);
+   for (int i = 0; i < numSupported; ++i)
+   {
+      MsgHeaderScanner::setScanImplementation(implementations[i]);
+      UInt64 start = Timer::getTimeMs();
+      for (int r = 0; r < runs; ++r)
+      {
+         scan(text, 0);
+      }
+      UInt64 elapsed = Timer::getTimeMs() - start;
+      if (elapsed == 0)
+      {
+         elapsed = 1;
+      }
+      cout << implementationNames[i] << ": " << runs << " INVITEs scanned in "
+           << elapsed << " ms, " << (UInt64)(runs * 1000.0 / elapsed)
+           << " per second" << endl;
+   }
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, argc > 2 ? Log::toLevel(argv[2]) : Log::Warning, argv[0]);
+
+   // Make sure the static tables exist before the implementation is forced.
+   MsgHeaderScanner scanner;
+
+   int numSupported = 1;
+   while (numSupported < numImplementations &&
+          MsgHeaderScanner::setScanImplementation(implementations[numSupported]) ==
+          implementations[numSupported])
+   {
+      ++numSupported;
+   }
+   cout << "Implementations supported: " << numSupported << endl;
+
+   bool ok = true;
+   int numChecked = 0;
+
+   vector<Data> messages = syntheticMessages();
+   for (size_t i = 0; i < messages.size(); ++i)
+   {
+      ok = check(Data("synthetic ") + Data((UInt32)i), messages[i], numSupported) && ok;
+      ++numChecked;
+   }
+
+   // The corpus lives next to the test source; automake passes that in srcdir.
+   Data dir(argc > 1 ? argv[1] : (getenv("srcdir") ? getenv("srcdir") : "."));
+   FileSystem::Directory corpus(dir);
+   for (FileSystem::Directory::iterator it = corpus.begin(); it != corpus.end(); ++it)
+   {
+      if (it.is_directory() || !it->postfix(".dat"))
+      {
+         continue;
+      }
+      Data text = Data::fromFile(dir + "/" + *it);
+      ok = check(*it, text, numSupported) && ok;
+      ++numChecked;
+   }
+   cout << numChecked << " messages checked" << endl;
+
+   benchmark(numSupported, 20000);
+
+   if (!ok)
+   {
+      cerr << "FAILED" << endl;
+      return -1;
+   }
+   cout << "PASSED" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
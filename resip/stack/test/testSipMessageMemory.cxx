@@ -1,5 +1,6 @@
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/Uri.hxx"
+#include "rutil/SlabPool.hxx"
 #include "resip/stack/test/TestSupport.hxx"
 
 #include <iostream>
@@ -69,6 +70,32 @@ main()
       assert(message1->getRawHeader(Headers::CSeq)->getParserContainer());
    }
 
+   {
+      resipCerr << "Testing repeated edits stay within the pool's slabs" << endl;
+
+      // As DUM does to the last REGISTER of a long-lived registration on
+      // every refresh: freed headers don't give their room back to the
+      // pool, so past a few slabs the pool has to use the heap instead.
+      const char *txt1 = "REGISTER sip:registrar.biloxi.com SIP/2.0\r\nVia: SIP/2.0/UDP bobspc.biloxi.com:5060;branch=z9hG4bKnashds7\r\nMax-Forwards: 70\r\nTo: Bob <sip:bob@biloxi.com>\r\nFrom: Bob <sip:bob@biloxi.com>;tag=456248\r\nCall-ID: 843817637684230@998sdasdh09\r\nCSeq: 1826 REGISTER\r\nContact: <sip:bob@192.0.2.4>\r\nExpires: 7200\r\nContent-Length: 0\r\n\r\n";
+
+      auto_ptr<SipMessage> message(TestSupport::makeMessage(Data(txt1)));
+      NameAddr contact(Uri("sip:bob@192.0.2.4;transport=tcp"));
+      contact.param(p_expires) = 3600;
+      for (int i = 0; i < 100000; ++i)
+      {
+         message->remove(h_Contacts);
+         message->header(h_Contacts).push_back(contact);
+         message->remove(h_Vias);
+         message->header(h_Vias).push_back(Via());
+         message->header(h_Vias).front().param(p_branch).reset(Data(i));
+         message->header(h_CSeq).sequence() = i;
+         message->header(h_Expires).value() = 3600;
+      }
+      assert(message->getPoolSlabCount() <= SlabCache::MaxPoolSlabs);
+      assert(message->header(h_CSeq).sequence() == 99999);
+      assert(message->header(h_Contacts).size() == 1);
+   }
+
    resipCout << "All OK" << endl;
    return 0;
 }
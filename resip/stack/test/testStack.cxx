@@ -591,6 +591,7 @@ main(int argc, char* argv[])
    int portBase = 0;
    const char* threadType = "event";
    int tpFlags = 0;
+   int udpShards = 0;
    int sendSleepMs = 0;
    int cManager=0;
    int statisticsInterval=60;
@@ -617,6 +618,7 @@ main(int argc, char* argv[])
       {"numports",    'n', POPT_ARG_INT,    &numPorts,  0, "number of parallel sessions(ports)", 0},
       {"thread-type", 't', POPT_ARG_STRING, &threadType,0, "stack thread type", threadTypeDesc},
       {"tf",          0,   POPT_ARG_INT,    &tpFlags,   0, "bit encoding of transportFlags", 0},
+      {"shards",      0,   POPT_ARG_INT,    &udpShards, 0, "number of SO_REUSEPORT shards for receiver UDP transports", 0},
       {"sleep",       0,   POPT_ARG_INT,    &sendSleepMs,0, "time (ms) to sleep after each sent request", 0},
       {"use-congestion-manager",0, POPT_ARG_NONE, &cManager ,   0, "use a CongestionManager", 0},
       {"statistics-interval",       0,   POPT_ARG_INT,    &statisticsInterval,0, "time in seconds between statistics logging", 0},
@@ -646,6 +648,7 @@ main(int argc, char* argv[])
      <<" bindIf="<<bindIfAddr
      <<" listen="<<doListen
      <<" tf="<<tpFlags
+     <<" shards="<<udpShards
      <<"." << endl;
 
    const char *eachThreadType = threadType;
@@ -734,7 +737,19 @@ main(int argc, char* argv[])
 
       // NOTE: we could also bind receive to bindIfAddr, but existing code
       // doesn't do this. Responses are sent from here, so why don't we?
-      transports.push_back(receiver->addTransport(UDP, 
+      if (udpShards > 1)
+      {
+         // shards run their own TransportThreads
+         receiver->addShardedUdpTransport(registrarPort+idx,
+                             udpShards,
+                             version,
+                             StunDisabled,
+                             /*ipInterface*/Data::Empty,
+                             tpFlags);
+      }
+      else
+      {
+         transports.push_back(receiver->addTransport(UDP, 
                              registrarPort+idx, 
                              version, 
                              StunDisabled,
@@ -743,6 +758,7 @@ main(int argc, char* argv[])
                              /*keypass*/Data::Empty, 
                              SecurityTypes::TLSv1,
                              tpFlags));
+      }
 
       transports.push_back(receiver->addTransport(TCP, 
                              registrarPort+idx, 
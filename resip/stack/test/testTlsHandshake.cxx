@@ -0,0 +1,413 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <signal.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "resip/stack/ConnectionTerminated.hxx"
+#include "resip/stack/Helper.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsTransport.hxx"
+#include "rutil/CongestionManager.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/FdPoll.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Opens a new TLS connection over loopback for every request - as happens
+// when a proxy restarts and all of its clients reconnect at once - and times
+// the handshakes without session resumption, with only the server session
+// cache, and with session tickets; then again with the handshakes run on a
+// crypto thread pool (TlsBaseTransport::HandshakeThreads), under select() and
+// under an FdPollGrp.  The number of connections per run defaults to 200
+// (override with argv[1]).  Nagle is turned off on every connection,
+// otherwise delayed ACKs rather than the handshakes dominate.
+
+namespace
+{
+
+const Data domain("127.0.0.1");
+
+void
+writePem(const Data& filename, X509* cert, EVP_PKEY* key)
+{
+   FILE* fp = fopen(filename.c_str(), "w");
+   assert(fp);
+   int ok = key ? PEM_write_PrivateKey(fp, key, 0, 0, 0, 0, 0) : PEM_write_X509(fp, cert);
+   assert(ok == 1);
+   fclose(fp);
+}
+
+// A self-signed certificate for domain, trusted as a root by the client
+void
+writeCertificates(const Data& dir)
+{
+   EVP_PKEY* key = 0;
+   EVP_PKEY_CTX* keyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, 0);
+   assert(keyCtx);
+   int ok = EVP_PKEY_keygen_init(keyCtx) == 1 &&
+            EVP_PKEY_CTX_set_rsa_keygen_bits(keyCtx, 2048) == 1 &&
+            EVP_PKEY_keygen(keyCtx, &key) == 1;
+   assert(ok);
+   EVP_PKEY_CTX_free(keyCtx);
+
+   X509* cert = X509_new();
+   X509_set_version(cert, 2);
+   ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+   X509_gmtime_adj(X509_get_notBefore(cert), -3600);
+   X509_gmtime_adj(X509_get_notAfter(cert), 86400);
+   X509_set_pubkey(cert, key);
+   X509_NAME* name = X509_get_subject_name(cert);
+   X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)domain.c_str(), -1, -1, 0);
+   X509_set_issuer_name(cert, name);
+   X509_EXTENSION* ext = X509V3_EXT_conf_nid(0, 0, NID_basic_constraints, const_cast<char*>("critical,CA:TRUE"));
+   assert(ext);
+   X509_add_ext(cert, ext, -1);
+   X509_EXTENSION_free(ext);
+   ok = X509_sign(cert, key, EVP_sha256());
+   assert(ok);
+
+   writePem(dir + "/domain_cert_" + domain + ".pem", cert, 0);
+   writePem(dir + "/domain_key_" + domain + ".pem", 0, key);
+   writePem(dir + "/root_cert_test.pem", cert, 0);
+   X509_free(cert);
+   EVP_PKEY_free(key);
+}
+
+void
+noDelay(Socket s, int transportType, const char* file, int line)
+{
+   int on = 1;
+   setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+void
+removeCertificates(const Data& dir)
+{
+   unlink((dir + "/domain_cert_" + domain + ".pem").c_str());
+   unlink((dir + "/domain_key_" + domain + ".pem").c_str());
+   unlink((dir + "/root_cert_test.pem").c_str());
+   rmdir(dir.c_str());
+}
+
+// Rejects new work on the TLS handshake queues only
+class RejectingHandshakes : public CongestionManager
+{
+   public:
+      RejectingHandshakes() : mRegistered(0) {}
+      virtual RejectionBehavior getRejectionBehavior(const FifoStatsInterface* fifo) const
+      {
+         return fifo->getDescription() == "TlsHandshakePool::mFifo" ? REJECTING_NEW_WORK : NORMAL;
+      }
+      virtual void registerFifo(FifoStatsInterface* fifo) { mRegistered++; }
+      virtual void unregisterFifo(FifoStatsInterface* fifo) { mRegistered--; }
+      virtual void logCurrentState() const {}
+      virtual EncodeStream& encodeCurrentState(EncodeStream& strm) const { return strm; }
+
+      int mRegistered;
+};
+
+// Runs both transports - through pollGrp if they were given one
+template <class T>
+T*
+waitFor(Fifo<TransactionMessage>& fifo, TlsTransport* server, TlsTransport* client,
+        FdPollGrp* pollGrp, unsigned int ms = 5000)
+{
+   UInt64 end = Timer::getTimeMs() + ms;
+   while(Timer::getTimeMs() < end)
+   {
+      if(pollGrp)
+      {
+         pollGrp->waitAndProcess(1);
+         server->process();
+         client->process();
+      }
+      else
+      {
+         FdSet fdset;
+         server->buildFdSet(fdset);
+         client->buildFdSet(fdset);
+         fdset.selectMilliSeconds(1);
+         server->process(fdset);
+         client->process(fdset);
+      }
+
+      while(fifo.messageAvailable())
+      {
+         TransactionMessage* msg = fifo.getNext();
+         T* wanted = dynamic_cast<T*>(msg);
+         if(wanted)
+         {
+            return wanted;
+         }
+         delete msg;
+      }
+   }
+   return 0;
+}
+
+void
+sendRequest(TlsTransport* client, const Tuple& dest, unsigned int seq)
+{
+   Data request("OPTIONS sip:" + domain + ":" + Data(dest.getPort()) + ";transport=tls SIP/2.0\r\n"
+                "Via: SIP/2.0/TLS " + domain + ":" + Data(client->port()) + ";branch=z9hG4bK-" + Data(seq) + "\r\n"
+                "Max-Forwards: 70\r\n"
+                "To: <sip:" + domain + ">\r\n"
+                "From: <sip:storm@" + domain + ">;tag=" + Data(seq) + "\r\n"
+                "Call-ID: storm-" + Data(seq) + "\r\n"
+                "CSeq: 1 OPTIONS\r\n"
+                "Content-Length: 0\r\n\r\n");
+   client->send(client->makeSendData(dest, request, Data(seq)));
+}
+
+// One OPTIONS transaction over a new connection, closed by the client once
+// the response (and with TLS 1.3, the session tickets before it) is read.
+// Waits for the close so that the next request can't be queued behind it.
+void
+exchange(TlsTransport* server, Fifo<TransactionMessage>& serverFifo,
+         TlsTransport* client, Fifo<TransactionMessage>& clientFifo,
+         const Tuple& dest, unsigned int seq, FdPollGrp* pollGrp)
+{
+   sendRequest(client, dest, seq);
+
+   SipMessage* received = waitFor<SipMessage>(serverFifo, server, client, pollGrp);
+   assert(received && received->isRequest());
+   SipMessage* response = Helper::makeResponse(*received, 200);
+   Data encoded;
+   {
+      DataStream strm(encoded);
+      response->encode(strm);
+   }
+   server->send(server->makeSendData(received->getSource(), encoded, Data(seq)));
+   delete response;
+   delete received;
+
+   received = waitFor<SipMessage>(clientFifo, server, client, pollGrp);
+   assert(received && received->isResponse());
+   std::auto_ptr<SendData> close(client->makeSendData(received->getSource(), Data::Empty, Data::Empty));
+   close->command = SendData::CloseConnection;
+   client->send(close);
+   delete received;
+
+   ConnectionTerminated* closed = waitFor<ConnectionTerminated>(clientFifo, server, client, pollGrp);
+   assert(closed);
+   delete closed;
+}
+
+void
+storm(const char* name, const Data& certDir, int port, unsigned int connections,
+      long cacheSize, bool tickets, unsigned int handshakeThreads = 0, bool poll = false)
+{
+   // read when each SSL_CTX and transport is created
+   BaseSecurity::TlsSessionCacheSize = cacheSize;
+   BaseSecurity::TlsSessionTickets = tickets;
+   TlsBaseTransport::HandshakeThreads = handshakeThreads;
+
+   Security security(certDir);
+   security.preload();
+
+   Fifo<TransactionMessage> serverFifo;
+   TlsTransport* server = new TlsTransport(serverFifo, port, V4, domain, security, domain, SecurityTypes::SSLv23, noDelay);
+   Fifo<TransactionMessage> clientFifo;
+   TlsTransport* client = new TlsTransport(clientFifo, port + 1, V4, domain, security, Data::Empty, SecurityTypes::SSLv23, noDelay);
+   TlsBaseTransport::HandshakeThreads = 0;
+   assert((server->getHandshakePool() != 0) == (handshakeThreads > 0));
+   Tuple dest(domain, port, V4, TLS, domain);
+
+   FdPollGrp* pollGrp = 0;
+   if(poll)
+   {
+      pollGrp = FdPollGrp::create();
+      server->setPollGrp(pollGrp);
+      client->setPollGrp(pollGrp);
+   }
+
+   UInt64 start = Timer::getTimeMs();
+   clock_t cpuStart = clock();
+   for(unsigned int i = 0; i < connections; i++)
+   {
+      exchange(server, serverFifo, client, clientFifo, dest, i, pollGrp);
+   }
+   UInt64 elapsed = Timer::getTimeMs() - start;
+   UInt64 cpu = (UInt64)(clock() - cpuStart) * 1000 / CLOCKS_PER_SEC;
+
+   BaseSecurity::TlsSessionStats stats = security.getTlsSessionStats();
+   cout << name << ": " << connections << " connections in " << elapsed << " ms ("
+        << connections * 1000.0 / (elapsed ? elapsed : 1) << " per second, " << cpu << " ms cpu), server resumed "
+        << stats.mServerResumed << "/" << stats.mServerHandshakes << ", client resumed "
+        << stats.mClientResumed << "/" << stats.mClientHandshakes << " ("
+        << stats.mClientOffered << " offered)" << endl;
+
+   assert(stats.mServerHandshakes == connections && stats.mClientHandshakes == connections);
+   assert(stats.mServerResumed == stats.mClientResumed);
+   if(cacheSize <= 0)
+   {
+      assert(stats.mClientOffered == 0 && stats.mClientResumed == 0);
+   }
+   else
+   {
+      // only the first connection needs a full handshake
+      assert(stats.mClientOffered == connections - 1);
+      assert(stats.mClientResumed == connections - 1);
+   }
+
+   if(tickets && cacheSize > 0)
+   {
+      // a ticket under the previous key is still accepted...
+      security.rotateSessionTicketKeys();
+      exchange(server, serverFifo, client, clientFifo, dest, connections, pollGrp);
+      assert(security.getTlsSessionStats().mServerResumed == stats.mServerResumed + 1);
+
+      // ...but not one two keys back
+      security.rotateSessionTicketKeys();
+      security.rotateSessionTicketKeys();
+      exchange(server, serverFifo, client, clientFifo, dest, connections + 1, pollGrp);
+      assert(security.getTlsSessionStats().mServerResumed == stats.mServerResumed + 1);
+      assert(security.getTlsSessionStats().mServerHandshakes == stats.mServerHandshakes + 2);
+   }
+
+   delete client;
+   delete server;
+   delete pollGrp;
+}
+
+// While the CongestionManager says the handshake queue is congested, new
+// inbound connections are closed without a handshake
+void
+refuse(const Data& certDir, int port)
+{
+   Security security(certDir);
+   security.preload();
+
+   TlsBaseTransport::HandshakeThreads = 2;
+   Fifo<TransactionMessage> serverFifo;
+   TlsTransport* server = new TlsTransport(serverFifo, port, V4, domain, security, domain, SecurityTypes::SSLv23, noDelay);
+   TlsBaseTransport::HandshakeThreads = 0;
+   Fifo<TransactionMessage> clientFifo;
+   TlsTransport* client = new TlsTransport(clientFifo, port + 1, V4, domain, security, Data::Empty, SecurityTypes::SSLv23, noDelay);
+   Tuple dest(domain, port, V4, TLS, domain);
+
+   RejectingHandshakes congestionManager;
+   server->setCongestionManager(&congestionManager);
+   client->setCongestionManager(&congestionManager);
+   // both transaction fifos and the server's handshake queue
+   assert(congestionManager.mRegistered == 3);
+
+   sendRequest(client, dest, 0);
+   ConnectionTerminated* closed = waitFor<ConnectionTerminated>(clientFifo, server, client, 0);
+   assert(closed);
+   delete closed;
+   assert(waitFor<SipMessage>(serverFifo, server, client, 0, 100) == 0);
+   assert(security.getTlsSessionStats().mServerHandshakes == 0);
+
+   server->setCongestionManager(0);
+   client->setCongestionManager(0);
+   assert(congestionManager.mRegistered == 0);
+   exchange(server, serverFifo, client, clientFifo, dest, 1, 0);
+   assert(security.getTlsSessionStats().mServerHandshakes == 1);
+
+   delete client;
+   delete server;
+   cout << "congested handshake queue: connection refused" << endl;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+#ifndef _WIN32
+   signal(SIGPIPE, SIG_IGN);
+#endif
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   unsigned int connections = 200;
+   if(argc > 1)
+   {
+      connections = atoi(argv[1]);
+   }
+
+   char dirTemplate[] = "/tmp/testTlsHandshakeXXXXXX";
+   char* dir = mkdtemp(dirTemplate);
+   assert(dir);
+   Data certDir(dir);
+   writeCertificates(certDir);
+
+   const long cacheSize = BaseSecurity::TlsSessionCacheSize;
+   storm("full handshakes ", certDir, 25140, connections, 0, false);
+   storm("session cache   ", certDir, 25142, connections, cacheSize, false);
+   storm("session tickets ", certDir, 25144, connections, cacheSize, true);
+   storm("full, pool/select", certDir, 25146, connections, 0, false, 2);
+   storm("tickets, pool/sel", certDir, 25148, connections, cacheSize, true, 2);
+   storm("full, pool/poll  ", certDir, 25150, connections, 0, false, 2, true);
+   storm("cache, pool/poll ", certDir, 25152, connections, cacheSize, false, 2, true);
+   refuse(certDir, 25154);
+
+   removeCertificates(certDir);
+   cout << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ */
@@ -0,0 +1,348 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "resip/stack/SipStack.hxx"
+#include "resip/stack/TransactionController.hxx"
+#include "resip/stack/TransactionMap.hxx"
+#include "resip/stack/TransactionState.hxx"
+#include "rutil/Logger.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks TransactionMap's probing: runs of colliding ids, erasing from a run
+// that wraps round the end of the table, growing with such a run in place,
+// and the destructor deleting states that remove themselves as it goes.
+
+namespace resip
+{
+// A friend of TransactionController and TransactionState, so that it can put
+// states of its own in a controller's server map and count their deletion.
+class TestTransactionMap : public TransactionState
+{
+   public:
+      TestTransactionMap(TransactionController& controller, const Data& tid)
+         : TransactionState(controller, ServerNonInvite, Trying, tid, OPTIONS, Data::Empty)
+      {
+         serverMap(controller).add(tid, this);
+      }
+      // ~TransactionState erases it from the map
+      ~TestTransactionMap() { ++Deleted; }
+
+      static TransactionMap& serverMap(TransactionController& controller)
+      {
+         return controller.mServerTransactionMap;
+      }
+
+      static int Deleted;
+};
+
+int TestTransactionMap::Deleted = 0;
+}
+
+typedef TestTransactionMap State;
+
+// the table starts with 64 slots and grows once it is 70% full
+static const size_t FirstSlots = 64;
+static const size_t FirstGrowAt = 45;
+
+// count tids whose home slot in the first table is home
+vector<Data>
+tidsFor(size_t home, unsigned int count)
+{
+   static UInt32 next = 0;
+   vector<Data> tids;
+   while (tids.size() < count)
+   {
+      Data tid = Data("z9hG4bK") + Data(next++);
+      if ((tid.caseInsensitiveTokenHash() & (FirstSlots - 1)) == home)
+      {
+         tids.push_back(tid);
+      }
+   }
+   return tids;
+}
+
+void
+checkAll(TransactionMap& map, const vector<Data>& tids, const vector<State*>& states)
+{
+   int live = 0;
+   for (size_t i = 0; i < tids.size(); ++i)
+   {
+      assert(map.find(tids[i]) == states[i]);
+      assert(map.find(tids[i], tids[i].caseInsensitiveTokenHash()) == states[i]);
+      live += states[i] != 0;
+   }
+   assert(map.size() == live);
+}
+
+void
+testCollisions(TransactionController& controller)
+{
+   TransactionMap& map = State::serverMap(controller);
+   assert(map.size() == 0);
+
+   // six ids after the same slot, and one more that is never added
+   vector<Data> tids = tidsFor(5, 7);
+   const Data absent = tids.back();
+   tids.pop_back();
+   vector<State*> states;
+   for (size_t i = 0; i < tids.size(); ++i)
+   {
+      states.push_back(new State(controller, tids[i]));
+   }
+   checkAll(map, tids, states);
+   assert(map.find(absent) == 0);
+
+   // branch parameters compare case-insensitively
+   Data upper(tids[3]);
+   upper.uppercase();
+   assert(map.find(upper) == states[3]);
+
+   // adding a state again changes nothing
+   map.add(tids[3], states[3]);
+   checkAll(map, tids, states);
+
+   // from the middle of the run, then from its start
+   delete states[2];
+   states[2] = 0;
+   checkAll(map, tids, states);
+   delete states[0];
+   states[0] = 0;
+   checkAll(map, tids, states);
+   assert(map.find(absent) == 0);
+
+   states[0] = new State(controller, tids[0]);
+   states[2] = new State(controller, tids[2]);
+   checkAll(map, tids, states);
+
+   for (size_t i = 0; i < states.size(); ++i)
+   {
+      delete states[i];
+   }
+   assert(map.size() == 0);
+}
+
+void
+testEraseAtWrap(TransactionController& controller)
+{
+   TransactionMap& map = State::serverMap(controller);
+
+   // three ids after the last slot sit in 63, 0 and 1; the ones after slots
+   // 0 and 1 are pushed on to 2 and 3
+   vector<Data> tids = tidsFor(FirstSlots - 1, 3);
+   vector<Data> more = tidsFor(0, 1);
+   tids.insert(tids.end(), more.begin(), more.end());
+   more = tidsFor(1, 1);
+   tids.insert(tids.end(), more.begin(), more.end());
+
+   // erase each one first, then the rest from the far end, so that entries
+   // are shifted back across the end of the table in every combination
+   for (size_t first = 0; first < tids.size(); ++first)
+   {
+      vector<State*> states;
+      for (size_t i = 0; i < tids.size(); ++i)
+      {
+         states.push_back(new State(controller, tids[i]));
+      }
+      checkAll(map, tids, states);
+
+      delete states[first];
+      states[first] = 0;
+      checkAll(map, tids, states);
+      for (size_t i = tids.size(); i-- > 0; )
+      {
+         if (states[i])
+         {
+            delete states[i];
+            states[i] = 0;
+            checkAll(map, tids, states);
+         }
+      }
+   }
+   assert(map.size() == 0);
+}
+
+void
+testGrow(TransactionController& controller)
+{
+   TransactionMap& map = State::serverMap(controller);
+   const size_t before = map.getMemoryUsage();
+
+   // fill up to the threshold with ids after the last four slots, so the
+   // run wraps round and the table is as full as it gets
+   vector<Data> tids;
+   for (size_t i = 0; tids.size() + 1 < FirstGrowAt; ++i)
+   {
+      vector<Data> more = tidsFor(FirstSlots - 4 + i % 4, 1);
+      tids.insert(tids.end(), more.begin(), more.end());
+   }
+   vector<State*> states;
+   for (size_t i = 0; i < tids.size(); ++i)
+   {
+      states.push_back(new State(controller, tids[i]));
+   }
+   checkAll(map, tids, states);
+   assert(map.getMemoryUsage() == before);
+
+   // the next one grows the table, and everything is rehashed into it
+   vector<Data> last = tidsFor(FirstSlots - 1, 1);
+   tids.push_back(last[0]);
+   states.push_back(new State(controller, last[0]));
+   assert(map.getMemoryUsage() > before);
+   checkAll(map, tids, states);
+
+   for (size_t i = 0; i < states.size(); ++i)
+   {
+      delete states[i];
+      states[i] = 0;
+      checkAll(map, tids, states);
+   }
+}
+
+// small deterministic generator, so failures reproduce
+UInt32
+nextRandom(UInt32& seed)
+{
+   seed = seed*1103515245 + 12345;
+   return seed >> 8;
+}
+
+void
+testAgainstMap(TransactionController& controller)
+{
+   TransactionMap& map = State::serverMap(controller);
+   const UInt32 space = 3000;
+   vector<Data> tids;
+   for (UInt32 i = 0; i < space; ++i)
+   {
+      tids.push_back(Data("z9hG4bK-random-") + Data(i));
+   }
+   std::map<Data, State*> live;
+   UInt32 seed = 1;
+
+   for (int op = 0; op < 100000; ++op)
+   {
+      const Data& tid = tids[nextRandom(seed) % space];
+      std::map<Data, State*>::iterator i = live.find(tid);
+      if (i == live.end())
+      {
+         live[tid] = new State(controller, tid);
+      }
+      else if (nextRandom(seed) % 3 == 0)
+      {
+         delete i->second;
+         live.erase(i);
+      }
+
+      const Data& probe = tids[nextRandom(seed) % space];
+      i = live.find(probe);
+      assert(map.find(probe) == (i == live.end() ? 0 : i->second));
+      assert(map.size() == (int)live.size());
+   }
+
+   for (std::map<Data, State*>::iterator i = live.begin(); i != live.end(); ++i)
+   {
+      delete i->second;
+   }
+   assert(map.size() == 0);
+}
+
+void
+testDestructor(SipStack& stack)
+{
+   // a controller of our own, with a fresh 64-slot map
+   TransactionController* controller = new TransactionController(stack, 0, false);
+   vector<Data> tids = tidsFor(FirstSlots - 2, 6);
+   vector<Data> more = tidsFor(0, 4);
+   tids.insert(tids.end(), more.begin(), more.end());
+   more = tidsFor(30, 20);
+   tids.insert(tids.end(), more.begin(), more.end());
+   for (size_t i = 0; i < tids.size(); ++i)
+   {
+      new State(*controller, tids[i]);
+   }
+   assert(State::serverMap(*controller).size() == (int)tids.size());
+
+   // each state removes itself while the map's destructor walks it, shifting
+   // others back into the slot just emptied, some of them across the end;
+   // all must still be found and deleted exactly once
+   const int deleted = State::Deleted;
+   delete controller;
+   assert(State::Deleted - deleted == (int)tids.size());
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   SipStack stack;
+   TransactionController controller(stack, 0, false);
+
+   testCollisions(controller);
+   testEraseAtWrap(controller);
+   testGrow(controller);
+   testAgainstMap(controller);
+   testDestructor(stack);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
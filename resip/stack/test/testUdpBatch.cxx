@@ -0,0 +1,231 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <iostream>
+#include <iomanip>
+
+#if defined (HAVE_POPT_H)
+#include <popt.h>
+#else
+#ifndef WIN32
+#warning "will not work very well without libpopt"
+#endif
+#endif
+
+#include "resip/stack/UdpTransport.hxx"
+#include "resip/stack/SendData.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Measures UDP transport throughput and messages moved per socket call, with
+// and without recvmmsg()/sendmmsg() batching. Sender and receiver are both
+// driven from this thread over loopback.
+
+namespace
+{
+
+class BenchUdpTransport : public UdpTransport
+{
+   public:
+      BenchUdpTransport(Fifo<TransactionMessage>& fifo, int port, unsigned flags)
+         : UdpTransport(fifo, port, V4, StunDisabled, Data::Empty, 0, Compression::Disabled, flags)
+      {}
+
+      unsigned rxMsgs() const { return mRxMsgCnt; }
+      unsigned rxCalls() const { return mRxSyscallCnt; }
+      unsigned txMsgs() const { return mTxMsgCnt; }
+      unsigned txCalls() const { return mTxSyscallCnt; }
+};
+
+const char* options =
+   "OPTIONS sip:bench@127.0.0.1:%PORT% SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 127.0.0.1:%FROM%;branch=z9hG4bK-bench-1\r\n"
+   "Max-Forwards: 70\r\n"
+   "To: <sip:bench@127.0.0.1>\r\n"
+   "From: <sip:bench@127.0.0.1>;tag=1234\r\n"
+   "Call-ID: udpbatchbench@127.0.0.1\r\n"
+   "CSeq: 1 OPTIONS\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+double
+perCall(unsigned msgs, unsigned calls)
+{
+   return calls ? (double)msgs / calls : 0.0;
+}
+
+void
+runTest(int runs, int window, unsigned int batchSize, int basePort)
+{
+   Fifo<TransactionMessage> txFifo;
+   Fifo<TransactionMessage> rxFifo;
+   const unsigned flags = RESIP_TRANSPORT_FLAG_RXALL | RESIP_TRANSPORT_FLAG_TXALL;
+   BenchUdpTransport sender(txFifo, basePort, flags);
+   BenchUdpTransport receiver(rxFifo, basePort+1, flags);
+   receiver.setRcvBufLen(8*1024*1024);
+   sender.setBatchSize(batchSize);
+   receiver.setBatchSize(batchSize);
+
+   Data encoded(options);
+   encoded.replace("%PORT%", Data(basePort+1));
+   encoded.replace("%FROM%", Data(basePort));
+   Tuple dest(Data("127.0.0.1"), basePort+1, UDP);
+
+   int sent = 0;
+   int received = 0;
+   int lost = 0;
+   UInt64 startTime = Timer::getTimeMs();
+   UInt64 lastRx = startTime;
+   while (received + lost < runs)
+   {
+      while (sent < runs && sent - received - lost < window)
+      {
+         std::auto_ptr<SendData> toSend(sender.makeSendData(dest, encoded, Data(sent), Data::Empty));
+         sender.send(toSend);
+         ++sent;
+      }
+
+      FdSet fdset;
+      receiver.buildFdSet(fdset);
+      sender.buildFdSet(fdset);
+      fdset.selectMilliSeconds(100);
+      sender.process(fdset);
+      receiver.process(fdset);
+
+      UInt64 now = Timer::getTimeMs();
+      while (rxFifo.messageAvailable())
+      {
+         delete rxFifo.getNext();
+         ++received;
+         lastRx = now;
+      }
+      if (now - lastRx > 1000)
+      {
+         // whatever is still outstanding was dropped by the kernel
+         lost += sent - received - lost;
+         lastRx = now;
+      }
+   }
+   UInt64 elapsed = Timer::getTimeMs() - startTime;
+   if (elapsed == 0)
+   {
+      elapsed = 1;
+   }
+
+   cout << setw(6) << (batchSize > 1 ? batchSize : 1)
+        << setw(10) << received
+        << setw(8) << lost
+        << setw(10) << elapsed
+        << setw(12) << (UInt64)(received * 1000.0 / elapsed)
+        << setw(12) << fixed << setprecision(2) << perCall(sender.txMsgs(), sender.txCalls())
+        << setw(12) << fixed << setprecision(2) << perCall(receiver.rxMsgs(), receiver.rxCalls())
+        << endl;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   char* logType = 0;
+   char* logLevel = 0;
+   int runs = 100000;
+   int window = 512;
+   int batchSize = 32;
+   int port = 5094;
+
+#if defined (HAVE_POPT_H)
+   struct poptOption table[] = {
+      {"log-type",    'l', POPT_ARG_STRING, &logType,   0, "where to send logging messages", "syslog|cerr|cout"},
+      {"log-level",   'v', POPT_ARG_STRING, &logLevel,  0, "specify the default log level", "DEBUG|INFO|WARNING|ALERT"},
+      {"num-runs",    'r', POPT_ARG_INT,    &runs,      0, "number of messages in each test", 0},
+      {"window-size", 'w', POPT_ARG_INT,    &window,    0, "max messages in flight", 0},
+      {"batch-size",  'b', POPT_ARG_INT,    &batchSize, 0, "datagrams per recvmmsg/sendmmsg", 0},
+      {"port",        'p', POPT_ARG_INT,    &port,      0, "first of two local ports to use", 0},
+      POPT_AUTOHELP
+      { NULL, 0, 0, NULL, 0 }
+   };
+
+   poptContext context = poptGetContext(NULL, argc, const_cast<const char**>(argv), table, 0);
+   poptGetNextOpt(context);
+#endif
+
+#ifdef WIN32
+   initNetwork();
+#endif
+   Log::initialize(logType ? logType : "cout", logLevel ? logLevel : "WARNING", argv[0]);
+
+   cout << " batch     rcvd    lost     ms      msgs/s   tx msg/call rx msg/call" << endl;
+   runTest(runs, window, 1, port);
+   for (int b = 4; b < batchSize; b *= 4)
+   {
+      runTest(runs, window, b, port);
+   }
+   if (batchSize > 1)
+   {
+      runTest(runs, window, batchSize, port);
+   }
+
+#if defined (HAVE_POPT_H)
+   poptFreeContext(context);
+#endif
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
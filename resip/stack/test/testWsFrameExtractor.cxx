@@ -0,0 +1,362 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string.h>
+
+#include "resip/stack/ConnectionBase.hxx"
+#include "resip/stack/WsFrameExtractor.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks the word at a time unmasking against the byte at a time loop it
+// replaced and the reassembly of fragmented messages split across reads,
+// then times WsFrameExtractor on back to back masked frames (as sent by a
+// browser) fed to it in ConnectionBase::ChunkSize reads.  Pass the total
+// payload per size in MB in argv[1] (default 256).
+
+namespace
+{
+
+const UInt8 key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+
+void
+unmaskBytes(UInt8* dst, const UInt8* src, Data::size_type len, const UInt8* key, Data::size_type keyPos)
+{
+   for(Data::size_type i = 0; i < len; i++)
+   {
+      dst[i] = src[i] ^ key[(keyPos + i) & 3];
+   }
+}
+
+Data
+randomPayload(Data::size_type len)
+{
+   Data payload(Data::Take, new char[len + 1], (Data::size_type)0, len + 1);
+   for(Data::size_type i = 0; i < len; i++)
+   {
+      payload += (char)(rand() & 0xff);
+   }
+   return payload;
+}
+
+// One frame of payload, in the shortest length encoding
+Data
+makeFrame(const Data& payload, bool masked, bool final)
+{
+   Data frame;
+   // a text frame; the caller clears the opcode of continuation frames
+   frame += (char)((final ? 0x80 : 0) | 0x1);
+   UInt64 len = payload.size();
+   UInt8 maskBit = masked ? 0x80 : 0;
+   if(len < 126)
+   {
+      frame += (char)(maskBit | len);
+   }
+   else if(len < 65536)
+   {
+      frame += (char)(maskBit | 126);
+      frame += (char)(len >> 8);
+      frame += (char)len;
+   }
+   else
+   {
+      frame += (char)(maskBit | 127);
+      for(int shift = 56; shift >= 0; shift -= 8)
+      {
+         frame += (char)(len >> shift);
+      }
+   }
+   if(masked)
+   {
+      frame.append((const char*)key, 4);
+      Data::size_type start = frame.size();
+      frame += payload;
+      unmaskBytes((UInt8*)frame.data() + start, (const UInt8*)payload.data(), payload.size(), key, 0);
+   }
+   else
+   {
+      frame += payload;
+   }
+   return frame;
+}
+
+// Frees a message returned by processBytes(), as SipMessage would
+void
+release(std::auto_ptr<Data>& msg)
+{
+   delete [] msg->data();
+   msg.reset();
+}
+
+void
+checkUnmask()
+{
+   UInt8 src[80];
+   UInt8 expected[80];
+   UInt8 dst[96];
+   for(unsigned int i = 0; i < sizeof(src); i++)
+   {
+      src[i] = (UInt8)rand();
+   }
+   for(unsigned int offset = 0; offset < 8; offset++)
+   {
+      for(unsigned int len = 0; len + offset <= 72; len++)
+      {
+         for(unsigned int keyPos = 0; keyPos < 4; keyPos++)
+         {
+            unmaskBytes(expected, src + offset, len, key, keyPos);
+            memset(dst, 0, sizeof(dst));
+            WsFrameExtractor::unmask(dst + 8 - offset, src + offset, len, key, keyPos);
+            assert(memcmp(dst + 8 - offset, expected, len) == 0);
+            assert(dst[8 - offset + len] == 0);
+
+            UInt8 inPlace[80];
+            memcpy(inPlace, src, sizeof(src));
+            WsFrameExtractor::unmask(inPlace + offset, inPlace + offset, len, key, keyPos);
+            assert(memcmp(inPlace + offset, expected, len) == 0);
+         }
+      }
+   }
+}
+
+void
+checkReassembly()
+{
+   // a message in 5 fragments, one of them empty and one with a 64 bit
+   // length, fed to the extractor in reads of every size up to 64 bytes
+   Data payloads[5] = { randomPayload(100), randomPayload(0), randomPayload(300),
+                        randomPayload(70000), randomPayload(7) };
+   Data expected;
+   Data stream;
+   for(int i = 0; i < 5; i++)
+   {
+      expected += payloads[i];
+      Data frame = makeFrame(payloads[i], i != 3, i == 4);
+      if(i > 0)
+      {
+         // continuation frame
+         ((char*)frame.data())[0] &= 0xf0;
+      }
+      stream += frame;
+   }
+   stream += makeFrame("\r\n\r\n", true, true);
+
+   for(Data::size_type chunk = 1; chunk <= 64; chunk += (chunk < 8 ? 1 : 13))
+   {
+      WsFrameExtractor extractor(expected.size());
+      unsigned int messages = 0;
+      bool dropConnection = false;
+      for(Data::size_type pos = 0; pos < stream.size(); pos += chunk)
+      {
+         Data::size_type len = resipMin(chunk, stream.size() - pos);
+         std::auto_ptr<Data> msg = extractor.processBytes((UInt8*)stream.data() + pos, len, dropConnection);
+         assert(!dropConnection);
+         while(msg.get())
+         {
+            if(messages == 0)
+            {
+               assert(*msg == expected);
+            }
+            else
+            {
+               assert(*msg == "\r\n\r\n");
+            }
+            // null terminated for MsgHeaderScanner
+            assert(msg->data()[msg->size()] == 0);
+            messages++;
+            release(msg);
+            msg = extractor.processBytes(0, 0, dropConnection);
+         }
+      }
+      assert(messages == 2);
+   }
+
+   // one byte more than the limit
+   WsFrameExtractor extractor(expected.size() - 1);
+   bool dropConnection = false;
+   std::auto_ptr<Data> msg = extractor.processBytes((UInt8*)stream.data(), stream.size(), dropConnection);
+   assert(dropConnection && msg.get() == 0);
+}
+
+// A frame header with a 64 bit length, and none of its payload
+Data
+makeHeader(UInt64 len, bool final)
+{
+   Data header;
+   header += (char)(final ? 0x80 : 0);
+   header += (char)(0x80 | 127);
+   for(int shift = 56; shift >= 0; shift -= 8)
+   {
+      header += (char)(len >> shift);
+   }
+   header.append((const char*)key, 4);
+   return header;
+}
+
+void
+checkHugeLengths()
+{
+   // lengths that only fit in a Data::size_type once they have wrapped,
+   // added to the size of earlier fragments or on their own, followed by
+   // more bytes than the frames before them had room for
+   const UInt64 lengths[] = { 0xFFFFFFCEULL, 0xFFFFFFFFULL, 0x100000010ULL, 0xFFFFFFFFFFFFFFFFULL };
+   for(unsigned int i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+   {
+      for(int fragmented = 0; fragmented < 2; fragmented++)
+      {
+         Data stream;
+         if(fragmented)
+         {
+            stream += makeFrame(randomPayload(100), true, false);
+         }
+         stream += makeHeader(lengths[i], true);
+         stream += randomPayload(4096);
+
+         WsFrameExtractor extractor(1000);
+         bool dropConnection = false;
+         std::auto_ptr<Data> msg = extractor.processBytes((UInt8*)stream.data(), stream.size(), dropConnection);
+         assert(dropConnection && msg.get() == 0);
+      }
+   }
+}
+
+void
+timeFrames(Data::size_type payloadSize, Data::size_type totalBytes)
+{
+   // copies of one frame, passed through passes times to make the total
+   const unsigned int passes = 16;
+   Data frame = makeFrame(randomPayload(payloadSize), true, true);
+   unsigned int framesPerStream = (unsigned int)resipMax((Data::size_type)1, totalBytes / frame.size() / passes);
+   Data stream;
+   for(unsigned int i = 0; i < framesPerStream; i++)
+   {
+      stream += frame;
+   }
+
+   WsFrameExtractor extractor(ConnectionBase::ChunkSize * 16);
+   unsigned int frames = 0;
+   bool dropConnection = false;
+   UInt64 start = Timer::getTimeMs();
+   clock_t cpuStart = clock();
+   for(unsigned int pass = 0; pass < passes; pass++)
+   {
+      for(Data::size_type pos = 0; pos < stream.size(); pos += ConnectionBase::ChunkSize)
+      {
+         Data::size_type len = resipMin((Data::size_type)ConnectionBase::ChunkSize, stream.size() - pos);
+         std::auto_ptr<Data> msg = extractor.processBytes((UInt8*)stream.data() + pos, len, dropConnection);
+         while(msg.get())
+         {
+            assert(msg->size() == payloadSize);
+            frames++;
+            release(msg);
+            msg = extractor.processBytes(0, 0, dropConnection);
+         }
+      }
+   }
+   UInt64 cpu = (UInt64)(clock() - cpuStart) * 1000 / CLOCKS_PER_SEC;
+   UInt64 elapsed = Timer::getTimeMs() - start;
+   assert(!dropConnection && frames == passes * framesPerStream);
+
+   // the same bytes through the byte at a time loop, for comparison
+   UInt8* out = new UInt8[payloadSize];
+   clock_t byteStart = clock();
+   for(unsigned int i = 0; i < frames; i++)
+   {
+      unmaskBytes(out, (const UInt8*)frame.data() + frame.size() - payloadSize, payloadSize, key, i);
+   }
+   UInt64 byteCpu = (UInt64)(clock() - byteStart) * 1000 / CLOCKS_PER_SEC;
+   clock_t wordStart = clock();
+   for(unsigned int i = 0; i < frames; i++)
+   {
+      WsFrameExtractor::unmask(out, (const UInt8*)frame.data() + frame.size() - payloadSize, payloadSize, key, i);
+   }
+   UInt64 wordCpu = (UInt64)(clock() - wordStart) * 1000 / CLOCKS_PER_SEC;
+   delete [] out;
+
+   double seconds = (cpu ? cpu : 1) / 1000.0;
+   cout << payloadSize << " byte frames: " << frames << " in " << elapsed << " ms ("
+        << (UInt64)(frames / seconds) << " frames/s, " << (UInt64)(frames * (double)payloadSize / seconds / 1048576) << " MB/s)"
+        << ", unmasking " << wordCpu << " ms (byte loop " << byteCpu << " ms)" << endl;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   Data::size_type megabytes = 256;
+   if(argc > 1)
+   {
+      megabytes = atoi(argv[1]);
+   }
+
+   checkUnmask();
+   checkReassembly();
+   checkHugeLengths();
+
+   const Data::size_type sizes[] = { 64, 256, 1024, 4096, 16384, 65536 };
+   for(unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+   {
+      timeFrames(sizes[i], megabytes * 1048576);
+   }
+
+   cout << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ */
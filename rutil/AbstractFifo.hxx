@@ -11,6 +11,7 @@
 
 #include "rutil/compat.hxx"
 #include "rutil/Timer.hxx"
+#include "rutil/AtomicOps.hxx"
 
 namespace resip
 {
@@ -119,6 +120,14 @@ class FifoStatsInterface
    @note Users of the resip stack will not need to interact with this class 
       directly in most cases. Look at Fifo and TimeLimitFifo instead.
 
+   By default every put and get takes mMutex. A fifo with many producers and
+   a single consumer can instead be switched to lock-free mode (see
+   setLockFree()): producers then push onto an atomic list (the "inbox") and
+   only take mMutex when the fifo goes from empty to non-empty, to wake a
+   consumer that may be blocked. Consumers still serialize on mMutex, and move
+   everything in the inbox over to mFifo in one exchange whenever they look at
+   the fifo, so getMultiple() picks up whole bursts at a time.
+
    @ingroup message_passing
  */
 template <typename T>
@@ -134,11 +143,22 @@ class AbstractFifo : public FifoStatsInterface
             mLastSampleTakenMicroSec(0),
             mCounter(0),
             mAverageServiceTimeMicroSec(0),
-            mSize(0)
+            mSize(0),
+            mInbox(0),
+            mLockFreeCount(0),
+            mLockFree(false)
       {}
 
       virtual ~AbstractFifo()
       {
+         // The items themselves are owned (and cleaned up) by subclasses.
+         InboxNode* node = mInbox;
+         while(node)
+         {
+            InboxNode* next = node->mNext;
+            delete node;
+            node = next;
+         }
       }
 
       /** 
@@ -147,8 +167,16 @@ class AbstractFifo : public FifoStatsInterface
        **/
       bool empty() const
       {
-         Lock lock(mMutex); (void)lock;
-         return mFifo.empty();
+         return !messageAvailable();
+      }
+
+      /**
+         @brief is this fifo in lock-free mode?
+         @see setLockFree()
+      */
+      bool isLockFree() const
+      {
+         return mLockFree;
       }
 
       /**
@@ -160,6 +188,10 @@ class AbstractFifo : public FifoStatsInterface
        */
       virtual unsigned int size() const
       {
+         if(mLockFree)
+         {
+            return lockFreeDepth();
+         }
          Lock lock(mMutex); (void)lock;
          return (unsigned int)mFifo.size();
       }
@@ -171,6 +203,10 @@ class AbstractFifo : public FifoStatsInterface
        
       bool messageAvailable() const
       {
+         if(mLockFree && inboxPending())
+         {
+            return true;
+         }
          Lock lock(mMutex); (void)lock;
          return !mFifo.empty();
       }
@@ -187,12 +223,13 @@ class AbstractFifo : public FifoStatsInterface
 
       virtual size_t getCountDepth() const
       {
-         return mSize;
+         return mLockFree ? lockFreeDepth() : mSize;
       }
 
       virtual time_t expectedWaitTimeMilliSec() const
       {
-         return ((mAverageServiceTimeMicroSec*mSize)+500)/1000;
+         UInt32 depth = mLockFree ? lockFreeDepth() : mSize;
+         return ((mAverageServiceTimeMicroSec*depth)+500)/1000;
       }
 
       virtual time_t averageServiceTimeMicroSec() const
@@ -204,6 +241,27 @@ class AbstractFifo : public FifoStatsInterface
       virtual void clear() {};
 
    protected:
+      /**
+         @brief Switches this fifo in or out of lock-free mode.
+         @details In lock-free mode add() and addMultiple() do not take mMutex
+         unless the fifo was empty, at the cost of one small allocation per
+         item (the inbox node, freed by the consumer). Keeping freed nodes for
+         producers to reuse was tried, and was 10-15ns per item slower than
+         the allocator: popping a shared free list safely takes as many atomic
+         operations as a thread-cached malloc/free pair costs.
+         Intended for fifos with several producer threads and a single
+         consumer. Must be called while the fifo is empty and before other
+         threads use it. Has no effect on platforms without RESIP_HAVE_ATOMICS.
+      */
+      void setLockFree(bool lockFree)
+      {
+#ifdef RESIP_HAVE_ATOMICS
+         Lock lock(mMutex); (void)lock;
+         resip_assert(mFifo.empty() && mInbox == 0);
+         mLockFree = lockFree;
+#endif
+      }
+
       /** 
           @brief Returns the first message available.
           @details Returns the first message available. It will wait if no
@@ -219,7 +277,7 @@ class AbstractFifo : public FifoStatsInterface
          onFifoPolled();
 
          // Wait util there are messages available.
-         while (mFifo.empty())
+         while (fifoEmpty())
          {
             mCondition.wait(mMutex);
          }
@@ -229,6 +287,7 @@ class AbstractFifo : public FifoStatsInterface
          T firstMessage(mFifo.front());
          mFifo.pop_front();
          onMessagePopped();
+         lockFreePopped(1);
          return firstMessage;
       }
 
@@ -254,10 +313,11 @@ class AbstractFifo : public FifoStatsInterface
          {
             Lock lock(mMutex); (void)lock;
             onFifoPolled();
-            if (mFifo.empty())	// WATCHOUT: Do not test mSize instead
+            if (fifoEmpty())	// WATCHOUT: Do not test mSize instead
               return false;
             toReturn = mFifo.front();
             mFifo.pop_front();
+            lockFreePopped(1);
             return true;
          }
 
@@ -267,7 +327,7 @@ class AbstractFifo : public FifoStatsInterface
          onFifoPolled();
 
          // Wait until there are messages available
-         while (mFifo.empty())
+         while (fifoEmpty())
          {
             if(ms==0)
             {
@@ -294,6 +354,7 @@ class AbstractFifo : public FifoStatsInterface
          toReturn=mFifo.front();
          mFifo.pop_front();
          onMessagePopped();
+         lockFreePopped(1);
          return true;
       }
 
@@ -304,26 +365,12 @@ class AbstractFifo : public FifoStatsInterface
          Lock lock(mMutex); (void)lock;
          onFifoPolled();
          resip_assert(other.empty());
-         while (mFifo.empty())
+         while (fifoEmpty())
          {
             mCondition.wait(mMutex);
          }
 
-         if(mFifo.size() <= max)
-         {
-            std::swap(mFifo, other);
-            onMessagePopped(mSize);
-         }
-         else
-         {
-            size_t num=max;
-            while( 0 != max-- )
-            {
-               other.push_back(mFifo.front());
-               mFifo.pop_front();
-            }
-            onMessagePopped((unsigned int)num);
-         }
+         takeFront(other, max);
       }
 
       bool getMultiple(int ms, Messages& other, unsigned int max)
@@ -341,7 +388,7 @@ class AbstractFifo : public FifoStatsInterface
          onFifoPolled();
 
          // Wait until there are messages available
-         while (mFifo.empty())
+         while (fifoEmpty())
          {
             if(ms < 0)
             {
@@ -363,26 +410,25 @@ class AbstractFifo : public FifoStatsInterface
             }
          }
 
-         if(mFifo.size() <= max)
-         {
-            std::swap(mFifo, other);
-            onMessagePopped(mSize);
-         }
-         else
-         {
-            size_t num=max;
-            while( 0 != max-- )
-            {
-               other.push_back(mFifo.front());
-               mFifo.pop_front();
-            }
-            onMessagePopped((unsigned int)num);
-         }
+         takeFront(other, max);
          return true;
       }
 
+      /**
+         @brief Adds an item to the back of the fifo.
+         @return the number of items in the fifo afterwards. In lock-free mode
+         this is 1 if the fifo was empty, but is otherwise only an estimate.
+      */
       size_t add(const T& item)
       {
+         if(mLockFree)
+         {
+            InboxNode* node = new InboxNode(item, atomicLoad(&mInbox));
+            while(!atomicCompareExchange(&mInbox, node->mNext, node))
+            {}
+            return lockFreePushed(1);
+         }
+
          Lock lock(mMutex); (void)lock;
          mFifo.push_back(item);
          mCondition.signal();
@@ -390,8 +436,35 @@ class AbstractFifo : public FifoStatsInterface
          return mFifo.size();
       }
 
+      /**
+         @brief Adds all of items to the back of the fifo, leaving items empty.
+         @return the number of items in the fifo afterwards. In lock-free mode
+         this is items.size() if the fifo was empty, but is otherwise only an
+         estimate.
+      */
       size_t addMultiple(Messages& items)
       {
+         if(mLockFree)
+         {
+            if(items.empty())
+            {
+               return lockFreeDepth();
+            }
+            // Link the batch newest-first, then push it with a single CAS.
+            InboxNode* last = new InboxNode(items.front(), 0);
+            InboxNode* first = last;
+            for(typename Messages::iterator i = items.begin() + 1; i != items.end(); ++i)
+            {
+               first = new InboxNode(*i, first);
+            }
+            Int32 num = (Int32)items.size();
+            items.clear();
+            last->mNext = atomicLoad(&mInbox);
+            while(!atomicCompareExchange(&mInbox, last->mNext, first))
+            {}
+            return lockFreePushed(num);
+         }
+
          Lock lock(mMutex); (void)lock;
          size_t size=items.size();
          if(mFifo.empty())
@@ -413,6 +486,56 @@ class AbstractFifo : public FifoStatsInterface
          return mFifo.size();
       }
 
+      /**
+         @brief Moves the contents of the fifo into items, leaving it empty.
+         Used by clear(). mMutex must be held.
+      */
+      void takeAll(Messages& items)
+      {
+         if(mLockFree)
+         {
+            drainInbox();
+         }
+         size_t num = mFifo.size();
+         std::swap(mFifo, items);
+         mFifo.clear();
+         mSize = 0;
+         lockFreePopped(num);
+      }
+
+      /**
+         @brief The number of items in the fifo, without locking; only
+         meaningful in lock-free mode.
+      */
+      UInt32 lockFreeDepth() const
+      {
+         Int32 count = atomicLoad(const_cast<volatile Int32*>(&mLockFreeCount));
+         return count > 0 ? (UInt32)count : 0;
+      }
+
+      /**
+         @brief The oldest item that is still in the inbox (ie, pushed in
+         lock-free mode but not yet moved to mFifo), or 0 if there is none.
+         mMutex must be held; nodes are only ever freed under it.
+      */
+      const T* oldestInInbox() const
+      {
+         if(!mLockFree)
+         {
+            return 0;
+         }
+         const InboxNode* node = atomicLoad(const_cast<InboxNode* volatile*>(&mInbox));
+         if(!node)
+         {
+            return 0;
+         }
+         while(node->mNext)
+         {
+            node = node->mNext;
+         }
+         return &node->mItem;
+      }
+
       /** @brief container for FIFO items */
       Messages mFifo;
       /** @brief access serialization lock */
@@ -472,6 +595,14 @@ class AbstractFifo : public FifoStatsInterface
          mSize-=num;
       }
 
+      /**
+         Called in lock-free mode, with mMutex held, whenever the oldest item
+         may have changed: after items are taken, and when a producer finds
+         the fifo empty. Lets a subclass keep what it needs of the oldest item
+         where producers can read it without the lock.
+      */
+      virtual void onOldestChanged() {}
+
       virtual void onMessagePushed(int num)
       {
          if(mSize==0)
@@ -483,6 +614,120 @@ class AbstractFifo : public FifoStatsInterface
          mSize+=num;
       }
    private:
+      /** @brief an item pushed in lock-free mode */
+      struct InboxNode
+      {
+         InboxNode(const T& item, InboxNode* next) : mItem(item), mNext(next) {}
+         T mItem;
+         InboxNode* mNext;
+      };
+
+      /** @brief items added in lock-free mode, newest first */
+      InboxNode* volatile mInbox;
+      /**
+         @brief items added minus items removed in lock-free mode. Producers
+         count their items after pushing them, so this can briefly go
+         negative.
+      */
+      volatile Int32 mLockFreeCount;
+      bool mLockFree;
+
+      bool inboxPending() const
+      {
+         return atomicLoad(const_cast<InboxNode* volatile*>(&mInbox)) != 0;
+      }
+
+      // Moves everything in the inbox to the back of mFifo, oldest first.
+      // mMutex must be held.
+      void drainInbox()
+      {
+         InboxNode* node = atomicExchange(&mInbox, (InboxNode*)0);
+         if(!node)
+         {
+            return;
+         }
+
+         InboxNode* oldest = 0;
+         while(node)
+         {
+            InboxNode* next = node->mNext;
+            node->mNext = oldest;
+            oldest = node;
+            node = next;
+         }
+
+         unsigned int num = 0;
+         while(oldest)
+         {
+            mFifo.push_back(oldest->mItem);
+            InboxNode* next = oldest->mNext;
+            delete oldest;
+            oldest = next;
+            ++num;
+         }
+         onMessagePushed((int)num);
+      }
+
+      // mMutex must be held.
+      bool fifoEmpty()
+      {
+         if(mLockFree)
+         {
+            drainInbox();
+         }
+         return mFifo.empty();
+      }
+
+      // Moves up to max items from the front of mFifo to other. mMutex must be
+      // held, and mFifo non-empty.
+      void takeFront(Messages& other, unsigned int max)
+      {
+         size_t num = mFifo.size();
+         if(num <= max)
+         {
+            std::swap(mFifo, other);
+            onMessagePopped(mSize);
+         }
+         else
+         {
+            num=max;
+            while( 0 != max-- )
+            {
+               other.push_back(mFifo.front());
+               mFifo.pop_front();
+            }
+            onMessagePopped((unsigned int)num);
+         }
+         lockFreePopped(num);
+      }
+
+      // Accounts for num items pushed onto the inbox, and wakes a consumer if
+      // the fifo just became non-empty. An item only counts once it has been
+      // pushed, so by the time a consumer that found the fifo empty goes to
+      // sleep the count is <= 0, and the push that takes it above 0 again
+      // signals. Returns the depth as described for add().
+      size_t lockFreePushed(Int32 num)
+      {
+         Int32 count = atomicAdd(&mLockFreeCount, num);
+         if(count > 0 && count <= num)
+         {
+            Lock lock(mMutex); (void)lock;
+            onOldestChanged();
+            mCondition.signal();
+            return (size_t)num;
+         }
+         return count > 0 ? (size_t)count : 0;
+      }
+
+      void lockFreePopped(size_t num)
+      {
+         if(mLockFree)
+         {
+            atomicAdd(&mLockFreeCount, -(Int32)num);
+            onOldestChanged();
+         }
+      }
+
       // no value semantics
       AbstractFifo(const AbstractFifo&);
       AbstractFifo& operator=(const AbstractFifo&);
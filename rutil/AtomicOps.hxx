@@ -0,0 +1,262 @@
+#if !defined(RESIP_ATOMICOPS_HXX)
+#define RESIP_ATOMICOPS_HXX
+
+#include "rutil/compat.hxx"
+
+#if defined(WIN32) && !defined(__GNUC__)
+#include <windows.h>
+#endif
+
+/**
+   @file
+   Minimal set of atomic operations for the lock-free structures in rutil.
+   All operations are sequentially consistent. RESIP_HAVE_ATOMICS is only
+   defined where we know how to implement them; elsewhere these are plain
+   (non-atomic) operations, so that code using them still compiles, and it is
+   up to that code to not take its lock-free paths.
+*/
+
+namespace resip
+{
+
+#if defined(__GNUC__)
+
+#define RESIP_HAVE_ATOMICS 1
+
+template<typename T>
+inline T*
+atomicLoad(T* volatile* ptr)
+{
+   return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+template<typename T>
+inline T*
+atomicExchange(T* volatile* ptr, T* value)
+{
+   return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+/// Stores desired if *ptr == expected. On failure, expected is updated to
+/// the value found.
+template<typename T>
+inline bool
+atomicCompareExchange(T* volatile* ptr, T*& expected, T* desired)
+{
+   return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+inline Int32
+atomicLoad(volatile Int32* ptr)
+{
+   return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+inline Int32
+atomicExchange(volatile Int32* ptr, Int32 value)
+{
+   return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+/// Returns the new value.
+inline Int32
+atomicAdd(volatile Int32* ptr, Int32 value)
+{
+   return __atomic_add_fetch(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+inline UInt64
+atomicLoad(volatile UInt64* ptr)
+{
+   return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+/// Returns the new value.
+inline UInt64
+atomicAdd(volatile UInt64* ptr, UInt64 value)
+{
+   return __atomic_add_fetch(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+#elif defined(WIN32)
+
+#define RESIP_HAVE_ATOMICS 1
+
+template<typename T>
+inline T*
+atomicLoad(T* volatile* ptr)
+{
+   return (T*)InterlockedCompareExchangePointer((PVOID volatile*)ptr, 0, 0);
+}
+
+template<typename T>
+inline T*
+atomicExchange(T* volatile* ptr, T* value)
+{
+   return (T*)InterlockedExchangePointer((PVOID volatile*)ptr, (PVOID)value);
+}
+
+template<typename T>
+inline bool
+atomicCompareExchange(T* volatile* ptr, T*& expected, T* desired)
+{
+   T* found = (T*)InterlockedCompareExchangePointer((PVOID volatile*)ptr,
+                                                    (PVOID)desired,
+                                                    (PVOID)expected);
+   if(found == expected)
+   {
+      return true;
+   }
+   expected = found;
+   return false;
+}
+
+inline Int32
+atomicLoad(volatile Int32* ptr)
+{
+   return (Int32)InterlockedCompareExchange((volatile LONG*)ptr, 0, 0);
+}
+
+inline Int32
+atomicExchange(volatile Int32* ptr, Int32 value)
+{
+   return (Int32)InterlockedExchange((volatile LONG*)ptr, (LONG)value);
+}
+
+inline Int32
+atomicAdd(volatile Int32* ptr, Int32 value)
+{
+   return (Int32)InterlockedExchangeAdd((volatile LONG*)ptr, (LONG)value) + value;
+}
+
+inline UInt64
+atomicLoad(volatile UInt64* ptr)
+{
+   return (UInt64)InterlockedCompareExchange64((volatile LONGLONG*)ptr, 0, 0);
+}
+
+inline UInt64
+atomicAdd(volatile UInt64* ptr, UInt64 value)
+{
+   return (UInt64)InterlockedExchangeAdd64((volatile LONGLONG*)ptr, (LONGLONG)value) + value;
+}
+
+#else
+
+template<typename T>
+inline T*
+atomicLoad(T* volatile* ptr)
+{
+   return *ptr;
+}
+
+template<typename T>
+inline T*
+atomicExchange(T* volatile* ptr, T* value)
+{
+   T* old = *ptr;
+   *ptr = value;
+   return old;
+}
+
+template<typename T>
+inline bool
+atomicCompareExchange(T* volatile* ptr, T*& expected, T* desired)
+{
+   if(*ptr == expected)
+   {
+      *ptr = desired;
+      return true;
+   }
+   expected = *ptr;
+   return false;
+}
+
+inline Int32
+atomicLoad(volatile Int32* ptr)
+{
+   return *ptr;
+}
+
+inline Int32
+atomicExchange(volatile Int32* ptr, Int32 value)
+{
+   Int32 old = *ptr;
+   *ptr = value;
+   return old;
+}
+
+inline Int32
+atomicAdd(volatile Int32* ptr, Int32 value)
+{
+   return *ptr += value;
+}
+
+inline UInt64
+atomicLoad(volatile UInt64* ptr)
+{
+   return *ptr;
+}
+
+inline UInt64
+atomicAdd(volatile UInt64* ptr, UInt64 value)
+{
+   return *ptr += value;
+}
+
+#endif
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -23,6 +23,7 @@ class Fifo : public AbstractFifo<Msg*>
       using AbstractFifo<Msg*>::mCondition;
       using AbstractFifo<Msg*>::empty;
       using AbstractFifo<Msg*>::size;
+      using AbstractFifo<Msg*>::setLockFree;
 
       /// Add a message to the fifo.
       size_t add(Msg* msg);
@@ -88,13 +89,16 @@ template <class Msg>
 void
 Fifo<Msg>::clear()
 {
-   Lock lock(mMutex); (void)lock;
-   while ( ! mFifo.empty() )
+   Messages items;
+   {
+      Lock lock(mMutex); (void)lock;
+      this->takeAll(items);
+   }
+   while ( ! items.empty() )
    {
-      delete mFifo.front();
-      mFifo.pop_front();
+      delete items.front();
+      items.pop_front();
    }
-   resip_assert(mFifo.empty());
 }
 
 template <class Msg>
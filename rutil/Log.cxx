@@ -1,9 +1,13 @@
 #include "rutil/Socket.hxx"
 
 #include "rutil/ResipAssert.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 #include "rutil/Data.hxx"
 
 #ifndef WIN32
@@ -13,17 +17,22 @@
 #include <sys/types.h>
 #include <time.h>
 
+#include "rutil/AtomicOps.hxx"
+#include "rutil/Condition.hxx"
 #include "rutil/Log.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/ParseBuffer.hxx"
 #include "rutil/ThreadIf.hxx"
 #include "rutil/Subsystem.hxx"
 #include "rutil/SysLogStream.hxx"
+#include "rutil/Timer.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 using namespace resip;
 using namespace std;
 
+#define RESIPROCATE_SUBSYSTEM Subsystem::NONE
+
 const Data Log::delim(" | ");
 Log::ThreadData Log::mDefaultLoggerData(0, Log::Cout, Log::Info, NULL, NULL);
 Data Log::mAppName;
@@ -59,6 +68,10 @@ HashMap<int, Log::Level> Log::mServiceToLevel;
 Log::LocalLoggerMap Log::mLocalLoggerMap;
 ThreadIf::TlsKey* Log::mLocalLoggerKey;
 
+Log::AsyncWriter* volatile Log::mAsyncWriter = 0;
+Mutex Log::mAsyncMutex;
+ThreadIf::TlsKey* Log::mAsyncBufferKey;
+
 const char
 Log::mDescriptions[][32] = {"NONE", "EMERG", "ALERT", "CRIT", "ERR", "WARNING", "NOTICE", "INFO", "DEBUG", "STACK", "CERR", ""}; 
 
@@ -94,12 +107,18 @@ LogStaticInitializer::LogStaticInitializer()
 
          Log::mLocalLoggerKey = new ThreadIf::TlsKey;
          ThreadIf::tlsKeyCreate(*Log::mLocalLoggerKey, freeLocalLogger);
+
+         Log::mAsyncBufferKey = new ThreadIf::TlsKey;
+         ThreadIf::tlsKeyCreate(*Log::mAsyncBufferKey, freeAsyncBuffer);
    }
 }
 LogStaticInitializer::~LogStaticInitializer()
 {
    if (--mInstanceCounter == 0)
    {
+      ThreadIf::tlsKeyDelete(*Log::mAsyncBufferKey);
+      delete Log::mAsyncBufferKey;
+
 #ifdef LOG_ENABLE_THREAD_SETTING
       ThreadIf::tlsKeyDelete(*Log::mLevelKey);
       delete Log::mLevelKey;
@@ -236,6 +255,8 @@ Log::initialize(Type type, Level level, const Data& appName,
                 ExternalLogger* externalLogger,
                 const Data& syslogFacilityName)
 {
+   // lines still buffered go where they were meant to
+   flush();
    Lock lock(_mutex);
    mDefaultLoggerData.reset();   
    
@@ -779,6 +800,429 @@ Log::OutputToWin32DebugWindow(const Data& result)
 #endif
 }
 
+#ifdef RESIP_HAVE_ATOMICS
+
+/**
+   The lines of every thread that logs, on their way to the writer thread.
+   Each thread copies its lines into a Buffer of its own, that only it
+   adds to and only drain() takes from, so that neither needs a lock.
+   drain() is called by the writer thread, and by flush() and stop() on
+   the threads that call them, one at a time.
+*/
+class Log::AsyncWriter
+{
+   public:
+      AsyncWriter()
+         : mThread(0),
+           mEnabled(0),
+           mBufferBytes(DefaultAsyncBufferBytes),
+           mDropped(0),
+           mReported(0),
+           mReportedAt(0),
+           mDraining(false)
+      {}
+
+      void start(unsigned int bufferBytes);
+      void stop();
+      bool enabled() { return atomicLoad(&mEnabled) != 0; }
+      UInt64 dropped() { return atomicLoad(&mDropped); }
+
+      /// false if async logging is off, and the caller is to write the line
+      bool post(ThreadData& logger,
+                Level level,
+                const Subsystem& subsystem,
+                const char* file,
+                int line,
+                const Data& text,
+                Data::size_type headerLength);
+
+      /// writes whatever is buffered; true if there was anything
+      bool drain();
+
+      /// a line as it is kept in a Buffer, followed by its text
+      struct Record
+      {
+         UInt32 mSize;  ///< of this Record and its text, rounded up to 8
+         UInt32 mLength;
+         Level mLevel;
+         int mLine;
+         const Subsystem* mSubsystem; ///< 0 for padding to the end of the Buffer
+         const char* mFile;
+         ThreadData* mLogger;
+         Data::size_type mHeaderLength;
+      };
+
+      /// single producer, single consumer ring of Records
+      class Buffer
+      {
+         public:
+            explicit Buffer(UInt32 capacity)
+               : mCapacity(capacity),
+                 mData(new char[capacity]),
+                 mHead(0),
+                 mTail(0),
+                 mOrphaned(0)
+            {}
+            ~Buffer() { delete [] mData; }
+
+            const UInt32 mCapacity;
+            char* const mData;
+            volatile Int32 mHead; ///< bytes ever added, wrapping
+            volatile Int32 mTail; ///< bytes ever taken, wrapping
+            volatile Int32 mOrphaned; ///< set once its thread has exited
+         private:
+            Buffer(const Buffer&);
+            Buffer& operator=(const Buffer&);
+      };
+
+   private:
+      class WriterThread : public ThreadIf
+      {
+         public:
+            explicit WriterThread(AsyncWriter& writer) : mWriter(writer) {}
+            virtual void thread();
+         private:
+            AsyncWriter& mWriter;
+      };
+
+      Buffer* addBuffer();
+      void wake();
+      void reportDropped();
+
+      WriterThread* mThread;
+      volatile Int32 mEnabled;
+      volatile Int32 mBufferBytes;
+      volatile UInt64 mDropped;
+      UInt64 mReported;
+      UInt64 mReportedAt;
+
+      Mutex mDrainMutex;
+      volatile bool mDraining;
+      ThreadIf::Id mDrainingThread;
+
+      Mutex mBuffersMutex;
+      std::vector<Buffer*> mBuffers;
+
+      Mutex mWakeMutex;
+      Condition mWake;
+};
+
+extern "C"
+{
+   void freeAsyncBuffer(void* pBuffer)
+   {
+      // the writer deletes it once it has taken the rest of its lines
+      atomicAdd(&static_cast<Log::AsyncWriter::Buffer*>(pBuffer)->mOrphaned, 1);
+   }
+}
+
+void
+Log::AsyncWriter::start(unsigned int bufferBytes)
+{
+   // big enough for a few long lines, and a power of two
+   UInt32 capacity = 4096;
+   while (capacity < bufferBytes && capacity < (1U << 30))
+   {
+      capacity *= 2;
+   }
+   // for Buffers added from now on
+   atomicAdd(&mBufferBytes, (Int32)capacity - atomicLoad(&mBufferBytes));
+
+   if (mThread == 0)
+   {
+      mThread = new WriterThread(*this);
+      mThread->run();
+      atomicAdd(&mEnabled, 1);
+   }
+}
+
+void
+Log::AsyncWriter::stop()
+{
+   if (mThread == 0)
+   {
+      return;
+   }
+
+   // a post() that sees this after adding its line drains it itself; any
+   // other line is drained below
+   atomicAdd(&mEnabled, -1);
+   mThread->shutdown();
+   wake();
+   mThread->join();
+   delete mThread;
+   mThread = 0;
+   drain();
+}
+
+bool
+Log::AsyncWriter::post(ThreadData& logger,
+                       Level level,
+                       const Subsystem& subsystem,
+                       const char* file,
+                       int line,
+                       const Data& text,
+                       Data::size_type headerLength)
+{
+   if (!enabled())
+   {
+      return false;
+   }
+
+   Buffer* buffer = static_cast<Buffer*>(ThreadIf::tlsGetValue(*mAsyncBufferKey));
+   if (buffer == 0)
+   {
+      buffer = addBuffer();
+   }
+
+   const UInt32 capacity = buffer->mCapacity;
+   const UInt32 size = (UInt32)(sizeof(Record) + text.size() + 7) & ~7U;
+   const UInt32 head = (UInt32)buffer->mHead;
+   const UInt32 used = head - (UInt32)atomicLoad(&buffer->mTail);
+   const UInt32 offset = head & (capacity - 1);
+   // a Record doesn't wrap: what is left at the end is skipped instead
+   const UInt32 skip = capacity - offset < size ? capacity - offset : 0;
+   if (used + skip + size > capacity)
+   {
+      atomicAdd(&mDropped, 1);
+      return true;
+   }
+
+   if (skip >= sizeof(Record))
+   {
+      Record* padding = reinterpret_cast<Record*>(buffer->mData + offset);
+      padding->mSize = skip;
+      padding->mSubsystem = 0;
+   }
+   Record* record = reinterpret_cast<Record*>(buffer->mData + ((head + skip) & (capacity - 1)));
+   record->mSize = size;
+   record->mLength = text.size();
+   record->mLevel = level;
+   record->mLine = line;
+   record->mSubsystem = &subsystem;
+   record->mFile = file;
+   record->mLogger = &logger;
+   record->mHeaderLength = headerLength;
+   memcpy(record + 1, text.data(), text.size());
+   atomicAdd(&buffer->mHead, (Int32)(skip + size));
+
+   // the writer looks for lines every WriterIdleMs anyway; only wake it
+   // early when this thread's Buffer is filling up
+   if (used * 2 < capacity && (used + skip + size) * 2 >= capacity)
+   {
+      wake();
+   }
+
+   // turned off meanwhile, and stop() may have drained already; unless
+   // this is an ExternalLogger logging from drain() itself, when the line
+   // waits for the next one
+   if (!enabled() && !(mDraining && mDrainingThread == ThreadIf::selfId()))
+   {
+      drain();
+   }
+   return true;
+}
+
+Log::AsyncWriter::Buffer*
+Log::AsyncWriter::addBuffer()
+{
+   Buffer* buffer = new Buffer((UInt32)atomicLoad(&mBufferBytes));
+   {
+      Lock lock(mBuffersMutex);
+      mBuffers.push_back(buffer);
+   }
+   ThreadIf::tlsSetValue(*mAsyncBufferKey, buffer);
+   return buffer;
+}
+
+bool
+Log::AsyncWriter::drain()
+{
+   Lock lock(mDrainMutex);
+   mDrainingThread = ThreadIf::selfId();
+   mDraining = true;
+
+   std::vector<Buffer*> buffers;
+   {
+      Lock lock(mBuffersMutex);
+      buffers = mBuffers;
+   }
+
+   bool wrote = false;
+   std::vector<ThreadData*> loggers;
+   std::vector<Buffer*> orphans;
+   for (std::vector<Buffer*>::iterator it = buffers.begin(); it != buffers.end(); ++it)
+   {
+      Buffer* buffer = *it;
+      // before mHead, so that every line added before its thread exited is seen
+      const bool orphaned = atomicLoad(&buffer->mOrphaned) != 0;
+      const UInt32 head = (UInt32)atomicLoad(&buffer->mHead);
+      const UInt32 capacity = buffer->mCapacity;
+      while ((UInt32)buffer->mTail != head)
+      {
+         const UInt32 offset = (UInt32)buffer->mTail & (capacity - 1);
+         UInt32 size = capacity - offset;
+         if (size >= sizeof(Record))
+         {
+            const Record* record = reinterpret_cast<const Record*>(buffer->mData + offset);
+            size = record->mSize;
+            if (record->mSubsystem)
+            {
+               const Data text(Data::Share, reinterpret_cast<const char*>(record + 1), record->mLength);
+               output(*record->mLogger, record->mLevel, *record->mSubsystem,
+                      record->mFile, record->mLine, text, record->mHeaderLength, true);
+               if (std::find(loggers.begin(), loggers.end(), record->mLogger) == loggers.end())
+               {
+                  loggers.push_back(record->mLogger);
+               }
+               wrote = true;
+            }
+         }
+         // frees the space for more lines as soon as this one is written
+         atomicAdd(&buffer->mTail, (Int32)size);
+      }
+
+      if (orphaned)
+      {
+         orphans.push_back(buffer);
+      }
+   }
+
+   if (!orphans.empty())
+   {
+      Lock lock(mBuffersMutex);
+      for (std::vector<Buffer*>::iterator it = orphans.begin(); it != orphans.end(); ++it)
+      {
+         mBuffers.erase(std::find(mBuffers.begin(), mBuffers.end(), *it));
+         delete *it;
+      }
+   }
+
+   if (!loggers.empty())
+   {
+      Lock lock(_mutex);
+      for (std::vector<ThreadData*>::iterator it = loggers.begin(); it != loggers.end(); ++it)
+      {
+         (*it)->flush();
+      }
+   }
+   mDraining = false;
+   return wrote;
+}
+
+void
+Log::AsyncWriter::wake()
+{
+   Lock lock(mWakeMutex);
+   mWake.signal();
+}
+
+void
+Log::AsyncWriter::reportDropped()
+{
+   const UInt64 dropped = atomicLoad(&mDropped);
+   const UInt64 now = Timer::getTimeMs();
+   // not so often that reporting it fills the buffers too
+   if (dropped != mReported && now >= mReportedAt + 1000)
+   {
+      WarningLog(<< "Log buffers full, " << dropped - mReported << " lines dropped");
+      mReported = dropped;
+      mReportedAt = now;
+   }
+}
+
+void
+Log::AsyncWriter::WriterThread::thread()
+{
+   // long enough for lines to be written in batches, short enough that
+   // they still show up as they happen
+   static const unsigned int WriterIdleMs = 20;
+
+   while (!isShutdown())
+   {
+      if (!mWriter.drain())
+      {
+         Lock lock(mWriter.mWakeMutex);
+         mWriter.mWake.wait(mWriter.mWakeMutex, WriterIdleMs);
+      }
+      mWriter.reportDropped();
+   }
+}
+
+static void
+stopAsyncLog()
+{
+   // writes what is still buffered, while the statics it needs are there
+   Log::setAsync(0);
+}
+
+#else
+
+extern "C"
+{
+   void freeAsyncBuffer(void* pBuffer)
+   {
+   }
+}
+
+#endif
+
+void
+Log::setAsync(unsigned int bufferBytes)
+{
+#ifdef RESIP_HAVE_ATOMICS
+   Lock lock(mAsyncMutex);
+   if (bufferBytes)
+   {
+      if (mAsyncWriter == 0)
+      {
+         atomicExchange(&mAsyncWriter, new AsyncWriter);
+         atexit(stopAsyncLog);
+      }
+      mAsyncWriter->start(bufferBytes);
+   }
+   else if (mAsyncWriter)
+   {
+      // kept, as other threads may be in post()
+      mAsyncWriter->stop();
+   }
+#endif
+}
+
+bool
+Log::isAsync()
+{
+#ifdef RESIP_HAVE_ATOMICS
+   AsyncWriter* writer = atomicLoad(&mAsyncWriter);
+   return writer && writer->enabled();
+#else
+   return false;
+#endif
+}
+
+void
+Log::flush()
+{
+#ifdef RESIP_HAVE_ATOMICS
+   AsyncWriter* writer = atomicLoad(&mAsyncWriter);
+   if (writer)
+   {
+      writer->drain();
+   }
+#endif
+}
+
+UInt64
+Log::getDroppedCount()
+{
+#ifdef RESIP_HAVE_ATOMICS
+   AsyncWriter* writer = atomicLoad(&mAsyncWriter);
+   return writer ? writer->dropped() : 0;
+#else
+   return 0;
+#endif
+}
+
 Log::LocalLoggerId Log::LocalLoggerMap::create(Log::Type type,
                                                     Log::Level level,
                                                     const char * logFileName,
@@ -799,6 +1243,8 @@ int Log::LocalLoggerMap::reinitialize(Log::LocalLoggerId loggerId,
                                       const char * logFileName,
                                       ExternalLogger* externalLogger)
 {
+   // lines still buffered for the old settings
+   Log::flush();
    Lock lock(mLoggerInstancesMapMutex);
    LoggerInstanceMap::iterator it = mLoggerInstancesMap.find(loggerId);
    if (it == mLoggerInstancesMap.end())
@@ -814,6 +1260,8 @@ int Log::LocalLoggerMap::reinitialize(Log::LocalLoggerId loggerId,
 
 int Log::LocalLoggerMap::remove(Log::LocalLoggerId loggerId)
 {
+   // buffered lines point at the ThreadData
+   Log::flush();
    Lock lock(mLoggerInstancesMapMutex);
    LoggerInstanceMap::iterator it = mLoggerInstancesMap.find(loggerId);
    if (it == mLoggerInstancesMap.end())
@@ -888,24 +1336,45 @@ Log::Guard::~Guard()
 {
    mStream.flush();
 
-   if (resip::Log::getExternal())
+   ThreadData& logger = resip::Log::getLoggerData();
+#ifdef RESIP_HAVE_ATOMICS
+   AsyncWriter* writer = atomicLoad(&mAsyncWriter);
+   if (writer && writer->post(logger, mLevel, mSubsystem, mFile, mLine, mData, mHeaderLength))
+   {
+      return;
+   }
+#endif
+   output(logger, mLevel, mSubsystem, mFile, mLine, mData, mHeaderLength, false);
+}
+
+void
+Log::output(ThreadData& logger,
+            Level level,
+            const Subsystem& subsystem,
+            const char* file,
+            int line,
+            const Data& text,
+            Data::size_type headerLength,
+            bool batched)
+{
+   if (logger.mExternalLogger)
    {
       const resip::Data rest(resip::Data::Share,
-                             mData.data() + mHeaderLength,
-                             (int)mData.size() - mHeaderLength);
-      if (!(*resip::Log::getExternal())(mLevel, 
-                                        mSubsystem, 
-                                        resip::Log::getAppName(),
-                                        mFile,
-                                        mLine, 
-                                        rest, 
-                                        mData))
+                             text.data() + headerLength,
+                             (int)text.size() - headerLength);
+      if (!(*logger.mExternalLogger)(level, 
+                                     subsystem, 
+                                     resip::Log::getAppName(),
+                                     file,
+                                     line, 
+                                     rest, 
+                                     text))
       {
          return;
       }
    }
     
-   Type logType = resip::Log::getLoggerData().mType;
+   Type logType = logger.type();
 
    if(logType == resip::Log::OnlyExternal ||
       logType == resip::Log::OnlyExternalNoHeaders) 
@@ -917,18 +1386,26 @@ Log::Guard::~Guard()
    // !dlb! implement VSDebugWindow as an external logger
    if (logType == resip::Log::VSDebugWindow)
    {
-      mData += "\r\n";
-      OutputToWin32DebugWindow(mData);
+      Data result(text);
+      result += "\r\n";
+      OutputToWin32DebugWindow(result);
    }
    else 
    {
       // endl is magic in syslog -- so put it here
-      std::ostream& _instance = Instance((int)mData.size()+2);
+      std::ostream& _instance = logger.Instance((int)text.size()+2);
       if (logType == resip::Log::Syslog)
       {
-         _instance << mLevel;
+         _instance << level << text << std::endl;
+      }
+      else if (batched)
+      {
+         _instance << text << '\n';
+      }
+      else
+      {
+         _instance << text << std::endl;
       }
-      _instance << mData << std::endl;  
    }
 }
 
@@ -977,6 +1454,29 @@ Log::ThreadData::Instance(unsigned int bytesToWrite)
    }
 }
 
+void
+Log::ThreadData::flush()
+{
+   switch (mType)
+   {
+      case Log::Cerr:
+         std::cerr.flush();
+         break;
+      case Log::Cout:
+         std::cout.flush();
+         break;
+      case Log::File:
+         if (mLogger)
+         {
+            mLogger->flush();
+         }
+         break;
+      default:
+         // syslog is written a line at a time
+         break;
+   }
+}
+
 void 
 Log::ThreadData::reset()
 {
@@ -36,6 +36,7 @@ extern "C"
 {
    // Forward declaration to make it friend of Log class.
    void freeLocalLogger(void* pThreadData);
+   void freeAsyncBuffer(void* pBuffer);
 };
 
 
@@ -208,6 +209,27 @@ class Log
       static void setMaxLineCount(unsigned int maxLineCount, LocalLoggerId loggerId);
       static void setMaxByteCount(unsigned int maxByteCount);
       static void setMaxByteCount(unsigned int maxByteCount, LocalLoggerId loggerId);
+      static const unsigned int DefaultAsyncBufferBytes = 256 * 1024;
+      /** @brief Write log lines from a background thread.
+      * Each thread that logs gets a lock-free buffer of bufferBytes
+      * (rounded up to a power of two) that its lines are copied into, and
+      * one writer thread takes them from there to the file, syslog,
+      * cout/cerr or ExternalLogger - which is then called on the writer
+      * thread.  A line that doesn't fit in its thread's buffer is dropped
+      * and counted.  Each thread's lines stay in order, but lines from
+      * different threads may be written out of order with each other.
+      * 0 goes back to writing on the thread that logs, once everything
+      * buffered has been written.  Ignored where rutil has no atomics.
+      */
+      static void setAsync(unsigned int bufferBytes = DefaultAsyncBufferBytes);
+      static bool isAsync();
+      /** @brief Returns once every line logged before the call has been
+      * written; a no-op unless setAsync() is on.
+      */
+      static void flush();
+      /// Lines dropped so far because a thread's async buffer was full.
+      static UInt64 getDroppedCount();
+
       static Level toLevel(const Data& l);
       static Type toType(const Data& t);
       static Data toString(Level l);
@@ -314,6 +336,7 @@ class Log
             Type type() const {return mType;}
 
             std::ostream& Instance(unsigned int bytesToWrite); ///< Return logger stream instance, creating it if needed.
+            void flush(); ///< Flushes logger stream, if any
             void reset(); ///< Frees logger stream
 #ifndef WIN32
             void droppingPrivileges(uid_t uid, pid_t pid);
@@ -350,6 +373,26 @@ class Log
          return pData?*pData:mDefaultLoggerData;
       }
 
+      /** Passes a formatted line to the ExternalLogger and stream of logger.
+      * A batched line is ended without flushing (except for syslog), and
+      * the caller flushes logger once it has written the batch.
+      */
+      static void output(ThreadData& logger,
+                         Level level,
+                         const Subsystem& subsystem,
+                         const char* file,
+                         int line,
+                         const Data& text,
+                         Data::size_type headerLength,
+                         bool batched);
+
+      class AsyncWriter;
+      friend class AsyncWriter;
+      static AsyncWriter* volatile mAsyncWriter;
+      static Mutex mAsyncMutex; ///< serializes setAsync()
+      static ThreadIf::TlsKey* mAsyncBufferKey;
+      friend void ::freeAsyncBuffer(void* pBuffer);
+
       /// Thread Local logger settings storage
       class LocalLoggerMap
       {
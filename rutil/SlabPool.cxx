@@ -0,0 +1,338 @@
+#include <list>
+#include <new>
+#include <stdlib.h>
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+#include "rutil/SlabPool.hxx"
+#include "rutil/AtomicOps.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
+
+using namespace resip;
+
+#define RESIPROCATE_SUBSYSTEM resip::Subsystem::STATS
+
+namespace
+{
+
+struct ThreadSlabs
+{
+   ThreadSlabs() : mFree(0), mFreeCount(0) {}
+
+   void* mFree; // linked through the first word
+   unsigned int mFreeCount;
+   SlabCache::Stats mStats; // written by the owner, read by getStats()
+};
+
+typedef std::list<ThreadSlabs*> ThreadSlabsList;
+
+Mutex slabMutex;
+volatile bool slabKeyCreated = false;
+ThreadIf::TlsKey slabKey;
+ThreadSlabsList liveThreads;
+SlabCache::Stats exitedThreadStats;
+
+// Adds to the stats of the calling thread, which getStats() may be reading.
+void
+addThreadStats(ThreadSlabs* slabs, const SlabCache::Stats& stats)
+{
+#ifdef RESIP_HAVE_ATOMICS
+   atomicAdd((volatile UInt64*)&slabs->mStats.mPools, stats.mPools);
+   atomicAdd((volatile UInt64*)&slabs->mStats.mPooledAllocations, stats.mPooledAllocations);
+   atomicAdd((volatile UInt64*)&slabs->mStats.mPooledBytes, stats.mPooledBytes);
+   atomicAdd((volatile UInt64*)&slabs->mStats.mHeapAllocations, stats.mHeapAllocations);
+   atomicAdd((volatile UInt64*)&slabs->mStats.mHeapBytes, stats.mHeapBytes);
+   atomicAdd((volatile UInt64*)&slabs->mStats.mSlabs, stats.mSlabs);
+   atomicAdd((volatile UInt64*)&slabs->mStats.mSlabsFromHeap, stats.mSlabsFromHeap);
+#else
+   Lock lock(slabMutex);
+   slabs->mStats += stats;
+#endif
+}
+
+// Reads the stats of another thread; slabMutex must be held.
+SlabCache::Stats
+loadThreadStats(ThreadSlabs* slabs)
+{
+#ifdef RESIP_HAVE_ATOMICS
+   SlabCache::Stats stats;
+   stats.mPools = atomicLoad((volatile UInt64*)&slabs->mStats.mPools);
+   stats.mPooledAllocations = atomicLoad((volatile UInt64*)&slabs->mStats.mPooledAllocations);
+   stats.mPooledBytes = atomicLoad((volatile UInt64*)&slabs->mStats.mPooledBytes);
+   stats.mHeapAllocations = atomicLoad((volatile UInt64*)&slabs->mStats.mHeapAllocations);
+   stats.mHeapBytes = atomicLoad((volatile UInt64*)&slabs->mStats.mHeapBytes);
+   stats.mSlabs = atomicLoad((volatile UInt64*)&slabs->mStats.mSlabs);
+   stats.mSlabsFromHeap = atomicLoad((volatile UInt64*)&slabs->mStats.mSlabsFromHeap);
+   return stats;
+#else
+   return slabs->mStats;
+#endif
+}
+
+void
+freeThreadSlabs(void* arg)
+{
+   ThreadSlabs* slabs = (ThreadSlabs*)arg;
+   {
+      Lock lock(slabMutex);
+      exitedThreadStats += loadThreadStats(slabs);
+      liveThreads.remove(slabs);
+   }
+   while(slabs->mFree)
+   {
+      void* next = *(void**)slabs->mFree;
+      SlabCache::freeBlock(slabs->mFree);
+      slabs->mFree = next;
+   }
+   delete slabs;
+}
+
+// Set once the main thread's slabs have been freed at static teardown; pools
+// released after that go straight back to the heap.
+volatile bool slabsTornDown = false;
+
+// Thread-specific data destructors only run for threads that exit, never for
+// the main thread, so its slabs are freed here instead.
+class SlabTeardown
+{
+   public:
+      ~SlabTeardown()
+      {
+         if(slabKeyCreated)
+         {
+            ThreadSlabs* slabs = (ThreadSlabs*)ThreadIf::tlsGetValue(slabKey);
+            if(slabs)
+            {
+               ThreadIf::tlsSetValue(slabKey, 0);
+               freeThreadSlabs(slabs);
+            }
+         }
+         slabsTornDown = true;
+      }
+};
+
+// Defined after the state above, so that it is destroyed before it.
+SlabTeardown slabTeardown;
+
+ThreadSlabs*
+threadSlabs()
+{
+   if(!slabKeyCreated)
+   {
+      Lock lock(slabMutex);
+      if(!slabKeyCreated)
+      {
+         ThreadIf::tlsKeyCreate(slabKey, freeThreadSlabs);
+         slabKeyCreated = true;
+      }
+   }
+
+   ThreadSlabs* slabs = (ThreadSlabs*)ThreadIf::tlsGetValue(slabKey);
+   if(!slabs)
+   {
+      slabs = new ThreadSlabs;
+      ThreadIf::tlsSetValue(slabKey, slabs);
+      Lock lock(slabMutex);
+      liveThreads.push_back(slabs);
+   }
+   return slabs;
+}
+
+}
+
+SlabCache::Stats::Stats()
+   : mPools(0),
+     mPooledAllocations(0),
+     mPooledBytes(0),
+     mHeapAllocations(0),
+     mHeapBytes(0),
+     mSlabs(0),
+     mSlabsFromHeap(0)
+{
+}
+
+SlabCache::Stats&
+SlabCache::Stats::operator+=(const Stats& rhs)
+{
+   mPools += rhs.mPools;
+   mPooledAllocations += rhs.mPooledAllocations;
+   mPooledBytes += rhs.mPooledBytes;
+   mHeapAllocations += rhs.mHeapAllocations;
+   mHeapBytes += rhs.mHeapBytes;
+   mSlabs += rhs.mSlabs;
+   mSlabsFromHeap += rhs.mSlabsFromHeap;
+   return *this;
+}
+
+void*
+SlabCache::getSlab()
+{
+   if(slabsTornDown)
+   {
+      return allocateBlock(SlabSize);
+   }
+
+   ThreadSlabs* slabs = threadSlabs();
+   if(slabs->mFree)
+   {
+      void* slab = slabs->mFree;
+      slabs->mFree = *(void**)slab;
+      --slabs->mFreeCount;
+      return slab;
+   }
+   Stats fromHeap;
+   fromHeap.mSlabsFromHeap = 1;
+   addThreadStats(slabs, fromHeap);
+   return allocateBlock(SlabSize);
+}
+
+void
+SlabCache::release(void* slab, const Stats& stats)
+{
+   if(slabsTornDown)
+   {
+      while(slab)
+      {
+         void* next = *(void**)slab;
+         freeBlock(slab);
+         slab = next;
+      }
+      return;
+   }
+
+   ThreadSlabs* slabs = threadSlabs();
+   addThreadStats(slabs, stats);
+   while(slab)
+   {
+      void* next = *(void**)slab;
+      if(slabs->mFreeCount < MaxCachedSlabs)
+      {
+         *(void**)slab = slabs->mFree;
+         slabs->mFree = slab;
+         ++slabs->mFreeCount;
+      }
+      else
+      {
+         freeBlock(slab);
+      }
+      slab = next;
+   }
+}
+
+void*
+SlabCache::allocateBlock(size_t size, size_t alignment)
+{
+   void* block = 0;
+#ifdef WIN32
+   block = _aligned_malloc(size, alignment);
+#else
+   if(posix_memalign(&block, alignment, size) != 0)
+   {
+      block = 0;
+   }
+#endif
+   if(!block)
+   {
+      throw std::bad_alloc();
+   }
+   return block;
+}
+
+void
+SlabCache::freeBlock(void* block)
+{
+#ifdef WIN32
+   _aligned_free(block);
+#else
+   free(block);
+#endif
+}
+
+SlabCache::Stats
+SlabCache::getStats()
+{
+   Lock lock(slabMutex);
+   // Each count is read atomically, but not all of a thread's counts at once,
+   // so a pool being released as we read may be half counted.
+   Stats total(exitedThreadStats);
+   for(ThreadSlabsList::const_iterator i = liveThreads.begin(); i != liveThreads.end(); ++i)
+   {
+      total += loadThreadStats(*i);
+   }
+   return total;
+}
+
+void
+SlabCache::dump()
+{
+   Stats stats(getStats());
+   if(stats.mPools == 0)
+   {
+      WarningLog(<< "No slab pools.");
+      return;
+   }
+   // Every pooled allocation is a heap call saved; slabs taken from the heap
+   // give some of that back.
+   WarningLog(<< "SlabPool: " << stats.mPools << " pools, per pool: "
+              << stats.mPooledBytes/stats.mPools << " bytes in "
+              << stats.mPooledAllocations/stats.mPools << " pooled allocations, "
+              << stats.mHeapBytes/stats.mPools << " bytes in "
+              << stats.mHeapAllocations/stats.mPools << " heap allocations; "
+              << stats.mSlabs << " slabs used, " << stats.mSlabsFromHeap
+              << " from the heap; heap calls saved="
+              << stats.mPooledAllocations - stats.mSlabsFromHeap);
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
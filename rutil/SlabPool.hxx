@@ -0,0 +1,237 @@
+#ifndef SlabPool_Include_Guard
+#define SlabPool_Include_Guard
+
+#include <limits>
+#include <stddef.h>
+
+#include "rutil/PoolBase.hxx"
+#include "rutil/compat.hxx"
+
+#ifdef max  // Max is defined under WIN32 and conflicts with std::numeric_limits<size_type>::max use below
+#undef max
+#endif
+
+namespace resip
+{
+/**
+   Per-thread cache of fixed-size memory slabs, used by SlabPool.
+
+   A slab goes back to the cache of whichever thread releases it, not to the
+   thread it came from. That is fine here, since all slabs are alike: a thread
+   that only creates messages will get its slabs from the heap, and a thread
+   that only destroys them will give its excess back to the heap, but every
+   heap call still covers a whole slab instead of a single object.
+*/
+class SlabCache
+{
+   public:
+      /// Bytes per slab. The first 8 bytes link the slabs of a pool together.
+      static const size_t SlabSize = 4096;
+      /// Allocations larger than this bypass the slabs and go to the heap.
+      static const size_t MaxPooledSize = 1024;
+      /// Slabs kept per thread; beyond that, released slabs are freed.
+      static const unsigned int MaxCachedSlabs = 256;
+      /// Slabs a single pool may use; beyond that, it allocates from the heap.
+      static const unsigned int MaxPoolSlabs = 4;
+
+      /// Statistics, both for a single pool and summed over all pools.
+      struct Stats
+      {
+         Stats();
+         Stats& operator+=(const Stats& rhs);
+
+         UInt64 mPools;             // number of pools destroyed
+         UInt64 mPooledAllocations; // allocations that did not call the heap
+         UInt64 mPooledBytes;       // ...and their size
+         UInt64 mHeapAllocations;   // allocations too big to pool
+         UInt64 mHeapBytes;         // ...and their size
+         UInt64 mSlabs;             // slabs used
+         UInt64 mSlabsFromHeap;     // ...of which were not in the thread's cache
+      };
+
+      /// A slab from this thread's cache, or from the heap if it is empty.
+      static void* getSlab();
+
+      /// size bytes straight from the heap, aligned to SlabSize like a slab
+      /// unless a smaller alignment is asked for; freed with freeBlock().
+      static void* allocateBlock(size_t size, size_t alignment = SlabSize);
+      static void freeBlock(void* block);
+
+      /// Returns a list of slabs (linked through their first word) to this
+      /// thread's cache, and adds stats to the totals.
+      static void release(void* slabs, const Stats& stats);
+
+      /// Sums of the Stats of every pool destroyed so far, on all threads.
+      static Stats getStats();
+
+      /// Logs getStats() at Warning level, in the manner of
+      /// HeapInstanceCounter::dump().
+      static void dump();
+};
+
+/**
+   A pool allocator for short-lifetime object graphs, such as a SipMessage and
+   all of its parsed headers. The first S bytes are carved out of a buffer
+   inside the pool itself; after that, allocations are carved out of 4KB slabs
+   taken from a per-thread SlabCache, so that a large message makes one heap
+   call per slab instead of one per object. Allocations larger than
+   SlabCache::MaxPooledSize go to the heap individually.
+
+   As with DinkyPool, deallocating a pooled object does _not_ free up room in
+   the pool; everything is given back in one shot when the pool goes away.
+   So that a long-lived object that is edited over and over (a DUM
+   registration's last REGISTER, say) does not grow without bound, a pool
+   stops taking slabs after SlabCache::MaxPoolSlabs; from then on, every
+   allocation goes to the heap and is freed by deallocate(), as DinkyPool
+   does with its overflow.
+*/
+template<unsigned int S>
+class SlabPool : public PoolBase
+{
+   public:
+      SlabPool() : mCount(0), mSlabs(0), mSlabUsed(0), mSlabCount(0) {}
+      ~SlabPool()
+      {
+         mStats.mPools = 1;
+         SlabCache::release(mSlabs, mStats);
+      }
+
+      void* allocate(size_t size)
+      {
+         size_t bytes = 8*((size+7)/8);
+         if((8*mCount)+bytes <= S)
+         {
+            void* result=mBuf[mCount];
+            mCount+=bytes/8;
+            ++mStats.mPooledAllocations;
+            mStats.mPooledBytes += bytes;
+            return result;
+         }
+
+         if(bytes <= SlabCache::MaxPooledSize)
+         {
+            if(!mSlabs || mSlabUsed+bytes > SlabCache::SlabSize)
+            {
+               if(mSlabCount == SlabCache::MaxPoolSlabs)
+               {
+                  ++mStats.mHeapAllocations;
+                  mStats.mHeapBytes += size;
+                  return SlabCache::allocateBlock(bytes, 8);
+               }
+               char* slab = (char*)SlabCache::getSlab();
+               *(char**)slab = mSlabs;
+               mSlabs = slab;
+               mSlabUsed = 8;
+               ++mSlabCount;
+               ++mStats.mSlabs;
+            }
+            void* result = mSlabs+mSlabUsed;
+            mSlabUsed += bytes;
+            ++mStats.mPooledAllocations;
+            mStats.mPooledBytes += bytes;
+            return result;
+         }
+
+         ++mStats.mHeapAllocations;
+         mStats.mHeapBytes += size;
+         return SlabCache::allocateBlock(size);
+      }
+
+      void deallocate(void* ptr)
+      {
+         if(ptr >= (void*)mBuf[0] && ptr < (void*)mBuf[(S+7)/8])
+         {
+            return;
+         }
+         // Slabs are SlabSize aligned and their first word is the link, so
+         // a pointer inside one of ours is never on the boundary itself.
+         // Anything else came from SlabCache::allocateBlock().
+         if(((size_t)ptr & (SlabCache::SlabSize-1)) != 0)
+         {
+            char* base = (char*)((size_t)ptr & ~(size_t)(SlabCache::SlabSize-1));
+            for(char* slab = mSlabs; slab; slab = *(char**)slab)
+            {
+               if(slab == base)
+               {
+                  return;
+               }
+            }
+         }
+         SlabCache::freeBlock(ptr);
+      }
+
+      size_t max_size() const
+      {
+         return std::numeric_limits<size_t>::max();
+      }
+
+      size_t getHeapBytes() const { return (size_t)mStats.mHeapBytes; }
+      size_t getPoolBytes() const { return (size_t)mStats.mPooledBytes; }
+      size_t getPoolSizeBytes() const { return sizeof(mBuf); }
+      size_t getSlabCount() const { return (size_t)mStats.mSlabs; }
+
+   private:
+      // disabled
+      SlabPool& operator=(const SlabPool& rhs);
+      SlabPool(const SlabPool& other);
+
+      size_t mCount; // 8-byte chunks of mBuf alloced so far
+      char mBuf[(S+7)/8][8]; // 8-byte chunks for alignment
+      char* mSlabs; // most recent slab first
+      size_t mSlabUsed; // bytes used in mSlabs
+      unsigned int mSlabCount; // at most SlabCache::MaxPoolSlabs
+      SlabCache::Stats mStats;
+};
+
+}
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -105,6 +105,8 @@ class TimeLimitFifo : public AbstractFifo< Timestamped<Msg*> >
       using AbstractFifo< Timestamped<Msg*> >::empty;
       using AbstractFifo< Timestamped<Msg*> >::size;
       using AbstractFifo< Timestamped<Msg*> >::onMessagePushed;
+      using AbstractFifo< Timestamped<Msg*> >::setLockFree;
+      using AbstractFifo< Timestamped<Msg*> >::isLockFree;
 
       /// @brief Add a message to the fifo.
       /// return true iff succeeds
@@ -206,8 +208,12 @@ class TimeLimitFifo : public AbstractFifo< Timestamped<Msg*> >
       */
       virtual void setTimeDepthTolerance(unsigned int maxSecs);
 
+   protected:
+      virtual void onOldestChanged();
+
    private:
       time_t timeDepthInternal() const;
+      size_t depthInternal() const;
       inline bool wouldAcceptInteral(DepthUsage usage) const;
       TimeLimitFifo(const TimeLimitFifo& rhs);
       TimeLimitFifo& operator=(const TimeLimitFifo& rhs);
@@ -215,6 +221,12 @@ class TimeLimitFifo : public AbstractFifo< Timestamped<Msg*> >
       time_t mMaxDurationSecs;
       unsigned int mMaxSize;
       unsigned int mUnreservedMaxSize;
+
+      // In lock-free mode, the timestamp of the oldest item, in seconds after
+      // mTimeBase plus one, or 0 if the fifo is empty; lets add() enforce the
+      // time depth without mMutex.
+      const time_t mTimeBase;
+      volatile Int32 mOldestTime;
 };
 
 template <class Msg>
@@ -223,7 +235,9 @@ TimeLimitFifo<Msg>::TimeLimitFifo(unsigned int maxDurationSecs,
    : AbstractFifo< Timestamped<Msg*> >(),
      mMaxDurationSecs(maxDurationSecs),
      mMaxSize(maxSize),
-     mUnreservedMaxSize((int)((maxSize*8)/10)) // !dlb! random guess
+     mUnreservedMaxSize((int)((maxSize*8)/10)), // !dlb! random guess
+     mTimeBase(time(0)),
+     mOldestTime(0)
 {}
 
 template <class Msg>
@@ -238,6 +252,18 @@ bool
 TimeLimitFifo<Msg>::add(Msg* msg,
                         DepthUsage usage)
 {
+   if (isLockFree())
+   {
+      // The size limits are checked against the lock-free count, and the
+      // time depth against mOldestTime; neither needs mMutex.
+      if (!wouldAcceptInteral(usage))
+      {
+         return false;
+      }
+      AbstractFifo< Timestamped<Msg*> >::add(Timestamped<Msg*>(msg, time(0)));
+      return true;
+   }
+
    Lock lock(mMutex); (void)lock;
 
    if (wouldAcceptInteral(usage))
@@ -283,10 +309,27 @@ TimeLimitFifo<Msg>::getNext(int ms)
    return 0;
 }
 
+template <class Msg>
+void
+TimeLimitFifo<Msg>::onOldestChanged()
+{
+   // Anything not yet picked up from the lock-free inbox is newer than what
+   // is in mFifo, so only look there when mFifo is empty.
+   const Timestamped<Msg*>* oldest = mFifo.empty() ? this->oldestInInbox() : &mFifo.front();
+   atomicExchange(&mOldestTime, oldest ? (Int32)(oldest->getTime() - mTimeBase) + 1 : 0);
+}
+
 template <class Msg>
 time_t
 TimeLimitFifo<Msg>::timeDepthInternal() const
 {
+   if(isLockFree())
+   {
+      // kept up to date by onOldestChanged()
+      Int32 oldest = atomicLoad(const_cast<volatile Int32*>(&mOldestTime));
+      return oldest ? time(0) - (mTimeBase + oldest - 1) : 0;
+   }
+
    if(mFifo.empty())
    {
       return 0;
@@ -295,12 +338,20 @@ TimeLimitFifo<Msg>::timeDepthInternal() const
    return time(0) - mFifo.front().getTime();
 }
 
+template <class Msg>
+size_t
+TimeLimitFifo<Msg>::depthInternal() const
+{
+   return isLockFree() ? this->lockFreeDepth() : mFifo.size();
+}
+
 template <class Msg>
 bool
 TimeLimitFifo<Msg>::wouldAcceptInteral(DepthUsage usage) const
 {
+   const size_t depth = depthInternal();
    if ((mMaxSize != 0 &&
-        mFifo.size() >= mMaxSize))
+        depth >= mMaxSize))
    {
       return false;
    }
@@ -311,7 +362,7 @@ TimeLimitFifo<Msg>::wouldAcceptInteral(DepthUsage usage) const
    }
 
    if (mUnreservedMaxSize != 0 &&
-       mFifo.size() >= mUnreservedMaxSize)
+       depth >= mUnreservedMaxSize)
    {
       return false;
    }
@@ -323,7 +374,7 @@ TimeLimitFifo<Msg>::wouldAcceptInteral(DepthUsage usage) const
 
    resip_assert(usage == EnforceTimeDepth);
 
-   if (mFifo.size() == 0 ||
+   if (depth == 0 ||
        mMaxDurationSecs == 0 ||
        timeDepthInternal() < mMaxDurationSecs)
    {
@@ -345,12 +396,16 @@ template <class Msg>
 void
 TimeLimitFifo<Msg>::clear()
 {
-   Lock lock(mMutex); (void)lock;
+   typename AbstractFifo< Timestamped<Msg*> >::Messages items;
+   {
+      Lock lock(mMutex); (void)lock;
+      this->takeAll(items);
+   }
 
-   while (!mFifo.empty())
+   while (!items.empty())
    {
-      delete mFifo.front().getMsg();
-      mFifo.pop_front();
+      delete items.front().getMsg();
+      items.pop_front();
    }
 }
 
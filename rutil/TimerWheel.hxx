@@ -0,0 +1,457 @@
+#if !defined(RESIP_TIMERWHEEL_HXX)
+#define RESIP_TIMERWHEEL_HXX
+
+#include <deque>
+#include <vector>
+#include "rutil/compat.hxx"
+#include "rutil/ResipAssert.h"
+#include "rutil/Timer.hxx"
+
+namespace resip
+{
+
+/**
+   @brief An ordered set of timers, keyed on T::getWhen() (absolute time in
+   milliseconds as returned by Timer::getTimeMs()).
+
+   This is a hierarchical timing wheel: four levels of 256 slots, where a slot
+   on the lowest level covers one millisecond and a slot on each level above
+   covers a whole turn of the level below (256ms, ~65s and ~4.6 hours). A
+   timer is filed in the lowest level that can hold it, and is moved down a
+   level ("cascaded") when the wheel below turns over to its slot. Timers more
+   than ~49 days out are parked on the top level and re-filed as the wheel
+   turns.
+
+   Compared to a std::priority_queue, add() and cancel() are O(1) no matter
+   how many timers are pending, and each timer is moved at most once per
+   level over its lifetime. Timers with the same expiry fire in the order
+   they were added.
+
+   Not thread-safe.
+*/
+template <class T>
+class TimerWheel
+{
+   public:
+      /// identifies a timer for cancel() and find(); 0 is never a valid Id
+      typedef UInt64 Id;
+
+      TimerWheel() :
+         mSize(0),
+         mCurrent(Timer::getTimeMs()),
+         mNextIndex(Nil),
+         mNextValid(true)
+      {
+         for (UInt32 s = 0; s < Levels*Slots; ++s)
+         {
+            mHeads[s] = Nil;
+            mTails[s] = Nil;
+         }
+         for (UInt32 l = 0; l < Levels; ++l)
+         {
+            mLevelCount[l] = 0;
+         }
+      }
+
+      /// files a copy of {timer}; a timer that is already due fires on the
+      /// next call to expire()
+      Id add(const T& timer)
+      {
+         UInt32 index;
+         if (mFree.empty())
+         {
+            index = (UInt32)mNodes.size();
+            mNodes.push_back(Node(timer));
+         }
+         else
+         {
+            index = mFree.back();
+            mFree.pop_back();
+            mNodes[index].mTimer = timer;
+         }
+
+         Node& node = mNodes[index];
+         ++node.mSerial;
+         file(index);
+
+         if (mSize++ == 0)
+         {
+            mNextIndex = index;
+            mNextValid = true;
+         }
+         else if (mNextValid && timer.getWhen() < mNodes[mNextIndex].mTimer.getWhen())
+         {
+            mNextIndex = index;
+         }
+
+         return (UInt64(node.mSerial) << 32) | (index + 1);
+      }
+
+      /// removes the timer identified by {id}; returns false if it has
+      /// already fired (or is firing) or was already cancelled
+      bool cancel(Id id)
+      {
+         UInt32 index;
+         if (!lookup(id, index))
+         {
+            return false;
+         }
+
+         unlink(index);
+         mFree.push_back(index);
+         --mSize;
+         if (mNextIndex == index)
+         {
+            mNextValid = false;
+         }
+         return true;
+      }
+
+      /// the timer identified by {id}, or 0 if it is no longer pending
+      const T* find(Id id) const
+      {
+         UInt32 index;
+         if (!lookup(id, index))
+         {
+            return 0;
+         }
+         return &mNodes[index].mTimer;
+      }
+
+      /// the timer that will fire next; the wheel must not be empty
+      const T& top() const
+      {
+         resip_assert(mSize);
+         if (!mNextValid)
+         {
+            findNext();
+         }
+         return mNodes[mNextIndex].mTimer;
+      }
+
+      /// when the next timer is due; the wheel must not be empty
+      UInt64 nextWhen() const
+      {
+         return top().getWhen();
+      }
+
+      /// turns the wheel up to and including {now}, calling fire(const T&)
+      /// for every timer that is due, in order of expiry. {fire} may add or
+      /// cancel timers; it must not call expire() or clear().
+      template <class F>
+      void expire(UInt64 now, F& fire)
+      {
+         while (mCurrent <= now)
+         {
+            if (mSize == 0)
+            {
+               mCurrent = now + 1;
+               break;
+            }
+
+            const UInt32 slot = UInt32(mCurrent & SlotMask);
+            if (slot == 0)
+            {
+               cascade(1);
+            }
+
+            // timers added from fire() for a time that has already come are
+            // appended to this same slot, so they go off in this pass
+            while (mHeads[slot] != Nil)
+            {
+               const UInt32 index = mHeads[slot];
+               unlink(index);
+               --mSize;
+               mNextValid = false;
+               fire(mNodes[index].mTimer);
+               mFree.push_back(index);
+            }
+            ++mCurrent;
+
+            if (mSize && mLevelCount[0] == 0)
+            {
+               // nothing left on the bottom level; skip straight to the next
+               // tick at which an occupied level gets cascaded
+               UInt32 level = 1;
+               while (level < Levels - 1 && mLevelCount[level] == 0)
+               {
+                  ++level;
+               }
+               const UInt64 mask = (UInt64(1) << (level*LevelBits)) - 1;
+               const UInt64 next = (mCurrent + mask) & ~mask;
+               mCurrent = next <= now ? next : now + 1;
+            }
+         }
+      }
+
+      /// removes all timers, first passing each one to discard(const T&)
+      template <class F>
+      void clear(F& discard)
+      {
+         for (typename std::deque<Node>::iterator i = mNodes.begin(); i != mNodes.end(); ++i)
+         {
+            if (i->mSlot != Nil)
+            {
+               discard(i->mTimer);
+            }
+         }
+         mNodes.clear();
+         mFree.clear();
+         for (UInt32 s = 0; s < Levels*Slots; ++s)
+         {
+            mHeads[s] = Nil;
+            mTails[s] = Nil;
+         }
+         for (UInt32 l = 0; l < Levels; ++l)
+         {
+            mLevelCount[l] = 0;
+         }
+         mSize = 0;
+         mNextIndex = Nil;
+         mNextValid = true;
+      }
+
+      size_t size() const
+      {
+         return mSize;
+      }
+
+      bool empty() const
+      {
+         return mSize == 0;
+      }
+
+   private:
+      enum
+      {
+         LevelBits = 8,
+         Levels = 4,
+         Slots = 1 << LevelBits,
+         SlotMask = Slots - 1
+      };
+
+      static const UInt32 Nil = 0xFFFFFFFFU;
+
+      struct Node
+      {
+         Node(const T& timer) :
+            mTimer(timer),
+            mNext(Nil),
+            mPrev(Nil),
+            mSlot(Nil),
+            mSerial(0)
+         {}
+
+         T mTimer;
+         UInt32 mNext;
+         UInt32 mPrev;
+         UInt32 mSlot;    // Nil unless the timer is pending
+         UInt32 mSerial;  // bumped on each reuse so that stale Ids miss
+      };
+
+      bool lookup(Id id, UInt32& index) const
+      {
+         const UInt32 low = UInt32(id & 0xFFFFFFFFU);
+         if (low == 0 || low > mNodes.size())
+         {
+            return false;
+         }
+         index = low - 1;
+         const Node& node = mNodes[index];
+         return node.mSlot != Nil && node.mSerial == UInt32(id >> 32);
+      }
+
+      void file(UInt32 index)
+      {
+         Node& node = mNodes[index];
+         UInt64 tick = node.mTimer.getWhen();
+         if (tick < mCurrent)
+         {
+            tick = mCurrent;
+         }
+
+         const UInt64 delta = tick - mCurrent;
+         UInt32 level = 0;
+         while (level < Levels - 1 && delta >> ((level + 1)*LevelBits))
+         {
+            ++level;
+         }
+         if (delta > 0xFFFFFFFFU)
+         {
+            // beyond the top level; park it as far out as possible and let
+            // the cascade re-file it
+            tick = mCurrent + 0xFFFFFFFFU;
+         }
+
+         const UInt32 slot = level*Slots + UInt32((tick >> (level*LevelBits)) & SlotMask);
+         node.mSlot = slot;
+         node.mNext = Nil;
+         node.mPrev = mTails[slot];
+         if (mTails[slot] == Nil)
+         {
+            mHeads[slot] = index;
+         }
+         else
+         {
+            mNodes[mTails[slot]].mNext = index;
+         }
+         mTails[slot] = index;
+         ++mLevelCount[level];
+      }
+
+      void unlink(UInt32 index)
+      {
+         Node& node = mNodes[index];
+         const UInt32 slot = node.mSlot;
+         if (node.mPrev == Nil)
+         {
+            mHeads[slot] = node.mNext;
+         }
+         else
+         {
+            mNodes[node.mPrev].mNext = node.mNext;
+         }
+         if (node.mNext == Nil)
+         {
+            mTails[slot] = node.mPrev;
+         }
+         else
+         {
+            mNodes[node.mNext].mPrev = node.mPrev;
+         }
+         --mLevelCount[slot >> LevelBits];
+         node.mSlot = Nil;
+      }
+
+      // Moves the timers in the current slot of {level} down the wheel; called
+      // when every level below has just turned over.
+      void cascade(UInt32 level)
+      {
+         const UInt32 slot = level*Slots + UInt32((mCurrent >> (level*LevelBits)) & SlotMask);
+         if (slot == level*Slots && level < Levels - 1)
+         {
+            cascade(level + 1);
+         }
+
+         UInt32 index = mHeads[slot];
+         mHeads[slot] = Nil;
+         mTails[slot] = Nil;
+         while (index != Nil)
+         {
+            const UInt32 next = mNodes[index].mNext;
+            --mLevelCount[level];
+            file(index);
+            index = next;
+         }
+      }
+
+      // The earliest timer on each level is in the first occupied slot from
+      // the current position onwards; take the best of those. The current
+      // slot of an upper level has already been cascaded (and can only hold
+      // timers a whole turn away) unless the wheel is sitting exactly on the
+      // tick that will cascade it.
+      void findNext() const
+      {
+         UInt32 best = Nil;
+         for (UInt32 level = 0; level < Levels; ++level)
+         {
+            if (mLevelCount[level] == 0)
+            {
+               continue;
+            }
+
+            const UInt32 shift = level*LevelBits;
+            const UInt32 first = (mCurrent & ((UInt64(1) << shift) - 1)) ? 1 : 0;
+            for (UInt32 offset = first; offset < Slots + first; ++offset)
+            {
+               const UInt32 slot = level*Slots + UInt32(((mCurrent >> shift) + offset) & SlotMask);
+               if (mHeads[slot] == Nil)
+               {
+                  continue;
+               }
+
+               const UInt64 slotStart = ((mCurrent >> shift) + offset) << shift;
+               if (best == Nil || slotStart < mNodes[best].mTimer.getWhen())
+               {
+                  for (UInt32 i = mHeads[slot]; i != Nil; i = mNodes[i].mNext)
+                  {
+                     if (best == Nil || mNodes[i].mTimer.getWhen() < mNodes[best].mTimer.getWhen())
+                     {
+                        best = i;
+                     }
+                  }
+               }
+               break;
+            }
+         }
+
+         resip_assert(best != Nil);
+         mNextIndex = best;
+         mNextValid = true;
+      }
+
+      std::deque<Node> mNodes;
+      std::vector<UInt32> mFree;
+      UInt32 mHeads[Levels*Slots];
+      UInt32 mTails[Levels*Slots];
+      size_t mLevelCount[Levels];
+      size_t mSize;
+      // the next tick (in ms) that expire() will look at
+      UInt64 mCurrent;
+      mutable UInt32 mNextIndex;
+      mutable bool mNextValid;
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -124,7 +124,7 @@ unsigned int
 DnsStub::getTimeTillNextProcessMS()
 {
     if(mCommandFifo.size() > 0) return 0;
-    return mDnsProvider->getTimeTillNextProcessMS();
+    return resipMin(mDnsProvider->getTimeTillNextProcessMS(), mRRCache.getTimeTillNextExpiryMS());
 }
 
 void
@@ -134,6 +134,20 @@ DnsStub::buildFdSet(FdSet& fdset)
    mSelectInterruptor.buildFdSet(fdset);
 }
 
+// Replaces target with its CNAME if that is cached, from any thread
+bool
+DnsStub::followCachedCname(int rrType, Data& target)
+{
+   std::vector<DnsCnameRecord> cnames;
+   int status = 0;
+   if (rrType == T_CNAME || !mRRCache.lookupCopy(target, T_CNAME, cnames, status) || cnames.empty())
+   {
+      return false;
+   }
+   target = cnames[0].cname();
+   return true;
+}
+
 void
 DnsStub::processFifo()
 {
@@ -149,6 +163,7 @@ void
 DnsStub::process(FdSet& fdset)
 {
    mSelectInterruptor.process(fdset);
+   mRRCache.expire();
    processFifo();
    mDnsProvider->process(fdset.read, fdset.write);
 }
@@ -157,6 +172,7 @@ void
 DnsStub::processTimers()
 {
    // the fifo is captures as a timer within getTimeTill... above
+   mRRCache.expire();
    processFifo();
    mDnsProvider->processTimers();
 }
@@ -179,6 +179,8 @@ class DnsStub : public ExternalDnsHandler
       void getDnsCacheDump(std::pair<unsigned long, unsigned long> key, GetDnsCacheDumpHandler* handler);
       void setDnsCacheTTL(int ttl);
       void setDnsCacheSize(int size);
+      // hits, misses, expiries and evictions; may be called from any thread
+      RRCache::CacheStats getDnsCacheStats() const { return mRRCache.getStats(); }
       void reloadDnsServers();
       bool checkDnsChange();
       bool supportedType(int);
@@ -201,6 +203,46 @@ class DnsStub : public ExternalDnsHandler
          queueCommand(command);
       }
 
+      // Whether lookupCached() can be used: not where rutil/AtomicOps.hxx has
+      // no atomics for the platform, or when a ResultTransform is set, as it
+      // is only safe on the DNS thread.  setResultTransform() is expected
+      // before lookups start.
+      bool isCacheReadable() const
+      {
+#ifdef RESIP_HAVE_ATOMICS
+         return mTransform == 0;
+#else
+         return false;
+#endif
+      }
+
+      // Answers a lookup from the cache, following cached CNAMEs as
+      // lookup() does, without queueing it to the DNS thread: may be called
+      // from any thread if isCacheReadable(), and fills result on the
+      // calling thread.  Returns false if the answer isn't (all) cached, when
+      // lookup() is needed.
+      template<class QueryType> bool lookupCached(const Data& target, DNSResult<typename QueryType::Type>& result)
+      {
+         if (!isCacheReadable())
+         {
+            return false;
+         }
+         const int rrType = QueryType::getRRType();
+         Data targetToQuery(target);
+         int status = 0;
+         for (int cnames = 0; !mRRCache.lookupCopy(targetToQuery, rrType, result.records, status); ++cnames)
+         {
+            if (cnames == Query::MAX_REQUERIES || !followCachedCname(rrType, targetToQuery))
+            {
+               return false;
+            }
+         }
+         result.domain = target;
+         result.status = status;
+         result.msg = errorMessage(status);
+         return true;
+      }
+
       virtual void handleDnsRaw(ExternalDnsRawResult);
 
       virtual void process(FdSet& fdset);
@@ -213,6 +255,7 @@ class DnsStub : public ExternalDnsHandler
 
   private:
       void processFifo();
+      bool followCachedCname(int rrType, Data& target);
 
    protected:
       void cache(const Data& key, in_addr addr);
@@ -23,9 +23,9 @@
 #endif
 #endif
 
-#include <set>
+#include <algorithm>
+#include <climits>
 #include <vector>
-#include <list>
 #include <map>
 #include "rutil/ResipAssert.h"
 #include "rutil/BaseException.hxx"
@@ -46,12 +46,92 @@
 using namespace resip;
 using namespace std;
 
+namespace
+{
+const UInt32 InitialSlots = 64;
+// expiries are clamped to this (secs) so that they can be kept in ms
+const UInt64 MaxExpiry = UInt64(1) << 40;
+
+class DiscardExpiry
+{
+   public:
+      template<class T> void operator()(const T&) {}
+};
+}
+
+// Removes each RRList whose expiry comes round
+class RRCache::ExpireList
+{
+   public:
+      ExpireList(RRCache& cache) : mCache(cache) {}
+      void operator()(const Expiry& expiry)
+      {
+         UInt32 slot;
+         if (mCache.findSlot(expiry.mList, slot))
+         {
+            mCache.remove(expiry.mList, slot);
+            mCache.mExpired++;
+         }
+      }
+   private:
+      RRCache& mCache;
+};
+
+RRCache::Table::Table(UInt32 slots)
+   : mMask(slots - 1),
+     mSlots(new RRList* volatile[slots])
+{
+   resip_assert((slots & mMask) == 0);
+   for (UInt32 i = 0; i < slots; ++i)
+   {
+      mSlots[i] = 0;
+   }
+}
+
+RRCache::Table::~Table()
+{
+   delete [] mSlots;
+}
+
+RRCache::ReadGuard::ReadGuard(RRCache& cache)
+   : mCache(cache)
+{
+   // If the epoch moves on between reading it and being counted in it, the
+   // writer may already have looked at that count; count again in the new
+   // epoch
+   for (;;)
+   {
+      mEpoch = atomicLoad(&mCache.mEpoch);
+      atomicAdd(&mCache.mReaders[mEpoch & 1], 1);
+      if (atomicLoad(&mCache.mEpoch) == mEpoch)
+      {
+         break;
+      }
+      atomicAdd(&mCache.mReaders[mEpoch & 1], -1);
+   }
+}
+
+RRCache::ReadGuard::~ReadGuard()
+{
+   atomicAdd(&mCache.mReaders[mEpoch & 1], -1);
+}
+
 RRCache::RRCache() 
-   : mHead(),
-     mLruHead(LruListType::makeList(&mHead)),
+   : mTable(new Table(InitialSlots)),
+     mRemoved(),
+     mCount(0),
+     mUsed(0),
+     mClockHand(0),
+     mEpoch(0),
+     mHits(0),
+     mMisses(0),
+     mExpired(0),
+     mEvicted(0),
      mUserDefinedTTL(DEFAULT_USER_DEFINED_TTL),
      mSize(DEFAULT_SIZE)
 {
+   mReaders[0] = 0;
+   mReaders[1] = 0;
    mFactoryMap[T_CNAME] = &mCnameRecordFactory;
    mFactoryMap[T_NAPTR] = &mNaptrRecordFacotry;
    mFactoryMap[T_SRV] = &mSrvRecordFactory;
@@ -64,28 +144,26 @@ RRCache::RRCache()
 RRCache::~RRCache()
 {
    cleanup();
-}
 
-void 
-RRCache::updateCacheFromHostFile(const DnsHostRecord &record)
-{
-   //FactoryMap::iterator it = mFactoryMap.find(T_A);
-   RRList* key = new RRList(record, 3600);         
-   RRSet::iterator lb = mRRSet.lower_bound(key);
-   if (lb != mRRSet.end() &&
-       !(mRRSet.key_comp()(key, *lb)))
+   // nobody can be reading any more
+   mPending.insert(mPending.end(), mRetired.begin(), mRetired.end());
+   mPendingTables.insert(mPendingTables.end(), mRetiredTables.begin(), mRetiredTables.end());
+   for (std::vector<RRList*>::iterator it = mPending.begin(); it != mPending.end(); ++it)
    {
-      (*lb)->update(record, 3600);
-      touch(*lb);
+      delete *it;
    }
-   else
+   for (std::vector<Table*>::iterator it = mPendingTables.begin(); it != mPendingTables.end(); ++it)
    {
-      RRList* val = new RRList(record, 3600);
-      mRRSet.insert(val);
-      mLruHead->push_back(val);
-      purge();
+      delete *it;
    }
-   delete key;
+   delete mTable;
+}
+
+void 
+RRCache::updateCacheFromHostFile(const DnsHostRecord &record)
+{
+   insert(new RRList(record, 3600));
+   reclaim();
 }
 
 void 
@@ -97,22 +175,8 @@ RRCache::updateCache(const Data& target,
    Data domain = (*begin).domain();
    FactoryMap::iterator it = mFactoryMap.find(rrType);
    resip_assert(it != mFactoryMap.end());
-   RRList* key = new RRList(domain, rrType);         
-   RRSet::iterator lb = mRRSet.lower_bound(key);
-   if (lb != mRRSet.end() &&
-       !(mRRSet.key_comp()(key, *lb)))
-   {
-      (*lb)->update(it->second, begin, end, mUserDefinedTTL);
-      touch(*lb);
-   }
-   else
-   {
-      RRList* val = new RRList(it->second, domain, rrType, begin, end, mUserDefinedTTL);
-      mRRSet.insert(val);
-      mLruHead->push_back(val);
-      purge();
-   }
-   delete key;
+   insert(new RRList(it->second, domain, rrType, begin, end, mUserDefinedTTL));
+   reclaim();
 }
 
 void 
@@ -133,17 +197,8 @@ RRCache::cacheTTL(const Data& target,
       ttl = mUserDefinedTTL;
    }
 
-   RRList* val = new RRList(target, rrType, ttl, status);
-   RRSet::iterator it = mRRSet.find(val);
-   if (it != mRRSet.end())
-   {
-      (*it)->remove();
-      delete *it;
-      mRRSet.erase(it);
-   }
-   mRRSet.insert(val);
-   mLruHead->push_back(val);
-   purge();
+   insert(new RRList(target, rrType, ttl, status));
+   reclaim();
 }
 
 bool 
@@ -153,55 +208,262 @@ RRCache::lookup(const Data& target,
                 Result& records, 
                 int& status)
 {
-   records.empty();
+   records.clear();
    status = 0;
-   RRList* key = new RRList(target, type);
-   RRSet::iterator it = mRRSet.find(key);
-   delete key;
-   if (it == mRRSet.end())
+   RRList* list = find(target, type);
+   if (list == 0)
    {
       return false;
    }
-   else
+   records = list->records(protocol);
+   status = list->status();
+   return true;
+}
+
+void
+RRCache::expire()
+{
+   ExpireList fire(*this);
+   mExpiries.expire(Timer::getTimeMs(), fire);
+   reclaim();
+}
+
+unsigned int
+RRCache::getTimeTillNextExpiryMS() const
+{
+   if (mExpiries.empty())
+   {
+      return INT_MAX;
+   }
+   UInt64 next = mExpiries.nextWhen();
+   UInt64 now = Timer::getTimeMs();
+   return next <= now ? 0 : (unsigned int)resipMin(next - now, (UInt64)INT_MAX);
+}
+
+void 
+RRCache::clearCache()
+{
+   cleanup();
+   reclaim();
+}
+
+RRCache::CacheStats
+RRCache::getStats() const
+{
+   CacheStats stats;
+   stats.mHits = atomicLoad(const_cast<volatile UInt64*>(&mHits));
+   stats.mMisses = atomicLoad(const_cast<volatile UInt64*>(&mMisses));
+   stats.mExpired = atomicLoad(const_cast<volatile UInt64*>(&mExpired));
+   stats.mEvicted = atomicLoad(const_cast<volatile UInt64*>(&mEvicted));
+   stats.mSize = (size_t)atomicLoad(const_cast<volatile Int32*>(&mCount));
+   return stats;
+}
+
+RRList*
+RRCache::find(const Data& target, int type)
+{
+   size_t hash = RRList::hash(target, type);
+   Table* table = atomicLoad(&mTable);
+   for (UInt32 slot = (UInt32)hash & table->mMask; ; slot = (slot + 1) & table->mMask)
    {
-      if (Timer::getTimeSecs() >= (*it)->absoluteExpiry())
+      RRList* list = atomicLoad(&table->mSlots[slot]);
+      if (list == 0)
       {
-         delete *it;
-         mRRSet.erase(it);
-         return false;
+         atomicAdd(&mMisses, 1);
+         return 0;
       }
-      else
+      if (list != &mRemoved && list->matches(hash, target, type))
+      {
+         list->reference();
+         atomicAdd(&mHits, 1);
+         return list;
+      }
+   }
+}
+
+void
+RRCache::insert(RRList* list)
+{
+   Table* table = mTable;
+   for (UInt32 slot = (UInt32)list->hash() & table->mMask; table->mSlots[slot] != 0; slot = (slot + 1) & table->mMask)
+   {
+      RRList* found = table->mSlots[slot];
+      if (found != &mRemoved && found->matches(list->hash(), list->key(), list->rrType()))
+      {
+         mExpiries.cancel(found->expiryTimer());
+         atomicExchange(&table->mSlots[slot], list);
+         retire(found);
+         list->expiryTimer() = mExpiries.add(Expiry(resipMin(list->absoluteExpiry(), MaxExpiry) * 1000, list));
+         return;
+      }
+   }
+
+   if ((UInt32)mCount >= mSize && mCount > 0)
+   {
+      evict();
+   }
+   if ((mUsed + 1) * 2 > table->mMask + 1)
+   {
+      grow();
+      table = mTable;
+   }
+
+   // the key isn't in the table, so the first Removed slot will do
+   UInt32 slot = (UInt32)list->hash() & table->mMask;
+   while (table->mSlots[slot] != 0 && table->mSlots[slot] != &mRemoved)
+   {
+      slot = (slot + 1) & table->mMask;
+   }
+   if (table->mSlots[slot] == 0)
+   {
+      mUsed++;
+   }
+   atomicExchange(&table->mSlots[slot], list);
+   atomicAdd(&mCount, 1);
+   list->expiryTimer() = mExpiries.add(Expiry(resipMin(list->absoluteExpiry(), MaxExpiry) * 1000, list));
+}
+
+void
+RRCache::remove(RRList* list, UInt32 slot)
+{
+   // the slot stays used, so that probes carry on past it
+   atomicExchange(&mTable->mSlots[slot], &mRemoved);
+   atomicAdd(&mCount, -1);
+   retire(list);
+}
+
+bool
+RRCache::findSlot(RRList* list, UInt32& slot) const
+{
+   Table* table = mTable;
+   for (slot = (UInt32)list->hash() & table->mMask; table->mSlots[slot] != 0; slot = (slot + 1) & table->mMask)
+   {
+      if (table->mSlots[slot] == list)
       {
-         records = (*it)->records(protocol);
-         status = (*it)->status();
-         touch(*it);
          return true;
       }
    }
+   return false;
 }
 
-void 
-RRCache::clearCache()
+void
+RRCache::grow()
 {
-    cleanup();
+   // rebuilt without the Removed slots, at most a quarter full
+   UInt32 slots = InitialSlots;
+   while (slots < ((UInt32)mCount + 1) * 4)
+   {
+      slots *= 2;
+   }
+
+   Table* old = mTable;
+   Table* table = new Table(slots);
+   for (UInt32 i = 0; i <= old->mMask; ++i)
+   {
+      RRList* list = old->mSlots[i];
+      if (list != 0 && list != &mRemoved)
+      {
+         UInt32 slot = (UInt32)list->hash() & table->mMask;
+         while (table->mSlots[slot] != 0)
+         {
+            slot = (slot + 1) & table->mMask;
+         }
+         table->mSlots[slot] = list;
+      }
+   }
+   mUsed = (UInt32)mCount;
+   mClockHand = 0;
+
+   // readers may still be probing the old table
+   atomicExchange(&mTable, table);
+   mRetiredTables.push_back(old);
 }
 
-void 
-RRCache::touch(RRList* node)
+void
+RRCache::evict()
 {
-   node->remove();
-   mLruHead->push_back(node);
+   // CLOCK: take the first RRList that hasn't been looked up since the hand
+   // last went past it; two turns always find one
+   Table* table = mTable;
+   for (UInt32 n = 0; n <= 2 * (table->mMask + 1); ++n)
+   {
+      UInt32 slot = mClockHand++ & table->mMask;
+      RRList* list = table->mSlots[slot];
+      if (list == 0 || list == &mRemoved)
+      {
+         continue;
+      }
+      if (list->referenced())
+      {
+         list->clearReferenced();
+         continue;
+      }
+      mExpiries.cancel(list->expiryTimer());
+      remove(list, slot);
+      mEvicted++;
+      return;
+   }
 }
 
 void 
 RRCache::cleanup()
 {
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); it++)
+   Table* old = mTable;
+   for (UInt32 i = 0; i <= old->mMask; ++i)
+   {
+      RRList* list = old->mSlots[i];
+      if (list != 0 && list != &mRemoved)
+      {
+         retire(list);
+      }
+   }
+   DiscardExpiry discard;
+   mExpiries.clear(discard);
+   atomicExchange(&mCount, 0);
+   mUsed = 0;
+   mClockHand = 0;
+
+   atomicExchange(&mTable, new Table(InitialSlots));
+   mRetiredTables.push_back(old);
+}
+
+void
+RRCache::retire(RRList* list)
+{
+   mRetired.push_back(list);
+}
+
+void
+RRCache::reclaim()
+{
+   if (mRetired.empty() && mRetiredTables.empty() &&
+       mPending.empty() && mPendingTables.empty())
+   {
+      return;
+   }
+
+   // What is pending was retired before the current epoch began, so only
+   // readers counted in the previous epoch can still see it.  If any of
+   // them are still reading, try again after the next change.
+   Int32 epoch = atomicLoad(&mEpoch);
+   if (atomicLoad(&mReaders[(epoch - 1) & 1]) != 0)
+   {
+      return;
+   }
+
+   for (std::vector<RRList*>::iterator it = mPending.begin(); it != mPending.end(); ++it)
+   {
+      delete *it;
+   }
+   for (std::vector<Table*>::iterator it = mPendingTables.begin(); it != mPendingTables.end(); ++it)
    {
-      (*it)->remove();
       delete *it;
    }
-   mRRSet.clear();
+   mPending.clear();
+   mPendingTables.clear();
+   mPending.swap(mRetired);
+   mPendingTables.swap(mRetiredTables);
+   atomicAdd(&mEpoch, 1);
 }
 
 int 
@@ -223,54 +485,42 @@ RRCache::getTTL(const RROverlay& overlay)
    return DNS__32BIT(pPos);         
 }
 
-void 
-RRCache::purge()
+void
+RRCache::getSortedLists(std::vector<RRList*>& lists)
 {
-   if (mRRSet.size() < mSize) return;
-   RRList* lst = *(mLruHead->begin());
-   RRSet::iterator it = mRRSet.find(lst);
-   resip_assert(it != mRRSet.end());
-   lst->remove();
-   delete *it;
-   mRRSet.erase(it);
+   expire();
+   Table* table = mTable;
+   for (UInt32 i = 0; i <= table->mMask; ++i)
+   {
+      RRList* list = table->mSlots[i];
+      if (list != 0 && list != &mRemoved)
+      {
+         lists.push_back(list);
+      }
+   }
+   std::sort(lists.begin(), lists.end(), CompareT());
 }
 
 void 
 RRCache::logCache()
 {
-   UInt64 now = Timer::getTimeSecs();
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); )
+   std::vector<RRList*> lists;
+   getSortedLists(lists);
+   for (std::vector<RRList*>::iterator it = lists.begin(); it != lists.end(); ++it)
    {
-      if (now >= (*it)->absoluteExpiry())
-      {
-         delete *it;
-         mRRSet.erase(it++);
-      }
-      else
-      {
-         (*it)->log();
-         ++it;
-      }
+      (*it)->log();
    }
 }
 
 void 
 RRCache::getCacheDump(Data& dnsCacheDump)
 {
-   UInt64 now = Timer::getTimeSecs();
+   std::vector<RRList*> lists;
+   getSortedLists(lists);
    DataStream strm(dnsCacheDump);
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); )
+   for (std::vector<RRList*>::iterator it = lists.begin(); it != lists.end(); ++it)
    {
-      if (now >= (*it)->absoluteExpiry())
-      {
-         delete *it;
-         mRRSet.erase(it++);
-      }
-      else
-      {
-         (*it)->encodeRRList(strm);
-         ++it;
-      }
+      (*it)->encodeRRList(strm);
    }
    strm.flush();
 }
@@ -2,9 +2,11 @@
 #define RESIP_RRCACHE_HXX
 
 #include <map>
-#include <set>
+#include <vector>
 #include <memory>
 
+#include "rutil/AtomicOps.hxx"
+#include "rutil/TimerWheel.hxx"
 #include "rutil/dns/RRFactory.hxx"
 #include "rutil/dns/DnsResourceRecord.hxx"
 #include "rutil/dns/DnsAAAARecord.hxx"
@@ -18,15 +20,43 @@ namespace resip
 {
 class RROverlay;
 
+/**
+   The DNS cache, an open addressing hash table of RRLists keyed on
+   (target, rrType).
+
+   Only one thread - the one running the DnsStub - may change the cache or
+   call lookup(), whose results point into the cache and are only valid
+   until it next changes.  lookupCopy() may be called from any thread at
+   the same time, without taking a lock: replaced and evicted RRLists (and
+   outgrown tables) are only deleted once every lookupCopy() that could
+   still see them has finished, which is tracked with a pair of reader
+   counts that alternate between epochs.  Where rutil/AtomicOps.hxx has no
+   atomics for the platform, lookupCopy() is only safe on the DnsStub
+   thread.
+
+   Records expire through a TimerWheel run by expire(), not when they are
+   looked up.  Once the cache is full, adding a name evicts one that has not
+   been looked up since the clock hand last passed it (CLOCK, an
+   approximation of LRU that lookups can maintain from any thread).
+*/
 class RRCache
 {
    public:
       typedef RRList::Protocol Protocol;
-      typedef RRList::LruList LruListType;
       typedef RRList::Records Result;
       typedef std::vector<RROverlay>::const_iterator Itr;
       typedef std::vector<Data> DataArr;
 
+      struct CacheStats
+      {
+         CacheStats() : mHits(0), mMisses(0), mExpired(0), mEvicted(0), mSize(0) {}
+         UInt64 mHits;
+         UInt64 mMisses;
+         UInt64 mExpired;
+         UInt64 mEvicted;
+         size_t mSize;
+      };
+
       RRCache();
       ~RRCache();
       void setTTL(int ttl) { if (ttl > 0) mUserDefinedTTL = ttl * MIN_TO_SEC; }
@@ -43,15 +73,43 @@ class RRCache
                     const int status,
                     RROverlay overlay);
       bool lookup(const Data& target, const int type, const int proto, Result& records, int& status);
+
+      // Copies the records cached for (target, type) into records, from any
+      // thread.  T is the record class for type, eg. DnsSrvRecord for T_SRV.
+      template<class T>
+      bool lookupCopy(const Data& target, const int type, std::vector<T>& records, int& status)
+      {
+         ReadGuard guard(*this);
+         RRList* list = find(target, type);
+         if (list == 0)
+         {
+            return false;
+         }
+         Result found = list->records(Protocol::Reserved);
+         for (Result::const_iterator it = found.begin(); it != found.end(); ++it)
+         {
+            records.push_back(*dynamic_cast<T*>(*it));
+         }
+         status = list->status();
+         return true;
+      }
+
+      // Removes the records that have expired; and how long until the next
+      // ones do (INT_MAX if none are cached)
+      void expire();
+      unsigned int getTimeTillNextExpiryMS() const;
+
       void clearCache();
       void logCache();
       void getCacheDump(Data& dnsCacheDump);
+      CacheStats getStats() const;
 
    private:
       static const int MIN_TO_SEC = 60;
       static const int DEFAULT_USER_DEFINED_TTL = 10; // in seconds.
 
       static const int DEFAULT_SIZE = 512;
+
       class CompareT  : public std::binary_function<const RRList*, const RRList*, bool>
       {
          public:
@@ -72,17 +130,76 @@ class RRCache
             }
       };
 
-      void touch(RRList* node);
+      // A power of two number of slots, each empty (0), an RRList, or
+      // Removed.  Kept at most half full, counting the Removed slots, so
+      // that every probe ends at an empty slot.
+      struct Table
+      {
+         Table(UInt32 slots);
+         ~Table();
+         UInt32 mMask;
+         RRList* volatile* mSlots;
+      };
+
+      // Marks the end of the expiry of an RRList
+      class Expiry
+      {
+         public:
+            Expiry() : mWhen(0), mList(0) {}
+            Expiry(UInt64 when, RRList* list) : mWhen(when), mList(list) {}
+            UInt64 getWhen() const { return mWhen; }
+            UInt64 mWhen;
+            RRList* mList;
+      };
+
+      class ExpireList;
+      friend class ExpireList;
+
+      // Counts lookupCopy() in the reader count for the current epoch
+      class ReadGuard
+      {
+         public:
+            ReadGuard(RRCache& cache);
+            ~ReadGuard();
+         private:
+            RRCache& mCache;
+            Int32 mEpoch;
+      };
+      friend class ReadGuard;
+
+      RRList* find(const Data& target, int type);
+      void insert(RRList* list);
+      void remove(RRList* list, UInt32 slot);
+      bool findSlot(RRList* list, UInt32& slot) const;
+      void grow();
+      void evict();
       void cleanup();
+      void getSortedLists(std::vector<RRList*>& lists);
       int getTTL(const RROverlay& overlay);
-      void purge();
+      void retire(RRList* list);
+      void reclaim();
+
+      Table* volatile mTable;
+      RRList mRemoved;
+      volatile Int32 mCount; // RRLists in mTable; read by getStats() on any thread
+      UInt32 mUsed;        // RRLists and Removed slots in mTable
+      UInt32 mClockHand;
+
+      TimerWheel<Expiry> mExpiries;
 
-      RRList mHead;
-      LruListType* mLruHead;                     
-      Result Empty;
+      // retired since the epoch began, and retired before it began (waiting
+      // for the readers of the previous epoch to finish)
+      std::vector<RRList*> mRetired;
+      std::vector<Table*> mRetiredTables;
+      std::vector<RRList*> mPending;
+      std::vector<Table*> mPendingTables;
+      volatile Int32 mEpoch;
+      volatile Int32 mReaders[2];
 
-      typedef std::set<RRList*, CompareT> RRSet;
-      RRSet mRRSet;
+      volatile UInt64 mHits;
+      volatile UInt64 mMisses;
+      volatile UInt64 mExpired;
+      volatile UInt64 mEvicted;
 
       RRFactory<DnsHostRecord> mHostRecordFactory;
       RRFactory<DnsSrvRecord> mSrvRecordFactory;
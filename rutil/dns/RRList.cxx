@@ -36,35 +36,30 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM resip::Subsystem::DNS
 
-RRList::RRList() : mRRType(0), mStatus(0), mAbsoluteExpiry(ULONG_MAX) {}
+RRList::RRList()
+   : mRRType(0), mHash(0), mStatus(0), mAbsoluteExpiry(ULONG_MAX), mReferenced(0), mExpiryTimer(0)
+{}
 
 RRList::RRList(const Data& key, 
                const int rrtype, 
                int ttl, 
                int status)
-   : mKey(key), mRRType(rrtype), mStatus(status)
+   : mKey(key), mRRType(rrtype), mHash(hash(key, rrtype)), mStatus(status), mReferenced(0), mExpiryTimer(0)
 {
    mAbsoluteExpiry = ttl + Timer::getTimeSecs();
 }
 
 RRList::RRList(const DnsHostRecord &record, int ttl)
-   : mKey(record.name()), mRRType(T_A), mStatus(0), mAbsoluteExpiry(ULONG_MAX)
-{
-   update(record, ttl);
-}
-
-void RRList::update(const DnsHostRecord &record, int ttl)
+   : mKey(record.name()), mRRType(T_A), mHash(hash(mKey, T_A)), mStatus(0), mReferenced(0), mExpiryTimer(0)
 {
-   this->clear();
-
    RecordItem item;
    item.record = new DnsHostRecord(record);
    mRecords.push_back(item);
    mAbsoluteExpiry = Timer::getTimeSecs() + ttl;
 }
-      
+
 RRList::RRList(const Data& key, int rrtype)
-   : mKey(key), mRRType(rrtype), mStatus(0), mAbsoluteExpiry(ULONG_MAX)
+   : mKey(key), mRRType(rrtype), mHash(hash(key, rrtype)), mStatus(0), mAbsoluteExpiry(ULONG_MAX), mReferenced(0), mExpiryTimer(0)
 {}
 
 RRList::~RRList()
@@ -78,16 +73,8 @@ RRList::RRList(const RRFactoryBase* factory,
                Itr begin,
                Itr end, 
                int ttl)
-   : mKey(key), mRRType(rrType), mStatus(0)
+   : mKey(key), mRRType(rrType), mHash(hash(key, rrType)), mStatus(0), mAbsoluteExpiry(ULONG_MAX), mReferenced(0), mExpiryTimer(0)
 {
-   update(factory, begin, end, ttl);
-}
-      
-void RRList::update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl)
-{
-   this->clear();
-   mAbsoluteExpiry = ULONG_MAX;
-   
    for (Itr it = begin; it != end; it++)
    {
       try
@@ -114,6 +101,11 @@ void RRList::update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl)
    mAbsoluteExpiry += Timer::getTimeSecs();
 }
 
+size_t RRList::hash(const Data& key, int rrType)
+{
+   return key.caseInsensitivehash() * 31 + (size_t)rrType;
+}
+
 RRList::Records RRList::records(const int protocol)
 {
    Records records;
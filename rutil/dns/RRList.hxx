@@ -3,7 +3,6 @@
 
 #include <vector>
 
-#include "rutil/IntrusiveListElement.hxx"
 #include "rutil/dns/RRFactory.hxx"
 
 namespace resip
@@ -11,7 +10,11 @@ namespace resip
 class DnsResourceRecord;
 class DnsHostRecord;
 
-class RRList : public IntrusiveListElement<RRList*>
+// The records cached for one (key, rrType).  Once it has been added to the
+// RRCache an RRList is never modified, apart from the cache's own
+// bookkeeping, since it may be read from any thread; a new answer for the
+// same key replaces it with a new RRList.
+class RRList
 {
    public:
 
@@ -26,7 +29,6 @@ class RRList : public IntrusiveListElement<RRList*>
       };
 
       typedef std::vector<DnsResourceRecord*> Records;
-      typedef IntrusiveListElement<RRList*> LruList;
       typedef std::vector<RROverlay>::const_iterator Itr;
       typedef std::vector<Data> DataArr;
 
@@ -42,9 +44,7 @@ class RRList : public IntrusiveListElement<RRList*>
              int ttl);
       
       RRList(const DnsHostRecord &record, int ttl);
-      void update(const DnsHostRecord &record, int ttl);
 
-      void update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl);
       Records records(const int protocol);
 
       const Data& key() const { return mKey; }
@@ -55,6 +55,21 @@ class RRList : public IntrusiveListElement<RRList*>
       void log();
       EncodeStream& encodeRRList(EncodeStream& strm);
 
+      // case insensitive on key, as DNS names are
+      static size_t hash(const Data& key, int rrType);
+      size_t hash() const { return mHash; }
+      bool matches(size_t hash, const Data& key, int rrType) const
+      {
+         return mHash == hash && mRRType == rrType && isEqualNoCase(mKey, key);
+      }
+
+      // RRCache bookkeeping: the CLOCK reference bit, which readers set from
+      // any thread, and the TimerWheel id of the expiry timer
+      void reference() { if (!mReferenced) mReferenced = 1; }
+      bool referenced() const { return mReferenced != 0; }
+      void clearReferenced() { mReferenced = 0; }
+      UInt64& expiryTimer() { return mExpiryTimer; }
+
    private:
 
       struct RecordItem
@@ -70,10 +85,14 @@ class RRList : public IntrusiveListElement<RRList*>
 
       Data mKey;
       int mRRType;
+      size_t mHash;
 
       int mStatus; // dns query status.
       UInt64 mAbsoluteExpiry;
 
+      volatile int mReferenced;
+      UInt64 mExpiryTimer;
+
       RecordItr find(const Data&);
       void clear();
       EncodeStream& encodeRecordItem(RRList::RecordItem& item, EncodeStream& strm);
@@ -0,0 +1,274 @@
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks that Log::setAsync() hands every line to the ExternalLogger and
+// the log file from the writer thread, each thread's lines in order, and
+// that lines dropped by a full buffer are counted; then times threads
+// logging to a file with and without it (200k lines each by default,
+// override with argv[1]).
+
+namespace
+{
+
+const unsigned int Threads = 4;
+
+// Checks each thread's lines come in order, and on which thread
+class CheckingLogger : public ExternalLogger
+{
+   public:
+      CheckingLogger()
+         : mNext(Threads, 0),
+           mLogging(Threads),
+           mLines(0),
+           mOnWriter(0),
+           mSlow(false)
+      {}
+
+      virtual bool operator()(Log::Level level,
+                              const Subsystem& subsystem,
+                              const Data& appName,
+                              const char* file,
+                              int line,
+                              const Data& message,
+                              const Data& messageWithHeaders)
+      {
+         Lock lock(mMutex);
+         // "<thread> <line>"
+         unsigned int thread = 0;
+         unsigned int n = 0;
+         if (sscanf(message.c_str(), "%u %u", &thread, &n) == 2 && thread < Threads)
+         {
+            assert(n >= mNext[thread]);
+            mNext[thread] = n + 1;
+            mLines++;
+            if (ThreadIf::selfId() != mLogging[thread])
+            {
+               mOnWriter++;
+            }
+            if (mSlow)
+            {
+               sleepMs(1);
+            }
+         }
+         return false;
+      }
+
+      Mutex mMutex;
+      vector<unsigned int> mNext;
+      vector<ThreadIf::Id> mLogging;
+      unsigned int mLines;
+      unsigned int mOnWriter;
+      bool mSlow;
+};
+
+class LogThread : public ThreadIf
+{
+   public:
+      LogThread(unsigned int index, unsigned int lines, CheckingLogger* logger)
+         : mIndex(index),
+           mLines(lines),
+           mLogger(logger)
+      {}
+
+      virtual void thread()
+      {
+         if (mLogger)
+         {
+            Lock lock(mLogger->mMutex);
+            mLogger->mLogging[mIndex] = ThreadIf::selfId();
+         }
+         for (unsigned int n = 0; n < mLines; n++)
+         {
+            InfoLog(<< mIndex << " " << n << " some text to make this about as long as a typical line");
+         }
+      }
+
+      unsigned int mIndex;
+      unsigned int mLines;
+      CheckingLogger* mLogger;
+};
+
+// Runs Threads LogThreads; returns the lines logged per second
+double
+logFromThreads(unsigned int lines, CheckingLogger* logger = 0)
+{
+   vector<LogThread*> threads;
+   for (unsigned int t = 0; t < Threads; t++)
+   {
+      threads.push_back(new LogThread(t, lines, logger));
+   }
+   UInt64 start = Timer::getTimeMicroSec();
+   for (unsigned int t = 0; t < Threads; t++)
+   {
+      threads[t]->run();
+   }
+   for (unsigned int t = 0; t < Threads; t++)
+   {
+      threads[t]->join();
+      delete threads[t];
+   }
+   return (double)Threads * lines * 1000000.0 / (double)(Timer::getTimeMicroSec() - start);
+}
+
+// Counts the lines logged by LogThreads, not those about dropped lines
+unsigned int
+countLines(const char* fileName)
+{
+   ifstream file(fileName);
+   string line;
+   unsigned int lines = 0;
+   while (getline(file, line))
+   {
+      if (line.find("some text") != string::npos)
+      {
+         lines++;
+      }
+   }
+   return lines;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   unsigned int lines = 200000;
+   if (argc > 1)
+   {
+      lines = atoi(argv[1]);
+   }
+
+   // every line reaches the ExternalLogger, from the writer thread
+   {
+      CheckingLogger logger;
+      Log::initialize(Log::OnlyExternal, Log::Info, argv[0], logger);
+      Log::setAsync(4 * 1024 * 1024);
+      assert(Log::isAsync());
+      logFromThreads(10000, &logger);
+      Log::flush();
+      assert(logger.mLines + Log::getDroppedCount() == Threads * 10000);
+      assert(logger.mOnWriter == logger.mLines);
+      cerr << "async: " << logger.mLines << " lines written, " << Log::getDroppedCount() << " dropped" << endl;
+   }
+
+   // a slow logger with a small buffer drops lines, and counts them
+   {
+      CheckingLogger logger;
+      logger.mSlow = true;
+      Log::setAsync(0);
+      Log::initialize(Log::OnlyExternal, Log::Info, argv[0], logger);
+      Log::setAsync(4096);
+      UInt64 dropped = Log::getDroppedCount();
+      logFromThreads(1000, &logger);
+      Log::flush();
+      dropped = Log::getDroppedCount() - dropped;
+      assert(dropped > 0);
+      assert(logger.mLines + dropped == Threads * 1000);
+      cerr << "slow: " << logger.mLines << " lines written, " << dropped << " dropped" << endl;
+
+      // and back on the logging threads
+      Log::setAsync(0);
+      assert(!Log::isAsync());
+      logger.mSlow = false;
+      logger.mLines = 0;
+      logger.mOnWriter = 0;
+      logger.mNext.assign(Threads, 0);
+      logFromThreads(100, &logger);
+      assert(logger.mLines == Threads * 100 && logger.mOnWriter == 0);
+   }
+
+   // to a file, timed against writing on the logging threads
+   {
+      const char* fileName = "testAsyncLog.txt";
+      remove(fileName);
+      Log::initialize(Log::File, Log::Info, argv[0], fileName);
+      double sync = logFromThreads(lines);
+      Log::initialize(Log::File, Log::Info, argv[0], fileName);
+      assert(countLines(fileName) == Threads * lines);
+
+      remove(fileName);
+      Log::initialize(Log::File, Log::Info, argv[0], fileName);
+      Log::setAsync();
+      UInt64 dropped = Log::getDroppedCount();
+      double async = logFromThreads(lines);
+      Log::flush();
+      dropped = Log::getDroppedCount() - dropped;
+      Log::setAsync(0);
+      Log::initialize(Log::File, Log::Info, argv[0], fileName);
+      assert(countLines(fileName) + dropped == Threads * lines);
+      remove(fileName);
+
+      cerr << Threads << " threads logging to a file: " << (unsigned int)sync << " lines/s, "
+           << (unsigned int)async << " lines/s async, of which " << dropped << " dropped" << endl;
+   }
+
+   Log::initialize(Log::Cout, Log::Info, argv[0]);
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
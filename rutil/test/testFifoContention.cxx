@@ -0,0 +1,293 @@
+#include <cassert>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "rutil/Fifo.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Time.hxx"
+#include "rutil/TimeLimitFifo.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks that a Fifo in lock-free mode loses, duplicates and reorders
+// nothing with many producers and one consumer, then compares the
+// throughput of the locked and lock-free modes at 1 to 32 producer threads.
+
+class Item
+{
+   public:
+      Item(unsigned int producer, UInt32 seq) : mProducer(producer), mSeq(seq) {}
+      unsigned int mProducer;
+      UInt32 mSeq;
+};
+
+class Producer : public ThreadIf
+{
+   public:
+      Producer(Fifo<Item>& fifo, unsigned int id, UInt32 count, bool batch)
+         : mFifo(fifo), mId(id), mCount(count), mBatch(batch)
+      {}
+      virtual ~Producer()
+      {
+         shutdown();
+         join();
+      }
+
+      void thread()
+      {
+         if (mBatch)
+         {
+            // Like ProducerFifoBuffer, which the transports feed the
+            // transaction fifo through.
+            Fifo<Item>::Messages batch;
+            for (UInt32 i = 0; i < mCount; ++i)
+            {
+               batch.push_back(new Item(mId, i));
+               if (batch.size() == 8 || i + 1 == mCount)
+               {
+                  mFifo.addMultiple(batch);
+               }
+            }
+         }
+         else
+         {
+            for (UInt32 i = 0; i < mCount; ++i)
+            {
+               mFifo.add(new Item(mId, i));
+            }
+         }
+      }
+
+   private:
+      Fifo<Item>& mFifo;
+      unsigned int mId;
+      UInt32 mCount;
+      bool mBatch;
+};
+
+// Consumes and checks total items from fifo, the way ConsumerFifoBuffer
+// does. Returns how long it took in ms.
+UInt64
+consume(Fifo<Item>& fifo, unsigned int producers, UInt32 total)
+{
+   vector<UInt32> next(producers, 0);
+   UInt64 start = Timer::getTimeMs();
+   UInt32 received = 0;
+   Fifo<Item>::Messages batch;
+   while (received < total)
+   {
+      if (!fifo.getMultiple(5000, batch, 64))
+      {
+         cerr << "Timed out after " << received << " of " << total << " items" << endl;
+         assert(0);
+         exit(-1);
+      }
+      while (!batch.empty())
+      {
+         Item* item = batch.front();
+         batch.pop_front();
+         assert(item->mProducer < producers);
+         assert(item->mSeq == next[item->mProducer]);
+         ++next[item->mProducer];
+         delete item;
+         ++received;
+      }
+   }
+   UInt64 elapsed = Timer::getTimeMs() - start;
+   assert(fifo.empty());
+   assert(fifo.size() == 0);
+   return elapsed ? elapsed : 1;
+}
+
+UInt64
+run(bool lockFree, unsigned int producers, UInt32 total, bool batch)
+{
+   Fifo<Item> fifo;
+   fifo.setLockFree(lockFree);
+
+   UInt32 each = total / producers;
+   vector<Producer*> threads;
+   for (unsigned int p = 0; p < producers; ++p)
+   {
+      threads.push_back(new Producer(fifo, p, each, batch));
+   }
+   for (unsigned int p = 0; p < producers; ++p)
+   {
+      threads[p]->run();
+   }
+   UInt64 elapsed = consume(fifo, producers, each * producers);
+   for (unsigned int p = 0; p < producers; ++p)
+   {
+      delete threads[p];
+   }
+   return elapsed;
+}
+
+void
+testBasics()
+{
+   Fifo<Item> fifo;
+   fifo.setLockFree(true);
+#ifdef RESIP_HAVE_ATOMICS
+   assert(fifo.isLockFree());
+#endif
+   assert(fifo.empty());
+   assert(fifo.getNext(RESIP_FIFO_NOWAIT) == 0);
+
+   // add() reports 1 when the fifo goes non-empty; Fifo uses that to decide
+   // whether to poke the interruptor.
+   assert(fifo.add(new Item(0, 0)) == 1);
+   assert(fifo.messageAvailable());
+   assert(fifo.size() == 1);
+   Fifo<Item>::Messages batch;
+   batch.push_back(new Item(0, 1));
+   batch.push_back(new Item(0, 2));
+   fifo.addMultiple(batch);
+   assert(batch.empty());
+   assert(fifo.size() == 3);
+   for (UInt32 i = 0; i < 3; ++i)
+   {
+      Item* item = fifo.getNext(RESIP_FIFO_NOWAIT);
+      assert(item && item->mSeq == i);
+      delete item;
+   }
+   assert(fifo.empty());
+   assert(fifo.add(new Item(0, 3)) == 1);
+   fifo.add(new Item(0, 4));
+   fifo.clear();
+   assert(fifo.empty());
+   assert(fifo.size() == 0);
+
+   // Blocking getNext() wakes up when a producer adds.
+   fifo.add(new Item(0, 5));
+   delete fifo.getNext();
+   assert(fifo.getNext(10) == 0);
+
+   // Count limits and reservations are enforced without taking the lock.
+   TimeLimitFifo<Item> tlf(0, 10);
+   tlf.setLockFree(true);
+   for (UInt32 i = 0; i < 8; ++i)
+   {
+      assert(tlf.add(new Item(0, i), TimeLimitFifo<Item>::EnforceTimeDepth));
+   }
+   assert(!tlf.add(new Item(0, 8), TimeLimitFifo<Item>::IgnoreTimeDepth));
+   assert(tlf.add(new Item(0, 8), TimeLimitFifo<Item>::InternalElement));
+   assert(tlf.add(new Item(0, 9), TimeLimitFifo<Item>::InternalElement));
+   assert(!tlf.add(new Item(0, 10), TimeLimitFifo<Item>::InternalElement));
+   assert(tlf.getCountDepth() == 10);
+   Item* first = tlf.getNext();
+   assert(first->mSeq == 0);
+   delete first;
+   assert(tlf.size() == 9);
+   assert(tlf.timeDepth() == 0);
+
+   // So is the time depth, from the age of the oldest item as last seen
+   // under the lock by the consumer or by the producer that found the fifo
+   // empty.
+   TimeLimitFifo<Item> aged(2, 0);
+   aged.setLockFree(true);
+   assert(aged.add(new Item(0, 0), TimeLimitFifo<Item>::EnforceTimeDepth));
+   sleepMs(3100);
+   assert(aged.timeDepth() >= 3);
+   assert(!aged.add(new Item(0, 1), TimeLimitFifo<Item>::EnforceTimeDepth));
+   assert(aged.add(new Item(0, 1), TimeLimitFifo<Item>::IgnoreTimeDepth));
+   delete aged.getNext();
+   // the next oldest was only just added
+   assert(aged.timeDepth() <= 1);
+   assert(aged.add(new Item(0, 2), TimeLimitFifo<Item>::EnforceTimeDepth));
+   delete aged.getNext();
+   delete aged.getNext();
+   assert(aged.empty() && aged.timeDepth() == 0);
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   UInt32 total = 320000;
+   if (argc > 1)
+   {
+      total = atoi(argv[1]);
+   }
+
+   testBasics();
+
+   // Correctness under contention, with single and batched adds.
+   run(true, 16, 64000, false);
+   run(true, 16, 64000, true);
+
+   cout << "producers      locked ms    msgs/s   lock-free ms    msgs/s" << endl;
+   for (unsigned int producers = 1; producers <= 32; producers *= 2)
+   {
+      UInt64 locked = run(false, producers, total, false);
+      UInt64 lockFree = run(true, producers, total, false);
+      cout << setw(9) << producers
+           << setw(15) << locked
+           << setw(10) << (UInt64)(total * 1000.0 / locked)
+           << setw(15) << lockFree
+           << setw(10) << (UInt64)(total * 1000.0 / lockFree)
+           << endl;
+   }
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,409 @@
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ParseBuffer.hxx"
+#include "rutil/Socket.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+#include "rutil/dns/DnsHostRecord.hxx"
+#include "rutil/dns/QueryTypes.hxx"
+#include "rutil/dns/RRCache.hxx"
+#include "rutil/dns/RROverlay.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks RRCache lookups, replacement, CLOCK eviction and timer driven
+// expiry, and lookupCopy() from several threads while the cache is being
+// changed under them; then times inserts and lookups with 1M cached names
+// (override with argv[1]).  The expiry check needs the 10 second minimum
+// TTL to pass, so it waits for whatever of that the benchmark didn't use.
+
+namespace
+{
+
+Data
+hostName(UInt32 i)
+{
+   return "host" + Data(i) + ".example.com";
+}
+
+in_addr
+hostAddress(UInt32 i, UInt32 generation = 0)
+{
+   in_addr addr;
+   addr.s_addr = htonl(i * 4 + generation);
+   return addr;
+}
+
+UInt32
+addressOf(const DnsHostRecord& record)
+{
+   return ntohl(record.addr().s_addr);
+}
+
+void
+addHost(RRCache& cache, UInt32 i, UInt32 generation = 0)
+{
+   cache.updateCacheFromHostFile(DnsHostRecord(hostName(i), hostAddress(i, generation)));
+}
+
+// An A record for name in wire format, with a ttl of ttl seconds
+Data
+aRecord(const Data& name, int ttl, UInt32 address)
+{
+   Data rr;
+   ParseBuffer pb(name);
+   while (!pb.eof())
+   {
+      const char* start = pb.position();
+      pb.skipToChar('.');
+      rr += (char)(pb.position() - start);
+      rr.append(start, pb.position() - start);
+      if (!pb.eof())
+      {
+         pb.skipChar();
+      }
+   }
+   rr += (char)0;
+   const unsigned char fixed[] = { 0, 1, 0, 1,
+                                   (unsigned char)(ttl >> 24), (unsigned char)(ttl >> 16), (unsigned char)(ttl >> 8), (unsigned char)ttl,
+                                   0, 4,
+                                   (unsigned char)(address >> 24), (unsigned char)(address >> 16), (unsigned char)(address >> 8), (unsigned char)address };
+   rr.append((const char*)fixed, sizeof(fixed));
+   return rr;
+}
+
+void
+testLookup()
+{
+   RRCache cache;
+   addHost(cache, 1);
+   addHost(cache, 2);
+
+   RRCache::Result records;
+   int status = -1;
+   assert(cache.lookup("HOST1.Example.COM", RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   assert(records.size() == 1 && status == 0);
+   assert(addressOf(*dynamic_cast<DnsHostRecord*>(records[0])) == 4);
+   assert(!cache.lookup(hostName(3), RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   assert(!cache.lookup(hostName(1), RR_SRV::getRRType(), RRCache::Protocol::Sip, records, status));
+
+   // replaced, not added
+   addHost(cache, 1, 1);
+   vector<DnsHostRecord> copies;
+   assert(cache.lookupCopy(hostName(1), RR_A::getRRType(), copies, status));
+   assert(copies.size() == 1 && addressOf(copies[0]) == 5);
+
+   RRCache::CacheStats stats = cache.getStats();
+   assert(stats.mHits == 2 && stats.mMisses == 2 && stats.mSize == 2);
+
+   cache.clearCache();
+   assert(!cache.lookup(hostName(2), RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   assert(cache.getStats().mSize == 0);
+}
+
+void
+testEviction()
+{
+   RRCache cache;
+   cache.setSize(200);
+   for (UInt32 i = 0; i < 200; i++)
+   {
+      addHost(cache, i);
+   }
+
+   // look up the even names, so that the hand passes over them and takes
+   // odd (or newly added) ones instead; sized so the table doesn't have to
+   // be rebuilt meanwhile, which restarts the hand
+   RRCache::Result records;
+   int status;
+   for (UInt32 i = 0; i < 200; i += 2)
+   {
+      assert(cache.lookup(hostName(i), RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   }
+   for (UInt32 i = 200; i < 300; i++)
+   {
+      addHost(cache, i);
+   }
+
+   RRCache::CacheStats stats = cache.getStats();
+   assert(stats.mSize == 200 && stats.mEvicted == 100);
+   UInt32 left = 0;
+   for (UInt32 i = 0; i < 300; i++)
+   {
+      if (cache.lookup(hostName(i), RR_A::getRRType(), RRCache::Protocol::Sip, records, status))
+      {
+         left++;
+      }
+      else
+      {
+         assert(i % 2 == 1 || i >= 200);
+      }
+   }
+   assert(left == 200);
+}
+
+// Starts lookupCopy() readers that check every answer they get while the
+// caller changes the cache
+class Reader : public ThreadIf
+{
+   public:
+      Reader(RRCache& cache, UInt32 names, UInt32 seed)
+         : mCache(cache), mNames(names), mSeed(seed), mLookups(0), mFound(0)
+      {}
+
+      virtual void thread()
+      {
+         vector<DnsHostRecord> records;
+         while (!isShutdown())
+         {
+            for (int n = 0; n < 1000; n++)
+            {
+               mSeed = mSeed * 1103515245 + 12345;
+               UInt32 i = (mSeed >> 8) % mNames;
+               records.clear();
+               int status = -1;
+               if (mCache.lookupCopy(hostName(i), RR_A::getRRType(), records, status))
+               {
+                  assert(status == 0 && records.size() == 1);
+                  assert(addressOf(records[0]) / 4 == i);
+                  assert(records[0].name() == hostName(i));
+                  mFound++;
+               }
+               mLookups++;
+            }
+         }
+      }
+
+      RRCache& mCache;
+      UInt32 mNames;
+      UInt32 mSeed;
+      UInt64 mLookups;
+      UInt64 mFound;
+};
+
+void
+testConcurrentReaders()
+{
+   const UInt32 names = 20000;
+   RRCache cache;
+   cache.setSize(names / 2);
+
+   vector<Reader*> readers;
+   for (UInt32 t = 0; t < 4; t++)
+   {
+      readers.push_back(new Reader(cache, names, t + 1));
+      readers.back()->run();
+   }
+
+   // replace, evict and clear under the readers for a second
+   UInt64 end = Timer::getTimeMs() + 1000;
+   UInt32 changes = 0;
+   while (Timer::getTimeMs() < end)
+   {
+      for (UInt32 n = 0; n < 1000; n++, changes++)
+      {
+         addHost(cache, (changes * 7919) % names, changes % 4);
+      }
+      if (changes % 100000 == 0)
+      {
+         cache.clearCache();
+      }
+      cache.expire();
+   }
+
+   UInt64 lookups = 0;
+   UInt64 found = 0;
+   for (vector<Reader*>::iterator it = readers.begin(); it != readers.end(); ++it)
+   {
+      (*it)->shutdown();
+      (*it)->join();
+      lookups += (*it)->mLookups;
+      found += (*it)->mFound;
+      delete *it;
+   }
+   assert(found > 0);
+   cerr << "4 readers: " << lookups << " lookups (" << found << " found) during " << changes << " changes" << endl;
+}
+
+void
+benchmark(UInt32 count)
+{
+   RRCache cache;
+   cache.setSize(count);
+
+   vector<Data> names;
+   names.reserve(count);
+   for (UInt32 i = 0; i < count; i++)
+   {
+      names.push_back(hostName(i));
+   }
+
+   UInt64 start = Timer::getTimeMicroSec();
+   for (UInt32 i = 0; i < count; i++)
+   {
+      cache.updateCacheFromHostFile(DnsHostRecord(names[i], hostAddress(i)));
+   }
+   UInt64 added = Timer::getTimeMicroSec();
+   cerr << "RRCache: " << count << " names added in " << (added - start)/1000 << "ms" << endl;
+
+   const UInt32 lookups = 2000000;
+   RRCache::Result records;
+   int status;
+   start = Timer::getTimeMicroSec();
+   for (UInt32 n = 0; n < lookups; n++)
+   {
+      UInt32 i = (UInt32)(((UInt64)n * 7919) % count);
+      bool found = cache.lookup(names[i], RR_A::getRRType(), RRCache::Protocol::Sip, records, status);
+      assert(found);
+   }
+   UInt64 done = Timer::getTimeMicroSec();
+   cerr << "RRCache: " << lookups << " lookup() in " << (done - start)/1000 << "ms ("
+        << (done - start) * 1000 / lookups << "ns each)" << endl;
+
+   vector<DnsHostRecord> copies;
+   start = Timer::getTimeMicroSec();
+   for (UInt32 n = 0; n < lookups; n++)
+   {
+      UInt32 i = (UInt32)(((UInt64)n * 7919) % count);
+      copies.clear();
+      bool found = cache.lookupCopy(names[i], RR_A::getRRType(), copies, status);
+      assert(found);
+   }
+   done = Timer::getTimeMicroSec();
+   cerr << "RRCache: " << lookups << " lookupCopy() in " << (done - start)/1000 << "ms ("
+        << (done - start) * 1000 / lookups << "ns each)" << endl;
+
+   start = Timer::getTimeMicroSec();
+   for (UInt32 n = 0; n < lookups; n++)
+   {
+      bool found = cache.lookup(names[n % count] + "x", RR_A::getRRType(), RRCache::Protocol::Sip, records, status);
+      assert(!found);
+   }
+   done = Timer::getTimeMicroSec();
+   cerr << "RRCache: " << lookups << " misses in " << (done - start)/1000 << "ms" << endl;
+
+   // every name is replaced by a new one
+   start = Timer::getTimeMicroSec();
+   for (UInt32 i = 0; i < count; i++)
+   {
+      addHost(cache, count + i);
+   }
+   done = Timer::getTimeMicroSec();
+   RRCache::CacheStats stats = cache.getStats();
+   assert(stats.mEvicted == count && stats.mSize == count);
+   cerr << "RRCache: " << count << " names added to a full cache in " << (done - start)/1000 << "ms" << endl;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   UInt32 count = 1000000;
+   if (argc > 1)
+   {
+      count = atoi(argv[1]);
+   }
+
+   // cached now, checked once the rest is done
+   RRCache expiring;
+   UInt64 expiringStart = Timer::getTimeMs();
+   vector<RROverlay> overlays;
+   Data shortRecord = aRecord("short.example.com", 1, 0x0a000001);
+   overlays.push_back(RROverlay((const unsigned char*)shortRecord.data(), (const unsigned char*)shortRecord.data(), (int)shortRecord.size()));
+   expiring.updateCache("short.example.com", RR_A::getRRType(), overlays.begin(), overlays.end());
+   Data longRecord = aRecord("long.example.com", 3600, 0x0a000002);
+   overlays.clear();
+   overlays.push_back(RROverlay((const unsigned char*)longRecord.data(), (const unsigned char*)longRecord.data(), (int)longRecord.size()));
+   expiring.updateCache("long.example.com", RR_A::getRRType(), overlays.begin(), overlays.end());
+   // the ttl of 1 is raised to the 10 second minimum
+   assert(expiring.getTimeTillNextExpiryMS() > 8000 && expiring.getTimeTillNextExpiryMS() <= 10000);
+   expiring.expire();
+   RRCache::Result records;
+   int status;
+   assert(expiring.lookup("short.example.com", RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+
+   testLookup();
+   testEviction();
+   testConcurrentReaders();
+   benchmark(count);
+
+   UInt64 elapsed = Timer::getTimeMs() - expiringStart;
+   if (elapsed < 11000)
+   {
+      sleepMs((unsigned int)(11000 - elapsed));
+   }
+   assert(expiring.getTimeTillNextExpiryMS() == 0);
+   // still there until the wheel is turned
+   assert(expiring.lookup("short.example.com", RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   expiring.expire();
+   assert(!expiring.lookup("short.example.com", RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   assert(expiring.lookup("long.example.com", RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   assert(expiring.getStats().mExpired == 1);
+   // what is left of the hour, less slack for the wheel's granularity
+   elapsed = Timer::getTimeMs() - expiringStart;
+   assert(expiring.getTimeTillNextExpiryMS() + elapsed + 2000 > 3600 * 1000);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,254 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "rutil/DinkyPool.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/SlabPool.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks SlabPool's bookkeeping, then compares it with DinkyPool for a
+// message-like allocation pattern that overflows the inline buffer.
+
+// Allocation sizes seen when parsing a large SIP message: header lists,
+// parser containers, parameters and the odd larger buffer.
+static const size_t sizes[] = { 48, 64, 24, 96, 32, 160, 40, 64, 512, 24 };
+static const unsigned int numSizes = sizeof(sizes)/sizeof(sizes[0]);
+
+template<class Pool>
+void
+fill(Pool& pool, unsigned int allocations)
+{
+   vector<void*> ptrs;
+   for (unsigned int i = 0; i < allocations; ++i)
+   {
+      void* p = pool.allocate(sizes[i % numSizes]);
+      assert(((size_t)p & 7) == 0);
+      memset(p, 0xa5, sizes[i % numSizes]);
+      ptrs.push_back(p);
+   }
+   // The owner frees its objects before the pool goes away.
+   for (unsigned int i = 0; i < ptrs.size(); ++i)
+   {
+      pool.deallocate(ptrs[i]);
+   }
+}
+
+void
+testBookkeeping()
+{
+   SlabCache::Stats before(SlabCache::getStats());
+   {
+      SlabPool<256> pool;
+      void* a = pool.allocate(100);
+      void* b = pool.allocate(100);
+      assert((char*)b - (char*)a == 104);
+      assert(pool.getSlabCount() == 0);
+
+      // Overflows the inline buffer into a slab.
+      void* c = pool.allocate(100);
+      assert(pool.getSlabCount() == 1);
+      assert(pool.getPoolBytes() == 312);
+      assert(pool.getHeapBytes() == 0);
+
+      // Too big to pool.
+      void* d = pool.allocate(SlabCache::MaxPooledSize + 1);
+      assert(pool.getHeapBytes() == SlabCache::MaxPooledSize + 1);
+      // ...so it is a block on its own, which deallocate() tells from the
+      // pooled objects by its alignment.
+      assert(((size_t)d & (SlabCache::SlabSize - 1)) == 0);
+      assert(((size_t)c & (SlabCache::SlabSize - 1)) != 0);
+
+      // Fill the first slab; the next allocation starts a second one.
+      for (size_t used = 8 + 104; used + 1024 <= SlabCache::SlabSize; used += 1024)
+      {
+         pool.allocate(1024);
+      }
+      assert(pool.getSlabCount() == 1);
+      pool.allocate(1024);
+      assert(pool.getSlabCount() == 2);
+
+      pool.deallocate(a);
+      pool.deallocate(c);
+      pool.deallocate(d);
+   }
+   SlabCache::Stats after(SlabCache::getStats());
+   assert(after.mPools == before.mPools + 1);
+   assert(after.mSlabs == before.mSlabs + 2);
+   assert(after.mHeapAllocations == before.mHeapAllocations + 1);
+
+   // The slabs went back to this thread's cache, so they are reused.
+   {
+      SlabPool<8> pool;
+      pool.allocate(16);
+      pool.allocate(16);
+   }
+   SlabCache::Stats reused(SlabCache::getStats());
+   assert(reused.mSlabs == after.mSlabs + 1);
+   assert(reused.mSlabsFromHeap == after.mSlabsFromHeap);
+}
+
+// A long-lived pool whose objects are replaced over and over, as a message
+// that is edited repeatedly: it must stop taking slabs, and give the heap
+// allocations it uses instead back as they are freed.
+void
+testBounded()
+{
+   SlabCache::Stats before(SlabCache::getStats());
+   {
+      SlabPool<256> pool;
+      vector<void*> live(numSizes, (void*)0);
+      for (unsigned int i = 0; i < 100000; ++i)
+      {
+         unsigned int j = i % numSizes;
+         if (live[j])
+         {
+            pool.deallocate(live[j]);
+         }
+         live[j] = pool.allocate(sizes[j]);
+         assert(((size_t)live[j] & 7) == 0);
+         memset(live[j], 0xa5, sizes[j]);
+      }
+      assert(pool.getSlabCount() == SlabCache::MaxPoolSlabs);
+      for (unsigned int j = 0; j < numSizes; ++j)
+      {
+         pool.deallocate(live[j]);
+      }
+   }
+   SlabCache::Stats after(SlabCache::getStats());
+   assert(after.mSlabs == before.mSlabs + SlabCache::MaxPoolSlabs);
+   assert(after.mHeapAllocations > before.mHeapAllocations);
+}
+
+// Releases pools filled on another thread, like a transport thread handing
+// messages to the stack thread.
+class Filler : public ThreadIf
+{
+   public:
+      Filler(vector<SlabPool<256>*>& pools) : mPools(pools) {}
+      virtual ~Filler() { shutdown(); join(); }
+      void thread()
+      {
+         for (unsigned int i = 0; i < mPools.size(); ++i)
+         {
+            mPools[i] = new SlabPool<256>;
+            fill(*mPools[i], 200);
+         }
+      }
+   private:
+      vector<SlabPool<256>*>& mPools;
+};
+
+void
+testCrossThread()
+{
+   vector<SlabPool<256>*> pools(100, (SlabPool<256>*)0);
+   {
+      Filler filler(pools);
+      filler.run();
+      filler.join();
+   }
+   SlabCache::Stats before(SlabCache::getStats());
+   for (unsigned int i = 0; i < pools.size(); ++i)
+   {
+      delete pools[i];
+   }
+   SlabCache::Stats after(SlabCache::getStats());
+   assert(after.mPools == before.mPools + pools.size());
+}
+
+template<class Pool>
+UInt64
+timeFill(unsigned int pools, unsigned int allocations)
+{
+   UInt64 start = Timer::getTimeMs();
+   for (unsigned int i = 0; i < pools; ++i)
+   {
+      Pool pool;
+      fill(pool, allocations);
+   }
+   return Timer::getTimeMs() - start;
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   unsigned int pools = 100000;
+   if (argc > 1)
+   {
+      pools = atoi(argv[1]);
+   }
+
+   testBookkeeping();
+   testBounded();
+   testCrossThread();
+
+   // SipMessage's inline buffer is 3732 bytes; 60 allocations of the sizes
+   // above come to ~6KB, as for a large INVITE.
+   cerr << "DinkyPool<3732>: " << timeFill<DinkyPool<3732> >(pools, 60) << " ms" << endl;
+   cerr << "SlabPool<3732>: " << timeFill<SlabPool<3732> >(pools, 60) << " ms" << endl;
+   SlabCache::dump();
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
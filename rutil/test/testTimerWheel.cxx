@@ -0,0 +1,369 @@
+#include <cassert>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Random.hxx"
+#include "rutil/Timer.hxx"
+#include "rutil/TimerWheel.hxx"
+
+using namespace resip;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TEST
+
+// Checks that TimerWheel fires in the same order as the std::priority_queue
+// that TimerQueue used to be built on, then times both with 1M pending
+// timers spread the way SIP transaction timers are (T1 up to 64*T1).
+
+class TestTimer
+{
+   public:
+      TestTimer(UInt64 when, UInt32 seq) : mWhen(when), mSeq(seq) {}
+      UInt64 getWhen() const { return mWhen; }
+      bool operator>(const TestTimer& rhs) const
+      {
+         return mWhen > rhs.mWhen || (mWhen == rhs.mWhen && mSeq > rhs.mSeq);
+      }
+
+      UInt64 mWhen;
+      UInt32 mSeq;
+};
+
+typedef priority_queue<TestTimer, vector<TestTimer>, greater<TestTimer> > TimerHeap;
+typedef TimerWheel<TestTimer> Wheel;
+
+// Shaped like TransactionTimer, which carries the transaction id.
+class BenchTimer
+{
+   public:
+      BenchTimer(UInt64 when, const Data& tid) : mWhen(when), mTid(tid) {}
+      UInt64 getWhen() const { return mWhen; }
+      bool operator>(const BenchTimer& rhs) const { return mWhen > rhs.mWhen; }
+
+      UInt64 mWhen;
+      Data mTid;
+};
+
+class Collect
+{
+   public:
+      Collect() : mLast(0), mCount(0) {}
+      void operator()(const TestTimer& timer)
+      {
+         // never early, and in order of expiry
+         assert(timer.mWhen >= mLast);
+         mLast = timer.mWhen;
+         mFired.push_back(timer.mSeq);
+         ++mCount;
+      }
+      vector<UInt32> mFired;
+      UInt64 mLast;
+      unsigned int mCount;
+};
+
+// Adds a follow-up timer for every timer that fires, like a retransmission
+// timer being re-armed from processTimer().
+class Rearm
+{
+   public:
+      Rearm(Wheel& wheel, UInt64& now) : mWheel(wheel), mNow(now), mCount(0) {}
+      void operator()(const TestTimer& timer)
+      {
+         assert(timer.mWhen <= mNow);
+         if (timer.mSeq < 8)
+         {
+            mWheel.add(TestTimer(mNow + (timer.mSeq ? 500 : 0), timer.mSeq + 1));
+         }
+         ++mCount;
+      }
+      Wheel& mWheel;
+      UInt64& mNow;
+      unsigned int mCount;
+};
+
+class Count
+{
+   public:
+      Count() : mCount(0) {}
+      void operator()(const TestTimer&) { ++mCount; }
+      void operator()(const BenchTimer&) { ++mCount; }
+      unsigned int mCount;
+};
+
+UInt64
+sipOffset()
+{
+   static const unsigned int offsets[] = { 500, 1000, 2000, 4000, 5000, 32000 };
+   return offsets[Random::getRandom() % (sizeof(offsets)/sizeof(offsets[0]))]
+      + Random::getRandom() % 16;
+}
+
+void
+testOrder()
+{
+   Wheel wheel;
+   const UInt64 base = Timer::getTimeMs();
+   TimerHeap heap;
+   const UInt32 count = 20000;
+
+   assert(wheel.empty());
+   for (UInt32 i = 0; i < count; ++i)
+   {
+      // mostly SIP timers, with a few far out to exercise the upper levels
+      UInt64 offset = (i % 100) ? sipOffset() : UInt64(Random::getRandom()) % (UInt64(1) << 26);
+      TestTimer t(base + offset, i);
+      wheel.add(t);
+      heap.push(t);
+      assert(wheel.nextWhen() == heap.top().mWhen);
+   }
+   assert(wheel.size() == count);
+
+   Collect collect;
+   UInt64 now = base;
+   while (!heap.empty())
+   {
+      assert(wheel.nextWhen() == heap.top().mWhen);
+      // jump straight to the next expiry, as a stack thread sleeping in
+      // msTillNextTimer() would
+      now = wheel.nextWhen();
+      wheel.expire(now, collect);
+      while (!heap.empty() && heap.top().mWhen <= now)
+      {
+         assert(collect.mFired[count - heap.size()] == heap.top().mSeq);
+         heap.pop();
+      }
+      assert(wheel.size() == heap.size());
+   }
+   assert(wheel.empty());
+   assert(collect.mCount == count);
+}
+
+void
+testCancel()
+{
+   Wheel wheel;
+   const UInt64 base = Timer::getTimeMs();
+   vector<Wheel::Id> ids;
+   for (UInt32 i = 0; i < 1000; ++i)
+   {
+      ids.push_back(wheel.add(TestTimer(base + 100 + i*100, i)));
+   }
+   assert(wheel.nextWhen() == base + 100);
+
+   // cancel every other timer, starting with the current top
+   for (UInt32 i = 0; i < ids.size(); i += 2)
+   {
+      assert(wheel.find(ids[i]) && wheel.find(ids[i])->mSeq == i);
+      assert(wheel.cancel(ids[i]));
+      assert(!wheel.cancel(ids[i]));
+      assert(!wheel.find(ids[i]));
+   }
+   assert(wheel.size() == 500);
+   assert(wheel.nextWhen() == base + 200);
+   assert(!wheel.cancel(0));
+
+   Collect collect;
+   wheel.expire(base + 1000*100 + 100, collect);
+   assert(collect.mCount == 500);
+   for (UInt32 i = 0; i < collect.mFired.size(); ++i)
+   {
+      assert(collect.mFired[i] % 2 == 1);
+   }
+   // ids of timers that have fired are no longer valid, even once their
+   // storage is reused
+   assert(!wheel.cancel(ids[1]));
+   Wheel::Id reused = wheel.add(TestTimer(base, 0));
+   assert(!wheel.cancel(ids[1]) && !wheel.cancel(ids[3]));
+   assert(wheel.cancel(reused));
+   assert(wheel.empty());
+}
+
+void
+testRearm()
+{
+   Wheel wheel;
+   const UInt64 base = Timer::getTimeMs();
+   UInt64 now = base;
+   Rearm rearm(wheel, now);
+
+   // a timer that is already due fires on the next expire(), and one added
+   // for "now" from within the callback fires in the same pass
+   wheel.add(TestTimer(base - 10, 0));
+   wheel.expire(now, rearm);
+   assert(rearm.mCount == 2);
+   assert(wheel.size() == 1 && wheel.nextWhen() == base + 500);
+
+   while (!wheel.empty())
+   {
+      now += 7;
+      wheel.expire(now, rearm);
+   }
+   assert(rearm.mCount == 9);
+
+   // nothing pending: the wheel catches up with a long idle period at once
+   now += UInt64(1) << 33;
+   wheel.expire(now, rearm);
+   wheel.add(TestTimer(now + 1, 8));
+   ++now;
+   wheel.expire(now, rearm);
+   assert(rearm.mCount == 10 && wheel.empty());
+
+   Count discarded;
+   wheel.add(TestTimer(now + 10, 8));
+   wheel.add(TestTimer(now + 100000000, 8));
+   wheel.clear(discarded);
+   assert(discarded.mCount == 2 && wheel.empty());
+}
+
+void
+benchmark(UInt32 count)
+{
+   vector<UInt64> offsets;
+   vector<Data> tids;
+   offsets.reserve(count);
+   tids.reserve(count);
+   for (UInt32 i = 0; i < count; ++i)
+   {
+      offsets.push_back(sipOffset());
+      tids.push_back("z9hG4bK-" + Random::getRandomHex(8));
+   }
+
+   {
+      priority_queue<BenchTimer, vector<BenchTimer>, greater<BenchTimer> > heap;
+      const UInt64 base = Timer::getTimeMs();
+      const UInt64 end = base + 33000;
+      UInt64 start = Timer::getTimeMicroSec();
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         heap.push(BenchTimer(base + offsets[i], tids[i]));
+      }
+      UInt64 added = Timer::getTimeMicroSec();
+      unsigned int fired = 0;
+      for (UInt64 now = base; now <= end; ++now)
+      {
+         while (!heap.empty() && heap.top().mWhen <= now)
+         {
+            heap.pop();
+            ++fired;
+         }
+      }
+      UInt64 done = Timer::getTimeMicroSec();
+      assert(fired == count);
+      cerr << "priority_queue: add " << count << " in " << (added - start)/1000 << "ms, "
+           << "fire all in " << (done - added)/1000 << "ms" << endl;
+   }
+
+   {
+      TimerWheel<BenchTimer> wheel;
+      const UInt64 base = Timer::getTimeMs();
+      const UInt64 end = base + 33000;
+      vector<TimerWheel<BenchTimer>::Id> ids;
+      ids.reserve(count);
+      UInt64 start = Timer::getTimeMicroSec();
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         ids.push_back(wheel.add(BenchTimer(base + offsets[i], tids[i])));
+      }
+      UInt64 added = Timer::getTimeMicroSec();
+      Count fired;
+      for (UInt64 now = base; now <= end; ++now)
+      {
+         wheel.expire(now, fired);
+      }
+      UInt64 done = Timer::getTimeMicroSec();
+      assert(fired.mCount == count);
+      cerr << "TimerWheel:     add " << count << " in " << (added - start)/1000 << "ms, "
+           << "fire all in " << (done - added)/1000 << "ms" << endl;
+
+      // most transactions finish long before Timer B/F would go off; the
+      // heap has to keep those until they fire, the wheel drops them
+      ids.clear();
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         ids.push_back(wheel.add(BenchTimer(end + offsets[i], tids[i])));
+      }
+      start = Timer::getTimeMicroSec();
+      for (UInt32 i = 0; i < count; ++i)
+      {
+         wheel.cancel(ids[i]);
+      }
+      done = Timer::getTimeMicroSec();
+      assert(wheel.empty());
+      cerr << "TimerWheel:     cancel " << count << " in " << (done - start)/1000 << "ms" << endl;
+   }
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cout, Log::Warning, argv[0]);
+
+   UInt32 count = 1000000;
+   if (argc > 1)
+   {
+      count = atoi(argv[1]);
+   }
+
+   testOrder();
+   testCancel();
+   testRearm();
+   benchmark(count);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */